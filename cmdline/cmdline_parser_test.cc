@@ -342,11 +342,12 @@ TEST_F(CmdlineParserTest, DISABLED_TestXGcOption) {
     option_all_true.verify_pre_gc_rosalloc_ = true;
     option_all_true.verify_pre_sweeping_rosalloc_ = true;
     option_all_true.verify_post_gc_rosalloc_ = true;
+    option_all_true.parallel_verify_ = true;
 
     const char * xgc_args_all_true = "-Xgc:concurrent,"
         "preverify,presweepingverify,postverify,"
         "preverify_rosalloc,presweepingverify_rosalloc,"
-        "postverify_rosalloc,precise,"
+        "postverify_rosalloc,parallelverify,precise,"
         "verifycardtable";
 
     EXPECT_SINGLE_PARSE_VALUE(option_all_true, xgc_args_all_true, M::GcOption);
@@ -359,10 +360,12 @@ TEST_F(CmdlineParserTest, DISABLED_TestXGcOption) {
     option_all_false.verify_pre_gc_rosalloc_ = false;
     option_all_false.verify_pre_sweeping_rosalloc_ = false;
     option_all_false.verify_post_gc_rosalloc_ = false;
+    option_all_false.parallel_verify_ = false;
 
     const char* xgc_args_all_false = "-Xgc:nonconcurrent,"
         "nopreverify,nopresweepingverify,nopostverify,nopreverify_rosalloc,"
-        "nopresweepingverify_rosalloc,nopostverify_rosalloc,noprecise,noverifycardtable";
+        "nopresweepingverify_rosalloc,nopostverify_rosalloc,noparallelverify,noprecise,"
+        "noverifycardtable";
 
     EXPECT_SINGLE_PARSE_VALUE(option_all_false, xgc_args_all_false, M::GcOption);
 
@@ -430,6 +430,7 @@ struct XGcOption {
   bool verify_pre_gc_rosalloc_ = kIsDebugBuild;
   bool verify_pre_sweeping_rosalloc_ = false;
   bool verify_post_gc_rosalloc_ = false;
+  bool parallel_verify_ = false;
   // Do no measurements for kUseTableLookupReadBarrier to avoid test timeouts. b/31679493
   bool measure_ = kIsDebugBuild && !kUseTableLookupReadBarrier;
   bool gcstress_ = false;
@@ -484,6 +485,10 @@ struct CmdlineType<XGcOption> : CmdlineTypeParser<XGcOption> {
         xgc.verify_post_gc_rosalloc_ = true;
       } else if (gc_option == "nopostverify_rosalloc") {
         xgc.verify_post_gc_rosalloc_ = false;
+      } else if (gc_option == "parallelverify") {
+        xgc.parallel_verify_ = true;
+      } else if (gc_option == "noparallelverify") {
+        xgc.parallel_verify_ = false;
       } else if (gc_option == "gcstress") {
         xgc.gcstress_ = true;
       } else if (gc_option == "nogcstress") {
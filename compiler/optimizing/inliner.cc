@@ -68,6 +68,15 @@ static constexpr size_t kMaximumNumberOfRecursiveCalls = 4;
 // Controls the use of inline caches in AOT mode.
 static constexpr bool kUseAOTInlineCaches = true;
 
+// A megamorphic call is inlined for its most frequent receivers, guarded by type checks, if
+// at most kMaximumNumberOfDominantReceivers receivers account for kDominantReceiversPercentage
+// of the calls profiled. The other receivers go through the original invoke.
+static constexpr size_t kMaximumNumberOfDominantReceivers = 3;
+static constexpr uint64_t kDominantReceiversPercentage = 75;
+
+// Minimum number of calls profiled by a megamorphic inline cache before trusting its counts.
+static constexpr uint64_t kMinimumMegamorphicCallsProfiled = 64;
+
 // We check for line numbers to make sure the DepthString implementation
 // aligns the output nicely.
 #define LOG_INTERNAL(msg) \
@@ -594,12 +603,19 @@ bool HInliner::TryInlineFromInlineCache(const DexFile& caller_dex_file,
 
   StackHandleScope<1> hs(Thread::Current());
   Handle<mirror::ObjectArray<mirror::Class>> inline_cache;
+  // Call counts are only profiled by the JIT, they stay zero for offline profiles.
+  uint32_t receiver_counts[InlineCache::kIndividualCacheSize] = {};
+  uint32_t megamorphic_count = 0u;
   // The Zygote JIT compiles based on a profile, so we shouldn't use runtime inline caches
   // for it.
   InlineCacheType inline_cache_type =
       (Runtime::Current()->IsAotCompiler() || Runtime::Current()->IsZygote())
           ? GetInlineCacheAOT(caller_dex_file, invoke_instruction, &hs, &inline_cache)
-          : GetInlineCacheJIT(invoke_instruction, &hs, &inline_cache);
+          : GetInlineCacheJIT(invoke_instruction,
+                              &hs,
+                              &inline_cache,
+                              receiver_counts,
+                              &megamorphic_count);
 
   switch (inline_cache_type) {
     case kInlineCacheNoData: {
@@ -621,7 +637,10 @@ bool HInliner::TryInlineFromInlineCache(const DexFile& caller_dex_file,
     case kInlineCacheMonomorphic: {
       MaybeRecordStat(stats_, MethodCompilationStat::kMonomorphicCall);
       if (UseOnlyPolymorphicInliningWithNoDeopt()) {
-        return TryInlinePolymorphicCall(invoke_instruction, resolved_method, inline_cache);
+        return TryInlinePolymorphicCall(invoke_instruction,
+                                        resolved_method,
+                                        inline_cache,
+                                        /* is_megamorphic= */ false);
       } else {
         return TryInlineMonomorphicCall(invoke_instruction, resolved_method, inline_cache);
       }
@@ -629,15 +648,25 @@ bool HInliner::TryInlineFromInlineCache(const DexFile& caller_dex_file,
 
     case kInlineCachePolymorphic: {
       MaybeRecordStat(stats_, MethodCompilationStat::kPolymorphicCall);
-      return TryInlinePolymorphicCall(invoke_instruction, resolved_method, inline_cache);
+      return TryInlinePolymorphicCall(invoke_instruction,
+                                      resolved_method,
+                                      inline_cache,
+                                      /* is_megamorphic= */ false);
     }
 
     case kInlineCacheMegamorphic: {
+      MaybeRecordStat(stats_, MethodCompilationStat::kMegamorphicCall);
+      if (TryInlineMegamorphicCall(invoke_instruction,
+                                   resolved_method,
+                                   inline_cache,
+                                   receiver_counts,
+                                   megamorphic_count)) {
+        return true;
+      }
       LOG_FAIL_NO_STAT()
           << "Interface or virtual call to "
           << caller_dex_file.PrettyMethod(invoke_instruction->GetDexMethodIndex())
           << " is megamorphic and not inlined";
-      MaybeRecordStat(stats_, MethodCompilationStat::kMegamorphicCall);
       return false;
     }
 
@@ -655,7 +684,9 @@ bool HInliner::TryInlineFromInlineCache(const DexFile& caller_dex_file,
 HInliner::InlineCacheType HInliner::GetInlineCacheJIT(
     HInvoke* invoke_instruction,
     StackHandleScope<1>* hs,
-    /*out*/Handle<mirror::ObjectArray<mirror::Class>>* inline_cache)
+    /*out*/Handle<mirror::ObjectArray<mirror::Class>>* inline_cache,
+    /*out*/uint32_t* receiver_counts,
+    /*out*/uint32_t* megamorphic_count)
     REQUIRES_SHARED(Locks::mutator_lock_) {
   DCHECK(Runtime::Current()->UseJitCompilation());
 
@@ -676,7 +707,9 @@ HInliner::InlineCacheType HInliner::GetInlineCacheJIT(
   } else {
     Runtime::Current()->GetJit()->GetCodeCache()->CopyInlineCacheInto(
         *profiling_info->GetInlineCache(invoke_instruction->GetDexPc()),
-        *inline_cache);
+        *inline_cache,
+        receiver_counts,
+        megamorphic_count);
     return GetInlineCacheType(*inline_cache);
   }
 }
@@ -992,13 +1025,77 @@ HInstruction* HInliner::AddTypeGuard(HInstruction* receiver,
   return compare;
 }
 
+bool HInliner::TryInlineMegamorphicCall(HInvoke* invoke_instruction,
+                                        ArtMethod* resolved_method,
+                                        Handle<mirror::ObjectArray<mirror::Class>> classes,
+                                        const uint32_t* receiver_counts,
+                                        uint32_t megamorphic_count) {
+  size_t number_of_types = 0;
+  while (number_of_types < InlineCache::kIndividualCacheSize &&
+         classes->Get(number_of_types) != nullptr) {
+    ++number_of_types;
+  }
+  const uint64_t total_count =
+      InlineCache::EstimateTotalCalls(receiver_counts, number_of_types, megamorphic_count);
+  if (total_count < kMinimumMegamorphicCallsProfiled) {
+    LOG_FAIL_NO_STAT()
+        << "Megamorphic call to " << ArtMethod::PrettyMethod(resolved_method)
+        << " has only " << total_count << " profiled calls";
+    return false;
+  }
+
+  // Pick the most frequent receivers until they account for enough of the calls.
+  size_t dominant_types[kMaximumNumberOfDominantReceivers];
+  size_t number_of_dominant_types = 0;
+  uint64_t dominant_count = 0;
+  bool picked[InlineCache::kIndividualCacheSize] = {};
+  while (number_of_dominant_types < std::min(number_of_types, kMaximumNumberOfDominantReceivers) &&
+         dominant_count * 100 < total_count * kDominantReceiversPercentage) {
+    size_t best = number_of_types;
+    for (size_t i = 0; i < number_of_types; ++i) {
+      if (!picked[i] && (best == number_of_types || receiver_counts[i] > receiver_counts[best])) {
+        best = i;
+      }
+    }
+    picked[best] = true;
+    dominant_types[number_of_dominant_types++] = best;
+    dominant_count += receiver_counts[best];
+  }
+  const uint64_t dominant_percentage = dominant_count * 100 / total_count;
+  LOG_NOTE() << "Megamorphic call to " << ArtMethod::PrettyMethod(resolved_method)
+             << " has " << total_count << " profiled calls, " << dominant_percentage
+             << "% of which to its " << number_of_dominant_types << " most frequent receivers";
+  if (dominant_percentage < kDominantReceiversPercentage) {
+    LOG_FAIL(stats_, MethodCompilationStat::kNotInlinedNoDominantReceiver)
+        << "Megamorphic call to " << ArtMethod::PrettyMethod(resolved_method)
+        << " has no dominant receivers";
+    return false;
+  }
+
+  // Keep only the dominant receivers in `classes`, most frequent first so that their type
+  // guards are checked first. No allocation happens while the classes are held in `dominant`.
+  ObjPtr<mirror::Class> dominant[kMaximumNumberOfDominantReceivers];
+  for (size_t i = 0; i < number_of_dominant_types; ++i) {
+    dominant[i] = classes->Get(dominant_types[i]);
+  }
+  for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
+    classes->Set(i, i < number_of_dominant_types ? dominant[i] : nullptr);
+  }
+  return TryInlinePolymorphicCall(invoke_instruction,
+                                  resolved_method,
+                                  classes,
+                                  /* is_megamorphic= */ true);
+}
+
 bool HInliner::TryInlinePolymorphicCall(HInvoke* invoke_instruction,
                                         ArtMethod* resolved_method,
-                                        Handle<mirror::ObjectArray<mirror::Class>> classes) {
+                                        Handle<mirror::ObjectArray<mirror::Class>> classes,
+                                        bool is_megamorphic) {
   DCHECK(invoke_instruction->IsInvokeVirtual() || invoke_instruction->IsInvokeInterface())
       << invoke_instruction->DebugName();
 
-  if (TryInlinePolymorphicCallToSameTarget(invoke_instruction, resolved_method, classes)) {
+  if (TryInlinePolymorphicCallToSameTarget(
+          invoke_instruction, resolved_method, classes, is_megamorphic)) {
     return true;
   }
 
@@ -1044,8 +1141,10 @@ bool HInliner::TryInlinePolymorphicCall(HInvoke* invoke_instruction,
                     << " has inlined " << ArtMethod::PrettyMethod(method);
 
       // If we have inlined all targets before, and this receiver is the last seen,
-      // we deoptimize instead of keeping the original invoke instruction.
-      bool deoptimize = !UseOnlyPolymorphicInliningWithNoDeopt() &&
+      // we deoptimize instead of keeping the original invoke instruction. Megamorphic
+      // calls keep it for the receivers that were not inlined.
+      bool deoptimize = !is_megamorphic &&
+          !UseOnlyPolymorphicInliningWithNoDeopt() &&
           all_targets_inlined &&
           (i != InlineCache::kIndividualCacheSize - 1) &&
           (classes->Get(i + 1) == nullptr);
@@ -1079,7 +1178,9 @@ bool HInliner::TryInlinePolymorphicCall(HInvoke* invoke_instruction,
     return false;
   }
 
-  MaybeRecordStat(stats_, MethodCompilationStat::kInlinedPolymorphicCall);
+  MaybeRecordStat(stats_,
+                  is_megamorphic ? MethodCompilationStat::kInlinedMegamorphicCall
+                                 : MethodCompilationStat::kInlinedPolymorphicCall);
 
   // Run type propagation to get the guards typed.
   ReferenceTypePropagation rtp_fixup(graph_,
@@ -1170,7 +1271,8 @@ void HInliner::CreateDiamondPatternForPolymorphicInline(HInstruction* compare,
 bool HInliner::TryInlinePolymorphicCallToSameTarget(
     HInvoke* invoke_instruction,
     ArtMethod* resolved_method,
-    Handle<mirror::ObjectArray<mirror::Class>> classes) {
+    Handle<mirror::ObjectArray<mirror::Class>> classes,
+    bool is_megamorphic) {
   // This optimization only works under JIT for now.
   if (!Runtime::Current()->UseJitCompilation()) {
     return false;
@@ -1258,7 +1360,7 @@ bool HInliner::TryInlinePolymorphicCallToSameTarget(
   bb_cursor->InsertInstructionAfter(class_table_get, receiver_class);
   bb_cursor->InsertInstructionAfter(compare, class_table_get);
 
-  if (outermost_graph_->IsCompilingOsr()) {
+  if (outermost_graph_->IsCompilingOsr() || is_megamorphic) {
     CreateDiamondPatternForPolymorphicInline(compare, return_replacement, invoke_instruction);
   } else {
     HDeoptimize* deoptimize = new (graph_->GetAllocator()) HDeoptimize(
@@ -1285,7 +1387,9 @@ bool HInliner::TryInlinePolymorphicCallToSameTarget(
                                      /* is_first_run= */ false);
   rtp_fixup.Run();
 
-  MaybeRecordStat(stats_, MethodCompilationStat::kInlinedPolymorphicCall);
+  MaybeRecordStat(stats_,
+                  is_megamorphic ? MethodCompilationStat::kInlinedMegamorphicCall
+                                 : MethodCompilationStat::kInlinedPolymorphicCall);
 
   LOG_SUCCESS() << "Inlined same polymorphic target " << actual_method->PrettyMethod();
   return true;
@@ -129,10 +129,14 @@ class HInliner : public HOptimization {
   // Try getting the inline cache from JIT code cache.
   // Return true if the inline cache was successfully allocated and the
   // invoke info was found in the profile info.
+  // The call counts of the classes are copied into the kIndividualCacheSize entries of
+  // `receiver_counts`.
   InlineCacheType GetInlineCacheJIT(
       HInvoke* invoke_instruction,
       StackHandleScope<1>* hs,
-      /*out*/Handle<mirror::ObjectArray<mirror::Class>>* inline_cache)
+      /*out*/Handle<mirror::ObjectArray<mirror::Class>>* inline_cache,
+      /*out*/uint32_t* receiver_counts,
+      /*out*/uint32_t* megamorphic_count)
     REQUIRES_SHARED(Locks::mutator_lock_);
 
   // Try getting the inline cache from AOT offline profile.
@@ -167,15 +171,28 @@ class HInliner : public HOptimization {
                                 Handle<mirror::ObjectArray<mirror::Class>> classes)
     REQUIRES_SHARED(Locks::mutator_lock_);
 
-  // Try to inline targets of a polymorphic call.
+  // Try to inline the dominant receivers of a megamorphic call, given the call counts
+  // profiled by the JIT inline cache. If successful, the code in the graph will look like
+  // the one of a polymorphic call, with the original invoke kept for the other receivers.
+  bool TryInlineMegamorphicCall(HInvoke* invoke_instruction,
+                                ArtMethod* resolved_method,
+                                Handle<mirror::ObjectArray<mirror::Class>> classes,
+                                const uint32_t* receiver_counts,
+                                uint32_t megamorphic_count)
+    REQUIRES_SHARED(Locks::mutator_lock_);
+
+  // Try to inline targets of a polymorphic call. If `is_megamorphic`, `classes` only holds
+  // some of the receivers and the original invoke is never replaced by a deoptimization.
   bool TryInlinePolymorphicCall(HInvoke* invoke_instruction,
                                 ArtMethod* resolved_method,
-                                Handle<mirror::ObjectArray<mirror::Class>> classes)
+                                Handle<mirror::ObjectArray<mirror::Class>> classes,
+                                bool is_megamorphic)
     REQUIRES_SHARED(Locks::mutator_lock_);
 
   bool TryInlinePolymorphicCallToSameTarget(HInvoke* invoke_instruction,
                                             ArtMethod* resolved_method,
-                                            Handle<mirror::ObjectArray<mirror::Class>> classes)
+                                            Handle<mirror::ObjectArray<mirror::Class>> classes,
+                                            bool is_megamorphic)
     REQUIRES_SHARED(Locks::mutator_lock_);
 
   // Returns whether or not we should use only polymorphic inlining with no deoptimizations.
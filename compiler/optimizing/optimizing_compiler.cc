@@ -1301,6 +1301,7 @@ bool OptimizingCompiler::JitCompile(Thread* self,
         jni_compiled_method.GetCode().data(),
         jni_compiled_method.GetCode().size(),
         data_size,
+        baseline,
         osr,
         roots,
         /* has_should_deoptimize_flag= */ false,
@@ -1406,6 +1407,7 @@ bool OptimizingCompiler::JitCompile(Thread* self,
       code_allocator.GetMemory().data(),
       code_allocator.GetMemory().size(),
       data_size,
+      baseline,
       osr,
       roots,
       codegen->GetGraph()->HasShouldDeoptimizeFlag(),
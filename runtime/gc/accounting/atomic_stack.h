@@ -188,6 +188,12 @@ class AtomicStack {
     return capacity_;
   }
 
+  // Number of slots left below the growth limit.
+  size_t FreeSlots() const {
+    const size_t back_index = back_index_.load(std::memory_order_relaxed);
+    return back_index < growth_limit_ ? growth_limit_ - back_index : 0u;
+  }
+
   // Will clear the stack.
   void Resize(size_t new_capacity) {
     capacity_ = new_capacity;
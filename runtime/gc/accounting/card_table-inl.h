@@ -19,6 +19,9 @@
 
 #include "card_table.h"
 
+#include <algorithm>
+#include <type_traits>
+
 #include <android-base/logging.h>
 
 #include "base/atomic.h"
@@ -62,62 +65,20 @@ inline size_t CardTable::Scan(ContinuousSpaceBitmap* bitmap,
   DCHECK_LE(scan_end, reinterpret_cast<uint8_t*>(bitmap->HeapLimit()));
   uint8_t* const card_begin = CardFromAddr(scan_begin);
   uint8_t* const card_end = CardFromAddr(AlignUp(scan_end, kCardSize));
-  uint8_t* card_cur = card_begin;
-  CheckCardValid(card_cur);
+  CheckCardValid(card_begin);
   CheckCardValid(card_end);
   size_t cards_scanned = 0;
 
-  // Handle any unaligned cards at the start.
-  while (!IsAligned<sizeof(intptr_t)>(card_cur) && card_cur < card_end) {
-    if (*card_cur >= minimum_age) {
-      uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(card_cur));
-      bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
-      ++cards_scanned;
-    }
-    ++card_cur;
-  }
-
-  uint8_t* aligned_end = card_end -
-      (reinterpret_cast<uintptr_t>(card_end) & (sizeof(uintptr_t) - 1));
-
-  uintptr_t* word_end = reinterpret_cast<uintptr_t*>(aligned_end);
-  for (uintptr_t* word_cur = reinterpret_cast<uintptr_t*>(card_cur); word_cur < word_end;
-      ++word_cur) {
-    while (LIKELY(*word_cur == 0)) {
-      ++word_cur;
-      if (UNLIKELY(word_cur >= word_end)) {
-        goto exit_for;
-      }
-    }
-
-    // Find the first dirty card.
-    uintptr_t start_word = *word_cur;
-    uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(reinterpret_cast<uint8_t*>(word_cur)));
-    // TODO: Investigate if processing continuous runs of dirty cards with a single bitmap visit is
-    // more efficient.
-    for (size_t i = 0; i < sizeof(uintptr_t); ++i) {
-      if (static_cast<uint8_t>(start_word) >= minimum_age) {
-        auto* card = reinterpret_cast<uint8_t*>(word_cur) + i;
-        DCHECK(*card == static_cast<uint8_t>(start_word) || *card == kCardDirty)
-            << "card " << static_cast<size_t>(*card) << " intptr_t " << (start_word & 0xFF);
-        bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
-        ++cards_scanned;
-      }
-      start_word >>= 8;
-      start += kCardSize;
-    }
-  }
-  exit_for:
-
-  // Handle any unaligned cards at the end.
-  card_cur = reinterpret_cast<uint8_t*>(word_end);
-  while (card_cur < card_end) {
-    if (*card_cur >= minimum_age) {
-      uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(card_cur));
-      bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
-      ++cards_scanned;
-    }
-    ++card_cur;
+  // The card search kernel skips runs of clean cards, a vector at a time when possible.
+  // TODO: Investigate if processing continuous runs of dirty cards with a single bitmap visit is
+  // more efficient.
+  const Kernels& kernels = GetKernels();
+  for (const uint8_t* card_cur = kernels.find_card(card_begin, card_end, minimum_age);
+       card_cur < card_end;
+       card_cur = kernels.find_card(card_cur + 1, card_end, minimum_age)) {
+    uintptr_t start = reinterpret_cast<uintptr_t>(AddrFromCard(card_cur));
+    bitmap->VisitMarkedRange(start, start + kCardSize, visitor);
+    ++cards_scanned;
   }
 
   if (kClearCard) {
@@ -176,31 +137,75 @@ inline void CardTable::ModifyCardsAtomic(uint8_t* scan_begin,
     uintptr_t new_word;
     uint8_t new_bytes[sizeof(uintptr_t)];
   };
+  auto visit_modified = [&](uintptr_t* word) {
+    for (size_t i = 0; i < sizeof(uintptr_t); ++i) {
+      const uint8_t expected_byte = expected_bytes[i];
+      const uint8_t new_byte = new_bytes[i];
+      if (expected_byte != new_byte) {
+        modified(reinterpret_cast<uint8_t*>(word) + i, expected_byte, new_byte);
+      }
+    }
+  };
 
+  // Words are snapshotted and modified in batches so that card aging, the common case, can use
+  // the vectorized kernel. Each word is still updated with its own CAS; a word that changed since
+  // the snapshot is retried on its own.
+  static constexpr size_t kBatchWords = 32;
+  uintptr_t batch_expected[kBatchWords];
+  uintptr_t batch_new[kBatchWords];
+  const Kernels& kernels = GetKernels();
   // TODO: Parallelize.
   while (word_cur < word_end) {
-    while (true) {
-      expected_word = *word_cur;
-      static_assert(kCardClean == 0);
-      if (LIKELY(expected_word == 0 /* All kCardClean */ )) {
-        break;
+    // Skip runs of clean cards.
+    static_assert(kCardClean == 0);
+    const uint8_t* first_non_clean =
+        kernels.find_card(reinterpret_cast<uint8_t*>(word_cur),
+                          card_end,
+                          static_cast<uint8_t>(kCardClean + 1));
+    word_cur = reinterpret_cast<uintptr_t*>(
+        AlignDown(const_cast<uint8_t*>(first_non_clean), sizeof(uintptr_t)));
+    if (word_cur >= word_end) {
+      break;
+    }
+    const size_t batch_words = std::min(kBatchWords, static_cast<size_t>(word_end - word_cur));
+    for (size_t w = 0; w < batch_words; ++w) {
+      batch_expected[w] = word_cur[w];
+    }
+    const uint8_t* batch_expected_bytes = reinterpret_cast<const uint8_t*>(batch_expected);
+    uint8_t* batch_new_bytes = reinterpret_cast<uint8_t*>(batch_new);
+    if (std::is_same<Visitor, AgeCardVisitor>::value) {
+      kernels.age_cards(batch_expected_bytes, batch_new_bytes, batch_words * sizeof(uintptr_t));
+    } else {
+      for (size_t i = 0; i < batch_words * sizeof(uintptr_t); ++i) {
+        batch_new_bytes[i] = visitor(batch_expected_bytes[i]);
       }
-      for (size_t i = 0; i < sizeof(uintptr_t); ++i) {
-        new_bytes[i] = visitor(expected_bytes[i]);
+    }
+    for (size_t w = 0; w < batch_words; ++w, ++word_cur) {
+      expected_word = batch_expected[w];
+      if (expected_word == 0 /* All kCardClean */) {
+        continue;
       }
+      new_word = batch_new[w];
       Atomic<uintptr_t>* atomic_word = reinterpret_cast<Atomic<uintptr_t>*>(word_cur);
       if (LIKELY(atomic_word->CompareAndSetWeakRelaxed(expected_word, new_word))) {
+        visit_modified(word_cur);
+        continue;
+      }
+      // The word changed since the snapshot (or the weak CAS failed spuriously).
+      while (true) {
+        expected_word = *word_cur;
+        if (LIKELY(expected_word == 0 /* All kCardClean */ )) {
+          break;
+        }
         for (size_t i = 0; i < sizeof(uintptr_t); ++i) {
-          const uint8_t expected_byte = expected_bytes[i];
-          const uint8_t new_byte = new_bytes[i];
-          if (expected_byte != new_byte) {
-            modified(reinterpret_cast<uint8_t*>(word_cur) + i, expected_byte, new_byte);
-          }
+          new_bytes[i] = visitor(expected_bytes[i]);
+        }
+        if (LIKELY(atomic_word->CompareAndSetWeakRelaxed(expected_word, new_word))) {
+          visit_modified(word_cur);
+          break;
         }
-        break;
       }
     }
-    ++word_cur;
   }
 }
 
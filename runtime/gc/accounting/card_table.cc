@@ -18,6 +18,14 @@
 
 #include <sys/mman.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "base/bit_utils.h"
+#include "base/logging.h"  // For VLOG
 #include "base/mem_map.h"
 #include "base/systrace.h"
 #include "base/utils.h"
@@ -36,6 +44,189 @@ constexpr size_t CardTable::kCardSize;
 constexpr uint8_t CardTable::kCardClean;
 constexpr uint8_t CardTable::kCardDirty;
 
+// Scalar kernels. The card search skips clean cards a word at a time.
+static const uint8_t* FindCardScalar(const uint8_t* begin,
+                                     const uint8_t* end,
+                                     uint8_t minimum_age) {
+  static_assert(CardTable::kCardClean == 0, "kCardClean must be 0");
+  if (minimum_age == CardTable::kCardClean) {
+    return begin;
+  }
+  const uint8_t* cur = begin;
+  while (!IsAligned<sizeof(uintptr_t)>(cur) && cur < end) {
+    if (*cur >= minimum_age) {
+      return cur;
+    }
+    ++cur;
+  }
+  for (; cur + sizeof(uintptr_t) <= end; cur += sizeof(uintptr_t)) {
+    if (LIKELY(*reinterpret_cast<const uintptr_t*>(cur) == 0)) {
+      continue;  // All kCardClean.
+    }
+    for (size_t i = 0; i < sizeof(uintptr_t); ++i) {
+      if (cur[i] >= minimum_age) {
+        return cur + i;
+      }
+    }
+  }
+  for (; cur < end; ++cur) {
+    if (*cur >= minimum_age) {
+      return cur;
+    }
+  }
+  return end;
+}
+
+static void AgeCardsScalar(const uint8_t* cards, uint8_t* aged, size_t count) {
+  const AgeCardVisitor visitor;
+  for (size_t i = 0; i < count; ++i) {
+    aged[i] = visitor(cards[i]);
+  }
+}
+
+static constexpr CardTable::Kernels kScalarKernels = { "scalar", FindCardScalar, AgeCardsScalar };
+
+#if defined(__x86_64__)
+
+// A card is at least minimum_age iff max(card, minimum_age) == card.
+
+__attribute__((target("sse4.1")))
+static const uint8_t* FindCardSse41(const uint8_t* begin,
+                                    const uint8_t* end,
+                                    uint8_t minimum_age) {
+  if (minimum_age == CardTable::kCardClean) {
+    return begin;
+  }
+  const __m128i min = _mm_set1_epi8(static_cast<char>(minimum_age));
+  const uint8_t* cur = begin;
+  for (; cur + sizeof(__m128i) <= end; cur += sizeof(__m128i)) {
+    const __m128i cards = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+    if (LIKELY(_mm_testz_si128(cards, cards))) {
+      continue;  // All kCardClean.
+    }
+    const __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(cards, min), cards);
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(ge));
+    if (mask != 0u) {
+      return cur + CTZ(mask);
+    }
+  }
+  return FindCardScalar(cur, end, minimum_age);
+}
+
+__attribute__((target("sse4.1")))
+static void AgeCardsSse41(const uint8_t* cards, uint8_t* aged, size_t count) {
+  const __m128i dirty = _mm_set1_epi8(static_cast<char>(CardTable::kCardDirty));
+  const __m128i aged_value = _mm_set1_epi8(static_cast<char>(CardTable::kCardAged));
+  size_t i = 0;
+  for (; i + sizeof(__m128i) <= count; i += sizeof(__m128i)) {
+    const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cards + i));
+    const __m128i out = _mm_and_si128(_mm_cmpeq_epi8(in, dirty), aged_value);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aged + i), out);
+  }
+  AgeCardsScalar(cards + i, aged + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* FindCardAvx2(const uint8_t* begin,
+                                   const uint8_t* end,
+                                   uint8_t minimum_age) {
+  if (minimum_age == CardTable::kCardClean) {
+    return begin;
+  }
+  const __m256i min = _mm256_set1_epi8(static_cast<char>(minimum_age));
+  const uint8_t* cur = begin;
+  for (; cur + sizeof(__m256i) <= end; cur += sizeof(__m256i)) {
+    const __m256i cards = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur));
+    if (LIKELY(_mm256_testz_si256(cards, cards))) {
+      continue;  // All kCardClean.
+    }
+    const __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(cards, min), cards);
+    const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(ge));
+    if (mask != 0u) {
+      return cur + CTZ(mask);
+    }
+  }
+  return FindCardScalar(cur, end, minimum_age);
+}
+
+__attribute__((target("avx2")))
+static void AgeCardsAvx2(const uint8_t* cards, uint8_t* aged, size_t count) {
+  const __m256i dirty = _mm256_set1_epi8(static_cast<char>(CardTable::kCardDirty));
+  const __m256i aged_value = _mm256_set1_epi8(static_cast<char>(CardTable::kCardAged));
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= count; i += sizeof(__m256i)) {
+    const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cards + i));
+    const __m256i out = _mm256_and_si256(_mm256_cmpeq_epi8(in, dirty), aged_value);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(aged + i), out);
+  }
+  AgeCardsScalar(cards + i, aged + i, count - i);
+}
+
+static constexpr CardTable::Kernels kSse41Kernels = { "sse4.1", FindCardSse41, AgeCardsSse41 };
+static constexpr CardTable::Kernels kAvx2Kernels = { "avx2", FindCardAvx2, AgeCardsAvx2 };
+
+#elif defined(__aarch64__)
+
+static const uint8_t* FindCardNeon(const uint8_t* begin,
+                                   const uint8_t* end,
+                                   uint8_t minimum_age) {
+  if (minimum_age == CardTable::kCardClean) {
+    return begin;
+  }
+  const uint8x16_t min = vdupq_n_u8(minimum_age);
+  const uint8_t* cur = begin;
+  for (; cur + sizeof(uint8x16_t) <= end; cur += sizeof(uint8x16_t)) {
+    const uint8x16_t ge = vcgeq_u8(vld1q_u8(cur), min);
+    if (LIKELY(vmaxvq_u8(ge) == 0u)) {
+      continue;
+    }
+    // Narrow each byte of the comparison mask to a nibble to find the first match.
+    const uint64_t mask =
+        vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(ge), 4)), 0);
+    return cur + CTZ(mask) / 4;
+  }
+  return FindCardScalar(cur, end, minimum_age);
+}
+
+static void AgeCardsNeon(const uint8_t* cards, uint8_t* aged, size_t count) {
+  const uint8x16_t dirty = vdupq_n_u8(CardTable::kCardDirty);
+  const uint8x16_t aged_value = vdupq_n_u8(CardTable::kCardAged);
+  size_t i = 0;
+  for (; i + sizeof(uint8x16_t) <= count; i += sizeof(uint8x16_t)) {
+    const uint8x16_t in = vld1q_u8(cards + i);
+    vst1q_u8(aged + i, vandq_u8(vceqq_u8(in, dirty), aged_value));
+  }
+  AgeCardsScalar(cards + i, aged + i, count - i);
+}
+
+static constexpr CardTable::Kernels kNeonKernels = { "neon", FindCardNeon, AgeCardsNeon };
+
+#endif
+
+const CardTable::Kernels* CardTable::kernels_ = &kScalarKernels;
+
+std::vector<const CardTable::Kernels*> CardTable::GetSupportedKernels() {
+  std::vector<const Kernels*> kernels = { &kScalarKernels };
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.1")) {
+    kernels.push_back(&kSse41Kernels);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(&kAvx2Kernels);
+  }
+#elif defined(__aarch64__)
+  // NEON is part of the arm64 baseline.
+  kernels.push_back(&kNeonKernels);
+#endif
+  return kernels;
+}
+
+const CardTable::Kernels* CardTable::SelectKernels() {
+  // The last supported kernels are the widest ones.
+  return GetSupportedKernels().back();
+}
+
 /*
  * Maintain a card table from the write barrier. All writes of
  * non-null values to heap addresses should go through an entry in
@@ -89,6 +280,8 @@ CardTable* CardTable::Create(const uint8_t* heap_begin, size_t heap_capacity) {
     biased_begin += offset;
   }
   CHECK_EQ(reinterpret_cast<uintptr_t>(biased_begin) & 0xff, kCardDirty);
+  kernels_ = SelectKernels();
+  VLOG(heap) << "Using " << kernels_->name << " card table kernels";
   return new CardTable(std::move(mem_map), biased_begin, offset);
 }
 
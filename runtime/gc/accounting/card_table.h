@@ -18,6 +18,7 @@
 #define ART_RUNTIME_GC_ACCOUNTING_CARD_TABLE_H_
 
 #include <memory>
+#include <vector>
 
 #include "base/locks.h"
 #include "base/mem_map.h"
@@ -52,6 +53,24 @@ class CardTable {
   static constexpr uint8_t kCardDirty = 0x70;
   static constexpr uint8_t kCardAged = kCardDirty - 1;
 
+  // Card search and aging kernels used by Scan and ModifyCardsAtomic. Vectorized versions are
+  // selected at runtime when the CPU supports them.
+  struct Kernels {
+    const char* name;
+    // Returns the first card in [begin, end) whose value is at least minimum_age, or end.
+    const uint8_t* (*find_card)(const uint8_t* begin, const uint8_t* end, uint8_t minimum_age);
+    // Stores AgeCardVisitor()(cards[i]) into aged[i] for i in [0, count).
+    void (*age_cards)(const uint8_t* cards, uint8_t* aged, size_t count);
+  };
+
+  // The kernels selected for the current CPU.
+  static const Kernels& GetKernels() {
+    return *kernels_;
+  }
+
+  // All the kernels the current CPU supports, starting with the scalar ones.
+  static std::vector<const Kernels*> GetSupportedKernels();
+
   static CardTable* Create(const uint8_t* heap_begin, size_t heap_capacity);
   ~CardTable();
 
@@ -153,6 +172,11 @@ class CardTable {
   // Verifies that all gray objects are on a dirty card.
   void VerifyCardTable();
 
+  static const Kernels* SelectKernels();
+
+  // Set by Create, the scalar kernels until then.
+  static const Kernels* kernels_;
+
   // Mmapped pages for the card table
   MemMap mem_map_;
   // Value used to compute card table addresses from object addresses, see GetBiasedBegin
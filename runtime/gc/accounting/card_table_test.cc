@@ -16,15 +16,23 @@
 
 #include "card_table-inl.h"
 
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <random>
 #include <string>
+#include <vector>
 
 #include "base/atomic.h"
+#include "base/histogram-inl.h"
+#include "base/time_utils.h"
 #include "base/utils.h"
 #include "common_runtime_test.h"
 #include "handle_scope-inl.h"
 #include "mirror/class-inl.h"
 #include "mirror/string-inl.h"  // Strings are easiest to allocate
 #include "scoped_thread_state_change-inl.h"
+#include "space_bitmap-inl.h"
 #include "thread_pool.h"
 
 namespace art {
@@ -145,7 +153,184 @@ TEST_F(CardTableTest, TestModifyCardsAtomic) {
   }
 }
 
-// TODO: Add test for CardTable::Scan.
+TEST_F(CardTableTest, TestScan) {
+  CommonSetup();
+  ScopedObjectAccess soa(Thread::Current());
+  WriterMutexLock mu(soa.Self(), *Locks::heap_bitmap_lock_);
+  std::unique_ptr<ContinuousSpaceBitmap> bitmap(ContinuousSpaceBitmap::Create(
+      "card table test bitmap", HeapBegin(), HeapLimit() - HeapBegin()));
+  ASSERT_TRUE(bitmap.get() != nullptr);
+  const size_t num_cards = (HeapLimit() - HeapBegin()) / CardTable::kCardSize;
+  // Cards on both sides of the chunk edges of the search kernels, and at the ends of the table.
+  const size_t dirty_cards[] = {
+      0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, num_cards - 2, num_cards - 1,
+  };
+  const size_t kAgedCard = 48;
+  // Mark the first and the last object of every card, the objects in clean cards must not be
+  // visited.
+  for (uint8_t* addr = HeapBegin(); addr < HeapLimit(); addr += CardTable::kCardSize) {
+    bitmap->Set(reinterpret_cast<mirror::Object*>(addr));
+    bitmap->Set(reinterpret_cast<mirror::Object*>(addr + CardTable::kCardSize - kObjectAlignment));
+  }
+  auto card_at = [&](size_t index) { return HeapBegin() + index * CardTable::kCardSize; };
+  auto mark_cards = [&]() {
+    for (size_t index : dirty_cards) {
+      card_table_->MarkCard(card_at(index));
+    }
+    *card_table_->CardFromAddr(card_at(kAgedCard)) = CardTable::kCardAged;
+  };
+  auto expected_objects = [&](size_t begin, size_t end, bool include_aged) {
+    std::vector<mirror::Object*> objects;
+    for (size_t index = begin; index < end; ++index) {
+      if (std::find(std::begin(dirty_cards), std::end(dirty_cards), index) !=
+              std::end(dirty_cards) ||
+          (include_aged && index == kAgedCard)) {
+        objects.push_back(reinterpret_cast<mirror::Object*>(card_at(index)));
+        objects.push_back(reinterpret_cast<mirror::Object*>(
+            card_at(index + 1) - kObjectAlignment));
+      }
+    }
+    return objects;
+  };
+  mark_cards();
+  const size_t kEdges[] = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65};
+  for (size_t begin : kEdges) {
+    for (size_t end_offset : kEdges) {
+      const size_t end = num_cards - end_offset;
+      for (uint8_t minimum_age : {CardTable::kCardDirty, CardTable::kCardAged}) {
+        std::vector<mirror::Object*> visited;
+        size_t cards_scanned = card_table_->Scan</* kClearCard= */ false>(
+            bitmap.get(),
+            card_at(begin),
+            card_at(end),
+            [&](mirror::Object* obj) { visited.push_back(obj); },
+            minimum_age);
+        std::vector<mirror::Object*> expected =
+            expected_objects(begin, end, minimum_age == CardTable::kCardAged);
+        EXPECT_EQ(expected.size() / 2, cards_scanned) << begin << " " << end;
+        EXPECT_EQ(expected, visited) << begin << " " << end;
+      }
+    }
+  }
+  // Scanning with kClearCard clears the scanned range only.
+  const size_t begin = 16;
+  const size_t end = 65;
+  size_t cards_scanned = card_table_->Scan</* kClearCard= */ true>(
+      bitmap.get(), card_at(begin), card_at(end), [](mirror::Object* obj ATTRIBUTE_UNUSED) {});
+  EXPECT_EQ(expected_objects(begin, end, /* include_aged= */ false).size() / 2, cards_scanned);
+  for (size_t index = 0; index < num_cards; ++index) {
+    uint8_t expected_card = CardTable::kCardClean;
+    if (index < begin || index >= end) {
+      if (std::find(std::begin(dirty_cards), std::end(dirty_cards), index) !=
+          std::end(dirty_cards)) {
+        expected_card = CardTable::kCardDirty;
+      } else if (index == kAgedCard) {
+        expected_card = CardTable::kCardAged;
+      }
+    }
+    EXPECT_EQ(expected_card, *card_table_->CardFromAddr(card_at(index))) << index;
+  }
+}
+
+// Fill cards with mostly clean cards and a few dirty or aged ones, like a card table at a GC.
+static void FillSparseCards(std::vector<uint8_t>* cards, size_t one_in, uint32_t seed) {
+  std::minstd_rand random(seed);
+  for (uint8_t& card : *cards) {
+    switch (random() % (2 * one_in)) {
+      case 0: card = CardTable::kCardDirty; break;
+      case 1: card = CardTable::kCardAged; break;
+      case 2: card = static_cast<uint8_t>(random()); break;
+      default: card = CardTable::kCardClean; break;
+    }
+  }
+}
+
+TEST(CardTableKernelsTest, MatchScalar) {
+  std::vector<const CardTable::Kernels*> kernels = CardTable::GetSupportedKernels();
+  ASSERT_FALSE(kernels.empty());
+  const CardTable::Kernels* scalar = kernels[0];
+  const uint8_t kMinimumAges[] = {
+      CardTable::kCardClean,
+      CardTable::kCardClean + 1,
+      CardTable::kCardAged,
+      CardTable::kCardDirty,
+      0xff,
+  };
+  for (size_t one_in : {1u, 4u, 64u, 1024u}) {
+    std::vector<uint8_t> cards(4 * KB + 64);
+    FillSparseCards(&cards, one_in, /* seed= */ one_in);
+    std::vector<uint8_t> expected_aged(cards.size());
+    std::vector<uint8_t> aged(cards.size());
+    // Exercise unaligned starts and ends and the scalar tails of the vector kernels.
+    for (size_t begin_offset = 0; begin_offset < 64; begin_offset += 7) {
+      for (size_t end_offset = 0; end_offset < 64; end_offset += 5) {
+        const uint8_t* begin = cards.data() + begin_offset;
+        const uint8_t* end = cards.data() + cards.size() - end_offset;
+        const size_t count = end - begin;
+        scalar->age_cards(begin, expected_aged.data(), count);
+        for (const CardTable::Kernels* k : kernels) {
+          for (uint8_t minimum_age : kMinimumAges) {
+            // Walk the cards the way CardTable::Scan does.
+            const uint8_t* cur = begin;
+            while (true) {
+              const uint8_t* expected = scalar->find_card(cur, end, minimum_age);
+              ASSERT_EQ(expected, k->find_card(cur, end, minimum_age))
+                  << k->name << " offset " << (cur - cards.data()) << " minimum age "
+                  << static_cast<int>(minimum_age);
+              if (expected == end) {
+                break;
+              }
+              cur = expected + 1;
+            }
+          }
+          std::fill(aged.begin(), aged.end(), 0xab);
+          k->age_cards(begin, aged.data(), count);
+          for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(expected_aged[i], aged[i]) << k->name << " index " << i;
+            ASSERT_EQ(AgeCardVisitor()(begin[i]), aged[i]) << k->name << " index " << i;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(CardTableKernelsTest, Speed) {
+  // A card table covering 256MB of heap with one non-clean card in 64.
+  std::vector<uint8_t> cards(256 * MB / CardTable::kCardSize);
+  FillSparseCards(&cards, 64, /* seed= */ 42);
+  std::vector<uint8_t> aged(cards.size());
+  const uint8_t* const end = cards.data() + cards.size();
+  for (const CardTable::Kernels* k : CardTable::GetSupportedKernels()) {
+    std::unique_ptr<Histogram<uint64_t>> find_hist(
+        new Histogram<uint64_t>((std::string("CardTableFindCard-") + k->name).c_str(), 5));
+    std::unique_ptr<Histogram<uint64_t>> age_hist(
+        new Histogram<uint64_t>((std::string("CardTableAgeCards-") + k->name).c_str(), 5));
+    size_t found = 0;
+    for (size_t i = 0; i < 64; ++i) {
+      uint64_t start_time = NanoTime();
+      for (const uint8_t* card = k->find_card(cards.data(), end, CardTable::kCardAged);
+           card < end;
+           card = k->find_card(card + 1, end, CardTable::kCardAged)) {
+        ++found;
+      }
+      uint64_t mid_time = NanoTime();
+      k->age_cards(cards.data(), aged.data(), cards.size());
+      uint64_t end_time = NanoTime();
+      find_hist->AddValue(mid_time - start_time);
+      age_hist->AddValue(end_time - mid_time);
+    }
+    EXPECT_NE(found, 0u);
+
+    Histogram<uint64_t>::CumulativeData find_data;
+    find_hist->CreateHistogram(&find_data);
+    find_hist->PrintConfidenceIntervals(std::cout, 0.99, find_data);
+
+    Histogram<uint64_t>::CumulativeData age_data;
+    age_hist->CreateHistogram(&age_data);
+    age_hist->PrintConfidenceIntervals(std::cout, 0.99, age_data);
+  }
+}
 }  // namespace accounting
 }  // namespace gc
 }  // namespace art
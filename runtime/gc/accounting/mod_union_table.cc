@@ -16,10 +16,13 @@
 
 #include "mod_union_table.h"
 
+#include <atomic>
 #include <memory>
+#include <ostream>
 
 #include "base/logging.h"  // For VLOG
 #include "base/stl_util.h"
+#include "base/time_utils.h"
 #include "bitmap-inl.h"
 #include "card_table-inl.h"
 #include "gc/accounting/space_bitmap-inl.h"
@@ -31,11 +34,85 @@
 #include "object_callbacks.h"
 #include "space_bitmap-inl.h"
 #include "thread-current-inl.h"
+#include "thread_pool.h"
 
 namespace art {
 namespace gc {
 namespace accounting {
 
+// Granularity of the parallel work split, in cards and in reference arrays. Chunks of cards are
+// a multiple of the bits of a word so that two threads never update the same word of a card
+// bitmap.
+static constexpr size_t kCardsPerChunk = 16 * KB;
+static constexpr size_t kReferenceArraysPerChunk = 1 * KB;
+static_assert(kCardsPerChunk % kBitsPerIntPtrT == 0, "Chunks must cover whole bitmap words");
+
+// Call visit(begin, end) for the chunks of [0, size), on the calling thread and thread_count - 1
+// workers of the thread pool. The workers run on behalf of the calling thread, which holds the
+// locks that the visitor requires.
+template <typename Visitor>
+static void VisitChunksParallel(ThreadPool* thread_pool,
+                                size_t thread_count,
+                                size_t size,
+                                size_t chunk_size,
+                                const Visitor& visit) NO_THREAD_SAFETY_ANALYSIS {
+  const size_t num_chunks = RoundUp(size, chunk_size) / chunk_size;
+  if (thread_pool == nullptr || thread_count <= 1u || num_chunks <= 1u) {
+    for (size_t begin = 0; begin < size; begin += chunk_size) {
+      visit(begin, std::min(begin + chunk_size, size));
+    }
+    return;
+  }
+  Thread* const self = Thread::Current();
+  std::atomic<size_t> next_chunk(0u);
+  const size_t num_tasks = std::min(thread_count, num_chunks);
+  for (size_t i = 0; i < num_tasks; ++i) {
+    thread_pool->AddTask(self, new FunctionTask([&](Thread*) NO_THREAD_SAFETY_ANALYSIS {
+      for (size_t chunk = next_chunk.fetch_add(1u, std::memory_order_relaxed);
+           chunk < num_chunks;
+           chunk = next_chunk.fetch_add(1u, std::memory_order_relaxed)) {
+        const size_t begin = chunk * chunk_size;
+        visit(begin, std::min(begin + chunk_size, size));
+      }
+    }));
+  }
+  thread_pool->SetMaxActiveWorkers(num_tasks - 1u);
+  thread_pool->StartWorkers(self);
+  thread_pool->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+  thread_pool->StopWorkers(self);
+}
+
+void ModUnionTable::RecordProcessCards(uint64_t start_ns, size_t dirty_cards) {
+  ++process_cards_count_;
+  process_cards_time_ns_ += NanoTime() - start_ns;
+  dirty_cards_ += dirty_cards;
+}
+
+void ModUnionTable::RecordUpdate(uint64_t start_ns, size_t cards, size_t references) {
+  ++update_count_;
+  update_time_ns_ += NanoTime() - start_ns;
+  updated_cards_ += cards;
+  marked_references_ += references;
+}
+
+void ModUnionTable::DumpStats(std::ostream& os) const {
+  os << "Mod-union table " << name_ << ": "
+     << process_cards_count_ << " card processings in " << PrettyDuration(process_cards_time_ns_)
+     << " with " << dirty_cards_ << " dirty cards, "
+     << update_count_ << " updates in " << PrettyDuration(update_time_ns_)
+     << " with " << updated_cards_ << " cards and " << marked_references_ << " references\n";
+}
+
+void ModUnionTable::ResetStats() {
+  process_cards_count_ = 0u;
+  process_cards_time_ns_ = 0u;
+  dirty_cards_ = 0u;
+  update_count_ = 0u;
+  update_time_ns_ = 0u;
+  updated_cards_ = 0u;
+  marked_references_ = 0u;
+}
+
 class ModUnionAddToCardSetVisitor {
  public:
   explicit ModUnionAddToCardSetVisitor(ModUnionTable::CardSet* const cleared_cards)
@@ -93,11 +170,11 @@ class ModUnionUpdateObjectReferencesVisitor {
   ModUnionUpdateObjectReferencesVisitor(MarkObjectVisitor* visitor,
                                         space::ContinuousSpace* from_space,
                                         space::ContinuousSpace* immune_space,
-                                        bool* contains_reference_to_other_space)
+                                        size_t* references_to_other_spaces)
     : visitor_(visitor),
       from_space_(from_space),
       immune_space_(immune_space),
-      contains_reference_to_other_space_(contains_reference_to_other_space) {}
+      references_to_other_spaces_(references_to_other_spaces) {}
 
   // Extra parameters are required since we use this same visitor signature for checking objects.
   void operator()(mirror::Object* obj, MemberOffset offset, bool is_static ATTRIBUTE_UNUSED) const
@@ -122,7 +199,7 @@ class ModUnionUpdateObjectReferencesVisitor {
     // Only add the reference if it is non null and fits our criteria.
     mirror::Object* ref = obj_ptr->AsMirrorPtr();
     if (ref != nullptr && !from_space_->HasAddress(ref) && !immune_space_->HasAddress(ref)) {
-      *contains_reference_to_other_space_ = true;
+      ++*references_to_other_spaces_;
       mirror::Object* new_object = visitor_->MarkObject(ref);
       if (ref != new_object) {
         obj_ptr->Assign(new_object);
@@ -134,8 +211,8 @@ class ModUnionUpdateObjectReferencesVisitor {
   // Space which we are scanning
   space::ContinuousSpace* const from_space_;
   space::ContinuousSpace* const immune_space_;
-  // Set if we have any references to another space.
-  bool* const contains_reference_to_other_space_;
+  // Number of references to another space.
+  size_t* const references_to_other_spaces_;
 };
 
 class ModUnionScanImageRootVisitor {
@@ -145,11 +222,11 @@ class ModUnionScanImageRootVisitor {
   ModUnionScanImageRootVisitor(MarkObjectVisitor* visitor,
                                space::ContinuousSpace* from_space,
                                space::ContinuousSpace* immune_space,
-                               bool* contains_reference_to_other_space)
+                               size_t* references_to_other_spaces)
       : visitor_(visitor),
         from_space_(from_space),
         immune_space_(immune_space),
-        contains_reference_to_other_space_(contains_reference_to_other_space) {}
+        references_to_other_spaces_(references_to_other_spaces) {}
 
   void operator()(mirror::Object* root) const
       REQUIRES(Locks::heap_bitmap_lock_)
@@ -158,7 +235,7 @@ class ModUnionScanImageRootVisitor {
     ModUnionUpdateObjectReferencesVisitor ref_visitor(visitor_,
                                                       from_space_,
                                                       immune_space_,
-                                                      contains_reference_to_other_space_);
+                                                      references_to_other_spaces_);
     root->VisitReferences(ref_visitor, VoidFunctor());
   }
 
@@ -167,15 +244,42 @@ class ModUnionScanImageRootVisitor {
   // Space which we are scanning
   space::ContinuousSpace* const from_space_;
   space::ContinuousSpace* const immune_space_;
-  // Set if we have any references to another space.
-  bool* const contains_reference_to_other_space_;
+  // Number of references to another space.
+  size_t* const references_to_other_spaces_;
 };
 
 void ModUnionTableReferenceCache::ProcessCards() {
+  ProcessCardsParallel(/* thread_pool= */ nullptr, /* thread_count= */ 1u);
+}
+
+void ModUnionTableReferenceCache::ProcessCardsParallel(ThreadPool* thread_pool,
+                                                       size_t thread_count) {
+  const uint64_t start_ns = NanoTime();
   CardTable* card_table = GetHeap()->GetCardTable();
-  ModUnionAddToCardSetVisitor visitor(&cleared_cards_);
-  // Clear dirty cards in the this space and update the corresponding mod-union bits.
-  card_table->ModifyCardsAtomic(space_->Begin(), space_->End(), AgeCardVisitor(), visitor);
+  uint8_t* const begin = space_->Begin();
+  uint8_t* const end = space_->End();
+  const size_t num_cards = RoundUp(end - begin, CardTable::kCardSize) / CardTable::kCardSize;
+  // The cards of every chunk are collected separately and added to the set afterwards.
+  std::vector<std::vector<uint8_t*>> chunk_cards(RoundUp(num_cards, kCardsPerChunk) /
+                                                 kCardsPerChunk);
+  VisitChunksParallel(thread_pool,
+                      thread_count,
+                      num_cards,
+                      kCardsPerChunk,
+                      [&](size_t card_begin, size_t card_end) {
+    ModUnionAddToCardVectorVisitor visitor(&chunk_cards[card_begin / kCardsPerChunk]);
+    // Clear dirty cards in the this space and update the corresponding mod-union bits.
+    card_table->ModifyCardsAtomic(begin + card_begin * CardTable::kCardSize,
+                                  std::min(begin + card_end * CardTable::kCardSize, end),
+                                  AgeCardVisitor(),
+                                  visitor);
+  });
+  size_t dirty_cards = 0u;
+  for (const std::vector<uint8_t*>& cards : chunk_cards) {
+    cleared_cards_.insert(cards.begin(), cards.end());
+    dirty_cards += cards.size();
+  }
+  RecordProcessCards(start_ns, dirty_cards);
 }
 
 void ModUnionTableReferenceCache::ClearTable() {
@@ -411,70 +515,108 @@ void ModUnionTableReferenceCache::VisitObjects(ObjectCallback callback, void* ar
 }
 
 void ModUnionTableReferenceCache::UpdateAndMarkReferences(MarkObjectVisitor* visitor) {
+  UpdateAndMarkReferencesParallel(visitor, /* thread_pool= */ nullptr, /* thread_count= */ 1u);
+}
+
+void ModUnionTableReferenceCache::UpdateAndMarkReferencesParallel(MarkObjectVisitor* visitor,
+                                                                  ThreadPool* thread_pool,
+                                                                  size_t thread_count) {
+  const uint64_t start_ns = NanoTime();
   CardTable* const card_table = heap_->GetCardTable();
-  std::vector<mirror::HeapReference<mirror::Object>*> cards_references;
+  // Re-compute the alloc space references of every cleared card. The cards are scanned in
+  // parallel, the table is updated afterwards.
+  const std::vector<uint8_t*> cards(cleared_cards_.begin(), cleared_cards_.end());
+  std::vector<std::vector<mirror::HeapReference<mirror::Object>*>> cards_references(cards.size());
   // If has_target_reference is true then there was a GcRoot compressed reference which wasn't
   // added. In this case we need to keep the card dirty.
   // We don't know if the GcRoot addresses will remain constant, for example, classloaders have a
   // hash set of GcRoot which may be resized or modified.
-  bool has_target_reference;
-  ModUnionReferenceVisitor add_visitor(this, visitor, &cards_references, &has_target_reference);
+  std::unique_ptr<bool[]> has_target_references(new bool[cards.size()]);
+  VisitChunksParallel(thread_pool,
+                      thread_count,
+                      cards.size(),
+                      kCardsPerChunk,
+                      [&](size_t begin, size_t end) NO_THREAD_SAFETY_ANALYSIS {
+    for (size_t i = begin; i < end; ++i) {
+      has_target_references[i] = false;
+      ModUnionReferenceVisitor add_visitor(this,
+                                           visitor,
+                                           &cards_references[i],
+                                           &has_target_references[i]);
+      uintptr_t start = reinterpret_cast<uintptr_t>(card_table->AddrFromCard(cards[i]));
+      space::ContinuousSpace* space =
+          heap_->FindContinuousSpaceFromObject(reinterpret_cast<mirror::Object*>(start), false);
+      DCHECK(space != nullptr);
+      space->GetLiveBitmap()->VisitMarkedRange(start, start + CardTable::kCardSize, add_visitor);
+    }
+  });
   CardSet new_cleared_cards;
-  for (uint8_t* card : cleared_cards_) {
-    // Clear and re-compute alloc space references associated with this card.
-    cards_references.clear();
-    has_target_reference = false;
-    uintptr_t start = reinterpret_cast<uintptr_t>(card_table->AddrFromCard(card));
-    uintptr_t end = start + CardTable::kCardSize;
-    space::ContinuousSpace* space =
-        heap_->FindContinuousSpaceFromObject(reinterpret_cast<mirror::Object*>(start), false);
-    DCHECK(space != nullptr);
-    ContinuousSpaceBitmap* live_bitmap = space->GetLiveBitmap();
-    live_bitmap->VisitMarkedRange(start, end, add_visitor);
+  for (size_t i = 0; i < cards.size(); ++i) {
+    uint8_t* card = cards[i];
     // Update the corresponding references for the card.
     auto found = references_.find(card);
     if (found == references_.end()) {
       // Don't add card for an empty reference array.
-      if (!cards_references.empty()) {
-        references_.Put(card, cards_references);
+      if (!cards_references[i].empty()) {
+        references_.Put(card, std::move(cards_references[i]));
       }
     } else {
-      if (cards_references.empty()) {
+      if (cards_references[i].empty()) {
         references_.erase(found);
       } else {
-        found->second = cards_references;
+        found->second = std::move(cards_references[i]);
       }
     }
-    if (has_target_reference) {
+    if (has_target_references[i]) {
       // Keep this card for next time since it contains a GcRoot which matches the
       // ShouldAddReference criteria. This usually occurs for class loaders.
       new_cleared_cards.insert(card);
     }
   }
   cleared_cards_ = std::move(new_cleared_cards);
-  size_t count = 0;
-  for (auto it = references_.begin(); it != references_.end();) {
-    std::vector<mirror::HeapReference<mirror::Object>*>& references = it->second;
-    // Since there is no card mark for setting a reference to null, we check each reference.
-    // If all of the references of a card are null then we can remove that card. This is racy
-    // with the mutators, but handled by rescanning dirty cards.
-    bool all_null = true;
-    for (mirror::HeapReference<mirror::Object>* obj_ptr : references) {
-      if (obj_ptr->AsMirrorPtr() != nullptr) {
-        all_null = false;
-        visitor->MarkHeapReference(obj_ptr, /*do_atomic_update=*/ false);
+  // Mark the references of all the cards in parallel, then drop the cards whose references are
+  // all null.
+  std::vector<std::vector<mirror::HeapReference<mirror::Object>*>*> reference_arrays;
+  reference_arrays.reserve(references_.size());
+  for (auto& entry : references_) {
+    reference_arrays.push_back(&entry.second);
+  }
+  std::unique_ptr<bool[]> all_null(new bool[reference_arrays.size()]);
+  std::atomic<size_t> count(0u);
+  VisitChunksParallel(thread_pool,
+                      thread_count,
+                      reference_arrays.size(),
+                      kReferenceArraysPerChunk,
+                      [&](size_t begin, size_t end) NO_THREAD_SAFETY_ANALYSIS {
+    size_t chunk_count = 0u;
+    for (size_t i = begin; i < end; ++i) {
+      // Since there is no card mark for setting a reference to null, we check each reference.
+      // If all of the references of a card are null then we can remove that card. This is racy
+      // with the mutators, but handled by rescanning dirty cards.
+      all_null[i] = true;
+      for (mirror::HeapReference<mirror::Object>* obj_ptr : *reference_arrays[i]) {
+        if (obj_ptr->AsMirrorPtr() != nullptr) {
+          all_null[i] = false;
+          visitor->MarkHeapReference(obj_ptr, /*do_atomic_update=*/ false);
+        }
       }
+      chunk_count += reference_arrays[i]->size();
     }
-    count += references.size();
-    if (!all_null) {
+    count.fetch_add(chunk_count, std::memory_order_relaxed);
+  });
+  size_t index = 0u;
+  for (auto it = references_.begin(); it != references_.end(); ++index) {
+    if (!all_null[index]) {
       ++it;
     } else {
       // All null references, erase the array from the set.
       it = references_.erase(it);
     }
   }
+  RecordUpdate(start_ns, cards.size(), count.load(std::memory_order_relaxed));
   if (VLOG_IS_ON(heap)) {
-    VLOG(gc) << "Marked " << count << " references in mod union table";
+    VLOG(gc) << "Marked " << count.load(std::memory_order_relaxed)
+             << " references in mod union table";
   }
 }
 
@@ -497,12 +639,16 @@ class CardBitVisitor {
   CardBitVisitor(MarkObjectVisitor* visitor,
                  space::ContinuousSpace* space,
                  space::ContinuousSpace* immune_space,
-                 ModUnionTable::CardBitmap* card_bitmap)
+                 ModUnionTable::CardBitmap* card_bitmap,
+                 size_t* card_count,
+                 size_t* reference_count)
       : visitor_(visitor),
         space_(space),
         immune_space_(immune_space),
         bitmap_(space->GetLiveBitmap()),
-        card_bitmap_(card_bitmap) {
+        card_bitmap_(card_bitmap),
+        card_count_(card_count),
+        reference_count_(reference_count) {
     DCHECK(immune_space_ != nullptr);
   }
 
@@ -510,14 +656,16 @@ class CardBitVisitor {
     const uintptr_t start = card_bitmap_->AddrFromBitIndex(bit_index);
     DCHECK(space_->HasAddress(reinterpret_cast<mirror::Object*>(start)))
         << start << " " << *space_;
-    bool reference_to_other_space = false;
+    size_t references_to_other_spaces = 0u;
     ModUnionScanImageRootVisitor scan_visitor(visitor_, space_, immune_space_,
-                                              &reference_to_other_space);
+                                              &references_to_other_spaces);
     bitmap_->VisitMarkedRange(start, start + CardTable::kCardSize, scan_visitor);
-    if (!reference_to_other_space) {
+    if (references_to_other_spaces == 0u) {
       // No non null reference to another space, clear the bit.
       card_bitmap_->ClearBit(bit_index);
     }
+    ++*card_count_;
+    *reference_count_ += references_to_other_spaces;
   }
 
  private:
@@ -526,13 +674,40 @@ class CardBitVisitor {
   space::ContinuousSpace* const immune_space_;
   ContinuousSpaceBitmap* const bitmap_;
   ModUnionTable::CardBitmap* const card_bitmap_;
+  size_t* const card_count_;
+  size_t* const reference_count_;
 };
 
 void ModUnionTableCardCache::ProcessCards() {
+  ProcessCardsParallel(/* thread_pool= */ nullptr, /* thread_count= */ 1u);
+}
+
+void ModUnionTableCardCache::ProcessCardsParallel(ThreadPool* thread_pool, size_t thread_count) {
+  const uint64_t start_ns = NanoTime();
   CardTable* const card_table = GetHeap()->GetCardTable();
-  ModUnionAddToCardBitmapVisitor visitor(card_bitmap_.get(), card_table);
-  // Clear dirty cards in the this space and update the corresponding mod-union bits.
-  card_table->ModifyCardsAtomic(space_->Begin(), space_->End(), AgeCardVisitor(), visitor);
+  uint8_t* const begin = space_->Begin();
+  uint8_t* const end = space_->End();
+  const size_t num_cards = RoundUp(end - begin, CardTable::kCardSize) / CardTable::kCardSize;
+  std::atomic<size_t> dirty_cards(0u);
+  // The card bitmap starts at the beginning of the space, so the chunks set bits of separate words.
+  VisitChunksParallel(thread_pool,
+                      thread_count,
+                      num_cards,
+                      kCardsPerChunk,
+                      [&](size_t card_begin, size_t card_end) {
+    size_t chunk_dirty_cards = 0u;
+    ModUnionAddToCardBitmapVisitor visitor(card_bitmap_.get(), card_table);
+    // Clear dirty cards in the this space and update the corresponding mod-union bits.
+    card_table->ModifyCardsAtomic(begin + card_begin * CardTable::kCardSize,
+                                  std::min(begin + card_end * CardTable::kCardSize, end),
+                                  AgeCardVisitor(),
+                                  [&](uint8_t* card, uint8_t expected_value, uint8_t new_value) {
+      chunk_dirty_cards += (expected_value == CardTable::kCardDirty) ? 1u : 0u;
+      visitor(card, expected_value, new_value);
+    });
+    dirty_cards.fetch_add(chunk_dirty_cards, std::memory_order_relaxed);
+  });
+  RecordProcessCards(start_ns, dirty_cards.load(std::memory_order_relaxed));
 }
 
 void ModUnionTableCardCache::ClearTable() {
@@ -541,15 +716,38 @@ void ModUnionTableCardCache::ClearTable() {
 
 // Mark all references to the alloc space(s).
 void ModUnionTableCardCache::UpdateAndMarkReferences(MarkObjectVisitor* visitor) {
+  UpdateAndMarkReferencesParallel(visitor, /* thread_pool= */ nullptr, /* thread_count= */ 1u);
+}
+
+void ModUnionTableCardCache::UpdateAndMarkReferencesParallel(MarkObjectVisitor* visitor,
+                                                             ThreadPool* thread_pool,
+                                                             size_t thread_count) {
+  const uint64_t start_ns = NanoTime();
   // TODO: Needs better support for multi-images? b/26317072
   space::ImageSpace* image_space =
       heap_->GetBootImageSpaces().empty() ? nullptr : heap_->GetBootImageSpaces()[0];
   // If we don't have an image space, just pass in space_ as the immune space. Pass in the same
   // space_ instead of image_space to avoid a null check in ModUnionUpdateObjectReferencesVisitor.
-  CardBitVisitor bit_visitor(visitor, space_, image_space != nullptr ? image_space : space_,
-      card_bitmap_.get());
-  card_bitmap_->VisitSetBits(
-      0, RoundUp(space_->Size(), CardTable::kCardSize) / CardTable::kCardSize, bit_visitor);
+  space::ContinuousSpace* immune_space = image_space != nullptr ? image_space : space_;
+  std::atomic<size_t> cards(0u);
+  std::atomic<size_t> references(0u);
+  // Every chunk clears the bits of separate words of the card bitmap.
+  VisitChunksParallel(thread_pool,
+                      thread_count,
+                      RoundUp(space_->Size(), CardTable::kCardSize) / CardTable::kCardSize,
+                      kCardsPerChunk,
+                      [&](size_t begin, size_t end) NO_THREAD_SAFETY_ANALYSIS {
+    size_t chunk_cards = 0u;
+    size_t chunk_references = 0u;
+    CardBitVisitor bit_visitor(visitor, space_, immune_space, card_bitmap_.get(),
+        &chunk_cards, &chunk_references);
+    card_bitmap_->VisitSetBits(begin, end, bit_visitor);
+    cards.fetch_add(chunk_cards, std::memory_order_relaxed);
+    references.fetch_add(chunk_references, std::memory_order_relaxed);
+  });
+  RecordUpdate(start_ns,
+               cards.load(std::memory_order_relaxed),
+               references.load(std::memory_order_relaxed));
 }
 
 void ModUnionTableCardCache::VisitObjects(ObjectCallback callback, void* arg) {
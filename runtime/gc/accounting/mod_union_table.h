@@ -25,6 +25,7 @@
 #include "mirror/object_reference.h"
 #include "runtime_globals.h"
 
+#include <iosfwd>
 #include <set>
 #include <vector>
 
@@ -35,6 +36,7 @@ class Object;
 }  // namespace mirror
 
 class MarkObjectVisitor;
+class ThreadPool;
 
 namespace gc {
 namespace space {
@@ -59,7 +61,14 @@ class ModUnionTable {
   explicit ModUnionTable(const std::string& name, Heap* heap, space::ContinuousSpace* space)
       : name_(name),
         heap_(heap),
-        space_(space) {}
+        space_(space),
+        process_cards_count_(0u),
+        process_cards_time_ns_(0u),
+        dirty_cards_(0u),
+        update_count_(0u),
+        update_time_ns_(0u),
+        updated_cards_(0u),
+        marked_references_(0u) {}
 
   virtual ~ModUnionTable() {}
 
@@ -68,6 +77,10 @@ class ModUnionTable {
   // references to track.
   virtual void ProcessCards() = 0;
 
+  // Same as ProcessCards(), with the cards of the space split across thread_count threads of the
+  // thread pool, including the calling thread.
+  virtual void ProcessCardsParallel(ThreadPool* thread_pool, size_t thread_count) = 0;
+
   // Set all the cards.
   virtual void SetCards() = 0;
 
@@ -79,6 +92,12 @@ class ModUnionTable {
   // references to other spaces which are stored in the mod-union table.
   virtual void UpdateAndMarkReferences(MarkObjectVisitor* visitor) = 0;
 
+  // Same as UpdateAndMarkReferences(), with the table split across thread_count threads of the
+  // thread pool, including the calling thread. The visitor must be safe to use concurrently.
+  virtual void UpdateAndMarkReferencesParallel(MarkObjectVisitor* visitor,
+                                               ThreadPool* thread_pool,
+                                               size_t thread_count) = 0;
+
   // Visit all of the objects that may contain references to other spaces.
   virtual void VisitObjects(ObjectCallback callback, void* arg) = 0;
 
@@ -97,6 +116,11 @@ class ModUnionTable {
 
   virtual void Dump(std::ostream& os) = 0;
 
+  // Write the time spent processing cards and updating the table, and the number of cards and
+  // references, since the last ResetStats(). Used by the GC performance dump.
+  void DumpStats(std::ostream& os) const;
+  void ResetStats();
+
   space::ContinuousSpace* GetSpace() {
     return space_;
   }
@@ -110,9 +134,21 @@ class ModUnionTable {
   }
 
  protected:
+  void RecordProcessCards(uint64_t start_ns, size_t dirty_cards);
+  void RecordUpdate(uint64_t start_ns, size_t cards, size_t references);
+
   const std::string name_;
   Heap* const heap_;
   space::ContinuousSpace* const space_;
+
+  // Statistics, only updated by the GC-running thread.
+  uint64_t process_cards_count_;
+  uint64_t process_cards_time_ns_;
+  uint64_t dirty_cards_;
+  uint64_t update_count_;
+  uint64_t update_time_ns_;
+  uint64_t updated_cards_;
+  uint64_t marked_references_;
 };
 
 // Reference caching implementation. Caches references pointing to alloc space(s) for each card.
@@ -126,11 +162,17 @@ class ModUnionTableReferenceCache : public ModUnionTable {
 
   // Clear and store cards for a space.
   void ProcessCards() override;
+  void ProcessCardsParallel(ThreadPool* thread_pool, size_t thread_count) override;
 
   // Update table based on cleared cards and mark all references to the other spaces.
   void UpdateAndMarkReferences(MarkObjectVisitor* visitor) override
       REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(Locks::heap_bitmap_lock_);
+  void UpdateAndMarkReferencesParallel(MarkObjectVisitor* visitor,
+                                       ThreadPool* thread_pool,
+                                       size_t thread_count) override
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(Locks::heap_bitmap_lock_);
 
   void VisitObjects(ObjectCallback callback, void* arg) override
       REQUIRES(Locks::heap_bitmap_lock_)
@@ -173,11 +215,17 @@ class ModUnionTableCardCache : public ModUnionTable {
 
   // Clear and store cards for a space.
   void ProcessCards() override;
+  void ProcessCardsParallel(ThreadPool* thread_pool, size_t thread_count) override;
 
   // Mark all references to the alloc space(s).
   void UpdateAndMarkReferences(MarkObjectVisitor* visitor) override
       REQUIRES(Locks::heap_bitmap_lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
+  void UpdateAndMarkReferencesParallel(MarkObjectVisitor* visitor,
+                                       ThreadPool* thread_pool,
+                                       size_t thread_count) override
+      REQUIRES(Locks::heap_bitmap_lock_)
+      REQUIRES_SHARED(Locks::mutator_lock_);
 
   void VisitObjects(ObjectCallback callback, void* arg) override
       REQUIRES(Locks::heap_bitmap_lock_)
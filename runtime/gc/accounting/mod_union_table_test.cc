@@ -25,6 +25,7 @@
 #include "space_bitmap-inl.h"
 #include "thread-current-inl.h"
 #include "thread_list.h"
+#include "thread_pool.h"
 
 namespace art {
 namespace gc {
@@ -66,7 +67,8 @@ class ModUnionTableTest : public CommonRuntimeTest {
   void ResetClass() {
     java_lang_object_array_ = nullptr;
   }
-  void RunTest(ModUnionTableFactory::TableType type);
+  // With a thread count above 1, the table is processed and updated in parallel.
+  void RunTest(ModUnionTableFactory::TableType type, size_t thread_count);
 
  private:
   mirror::Class* GetObjectArrayClass(Thread* self, space::ContinuousMemMapAllocSpace* space)
@@ -94,10 +96,11 @@ class ModUnionTableTest : public CommonRuntimeTest {
   mirror::Class* java_lang_object_array_;
 };
 
-// Collect visited objects into container.
+// Collect visited objects into container. Thread-safe for the parallel updates.
 class CollectVisitedVisitor : public MarkObjectVisitor {
  public:
-  explicit CollectVisitedVisitor(std::set<mirror::Object*>* out) : out_(out) {}
+  explicit CollectVisitedVisitor(std::set<mirror::Object*>* out)
+      : out_(out), lock_("collect visited lock") {}
   void MarkHeapReference(mirror::HeapReference<mirror::Object>* ref,
                          bool do_atomic_update ATTRIBUTE_UNUSED) override
       REQUIRES_SHARED(Locks::mutator_lock_) {
@@ -107,12 +110,14 @@ class CollectVisitedVisitor : public MarkObjectVisitor {
   mirror::Object* MarkObject(mirror::Object* obj) override
       REQUIRES_SHARED(Locks::mutator_lock_) {
     DCHECK(obj != nullptr);
+    MutexLock mu(Thread::Current(), lock_);
     out_->insert(obj);
     return obj;
   }
 
  private:
   std::set<mirror::Object*>* const out_;
+  Mutex lock_;
 };
 
 // A mod union table that only holds references to a specified target space.
@@ -168,15 +173,27 @@ ModUnionTable* ModUnionTableFactory::Create(
 }
 
 TEST_F(ModUnionTableTest, TestCardCache) {
-  RunTest(ModUnionTableFactory::kTableTypeCardCache);
+  RunTest(ModUnionTableFactory::kTableTypeCardCache, /*thread_count=*/ 1u);
 }
 
 TEST_F(ModUnionTableTest, TestReferenceCache) {
-  RunTest(ModUnionTableFactory::kTableTypeReferenceCache);
+  RunTest(ModUnionTableFactory::kTableTypeReferenceCache, /*thread_count=*/ 1u);
 }
 
-void ModUnionTableTest::RunTest(ModUnionTableFactory::TableType type) {
+TEST_F(ModUnionTableTest, TestCardCacheParallel) {
+  RunTest(ModUnionTableFactory::kTableTypeCardCache, /*thread_count=*/ 4u);
+}
+
+TEST_F(ModUnionTableTest, TestReferenceCacheParallel) {
+  RunTest(ModUnionTableFactory::kTableTypeReferenceCache, /*thread_count=*/ 4u);
+}
+
+void ModUnionTableTest::RunTest(ModUnionTableFactory::TableType type, size_t thread_count) {
   Thread* const self = Thread::Current();
+  std::unique_ptr<ThreadPool> thread_pool;
+  if (thread_count > 1u) {
+    thread_pool.reset(new ThreadPool("Mod union table test thread pool", thread_count - 1u));
+  }
   ScopedObjectAccess soa(self);
   Runtime* const runtime = Runtime::Current();
   gc::Heap* const heap = runtime->GetHeap();
@@ -216,10 +233,10 @@ void ModUnionTableTest::RunTest(ModUnionTableFactory::TableType type) {
   ASSERT_TRUE(other_space_ref2 != nullptr);
   obj1->Set(1, other_space_ref1);
   obj2->Set(3, other_space_ref2);
-  table->ProcessCards();
+  table->ProcessCardsParallel(thread_pool.get(), thread_count);
   std::set<mirror::Object*> visited_before;
   CollectVisitedVisitor collector_before(&visited_before);
-  table->UpdateAndMarkReferences(&collector_before);
+  table->UpdateAndMarkReferencesParallel(&collector_before, thread_pool.get(), thread_count);
   // Check that we visited all the references in other spaces only.
   ASSERT_GE(visited_before.size(), 2u);
   ASSERT_TRUE(visited_before.find(other_space_ref1) != visited_before.end());
@@ -251,7 +268,7 @@ void ModUnionTableTest::RunTest(ModUnionTableFactory::TableType type) {
   // Visit again and make sure the cards got cleared back to their sane state.
   std::set<mirror::Object*> visited_after;
   CollectVisitedVisitor collector_after(&visited_after);
-  table->UpdateAndMarkReferences(&collector_after);
+  table->UpdateAndMarkReferencesParallel(&collector_after, thread_pool.get(), thread_count);
   // Check that we visited a superset after.
   for (auto* obj : visited_before) {
     ASSERT_TRUE(visited_after.find(obj) != visited_after.end()) << obj;
@@ -259,6 +276,10 @@ void ModUnionTableTest::RunTest(ModUnionTableFactory::TableType type) {
   // Verify that the dump still works.
   std::ostringstream oss2;
   table->Dump(oss2);
+  std::ostringstream stats;
+  table->DumpStats(stats);
+  EXPECT_NE(stats.str().find("1 card processings"), std::string::npos) << stats.str();
+  EXPECT_NE(stats.str().find("2 updates"), std::string::npos) << stats.str();
   // Remove the space we added so it doesn't persist to the next test.
   ScopedThreadSuspension sts(self, kSuspended);
   ScopedSuspendAll ssa("Add image space");
@@ -19,8 +19,15 @@
 
 #include "space_bitmap.h"
 
+#include <algorithm>
 #include <memory>
 
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include <android-base/logging.h>
 
 #include "base/atomic.h"
@@ -30,6 +37,78 @@ namespace art {
 namespace gc {
 namespace accounting {
 
+// Number of bitmap words checked at once when skipping runs of words without bits to visit.
+static constexpr size_t kBitmapWordsPerBlock = 4;
+
+// Returns true if no bit is set in `live` and clear in `mark` (or, if `mark` is null, no bit is
+// set in `live`) for the kBitmapWordsPerBlock words starting at `live` and `mark`. The words are
+// read with vector loads where available, callers re-read the words they visit atomically.
+ALWAYS_INLINE static inline bool IsBitmapBlockClear(const Atomic<uintptr_t>* live,
+                                                    const Atomic<uintptr_t>* mark) {
+  static_assert(sizeof(Atomic<uintptr_t>) == sizeof(uintptr_t), "Unexpected Atomic size");
+#if defined(__x86_64__)
+  static_assert(kBitmapWordsPerBlock * sizeof(uintptr_t) == 2 * sizeof(__m128i));
+  const __m128i* live_vectors = reinterpret_cast<const __m128i*>(live);
+  __m128i v0 = _mm_loadu_si128(live_vectors);
+  __m128i v1 = _mm_loadu_si128(live_vectors + 1);
+  if (mark != nullptr) {
+    const __m128i* mark_vectors = reinterpret_cast<const __m128i*>(mark);
+    v0 = _mm_andnot_si128(_mm_loadu_si128(mark_vectors), v0);
+    v1 = _mm_andnot_si128(_mm_loadu_si128(mark_vectors + 1), v1);
+  }
+  const __m128i zero = _mm_cmpeq_epi8(_mm_or_si128(v0, v1), _mm_setzero_si128());
+  return _mm_movemask_epi8(zero) == 0xffff;
+#elif defined(__aarch64__)
+  static_assert(kBitmapWordsPerBlock * sizeof(uintptr_t) == 2 * sizeof(uint64x2_t));
+  const uint64_t* live_words = reinterpret_cast<const uint64_t*>(live);
+  uint64x2_t v0 = vld1q_u64(live_words);
+  uint64x2_t v1 = vld1q_u64(live_words + 2);
+  if (mark != nullptr) {
+    const uint64_t* mark_words = reinterpret_cast<const uint64_t*>(mark);
+    v0 = vbicq_u64(v0, vld1q_u64(mark_words));
+    v1 = vbicq_u64(v1, vld1q_u64(mark_words + 2));
+  }
+  return vmaxvq_u32(vreinterpretq_u32_u64(vorrq_u64(v0, v1))) == 0u;
+#else
+  uintptr_t bits = 0;
+  for (size_t i = 0; i < kBitmapWordsPerBlock; ++i) {
+    uintptr_t w = live[i].load(std::memory_order_relaxed);
+    if (mark != nullptr) {
+      w &= ~mark[i].load(std::memory_order_relaxed);
+    }
+    bits |= w;
+  }
+  return bits == 0;
+#endif
+}
+
+// Returns the index of the first word in [begin, end) with a bit set in `live` and clear in
+// `mark` (or, if `mark` is null, with a bit set in `live`), or `end` if there is none. Runs of
+// words without such bits are skipped a block at a time.
+static inline size_t FindBitmapWord(const Atomic<uintptr_t>* live,
+                                    const Atomic<uintptr_t>* mark,
+                                    size_t begin,
+                                    size_t end) {
+  size_t i = begin;
+  while (i < end) {
+    if (i + kBitmapWordsPerBlock <= end &&
+        IsBitmapBlockClear(live + i, mark != nullptr ? mark + i : nullptr)) {
+      i += kBitmapWordsPerBlock;
+      continue;
+    }
+    for (const size_t block_end = std::min(i + kBitmapWordsPerBlock, end); i < block_end; ++i) {
+      uintptr_t w = live[i].load(std::memory_order_relaxed);
+      if (mark != nullptr) {
+        w &= ~mark[i].load(std::memory_order_relaxed);
+      }
+      if (w != 0) {
+        return i;
+      }
+    }
+  }
+  return end;
+}
+
 template<size_t kAlignment>
 inline bool SpaceBitmap<kAlignment>::AtomicTestAndSet(const mirror::Object* obj) {
   uintptr_t addr = reinterpret_cast<uintptr_t>(obj);
@@ -118,8 +197,11 @@ inline void SpaceBitmap<kAlignment>::VisitMarkedRange(uintptr_t visit_begin,
       } while (left_edge != 0);
     }
 
-    // Traverse the middle, full part.
-    for (size_t i = index_start + 1; i < index_end; ++i) {
+    // Traverse the middle, full part, skipping runs of zero words.
+    for (size_t i = FindBitmapWord(bitmap_begin_, nullptr, index_start + 1, index_end);
+         i < index_end;
+         i = FindBitmapWord(bitmap_begin_, nullptr, i + 1, index_end)) {
+      // Reload the word, it may have changed since it was found.
       uintptr_t w = bitmap_begin_[i].load(std::memory_order_relaxed);
       if (w != 0) {
         const uintptr_t ptr_base = IndexToOffset(i) + heap_begin_;
@@ -168,7 +250,9 @@ void SpaceBitmap<kAlignment>::Walk(Visitor&& visitor) {
 
   uintptr_t end = OffsetToIndex(HeapLimit() - heap_begin_ - 1);
   Atomic<uintptr_t>* bitmap_begin = bitmap_begin_;
-  for (uintptr_t i = 0; i <= end; ++i) {
+  for (uintptr_t i = FindBitmapWord(bitmap_begin, nullptr, 0, end + 1);
+       i <= end;
+       i = FindBitmapWord(bitmap_begin, nullptr, i + 1, end + 1)) {
     uintptr_t w = bitmap_begin[i].load(std::memory_order_relaxed);
     if (w != 0) {
       uintptr_t ptr_base = IndexToOffset(i) + heap_begin_;
@@ -191,10 +191,14 @@ void SpaceBitmap<kAlignment>::SweepWalk(const SpaceBitmap<kAlignment>& live_bitm
   mirror::Object** cur_pointer = &pointer_buf[0];
   mirror::Object** pointer_end = cur_pointer + (buffer_size - kBitsPerIntPtrT);
 
-  for (size_t i = start; i <= end; i++) {
+  // Skip runs of words without garbage in bulk, which is most of the bitmap for spaces with few
+  // dead objects.
+  for (size_t i = FindBitmapWord(live, mark, start, end + 1);
+       i <= end;
+       i = FindBitmapWord(live, mark, i + 1, end + 1)) {
     uintptr_t garbage =
         live[i].load(std::memory_order_relaxed) & ~mark[i].load(std::memory_order_relaxed);
-    if (UNLIKELY(garbage != 0)) {
+    if (garbage != 0) {
       uintptr_t ptr_base = IndexToOffset(i) + live_bitmap.heap_begin_;
       do {
         const size_t shift = CTZ(garbage);
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 #include <memory>
+#include <vector>
 
 #include "base/mutex.h"
 #include "common_runtime_test.h"
@@ -257,6 +258,66 @@ TEST_F(SpaceBitmapTest, OrderPageAlignment) {
   RunTestOrder<kPageSize>();
 }
 
+template <size_t kAlignment>
+static void RunTestSweepWalk() {
+  uint8_t* heap_begin = reinterpret_cast<uint8_t*>(0x10000000);
+  size_t heap_capacity = 16 * MB;
+
+  // Seed with 0x1234 for reproducability.
+  RandGen r(0x1234);
+
+  std::unique_ptr<ContinuousSpaceBitmap> live_bitmap(
+      ContinuousSpaceBitmap::Create("live bitmap", heap_begin, heap_capacity));
+  std::unique_ptr<ContinuousSpaceBitmap> mark_bitmap(
+      ContinuousSpaceBitmap::Create("mark bitmap", heap_begin, heap_capacity));
+  // Sparse live objects, most of them marked, so that there are long runs of words to skip.
+  for (int j = 0; j < 10000; ++j) {
+    mirror::Object* obj = reinterpret_cast<mirror::Object*>(
+        heap_begin + RoundDown(r.next() % heap_capacity, kAlignment));
+    live_bitmap->Set(obj);
+    if (r.next() % 8 != 0) {
+      mark_bitmap->Set(obj);
+    }
+  }
+
+  for (int j = 0; j < 50; ++j) {
+    const size_t offset = RoundDown(r.next() % heap_capacity, kAlignment);
+    const size_t remain = heap_capacity - offset;
+    const size_t end = offset + RoundDown(r.next() % (remain + 1), kAlignment);
+    const uintptr_t range_begin = reinterpret_cast<uintptr_t>(heap_begin) + offset;
+    const uintptr_t range_end = reinterpret_cast<uintptr_t>(heap_begin) + end;
+
+    // SweepWalk works on whole bitmap words, the expected garbage covers the words of the range.
+    const uintptr_t word_size = kObjectAlignment * kBitsPerIntPtrT;
+    std::vector<mirror::Object*> expected;
+    for (uintptr_t k = RoundDown(range_begin, word_size);
+         range_begin < range_end && k < RoundUp(range_end, word_size);
+         k += kObjectAlignment) {
+      mirror::Object* obj = reinterpret_cast<mirror::Object*>(k);
+      if (live_bitmap->Test(obj) && !mark_bitmap->Test(obj)) {
+        expected.push_back(obj);
+      }
+    }
+
+    std::vector<mirror::Object*> swept;
+    auto callback = [](size_t ptr_count, mirror::Object** ptrs, void* arg) {
+      auto* out = reinterpret_cast<std::vector<mirror::Object*>*>(arg);
+      out->insert(out->end(), ptrs, ptrs + ptr_count);
+    };
+    ContinuousSpaceBitmap::SweepWalk(
+        *live_bitmap, *mark_bitmap, range_begin, range_end, callback, &swept);
+    EXPECT_EQ(expected, swept);
+  }
+}
+
+TEST_F(SpaceBitmapTest, SweepWalkObjectAlignment) {
+  RunTestSweepWalk<kObjectAlignment>();
+}
+
+TEST_F(SpaceBitmapTest, SweepWalkPageAlignment) {
+  RunTestSweepWalk<kPageSize>();
+}
+
 }  // namespace accounting
 }  // namespace gc
 }  // namespace art
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_sampler.h"
+
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+#include "android-base/stringprintf.h"
+
+#include "art_method-inl.h"
+#include "base/enums.h"
+#include "base/logging.h"  // For VLOG
+#include "base/time_utils.h"
+#include "base/utils.h"
+#include "dex/dex_file_types.h"
+#include "handle_scope-inl.h"
+#include "obj_ptr-inl.h"
+#include "object_callbacks.h"
+#include "stack.h"
+#include "thread-current-inl.h"
+
+namespace art {
+namespace gc {
+
+using android::base::StringPrintf;
+
+AllocationSampler::AllocationSampler()
+    : SystemWeakHolder(kAllocTrackerLock),
+      sampling_(false),
+      sampling_interval_(kDefaultSamplingInterval),
+      random_(static_cast<std::minstd_rand::result_type>(NanoTime())) {}
+
+uint64_t AllocationSampler::NextSamplingDistance() {
+  // For a Poisson process with rate 1 / sampling_interval_, the distance between two samples is
+  // exponentially distributed with mean sampling_interval_. Map a uniform value in (0, 1] to it.
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  double q = 1.0 - uniform(random_);
+  double distance = -std::log(q) * static_cast<double>(sampling_interval_);
+  // Clamp to avoid overflow for values of q very close to 0, and return at least 1 since 0 marks
+  // threads that do not have a sampling distance yet.
+  constexpr double kMaxDistance = static_cast<double>(std::numeric_limits<uint32_t>::max());
+  return static_cast<uint64_t>(std::min(distance, kMaxDistance)) + 1u;
+}
+
+void AllocationSampler::ObjectAllocated(Thread* self,
+                                        ObjPtr<mirror::Object>* obj,
+                                        size_t byte_count) {
+  if (!IsSampling()) {
+    return;
+  }
+  // Fast path: count down the bytes until the next sample without taking any lock.
+  uint64_t bytes_until_sample = self->GetAllocSamplingBytesUntilSample();
+  if (LIKELY(bytes_until_sample > byte_count)) {
+    self->SetAllocSamplingBytesUntilSample(bytes_until_sample - byte_count);
+    return;
+  }
+  {
+    MutexLock mu(self, allow_disallow_lock_);
+    self->SetAllocSamplingBytesUntilSample(NextSamplingDistance());
+  }
+  if (bytes_until_sample == 0u) {
+    // First allocation of this thread since the sampler started, the distance to the first
+    // sample has just been drawn.
+    return;
+  }
+
+  // Get the stack trace outside of the lock in case there are allocations during the stack walk,
+  // see AllocRecordObjectMap::RecordAllocation. Frames are symbolized right away, this is only
+  // done for sampled allocations.
+  std::vector<std::string> frames;
+  {
+    StackHandleScope<1> hs(self);
+    auto obj_wrapper = hs.NewHandleWrapper(obj);
+    StackVisitor::WalkStack(
+        [&](const art::StackVisitor* stack_visitor) REQUIRES_SHARED(Locks::mutator_lock_) {
+          if (frames.size() >= kMaxStackDepth) {
+            return false;
+          }
+          ArtMethod* m = stack_visitor->GetMethod();
+          // m may be null if we have inlined methods of unresolved classes. b/27858645
+          if (m != nullptr && !m->IsRuntimeMethod()) {
+            m = m->GetInterfaceMethodIfProxy(kRuntimePointerSize);
+            uint32_t dex_pc = stack_visitor->GetDexPc(/* abort_on_failure= */ false);
+            const char* source_file = m->GetDeclaringClassSourceFile();
+            if (m->IsNative() || dex_pc == dex::kDexNoIndex) {
+              frames.push_back(m->PrettyMethod(/* with_signature= */ false) + " (Native Method)");
+            } else {
+              frames.push_back(StringPrintf("%s (%s:%d)",
+                                            m->PrettyMethod(/* with_signature= */ false).c_str(),
+                                            source_file != nullptr ? source_file : "Unknown Source",
+                                            m->GetLineNumFromDexPC(dex_pc)));
+            }
+          }
+          return true;
+        },
+        self,
+        /* context= */ nullptr,
+        art::StackVisitor::StackWalkKind::kIncludeInlinedFrames);
+  }
+
+  MutexLock mu(self, allow_disallow_lock_);
+  // Wait for the GC's sweeping to complete before adding a new weak.
+  Wait(self);
+  if (!IsSampling()) {
+    // The sampler has been stopped while we were walking the stack or waiting.
+    return;
+  }
+  std::vector<uint32_t> frame_ids;
+  frame_ids.reserve(frames.size());
+  for (const std::string& frame : frames) {
+    frame_ids.push_back(InternFrame(frame));
+  }
+  auto it = site_ids_.find(frame_ids);
+  uint32_t site;
+  if (it != site_ids_.end()) {
+    site = it->second;
+  } else {
+    site = static_cast<uint32_t>(sites_.size());
+    sites_.emplace_back();
+    sites_.back().frames = frame_ids;
+    site_ids_.emplace(std::move(frame_ids), site);
+  }
+  ++sites_[site].allocated_samples;
+  sites_[site].allocated_bytes += byte_count;
+  live_samples_.push_back(Sample { GcRoot<mirror::Object>(obj->Ptr()), site, byte_count });
+}
+
+uint32_t AllocationSampler::InternFrame(const std::string& frame) {
+  auto it = frame_ids_.find(frame);
+  if (it != frame_ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = static_cast<uint32_t>(frames_.size());
+  frames_.push_back(frame);
+  frame_ids_.emplace(frame, id);
+  return id;
+}
+
+void AllocationSampler::Sweep(IsMarkedVisitor* visitor) {
+  MutexLock mu(Thread::Current(), allow_disallow_lock_);
+  size_t count_freed = 0u;
+  auto out = live_samples_.begin();
+  for (Sample& sample : live_samples_) {
+    // This does not need a read barrier because this is called by GC.
+    mirror::Object* old_object = sample.object.Read<kWithoutReadBarrier>();
+    mirror::Object* new_object = visitor->IsMarked(old_object);
+    if (new_object == nullptr) {
+      AllocationSite& site = sites_[sample.site];
+      ++site.freed_samples;
+      site.freed_bytes += sample.byte_count;
+      ++count_freed;
+    } else {
+      sample.object = GcRoot<mirror::Object>(new_object);
+      *out = sample;
+      ++out;
+    }
+  }
+  live_samples_.erase(out, live_samples_.end());
+  VLOG(heap) << "Allocation sampler freed " << count_freed << " samples, "
+             << live_samples_.size() << " live";
+}
+
+void AllocationSampler::Start(size_t sampling_interval) {
+  DCHECK_NE(sampling_interval, 0u);
+  MutexLock mu(Thread::Current(), allow_disallow_lock_);
+  Clear();
+  sampling_interval_ = sampling_interval;
+  sampling_.store(true, std::memory_order_relaxed);
+}
+
+void AllocationSampler::Stop() {
+  MutexLock mu(Thread::Current(), allow_disallow_lock_);
+  sampling_.store(false, std::memory_order_relaxed);
+}
+
+void AllocationSampler::Clear() {
+  frame_ids_.clear();
+  frames_.clear();
+  site_ids_.clear();
+  sites_.clear();
+  live_samples_.clear();
+}
+
+void AllocationSampler::DumpProfile(std::ostream& os) {
+  MutexLock mu(Thread::Current(), allow_disallow_lock_);
+  os << "--- heapz 1 ---\n"
+     << "format = java\n"
+     << "resolution = bytes\n"
+     << "sampling period = " << sampling_interval_ << "\n";
+  for (const AllocationSite& site : sites_) {
+    uint64_t live_samples = site.allocated_samples - site.freed_samples;
+    if (live_samples == 0u) {
+      continue;
+    }
+    os << live_samples << " " << (site.allocated_bytes - site.freed_bytes) << " @";
+    for (uint32_t frame : site.frames) {
+      // Frame ids are offset by one so that no location has address 0.
+      os << StringPrintf(" 0x%x", frame + 1u);
+    }
+    os << "\n";
+  }
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    os << StringPrintf("0x%zx ", i + 1u) << frames_[i] << "\n";
+  }
+}
+
+void AllocationSampler::DumpStats(std::ostream& os) {
+  MutexLock mu(Thread::Current(), allow_disallow_lock_);
+  uint64_t allocated_samples = 0u;
+  uint64_t allocated_bytes = 0u;
+  uint64_t freed_samples = 0u;
+  uint64_t freed_bytes = 0u;
+  for (const AllocationSite& site : sites_) {
+    allocated_samples += site.allocated_samples;
+    allocated_bytes += site.allocated_bytes;
+    freed_samples += site.freed_samples;
+    freed_bytes += site.freed_bytes;
+  }
+  os << "Allocation sampling " << (IsSampling() ? "enabled" : "disabled")
+     << ", mean interval " << PrettySize(sampling_interval_) << "\n"
+     << "Sampled allocations: " << allocated_samples << " (" << PrettySize(allocated_bytes)
+     << "), freed: " << freed_samples << " (" << PrettySize(freed_bytes)
+     << "), allocation sites: " << sites_.size() << "\n";
+}
+
+}  // namespace gc
+}  // namespace art
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_ALLOCATION_SAMPLER_H_
+#define ART_RUNTIME_GC_ALLOCATION_SAMPLER_H_
+
+#include <iosfwd>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "allocation_listener.h"
+#include "base/atomic.h"
+#include "base/globals.h"
+#include "base/mutex.h"
+#include "gc_root.h"
+#include "system_weak.h"
+
+namespace art {
+
+class IsMarkedVisitor;
+class Thread;
+
+namespace mirror {
+class Object;
+}  // namespace mirror
+
+namespace gc {
+
+// Low overhead heap profiler. Unlike AllocRecordObjectMap, which records every allocation, the
+// sampler picks allocations with a Poisson process over allocated bytes (as tcmalloc does): every
+// byte has the same probability 1 / sampling_interval of being sampled, so the expected number of
+// sampled allocations only depends on the number of allocated bytes. Stack traces are only
+// collected for sampled allocations.
+//
+// Sampled objects are held as system weaks. When the GC finds a sampled object dead, its sample is
+// moved from the live to the freed accounting of its allocation site, so the profile keeps track
+// of both the allocated and the still live memory across GCs.
+class AllocationSampler final : public AllocationListener, public SystemWeakHolder {
+ public:
+  static constexpr size_t kDefaultSamplingInterval = 512 * KB;
+  static constexpr size_t kMaxStackDepth = 64;
+
+  AllocationSampler();
+
+  void ObjectAllocated(Thread* self, ObjPtr<mirror::Object>* obj, size_t byte_count) override
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!allow_disallow_lock_);
+
+  void Sweep(IsMarkedVisitor* visitor) override
+      REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!allow_disallow_lock_);
+
+  // Start a new profile with the given mean sampling interval in bytes. Samples from a previous
+  // profile are discarded.
+  void Start(size_t sampling_interval) REQUIRES(!allow_disallow_lock_);
+
+  // Stop taking new samples. Samples taken so far are kept (and their objects are still tracked
+  // by the GC) so that the profile can be dumped after stopping.
+  void Stop() REQUIRES(!allow_disallow_lock_);
+
+  bool IsSampling() const {
+    return sampling_.load(std::memory_order_relaxed);
+  }
+
+  // Write the samples of live objects as a Java heap profile that pprof can read:
+  //
+  //   --- heapz 1 ---
+  //   format = java
+  //   resolution = bytes
+  //   sampling period = <sampling interval>
+  //   <live samples> <live sampled bytes> @ <frame id> <frame id> ...
+  //   ...
+  //   <frame id> <method> (<source file>:<line>)
+  //   ...
+  //
+  // Counts are not scaled, pprof unsamples them using the sampling period.
+  void DumpProfile(std::ostream& os) REQUIRES(!allow_disallow_lock_);
+
+  // Summary of the allocated and freed sampled memory, used by the SIGQUIT dump.
+  void DumpStats(std::ostream& os) REQUIRES(!allow_disallow_lock_);
+
+ private:
+  // Per allocation site accounting. Live samples are allocated minus freed ones.
+  struct AllocationSite {
+    std::vector<uint32_t> frames;
+    uint64_t allocated_samples = 0u;
+    uint64_t allocated_bytes = 0u;
+    uint64_t freed_samples = 0u;
+    uint64_t freed_bytes = 0u;
+  };
+
+  struct Sample {
+    // Weak root, needs a read barrier.
+    GcRoot<mirror::Object> object;
+    uint32_t site;
+    size_t byte_count;
+  };
+
+  // Draw the number of bytes until the next sample from an exponential distribution.
+  uint64_t NextSamplingDistance() REQUIRES(allow_disallow_lock_);
+
+  uint32_t InternFrame(const std::string& frame) REQUIRES(allow_disallow_lock_);
+
+  void Clear() REQUIRES(allow_disallow_lock_);
+
+  Atomic<bool> sampling_;
+  size_t sampling_interval_ GUARDED_BY(allow_disallow_lock_);
+  std::minstd_rand random_ GUARDED_BY(allow_disallow_lock_);
+
+  // Frames are identified by their symbolized form rather than by ArtMethod* so that the profile
+  // stays valid if the method's class gets unloaded.
+  std::unordered_map<std::string, uint32_t> frame_ids_ GUARDED_BY(allow_disallow_lock_);
+  std::vector<std::string> frames_ GUARDED_BY(allow_disallow_lock_);
+  std::map<std::vector<uint32_t>, uint32_t> site_ids_ GUARDED_BY(allow_disallow_lock_);
+  std::vector<AllocationSite> sites_ GUARDED_BY(allow_disallow_lock_);
+  std::vector<Sample> live_samples_ GUARDED_BY(allow_disallow_lock_);
+
+  friend class AllocationSamplerTest;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocationSampler);
+};
+
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_ALLOCATION_SAMPLER_H_
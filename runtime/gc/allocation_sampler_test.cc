@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocation_sampler.h"
+
+#include <sstream>
+#include <string>
+
+#include "class_root.h"
+#include "common_runtime_test.h"
+#include "gc/heap.h"
+#include "handle_scope-inl.h"
+#include "mirror/array-alloc-inl.h"
+#include "mirror/array-inl.h"
+#include "mirror/class-inl.h"
+#include "scoped_thread_state_change-inl.h"
+
+namespace art {
+namespace gc {
+
+class AllocationSamplerTest : public CommonRuntimeTest {
+ protected:
+  static constexpr size_t kSamplingInterval = 4 * KB;
+
+  static uint64_t GetSampleCount(AllocationSampler* sampler) {
+    MutexLock mu(Thread::Current(), sampler->allow_disallow_lock_);
+    uint64_t samples = 0u;
+    for (const AllocationSampler::AllocationSite& site : sampler->sites_) {
+      samples += site.allocated_samples;
+    }
+    return samples;
+  }
+};
+
+// Test that the number of samples matches the allocated bytes over the sampling interval.
+TEST_F(AllocationSamplerTest, SamplingInterval) {
+  static constexpr size_t kAllocationSize = 64;
+  static constexpr size_t kAllocations = 64 * KB;
+  // 1024 samples on average, with a standard deviation of 32 for a Poisson process.
+  static constexpr uint64_t kExpectedSamples = kAllocations * kAllocationSize / kSamplingInterval;
+  Thread* self = Thread::Current();
+  AllocationSampler sampler;
+  sampler.Start(kSamplingInterval);
+  {
+    ScopedObjectAccess soa(self);
+    for (size_t i = 0; i < kAllocations; ++i) {
+      ObjPtr<mirror::Object> obj = GetClassRoot<mirror::Object>();
+      sampler.ObjectAllocated(self, &obj, kAllocationSize);
+    }
+  }
+  sampler.Stop();
+  const uint64_t samples = GetSampleCount(&sampler);
+  EXPECT_GT(samples, kExpectedSamples * 3 / 4);
+  EXPECT_LT(samples, kExpectedSamples * 5 / 4);
+
+  // Samples are kept after stopping, and no new ones are taken.
+  {
+    ScopedObjectAccess soa(self);
+    for (size_t i = 0; i < kAllocations; ++i) {
+      ObjPtr<mirror::Object> obj = GetClassRoot<mirror::Object>();
+      sampler.ObjectAllocated(self, &obj, kAllocationSize);
+    }
+  }
+  EXPECT_EQ(samples, GetSampleCount(&sampler));
+}
+
+// Test that the heap samples allocations while enabled and dumps the profile.
+TEST_F(AllocationSamplerTest, HeapSampling) {
+  Thread* self = Thread::Current();
+  Heap* heap = Runtime::Current()->GetHeap();
+  heap->SetAllocationSamplingInterval(kSamplingInterval);
+  EXPECT_TRUE(heap->IsAllocationSamplingEnabled());
+  {
+    ScopedObjectAccess soa(self);
+    StackHandleScope<1> hs(self);
+    MutableHandle<mirror::ByteArray> array(hs.NewHandle<mirror::ByteArray>(nullptr));
+    for (size_t i = 0; i < 1024; ++i) {
+      array.Assign(mirror::ByteArray::Alloc(self, 1 * KB));
+      ASSERT_TRUE(array != nullptr);
+    }
+  }
+  heap->SetAllocationSamplingInterval(0u);
+  EXPECT_FALSE(heap->IsAllocationSamplingEnabled());
+
+  std::ostringstream oss;
+  heap->DumpAllocationSamples(oss);
+  const std::string profile = oss.str();
+  EXPECT_EQ(0u, profile.find("--- heapz 1 ---\n")) << profile;
+  EXPECT_NE(std::string::npos, profile.find("sampling period = 4096\n")) << profile;
+  // At least one allocation site with its frames.
+  EXPECT_NE(std::string::npos, profile.find(" @")) << profile;
+}
+
+}  // namespace gc
+}  // namespace art
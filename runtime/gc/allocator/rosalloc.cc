@@ -16,6 +16,7 @@
 
 #include "rosalloc-inl.h"
 
+#include <algorithm>
 #include <list>
 #include <map>
 #include <sstream>
@@ -1022,6 +1023,9 @@ size_t RosAlloc::BulkFree(Thread* self, void** ptrs, size_t num_ptrs) {
 #else
   std::unordered_set<Run*, hash_run, eq_run> runs;
 #endif
+  // Large objects are freed together with the pages of the runs that
+  // become completely free, under a single acquisition of lock_.
+  std::vector<void*> large_objects;
   for (size_t i = 0; i < num_ptrs; i++) {
     void* ptr = ptrs[i];
     DCHECK_LE(base_, ptr);
@@ -1047,8 +1051,7 @@ size_t RosAlloc::BulkFree(Thread* self, void** ptrs, size_t num_ptrs) {
         } while (page_map_[pi] != kPageMapRun);
         run = reinterpret_cast<Run*>(base_ + pi * kPageSize);
       } else if (page_map_entry == kPageMapLargeObject) {
-        MutexLock mu(self, lock_);
-        freed_bytes += FreePages(self, ptr, false);
+        large_objects.push_back(ptr);
         continue;
       } else {
         LOG(FATAL) << "Unreachable - page map type: " << static_cast<int>(page_map_entry);
@@ -1097,111 +1100,138 @@ size_t RosAlloc::BulkFree(Thread* self, void** ptrs, size_t num_ptrs) {
   // Now, iterate over the affected runs and update the alloc bit map
   // based on the bulk free bit map (for non-thread-local runs) and
   // union the bulk free bit map into the thread-local free bit map
-  // (for thread-local runs.)
-  for (Run* run : runs) {
+  // (for thread-local runs.) The runs are grouped by size bracket so
+  // that each bracket lock is acquired once per bracket rather than
+  // once per run, and the pages of the runs that become completely
+  // free are released with a single acquisition of lock_ afterwards.
 #ifdef ART_TARGET_ANDROID
-    DCHECK(run->to_be_bulk_freed_);
-    run->to_be_bulk_freed_ = false;
+  std::vector<Run*>& sorted_runs = runs;
+#else
+  std::vector<Run*> sorted_runs(runs.begin(), runs.end());
 #endif
-    size_t idx = run->size_bracket_idx_;
+  std::sort(sorted_runs.begin(), sorted_runs.end(), [](const Run* a, const Run* b) {
+    return a->size_bracket_idx_ != b->size_bracket_idx_
+        ? a->size_bracket_idx_ < b->size_bracket_idx_
+        : a < b;
+  });
+  std::vector<Run*> free_runs;
+  for (auto it = sorted_runs.begin(); it != sorted_runs.end(); ) {
+    size_t idx = (*it)->size_bracket_idx_;
     MutexLock brackets_mu(self, *size_bracket_locks_[idx]);
-    if (run->IsThreadLocal()) {
-      DCHECK_LT(run->size_bracket_idx_, kNumThreadLocalSizeBrackets);
-      DCHECK(non_full_runs_[idx].find(run) == non_full_runs_[idx].end());
-      DCHECK(full_runs_[idx].find(run) == full_runs_[idx].end());
-      run->MergeBulkFreeListToThreadLocalFreeList();
-      if (kTraceRosAlloc) {
-        LOG(INFO) << "RosAlloc::BulkFree() : Freed slot(s) in a thread local run 0x"
-                  << std::hex << reinterpret_cast<intptr_t>(run);
-      }
-      DCHECK(run->IsThreadLocal());
-      // A thread local run will be kept as a thread local even if
-      // it's become all free.
-    } else {
-      bool run_was_full = run->IsFull();
-      run->MergeBulkFreeListToFreeList();
-      if (kTraceRosAlloc) {
-        LOG(INFO) << "RosAlloc::BulkFree() : Freed slot(s) in a run 0x" << std::hex
-                  << reinterpret_cast<intptr_t>(run);
-      }
-      // Check if the run should be moved to non_full_runs_ or
-      // free_page_runs_.
-      auto* non_full_runs = &non_full_runs_[idx];
-      auto* full_runs = kIsDebugBuild ? &full_runs_[idx] : nullptr;
-      if (run->IsAllFree()) {
-        // It has just become completely free. Free the pages of the
-        // run.
-        bool run_was_current = run == current_runs_[idx];
-        if (run_was_current) {
-          DCHECK(full_runs->find(run) == full_runs->end());
-          DCHECK(non_full_runs->find(run) == non_full_runs->end());
-          // If it was a current run, reuse it.
-        } else if (run_was_full) {
-          // If it was full, remove it from the full run set (debug
-          // only.)
-          if (kIsDebugBuild) {
-            std::unordered_set<Run*, hash_run, eq_run>::iterator pos = full_runs->find(run);
-            DCHECK(pos != full_runs->end());
-            full_runs->erase(pos);
+    for (; it != sorted_runs.end() && (*it)->size_bracket_idx_ == idx; ++it) {
+      Run* run = *it;
+#ifdef ART_TARGET_ANDROID
+      DCHECK(run->to_be_bulk_freed_);
+      run->to_be_bulk_freed_ = false;
+#endif
+      if (run->IsThreadLocal()) {
+        DCHECK_LT(run->size_bracket_idx_, kNumThreadLocalSizeBrackets);
+        DCHECK(non_full_runs_[idx].find(run) == non_full_runs_[idx].end());
+        DCHECK(full_runs_[idx].find(run) == full_runs_[idx].end());
+        run->MergeBulkFreeListToThreadLocalFreeList();
+        if (kTraceRosAlloc) {
+          LOG(INFO) << "RosAlloc::BulkFree() : Freed slot(s) in a thread local run 0x"
+                    << std::hex << reinterpret_cast<intptr_t>(run);
+        }
+        DCHECK(run->IsThreadLocal());
+        // A thread local run will be kept as a thread local even if
+        // it's become all free.
+      } else {
+        bool run_was_full = run->IsFull();
+        run->MergeBulkFreeListToFreeList();
+        if (kTraceRosAlloc) {
+          LOG(INFO) << "RosAlloc::BulkFree() : Freed slot(s) in a run 0x" << std::hex
+                    << reinterpret_cast<intptr_t>(run);
+        }
+        // Check if the run should be moved to non_full_runs_ or
+        // free_page_runs_.
+        auto* non_full_runs = &non_full_runs_[idx];
+        auto* full_runs = kIsDebugBuild ? &full_runs_[idx] : nullptr;
+        if (run->IsAllFree()) {
+          // It has just become completely free. Free the pages of the
+          // run.
+          bool run_was_current = run == current_runs_[idx];
+          if (run_was_current) {
+            DCHECK(full_runs->find(run) == full_runs->end());
+            DCHECK(non_full_runs->find(run) == non_full_runs->end());
+            // If it was a current run, reuse it.
+          } else if (run_was_full) {
+            // If it was full, remove it from the full run set (debug
+            // only.)
+            if (kIsDebugBuild) {
+              std::unordered_set<Run*, hash_run, eq_run>::iterator pos = full_runs->find(run);
+              DCHECK(pos != full_runs->end());
+              full_runs->erase(pos);
+              if (kTraceRosAlloc) {
+                LOG(INFO) << "RosAlloc::BulkFree() : Erased run 0x" << std::hex
+                          << reinterpret_cast<intptr_t>(run)
+                          << " from full_runs_";
+              }
+              DCHECK(full_runs->find(run) == full_runs->end());
+            }
+          } else {
+            // If it was in a non full run set, remove it from the set.
+            DCHECK(full_runs->find(run) == full_runs->end());
+            DCHECK(non_full_runs->find(run) != non_full_runs->end());
+            non_full_runs->erase(run);
             if (kTraceRosAlloc) {
               LOG(INFO) << "RosAlloc::BulkFree() : Erased run 0x" << std::hex
                         << reinterpret_cast<intptr_t>(run)
-                        << " from full_runs_";
+                        << " from non_full_runs_";
             }
-            DCHECK(full_runs->find(run) == full_runs->end());
+            DCHECK(non_full_runs->find(run) == non_full_runs->end());
           }
-        } else {
-          // If it was in a non full run set, remove it from the set.
-          DCHECK(full_runs->find(run) == full_runs->end());
-          DCHECK(non_full_runs->find(run) != non_full_runs->end());
-          non_full_runs->erase(run);
-          if (kTraceRosAlloc) {
-            LOG(INFO) << "RosAlloc::BulkFree() : Erased run 0x" << std::hex
-                      << reinterpret_cast<intptr_t>(run)
-                      << " from non_full_runs_";
+          if (!run_was_current) {
+            // The run is no longer reachable from the bracket, so its
+            // pages can be freed after the bracket lock is released.
+            run->ZeroHeaderAndSlotHeaders();
+            free_runs.push_back(run);
           }
-          DCHECK(non_full_runs->find(run) == non_full_runs->end());
-        }
-        if (!run_was_current) {
-          run->ZeroHeaderAndSlotHeaders();
-          MutexLock lock_mu(self, lock_);
-          FreePages(self, run, true);
-        }
-      } else {
-        // It is not completely free. If it wasn't the current run or
-        // already in the non-full run set (i.e., it was full) insert
-        // it into the non-full run set.
-        if (run == current_runs_[idx]) {
-          DCHECK(non_full_runs->find(run) == non_full_runs->end());
-          DCHECK(full_runs->find(run) == full_runs->end());
-          // If it was a current run, keep it.
-        } else if (run_was_full) {
-          // If it was full, remove it from the full run set (debug
-          // only) and insert into the non-full run set.
-          DCHECK(full_runs->find(run) != full_runs->end());
-          DCHECK(non_full_runs->find(run) == non_full_runs->end());
-          if (kIsDebugBuild) {
-            full_runs->erase(run);
+        } else {
+          // It is not completely free. If it wasn't the current run or
+          // already in the non-full run set (i.e., it was full) insert
+          // it into the non-full run set.
+          if (run == current_runs_[idx]) {
+            DCHECK(non_full_runs->find(run) == non_full_runs->end());
+            DCHECK(full_runs->find(run) == full_runs->end());
+            // If it was a current run, keep it.
+          } else if (run_was_full) {
+            // If it was full, remove it from the full run set (debug
+            // only) and insert into the non-full run set.
+            DCHECK(full_runs->find(run) != full_runs->end());
+            DCHECK(non_full_runs->find(run) == non_full_runs->end());
+            if (kIsDebugBuild) {
+              full_runs->erase(run);
+              if (kTraceRosAlloc) {
+                LOG(INFO) << "RosAlloc::BulkFree() : Erased run 0x" << std::hex
+                          << reinterpret_cast<intptr_t>(run)
+                          << " from full_runs_";
+              }
+            }
+            non_full_runs->insert(run);
             if (kTraceRosAlloc) {
-              LOG(INFO) << "RosAlloc::BulkFree() : Erased run 0x" << std::hex
+              LOG(INFO) << "RosAlloc::BulkFree() : Inserted run 0x" << std::hex
                         << reinterpret_cast<intptr_t>(run)
-                        << " from full_runs_";
+                        << " into non_full_runs_[" << std::dec << idx;
             }
+          } else {
+            // If it was not full, so leave it in the non full run set.
+            DCHECK(full_runs->find(run) == full_runs->end());
+            DCHECK(non_full_runs->find(run) != non_full_runs->end());
           }
-          non_full_runs->insert(run);
-          if (kTraceRosAlloc) {
-            LOG(INFO) << "RosAlloc::BulkFree() : Inserted run 0x" << std::hex
-                      << reinterpret_cast<intptr_t>(run)
-                      << " into non_full_runs_[" << std::dec << idx;
-          }
-        } else {
-          // If it was not full, so leave it in the non full run set.
-          DCHECK(full_runs->find(run) == full_runs->end());
-          DCHECK(non_full_runs->find(run) != non_full_runs->end());
         }
       }
     }
   }
+  if (!free_runs.empty() || !large_objects.empty()) {
+    MutexLock mu(self, lock_);
+    for (Run* run : free_runs) {
+      FreePages(self, run, true);
+    }
+    for (void* ptr : large_objects) {
+      freed_bytes += FreePages(self, ptr, false);
+    }
+  }
   return freed_bytes;
 }
 
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rosalloc-inl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/histogram-inl.h"
+#include "base/mem_map.h"
+#include "base/time_utils.h"
+#include "common_runtime_test.h"
+#include "thread-current-inl.h"
+#include "thread_pool.h"
+
+namespace art {
+namespace gc {
+namespace allocator {
+
+class RosAllocTest : public CommonRuntimeTest {
+ protected:
+  static constexpr size_t kCapacity = 64 * MB;
+  // Same chunk size as the sweeping code uses for the allocation stack.
+  static constexpr size_t kBulkFreeChunkSize = 128;
+
+  void SetUp() override {
+    CommonRuntimeTest::SetUp();
+    std::string error_msg;
+    mem_map_ = MemMap::MapAnonymous("rosalloc test",
+                                    kCapacity,
+                                    PROT_READ | PROT_WRITE,
+                                    /*low_4gb=*/ false,
+                                    &error_msg);
+    ASSERT_TRUE(mem_map_.IsValid()) << error_msg;
+    rosalloc_.reset(new RosAlloc(mem_map_.Begin(),
+                                 kCapacity,
+                                 kCapacity,
+                                 RosAlloc::kPageReleaseModeSizeAndEnd,
+                                 /*running_on_memory_tool=*/ false));
+  }
+
+  void TearDown() override {
+    rosalloc_.reset();
+    mem_map_.Reset();
+    CommonRuntimeTest::TearDown();
+  }
+
+  // Sizes above the thread-local brackets so that the test does not touch the thread-local
+  // runs of the heap's own RosAlloc, plus a large object size.
+  static size_t RandomSize(std::minstd_rand* random) {
+    static constexpr size_t kSizes[] = { 144, 256, 512, 1 * KB, 2 * KB, 3 * kPageSize };
+    return kSizes[(*random)() % arraysize(kSizes)];
+  }
+
+  size_t AllocObjects(Thread* self, size_t count, uint32_t seed, std::vector<void*>* ptrs) {
+    std::minstd_rand random(seed);
+    size_t allocated = 0;
+    for (size_t i = 0; i < count; ++i) {
+      size_t bytes_allocated;
+      size_t usable_size;
+      size_t bytes_tl_bulk_allocated;
+      void* ptr = rosalloc_->Alloc<true>(self,
+                                         RandomSize(&random),
+                                         &bytes_allocated,
+                                         &usable_size,
+                                         &bytes_tl_bulk_allocated);
+      CHECK(ptr != nullptr);
+      ptrs->push_back(ptr);
+      allocated += bytes_allocated;
+    }
+    return allocated;
+  }
+
+  size_t BulkFreeObjects(Thread* self, std::vector<void*>* ptrs) {
+    size_t freed = 0;
+    for (size_t i = 0; i < ptrs->size(); i += kBulkFreeChunkSize) {
+      size_t count = std::min(kBulkFreeChunkSize, ptrs->size() - i);
+      freed += rosalloc_->BulkFree(self, ptrs->data() + i, count);
+    }
+    ptrs->clear();
+    return freed;
+  }
+
+  MemMap mem_map_;
+  std::unique_ptr<RosAlloc> rosalloc_;
+};
+
+TEST_F(RosAllocTest, BulkFree) {
+  Thread* self = Thread::Current();
+  std::vector<void*> ptrs;
+  size_t allocated = AllocObjects(self, 4096, /*seed=*/ 42, &ptrs);
+  // Free in random order so that chunks span many runs of different brackets.
+  std::shuffle(ptrs.begin(), ptrs.end(), std::minstd_rand(7));
+  EXPECT_EQ(BulkFreeObjects(self, &ptrs), allocated);
+  // All the runs became free, so the same objects can be allocated again.
+  allocated = AllocObjects(self, 4096, /*seed=*/ 42, &ptrs);
+  EXPECT_EQ(BulkFreeObjects(self, &ptrs), allocated);
+}
+
+TEST_F(RosAllocTest, Speed) {
+  static constexpr size_t kObjectsPerThread = 4096;
+  static constexpr size_t kIterations = 32;
+  Thread* self = Thread::Current();
+  for (size_t num_threads : { 1u, 2u, 4u }) {
+    ThreadPool thread_pool("RosAlloc test thread pool", num_threads);
+    std::unique_ptr<Histogram<uint64_t>> hist(new Histogram<uint64_t>(
+        (std::string("RosAllocAllocBulkFree-") + std::to_string(num_threads)).c_str(), 5));
+    for (size_t i = 0; i < kIterations; ++i) {
+      std::atomic<bool> mismatch(false);
+      for (size_t t = 0; t < num_threads; ++t) {
+        thread_pool.AddTask(self, new FunctionTask([this, t, &mismatch](Thread* worker) {
+          std::vector<void*> ptrs;
+          ptrs.reserve(kObjectsPerThread);
+          uint32_t seed = static_cast<uint32_t>(t + 1u);
+          size_t allocated = AllocObjects(worker, kObjectsPerThread, seed, &ptrs);
+          if (BulkFreeObjects(worker, &ptrs) != allocated) {
+            mismatch.store(true, std::memory_order_relaxed);
+          }
+        }));
+      }
+      uint64_t start_time = NanoTime();
+      thread_pool.StartWorkers(self);
+      thread_pool.Wait(self, /*do_work=*/ false, /*may_hold_locks=*/ false);
+      thread_pool.StopWorkers(self);
+      hist->AddValue(NanoTime() - start_time);
+      EXPECT_FALSE(mismatch.load(std::memory_order_relaxed));
+    }
+    Histogram<uint64_t>::CumulativeData data;
+    hist->CreateHistogram(&data);
+    hist->PrintConfidenceIntervals(std::cout, 0.99, data);
+  }
+}
+
+}  // namespace allocator
+}  // namespace gc
+}  // namespace art
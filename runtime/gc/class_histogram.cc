@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "class_histogram.h"
+
+#include <algorithm>
+#include <ostream>
+
+#include "base/time_utils.h"
+#include "mirror/class-inl.h"
+#include "thread-current-inl.h"
+
+namespace art {
+namespace gc {
+
+ClassHistogram::ClassHistogram()
+    : enabled_(false),
+      slots_(new Slot[kCapacity]),
+      dropped_count_(0u),
+      dropped_bytes_(0u),
+      lock_("class histogram lock"),
+      snapshot_time_ns_(0u),
+      snapshot_dropped_count_(0u),
+      snapshot_dropped_bytes_(0u) {
+  Reset();
+}
+
+size_t ClassHistogram::Hash(mirror::Class* klass) {
+  // Fibonacci hashing, the high bits of the product depend on all the bits of the address.
+  const uint64_t address = reinterpret_cast<uintptr_t>(klass);
+  return static_cast<size_t>((address * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - kCapacityBits));
+}
+
+void ClassHistogram::Reset() {
+  for (size_t i = 0; i < kCapacity; ++i) {
+    slots_[i].klass.store(nullptr, std::memory_order_relaxed);
+    slots_[i].count.store(0u, std::memory_order_relaxed);
+    slots_[i].bytes.store(0u, std::memory_order_relaxed);
+  }
+  dropped_count_.store(0u, std::memory_order_relaxed);
+  dropped_bytes_.store(0u, std::memory_order_relaxed);
+}
+
+void ClassHistogram::AddObject(mirror::Class* klass, size_t byte_count) {
+  DCHECK(klass != nullptr);
+  // Open addressing with linear probing, a slot is claimed for a class by a CAS from null.
+  size_t index = Hash(klass);
+  for (size_t probes = 0; probes < kCapacity; ++probes, index = (index + 1) & (kCapacity - 1)) {
+    Slot& slot = slots_[index];
+    mirror::Class* slot_class = slot.klass.load(std::memory_order_relaxed);
+    if (slot_class == nullptr) {
+      if (slot.klass.CompareAndSetStrongRelaxed(nullptr, klass)) {
+        slot_class = klass;
+      } else {
+        slot_class = slot.klass.load(std::memory_order_relaxed);
+      }
+    }
+    if (slot_class == klass) {
+      slot.count.fetch_add(1u, std::memory_order_relaxed);
+      slot.bytes.fetch_add(byte_count, std::memory_order_relaxed);
+      return;
+    }
+  }
+  dropped_count_.fetch_add(1u, std::memory_order_relaxed);
+  dropped_bytes_.fetch_add(byte_count, std::memory_order_relaxed);
+}
+
+void ClassHistogram::Publish() {
+  std::vector<Entry> entries;
+  for (size_t i = 0; i < kCapacity; ++i) {
+    mirror::Class* klass = slots_[i].klass.load(std::memory_order_relaxed);
+    if (klass != nullptr) {
+      entries.push_back(Entry { klass->PrettyDescriptor(),
+                                slots_[i].count.load(std::memory_order_relaxed),
+                                slots_[i].bytes.load(std::memory_order_relaxed) });
+    }
+  }
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.bytes != b.bytes ? a.bytes > b.bytes : a.descriptor < b.descriptor;
+  });
+  MutexLock mu(Thread::Current(), lock_);
+  snapshot_.swap(entries);
+  snapshot_time_ns_ = NanoTime();
+  snapshot_dropped_count_ = dropped_count_.load(std::memory_order_relaxed);
+  snapshot_dropped_bytes_ = dropped_bytes_.load(std::memory_order_relaxed);
+}
+
+bool ClassHistogram::HasSnapshot() {
+  MutexLock mu(Thread::Current(), lock_);
+  return snapshot_time_ns_ != 0u;
+}
+
+std::vector<ClassHistogram::Entry> ClassHistogram::GetSnapshot() {
+  MutexLock mu(Thread::Current(), lock_);
+  return snapshot_;
+}
+
+void ClassHistogram::Dump(std::ostream& os) {
+  MutexLock mu(Thread::Current(), lock_);
+  os << "gc-time-ns=" << snapshot_time_ns_ << "\n"
+     << "dropped=" << snapshot_dropped_count_ << " " << snapshot_dropped_bytes_ << "\n";
+  for (const Entry& entry : snapshot_) {
+    os << entry.count << " " << entry.bytes << " " << entry.descriptor << "\n";
+  }
+}
+
+}  // namespace gc
+}  // namespace art
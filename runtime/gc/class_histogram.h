@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ART_RUNTIME_GC_CLASS_HISTOGRAM_H_
+#define ART_RUNTIME_GC_CLASS_HISTOGRAM_H_
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/atomic.h"
+#include "base/globals.h"
+#include "base/mutex.h"
+
+namespace art {
+
+namespace mirror {
+class Class;
+}  // namespace mirror
+
+namespace gc {
+
+// Live object histogram by class, built by the concurrent copying collector at mark time. Every
+// object marked by a full-heap collection is counted in a lock-free hash table keyed by its class,
+// and the table is published as a snapshot once marking is done. The heap composition as of the
+// last full-heap collection can then be read at any time without walking the heap.
+//
+// Objects of the image and zygote spaces are never marked and not counted. Young collections only
+// mark young objects, they leave the snapshot of the last full-heap collection in place.
+class ClassHistogram {
+ public:
+  struct Entry {
+    std::string descriptor;
+    uint64_t count;
+    uint64_t bytes;
+  };
+
+  // Number of distinct classes a collection can count. Objects of further classes are only added
+  // to the dropped totals.
+  static constexpr size_t kCapacityBits = 14;
+  static constexpr size_t kCapacity = static_cast<size_t>(1) << kCapacityBits;
+
+  ClassHistogram();
+
+  bool IsEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  void SetEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  // Start counting for a new collection. Called by the GC-running thread before marking.
+  void Reset();
+
+  // Count a marked object. Lock-free, may be called by GC worker threads marking in parallel.
+  void AddObject(mirror::Class* klass, size_t byte_count);
+
+  // Replace the snapshot with the counts added since Reset(). Called by the GC-running thread
+  // once marking is done, while the counted classes are still valid.
+  void Publish() REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_);
+
+  bool HasSnapshot() REQUIRES(!lock_);
+  std::vector<Entry> GetSnapshot() REQUIRES(!lock_);
+
+  // Write the snapshot, largest classes first:
+  //
+  //   gc-time-ns=<time of the collection>
+  //   dropped=<objects> <bytes>
+  //   <objects> <bytes> <class>
+  //   ...
+  void Dump(std::ostream& os) REQUIRES(!lock_);
+
+ private:
+  struct Slot {
+    Atomic<mirror::Class*> klass;
+    Atomic<uint64_t> count;
+    Atomic<uint64_t> bytes;
+  };
+
+  static size_t Hash(mirror::Class* klass);
+
+  Atomic<bool> enabled_;
+  std::unique_ptr<Slot[]> slots_;
+  Atomic<uint64_t> dropped_count_;
+  Atomic<uint64_t> dropped_bytes_;
+
+  Mutex lock_;
+  std::vector<Entry> snapshot_ GUARDED_BY(lock_);
+  uint64_t snapshot_time_ns_ GUARDED_BY(lock_);
+  uint64_t snapshot_dropped_count_ GUARDED_BY(lock_);
+  uint64_t snapshot_dropped_bytes_ GUARDED_BY(lock_);
+
+  DISALLOW_COPY_AND_ASSIGN(ClassHistogram);
+};
+
+}  // namespace gc
+}  // namespace art
+
+#endif  // ART_RUNTIME_GC_CLASS_HISTOGRAM_H_
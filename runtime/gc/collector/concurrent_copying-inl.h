@@ -105,7 +105,8 @@ inline mirror::Object* ConcurrentCopying::MarkImmuneSpace(Thread* const self,
                updated_all_immune_objects_.load(std::memory_order_relaxed) ||
                gc_grays_immune_objects_);
       } else {
-        DCHECK(kGrayImmuneObject);
+        // GC worker threads marking in parallel behave like the GC-running thread.
+        DCHECK(kGrayImmuneObject || parallel_marking_active_.load(std::memory_order_relaxed));
       }
     }
     if (!kGrayImmuneObject || updated_all_immune_objects_.load(std::memory_order_relaxed)) {
@@ -136,7 +137,7 @@ inline mirror::Object* ConcurrentCopying::Mark(Thread* const self,
   DCHECK(heap_->collector_type_ == kCollectorTypeCC);
   if (kFromGCThread) {
     DCHECK(is_active_);
-    DCHECK_EQ(self, thread_running_gc_);
+    DCHECK(self == thread_running_gc_ || parallel_marking_active_.load(std::memory_order_relaxed));
   } else if (UNLIKELY(kUseBakerReadBarrier && !is_active_)) {
     // In the lock word forward address state, the read barrier bits
     // in the lock word are part of the stored forwarding address and
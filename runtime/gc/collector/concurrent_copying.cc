@@ -26,6 +26,7 @@
 #include "base/systrace.h"
 #include "class_root.h"
 #include "debugger.h"
+#include "gc/class_histogram.h"
 #include "gc/accounting/atomic_stack.h"
 #include "gc/accounting/heap_bitmap-inl.h"
 #include "gc/accounting/mod_union_table-inl.h"
@@ -45,6 +46,7 @@
 #include "scoped_thread_state_change-inl.h"
 #include "thread-inl.h"
 #include "thread_list.h"
+#include "thread_pool.h"
 #include "well_known_classes.h"
 
 namespace art {
@@ -66,6 +68,8 @@ static constexpr size_t kReadBarrierMarkStackSize = 512 * KB;
 static constexpr size_t kSweepArrayChunkFreeSize = 1024;
 // Verify that there are no missing card marks.
 static constexpr bool kVerifyNoMissingCardMarks = kIsDebugBuild;
+// Size of the address ranges that the card scan of young GCs is split into.
+static constexpr size_t kYoungGenCardScanChunkSize = 1 * MB;
 
 ConcurrentCopying::ConcurrentCopying(Heap* heap,
                                      bool young_gen,
@@ -98,12 +102,31 @@ ConcurrentCopying::ConcurrentCopying(Heap* heap,
       from_space_num_objects_at_first_pause_(0),
       from_space_num_bytes_at_first_pause_(0),
       mark_stack_mode_(kMarkStackModeOff),
+      parallel_marking_active_(false),
       weak_ref_access_enabled_(true),
       copied_live_bytes_ratio_sum_(0.f),
       gc_count_(0),
       region_space_inter_region_bitmap_(nullptr),
       non_moving_space_inter_region_bitmap_(nullptr),
       reclaimed_bytes_ratio_sum_(0.f),
+      parallel_mark_rounds_(0),
+      flip_callback_start_ns_(0),
+      flip_callback_end_ns_(0),
+      flip_suspend_histogram_("Thread flip suspend time", kPauseBucketSize, kPauseBucketCount),
+      flip_callback_histogram_("Thread flip callback time", kPauseBucketSize, kPauseBucketCount),
+      flip_suspended_threads_histogram_("Thread flip time for suspended threads",
+                                        kPauseBucketSize,
+                                        kPauseBucketCount),
+      capture_thread_roots_histogram_("Capture thread roots time",
+                                      kPauseBucketSize,
+                                      kPauseBucketCount),
+      young_gen_card_scans_(0),
+      young_gen_cards_scanned_sum_(0),
+      max_young_gen_cards_scanned_(0),
+      young_gen_card_scan_histogram_("Young GC card scan time",
+                                     kPauseBucketSize,
+                                     kPauseBucketCount),
+      class_histogram_(nullptr),
       skipped_blocks_lock_("concurrent copying bytes blocks lock", kMarkSweepMarkStackLock),
       measure_read_barrier_slow_path_(measure_read_barrier_slow_path),
       mark_from_read_barrier_measurements_(false),
@@ -397,6 +420,7 @@ void ConcurrentCopying::InitializePhase() {
   if (!use_generational_cc_ || !young_gen_) {
     if (gc_cause == kGcCauseExplicit ||
         gc_cause == kGcCauseCollectorTransition ||
+        gc_cause == kGcCauseBackgroundCompaction ||
         GetCurrentIteration()->GetClearSoftReferences()) {
       force_evacuate_all_ = true;
     }
@@ -413,6 +437,12 @@ void ConcurrentCopying::InitializePhase() {
   if (use_generational_cc_) {
     done_scanning_.store(false, std::memory_order_release);
   }
+  DCHECK(class_histogram_ == nullptr);
+  ClassHistogram* class_histogram = heap_->GetClassHistogram();
+  if (class_histogram != nullptr && class_histogram->IsEnabled() && !young_gen_) {
+    class_histogram->Reset();
+    class_histogram_ = class_histogram;
+  }
   BindBitmaps();
   if (kVerboseMode) {
     LOG(INFO) << "young_gen=" << std::boolalpha << young_gen_ << std::noboolalpha;
@@ -516,6 +546,7 @@ class ConcurrentCopying::FlipCallback : public Closure {
   void Run(Thread* thread) override REQUIRES(Locks::mutator_lock_) {
     ConcurrentCopying* cc = concurrent_copying_;
     TimingLogger::ScopedTiming split("(Paused)FlipCallback", cc->GetTimings());
+    cc->flip_callback_start_ns_ = NanoTime();
     // Note: self is not necessarily equal to thread since thread may be suspended.
     Thread* self = Thread::Current();
     if (kVerifyNoMissingCardMarks && cc->young_gen_) {
@@ -569,6 +600,7 @@ class ConcurrentCopying::FlipCallback : public Closure {
     } else {
       cc->java_lang_Object_ = nullptr;
     }
+    cc->flip_callback_end_ns_ = NanoTime();
   }
 
  private:
@@ -742,7 +774,21 @@ void ConcurrentCopying::FlipThreadRoots() {
   FlipCallback flip_callback(this);
 
   size_t barrier_count = Runtime::Current()->GetThreadList()->FlipThreadRoots(
-      &thread_flip_visitor, &flip_callback, this, GetHeap()->GetGcPauseListener());
+      &thread_flip_visitor,
+      &flip_callback,
+      this,
+      GetHeap()->GetGcPauseListener(),
+      GetThreadRootsVisitPool());
+  {
+    // The pause registered by ThreadList::FlipThreadRoots() covers suspending the threads and the
+    // flip callback. The threads that were suspended before the pause stay suspended until their
+    // roots are flipped.
+    const uint64_t pause_ns = GetCurrentIteration()->GetPauseTimes().back();
+    const uint64_t callback_ns = flip_callback_end_ns_ - flip_callback_start_ns_;
+    flip_suspend_histogram_.AdjustAndAddValue(pause_ns > callback_ns ? pause_ns - callback_ns : 0u);
+    flip_callback_histogram_.AdjustAndAddValue(callback_ns);
+    flip_suspended_threads_histogram_.AdjustAndAddValue(NanoTime() - flip_callback_end_ns_);
+  }
 
   {
     ScopedThreadStateChange tsc(self, kWaitingForCheckPointsToRun);
@@ -1010,19 +1056,25 @@ void ConcurrentCopying::CaptureThreadRootsForMarking() {
   Thread* const self = Thread::Current();
   CaptureThreadRootsForMarkingAndCheckpoint check_point(this);
   ThreadList* thread_list = Runtime::Current()->GetThreadList();
+  const uint64_t start_time = NanoTime();
   gc_barrier_->Init(self, 0);
-  size_t barrier_count = thread_list->RunCheckpoint(&check_point, /* callback */ nullptr);
+  size_t barrier_count = thread_list->RunCheckpoint(&check_point,
+                                                    /* callback */ nullptr,
+                                                    GetThreadRootsVisitPool());
   // If there are no threads to wait which implys that all the checkpoint functions are finished,
   // then no need to release the mutator lock.
+  if (barrier_count != 0) {
+    Locks::mutator_lock_->SharedUnlock(self);
+    {
+      ScopedThreadStateChange tsc(self, kWaitingForCheckPointsToRun);
+      gc_barrier_->Increment(self, barrier_count);
+    }
+    Locks::mutator_lock_->SharedLock(self);
+  }
+  capture_thread_roots_histogram_.AdjustAndAddValue(NanoTime() - start_time);
   if (barrier_count == 0) {
     return;
   }
-  Locks::mutator_lock_->SharedUnlock(self);
-  {
-    ScopedThreadStateChange tsc(self, kWaitingForCheckPointsToRun);
-    gc_barrier_->Increment(self, barrier_count);
-  }
-  Locks::mutator_lock_->SharedLock(self);
   if (kVerboseMode) {
     LOG(INFO) << "time=" << region_space_->Time();
     region_space_->DumpNonFreeRegions(LOG_STREAM(INFO));
@@ -1124,6 +1176,10 @@ void ConcurrentCopying::AddLiveBytesAndScanRef(mirror::Object* ref) {
       region_space_->AddLiveBytes(ref, alloc_size);
     }
   }
+  if (class_histogram_ != nullptr) {
+    class_histogram_->AddObject(ref->GetClass<kVerifyNone, kWithoutReadBarrier>(),
+                                ref->SizeOf<kDefaultVerifyFlags>());
+  }
   ComputeLiveBytesAndMarkRefFieldsVisitor</*kHandleInterRegionRefs*/ true>
       visitor(this, obj_region_idx);
   ref->VisitReferences</*kVisitNativeRoots=*/ true, kDefaultVerifyFlags, kWithoutReadBarrier>(
@@ -1356,6 +1412,11 @@ void ConcurrentCopying::MarkingPhase() {
   CaptureThreadRootsForMarking();
   // Process mark stack
   ProcessMarkStackForMarkingAndComputeLiveBytes();
+  if (class_histogram_ != nullptr) {
+    // The marking phase reached all the live objects, the copying phase must not count them again.
+    class_histogram_->Publish();
+    class_histogram_ = nullptr;
+  }
 
   if (kVerboseMode) {
     LOG(INFO) << "GC end of MarkingPhase";
@@ -1377,6 +1438,127 @@ void ConcurrentCopying::ScanDirtyObject(mirror::Object* obj) {
   }
 }
 
+void ConcurrentCopying::ScanYoungGenCards() {
+  TimingLogger::ScopedTiming split("ScanYoungGenCards", GetTimings());
+  Thread* const self = Thread::Current();
+  accounting::CardTable* const card_table = heap_->GetCardTable();
+  const uint64_t start_time = NanoTime();
+  // Only the cards of the old objects, i.e. of the non-moving space and of the unevacuated
+  // regions, need to be scanned. Objects of the newly allocated (from-space) regions get scanned
+  // when they are evacuated, and free regions have no objects. The large-object space does not need
+  // to be scanned either, see the comment in CopyingPhase().
+  //
+  // The card table is the remembered set: there is no per-region summary to skip old regions
+  // with. Mutators keep dirtying cards between the aging in BindBitmaps() and the flip, and these
+  // cards may hold the only references to from-space objects. Only a write barrier that also marks
+  // regions could keep such a summary exact, so every old region gets its clean cards skipped by
+  // the card scan instead.
+  struct CardScanChunk {
+    accounting::ContinuousSpaceBitmap* bitmap;
+    uint8_t* begin;
+    uint8_t* end;
+  };
+  std::vector<CardScanChunk> chunks;
+  for (space::ContinuousSpace* space : GetHeap()->GetContinuousSpaces()) {
+    if (space->IsImageSpace() || space->IsZygoteSpace()) {
+      // Image and zygote spaces are already handled since we gray the objects in the pause.
+      continue;
+    }
+    if (space == region_space_) {
+      // Split runs of unevacuated regions into chunks.
+      uint8_t* chunk_begin = nullptr;
+      uint8_t* chunk_end = nullptr;
+      for (size_t i = 0; i < region_space_->GetNumRegions(); ++i) {
+        uint8_t* const region_begin = region_space_->RegionBegin(i);
+        const bool unevac = region_space_->IsRegionUnevacFromSpace(i);
+        if (chunk_begin != nullptr &&
+            (!unevac ||
+             chunk_end != region_begin ||
+             static_cast<size_t>(chunk_end - chunk_begin) >= kYoungGenCardScanChunkSize)) {
+          chunks.push_back({region_space_bitmap_, chunk_begin, chunk_end});
+          chunk_begin = nullptr;
+        }
+        if (!unevac) {
+          continue;
+        }
+        if (chunk_begin == nullptr) {
+          chunk_begin = region_begin;
+        }
+        chunk_end = region_begin + space::RegionSpace::kRegionSize;
+      }
+      if (chunk_begin != nullptr) {
+        chunks.push_back({region_space_bitmap_, chunk_begin, chunk_end});
+      }
+    } else {
+      DCHECK(space == heap_->non_moving_space_);
+      for (uint8_t* begin = space->Begin(); begin < space->End();
+           begin += kYoungGenCardScanChunkSize) {
+        uint8_t* const end = std::min(begin + kYoungGenCardScanChunkSize, space->End());
+        chunks.push_back({space->GetMarkBitmap(), begin, end});
+      }
+    }
+  }
+
+  Atomic<size_t> next_chunk(0u);
+  Atomic<size_t> cards_scanned(0u);
+  auto scan_chunks = [&](Thread* thread) NO_THREAD_SAFETY_ANALYSIS {
+    size_t cards = 0;
+    for (size_t i = next_chunk.fetch_add(1u, std::memory_order_relaxed);
+         i < chunks.size();
+         i = next_chunk.fetch_add(1u, std::memory_order_relaxed)) {
+      cards += card_table->Scan<false>(
+          chunks[i].bitmap,
+          chunks[i].begin,
+          chunks[i].end,
+          [this](mirror::Object* obj) NO_THREAD_SAFETY_ANALYSIS {
+            // Don't push or gray unevac refs.
+            if (kIsDebugBuild && region_space_->HasAddress(obj)) {
+              // We may get unevac large objects.
+              if (!region_space_->IsInUnevacFromSpace(obj)) {
+                CHECK(region_space_bitmap_->Test(obj));
+                region_space_->DumpRegionForObject(LOG_STREAM(FATAL_WITHOUT_ABORT), obj);
+                LOG(FATAL) << "Scanning " << obj << " not in unevac space";
+              }
+            }
+            ScanDirtyObject</*kNoUnEvac*/ true>(obj);
+          },
+          accounting::CardTable::kCardAged);
+    }
+    cards_scanned.fetch_add(cards, std::memory_order_relaxed);
+    if (thread != thread_running_gc_) {
+      // Hand the refs pushed by the worker over to the GC-running thread.
+      RevokeThreadLocalMarkStack(thread);
+    }
+  };
+  const size_t thread_count = std::min(GetParallelMarkThreadCount(), chunks.size());
+  if (thread_count > 1) {
+    ThreadPool* thread_pool = heap_->GetThreadPool();
+    for (size_t i = 0; i < thread_count; ++i) {
+      thread_pool->AddTask(self, new FunctionTask([&scan_chunks](Thread* thread) {
+        scan_chunks(thread);
+      }));
+    }
+    parallel_marking_active_.store(true, std::memory_order_relaxed);
+    thread_pool->SetMaxActiveWorkers(thread_count - 1);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+    thread_pool->StopWorkers(self);
+    parallel_marking_active_.store(false, std::memory_order_relaxed);
+  } else {
+    scan_chunks(self);
+  }
+
+  const uint64_t scan_time = NanoTime() - start_time;
+  const size_t cards = cards_scanned.load(std::memory_order_relaxed);
+  ++young_gen_card_scans_;
+  young_gen_cards_scanned_sum_ += cards;
+  max_young_gen_cards_scanned_ = std::max<uint64_t>(max_young_gen_cards_scanned_, cards);
+  young_gen_card_scan_histogram_.AdjustAndAddValue(scan_time);
+  VLOG(gc) << "Young GC card scan: scanned " << cards << " cards in "
+           << PrettyDuration(scan_time) << " with " << std::max<size_t>(thread_count, 1u)
+           << " threads";
+}
+
 // Concurrently mark roots that are guarded by read barriers and process the mark stack.
 void ConcurrentCopying::CopyingPhase() {
   TimingLogger::ScopedTiming split("CopyingPhase", GetTimings());
@@ -1409,62 +1591,53 @@ void ConcurrentCopying::CopyingPhase() {
       // scanning and mutators reading references.
       usleep(10 * 1000);
     }
-    for (space::ContinuousSpace* space : GetHeap()->GetContinuousSpaces()) {
-      if (space->IsImageSpace() || space->IsZygoteSpace()) {
-        // Image and zygote spaces are already handled since we gray the objects in the pause.
-        continue;
-      }
-      // Scan all of the objects on dirty cards in unevac from space, and non moving space. These
-      // are from previous GCs (or from marking phase of 2-phase full GC) and may reference things
-      // in the from space.
-      //
-      // Note that we do not need to process the large-object space (the only discontinuous space)
-      // as it contains only large string objects and large primitive array objects, that have no
-      // reference to other objects, except their class. There is no need to scan these large
-      // objects, as the String class and the primitive array classes are expected to never move
-      // during a collection:
-      // - In the case where we run with a boot image, these classes are part of the image space,
-      //   which is an immune space.
-      // - In the case where we run without a boot image, these classes are allocated in the
-      //   non-moving space (see art::ClassLinker::InitWithoutImage).
-      card_table->Scan<false>(
-          space->GetMarkBitmap(),
-          space->Begin(),
-          space->End(),
-          [this, space](mirror::Object* obj)
-              REQUIRES(Locks::heap_bitmap_lock_)
-              REQUIRES_SHARED(Locks::mutator_lock_) {
-            // TODO: This code may be refactored to avoid scanning object while
-            // done_scanning_ is false by setting rb_state to gray, and pushing the
-            // object on mark stack. However, it will also require clearing the
-            // corresponding mark-bit and, for region space objects,
-            // decrementing the object's size from the corresponding region's
-            // live_bytes.
-            if (young_gen_) {
-              // Don't push or gray unevac refs.
-              if (kIsDebugBuild && space == region_space_) {
-                // We may get unevac large objects.
-                if (!region_space_->IsInUnevacFromSpace(obj)) {
-                  CHECK(region_space_bitmap_->Test(obj));
-                  region_space_->DumpRegionForObject(LOG_STREAM(FATAL_WITHOUT_ABORT), obj);
-                  LOG(FATAL) << "Scanning " << obj << " not in unevac space";
-                }
+    if (young_gen_) {
+      ScanYoungGenCards();
+    } else {
+      for (space::ContinuousSpace* space : GetHeap()->GetContinuousSpaces()) {
+        if (space->IsImageSpace() || space->IsZygoteSpace()) {
+          // Image and zygote spaces are already handled since we gray the objects in the pause.
+          continue;
+        }
+        // Scan all of the objects on dirty cards in unevac from space, and non moving space. These
+        // are from previous GCs (or from marking phase of 2-phase full GC) and may reference things
+        // in the from space.
+        //
+        // Note that we do not need to process the large-object space (the only discontinuous space)
+        // as it contains only large string objects and large primitive array objects, that have no
+        // reference to other objects, except their class. There is no need to scan these large
+        // objects, as the String class and the primitive array classes are expected to never move
+        // during a collection:
+        // - In the case where we run with a boot image, these classes are part of the image space,
+        //   which is an immune space.
+        // - In the case where we run without a boot image, these classes are allocated in the
+        //   non-moving space (see art::ClassLinker::InitWithoutImage).
+        card_table->Scan<false>(
+            space->GetMarkBitmap(),
+            space->Begin(),
+            space->End(),
+            [this, space](mirror::Object* obj)
+                REQUIRES(Locks::heap_bitmap_lock_)
+                REQUIRES_SHARED(Locks::mutator_lock_) {
+              // TODO: This code may be refactored to avoid scanning object while
+              // done_scanning_ is false by setting rb_state to gray, and pushing the
+              // object on mark stack. However, it will also require clearing the
+              // corresponding mark-bit and, for region space objects,
+              // decrementing the object's size from the corresponding region's
+              // live_bytes.
+              if (space != region_space_) {
+                DCHECK(space == heap_->non_moving_space_);
+                // We need to process un-evac references as they may be unprocessed,
+                // if they skipped the marking phase due to heap mutation.
+                ScanDirtyObject</*kNoUnEvac*/ false>(obj);
+                non_moving_space_inter_region_bitmap_->Clear(obj);
+              } else if (region_space_->IsInUnevacFromSpace(obj)) {
+                ScanDirtyObject</*kNoUnEvac*/ false>(obj);
+                region_space_inter_region_bitmap_->Clear(obj);
               }
-              ScanDirtyObject</*kNoUnEvac*/ true>(obj);
-            } else if (space != region_space_) {
-              DCHECK(space == heap_->non_moving_space_);
-              // We need to process un-evac references as they may be unprocessed,
-              // if they skipped the marking phase due to heap mutation.
-              ScanDirtyObject</*kNoUnEvac*/ false>(obj);
-              non_moving_space_inter_region_bitmap_->Clear(obj);
-            } else if (region_space_->IsInUnevacFromSpace(obj)) {
-              ScanDirtyObject</*kNoUnEvac*/ false>(obj);
-              region_space_inter_region_bitmap_->Clear(obj);
-            }
-          },
-          accounting::CardTable::kCardAged);
+            },
+            accounting::CardTable::kCardAged);
 
-      if (!young_gen_) {
         auto visitor = [this](mirror::Object* obj) REQUIRES_SHARED(Locks::mutator_lock_) {
                          // We don't need to process un-evac references as any unprocessed
                          // ones will be taken care of in the card-table scan above.
@@ -2032,6 +2205,11 @@ bool ConcurrentCopying::ProcessMarkStackOnce() {
   size_t count = 0;
   MarkStackMode mark_stack_mode = mark_stack_mode_.load(std::memory_order_relaxed);
   if (mark_stack_mode == kMarkStackModeThreadLocal) {
+    const size_t thread_count = GetParallelMarkThreadCount();
+    if (thread_count > 1) {
+      // Process the thread-local mark stacks and the GC mark stack with the GC worker threads.
+      return ProcessMarkStackParallel(thread_count) == 0;
+    }
     // Process the thread-local mark stacks and the GC mark stack.
     count += ProcessThreadLocalMarkStacks(/* disable_weak_ref_access= */ false,
                                           /* checkpoint_callback= */ nullptr,
@@ -2116,19 +2294,202 @@ size_t ConcurrentCopying::ProcessThreadLocalMarkStacks(bool disable_weak_ref_acc
     }
     {
       MutexLock mu(thread_running_gc_, mark_stack_lock_);
-      if (pooled_mark_stacks_.size() >= kMarkStackPoolSize) {
-        // The pool has enough. Delete it.
-        delete mark_stack;
-      } else {
-        // Otherwise, put it into the pool for later reuse.
-        mark_stack->Reset();
-        pooled_mark_stacks_.push_back(mark_stack);
+      RecycleMarkStack(thread_running_gc_, mark_stack);
+    }
+  }
+  return count;
+}
+
+void ConcurrentCopying::RecycleMarkStack(Thread* const self ATTRIBUTE_UNUSED,
+                                         accounting::ObjectStack* mark_stack) {
+  if (pooled_mark_stacks_.size() >= kMarkStackPoolSize) {
+    // The pool has enough. Delete it.
+    delete mark_stack;
+  } else {
+    // Otherwise, put it into the pool for later reuse.
+    mark_stack->Reset();
+    pooled_mark_stacks_.push_back(mark_stack);
+  }
+}
+
+// A marking task run by the heap thread pool workers (and the GC-running thread) in the
+// thread-local mark stack mode. Each task starts with a slice of the collected mark stack
+// entries. Refs newly pushed by a worker go onto its own thread-local mark stack (or onto the GC
+// mark stack for the GC-running thread), which the worker drains itself. Full thread-local mark
+// stacks get revoked into revoked_mark_stacks_, where idle workers steal them from. Anything left
+// behind is picked up by the serial loop in ProcessMarkStack().
+class ConcurrentCopying::ParallelMarkTask : public Task {
+ public:
+  ParallelMarkTask(ConcurrentCopying* collector,
+                   mirror::Object* const* begin,
+                   mirror::Object* const* end)
+      : collector_(collector), begin_(begin), end_(end), objects_processed_(0), time_ns_(0) {}
+
+  // No thread safety analysis since the GC-running thread holds the mutator lock on behalf of
+  // the workers, as in MarkSweep::MarkStackTask.
+  void Run(Thread* self) override NO_THREAD_SAFETY_ANALYSIS {
+    const uint64_t start_time = NanoTime();
+    size_t count = 0;
+    for (mirror::Object* const* it = begin_; it != end_; ++it) {
+      collector_->ProcessMarkStackRef</*kParallel=*/ true>(*it);
+      ++count;
+    }
+    accounting::ObjectStack* stolen_mark_stack = nullptr;
+    mirror::Object* ref;
+    while ((ref = collector_->PopParallelMarkStackRef(self, &stolen_mark_stack)) != nullptr) {
+      collector_->ProcessMarkStackRef</*kParallel=*/ true>(ref);
+      ++count;
+    }
+    DCHECK(stolen_mark_stack == nullptr);
+    if (self != collector_->thread_running_gc_) {
+      // Hand the (empty) thread-local mark stack back so that the pool stays balanced.
+      accounting::ObjectStack* tl_mark_stack = self->GetThreadLocalMarkStack();
+      if (tl_mark_stack != nullptr) {
+        DCHECK(tl_mark_stack->IsEmpty());
+        MutexLock mu(self, collector_->mark_stack_lock_);
+        self->SetThreadLocalMarkStack(nullptr);
+        collector_->RecycleMarkStack(self, tl_mark_stack);
       }
     }
+    objects_processed_ += count;
+    time_ns_ += NanoTime() - start_time;
+  }
+
+  size_t GetObjectsProcessed() const {
+    return objects_processed_;
+  }
+
+  uint64_t GetTimeNs() const {
+    return time_ns_;
+  }
+
+ private:
+  ConcurrentCopying* const collector_;
+  mirror::Object* const* const begin_;
+  mirror::Object* const* const end_;
+  size_t objects_processed_;
+  uint64_t time_ns_;
+};
+
+size_t ConcurrentCopying::GetParallelMarkThreadCount() const {
+  // Use less threads if we are in a background state (non jank perceptible) since we want to leave
+  // more CPU time for the foreground apps.
+  if (heap_->GetThreadPool() == nullptr ||
+      heap_->GetCCParallelMarkThreadCount() == 0 ||
+      !Runtime::Current()->InJankPerceptibleProcessState()) {
+    return 1;
+  }
+  return std::min(heap_->GetCCParallelMarkThreadCount(),
+                  heap_->GetThreadPool()->GetThreadCount()) + 1;
+}
+
+ThreadPool* ConcurrentCopying::GetThreadRootsVisitPool() const {
+  // The thread root visits of suspended threads are spread over the same workers as the parallel
+  // marking.
+  const size_t thread_count = GetParallelMarkThreadCount();
+  if (thread_count <= 1) {
+    return nullptr;
+  }
+  ThreadPool* thread_pool = heap_->GetThreadPool();
+  thread_pool->SetMaxActiveWorkers(thread_count - 1);
+  return thread_pool;
+}
+
+mirror::Object* ConcurrentCopying::PopParallelMarkStackRef(
+    Thread* const self,
+    accounting::ObjectStack** stolen_mark_stack) {
+  // Work on refs we pushed ourselves first, they are likely to be in the cache.
+  if (self == thread_running_gc_) {
+    if (!gc_mark_stack_->IsEmpty()) {
+      return gc_mark_stack_->PopBack();
+    }
+  } else {
+    accounting::ObjectStack* tl_mark_stack = self->GetThreadLocalMarkStack();
+    if (tl_mark_stack != nullptr && !tl_mark_stack->IsEmpty()) {
+      return tl_mark_stack->PopBack();
+    }
+  }
+  // Then drain the mark stack we stole last time.
+  if (*stolen_mark_stack != nullptr) {
+    if (!(*stolen_mark_stack)->IsEmpty()) {
+      return (*stolen_mark_stack)->PopBack();
+    }
+    MutexLock mu(self, mark_stack_lock_);
+    RecycleMarkStack(self, *stolen_mark_stack);
+    *stolen_mark_stack = nullptr;
+  }
+  // Finally, steal a full mark stack revoked by another thread.
+  MutexLock mu(self, mark_stack_lock_);
+  while (!revoked_mark_stacks_.empty()) {
+    accounting::ObjectStack* mark_stack = revoked_mark_stacks_.back();
+    revoked_mark_stacks_.pop_back();
+    if (!mark_stack->IsEmpty()) {
+      *stolen_mark_stack = mark_stack;
+      return mark_stack->PopBack();
+    }
+    RecycleMarkStack(self, mark_stack);
+  }
+  return nullptr;
+}
+
+size_t ConcurrentCopying::ProcessMarkStackParallel(size_t thread_count) {
+  Thread* const self = Thread::Current();
+  DCHECK_EQ(self, thread_running_gc_);
+  // Collect the thread-local mark stacks and the GC mark stack into one array to split up.
+  std::vector<mirror::Object*> refs;
+  ProcessThreadLocalMarkStacks(/* disable_weak_ref_access= */ false,
+                               /* checkpoint_callback= */ nullptr,
+                               [&refs] (mirror::Object* ref) {
+                                 refs.push_back(ref);
+                               });
+  for (StackReference<mirror::Object>* p = gc_mark_stack_->Begin();
+       p != gc_mark_stack_->End(); ++p) {
+    refs.push_back(p->AsMirrorPtr());
+  }
+  gc_mark_stack_->Reset();
+  if (refs.size() < kMinimumParallelMarkStackSize) {
+    // Not worth waking up the workers.
+    size_t count = refs.size();
+    for (mirror::Object* ref : refs) {
+      ProcessMarkStackRef(ref);
+    }
+    while (!gc_mark_stack_->IsEmpty()) {
+      ProcessMarkStackRef(gc_mark_stack_->PopBack());
+      ++count;
+    }
+    gc_mark_stack_->Reset();
+    return count;
+  }
+  TimingLogger::ScopedTiming split("ProcessMarkStackParallel", GetTimings());
+  ThreadPool* thread_pool = heap_->GetThreadPool();
+  const size_t chunk_size = RoundUp(refs.size(), thread_count) / thread_count;
+  std::vector<std::unique_ptr<ParallelMarkTask>> tasks;
+  for (size_t begin = 0; begin < refs.size(); begin += chunk_size) {
+    const size_t end = std::min(begin + chunk_size, refs.size());
+    tasks.emplace_back(new ParallelMarkTask(this, refs.data() + begin, refs.data() + end));
+    thread_pool->AddTask(self, tasks.back().get());
+  }
+  parallel_marking_active_.store(true, std::memory_order_relaxed);
+  thread_pool->SetMaxActiveWorkers(thread_count - 1);
+  thread_pool->StartWorkers(self);
+  thread_pool->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+  thread_pool->StopWorkers(self);
+  parallel_marking_active_.store(false, std::memory_order_relaxed);
+  ++parallel_mark_rounds_;
+  if (parallel_mark_thread_time_ns_.size() < tasks.size()) {
+    parallel_mark_thread_time_ns_.resize(tasks.size(), 0u);
+    parallel_mark_thread_objects_.resize(tasks.size(), 0u);
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    count += tasks[i]->GetObjectsProcessed();
+    parallel_mark_thread_time_ns_[i] += tasks[i]->GetTimeNs();
+    parallel_mark_thread_objects_[i] += tasks[i]->GetObjectsProcessed();
   }
   return count;
 }
 
+template <bool kParallel>
 inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
   DCHECK(!region_space_->IsInFromSpace(to_ref));
   space::RegionSpace::RegionType rtype = region_space_->GetRegionType(to_ref);
@@ -2151,8 +2512,11 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
   bool perform_scan = false;
   switch (rtype) {
     case space::RegionSpace::RegionType::kRegionTypeUnevacFromSpace:
-      // Mark the bitmap only in the GC thread here so that we don't need a CAS.
-      if (!kUseBakerReadBarrier || !region_space_bitmap_->Set(to_ref)) {
+      // Mark the bitmap only in the GC thread here so that we don't need a CAS (unless GC worker
+      // threads are processing the mark stack in parallel).
+      if (!kUseBakerReadBarrier ||
+          !(kParallel ? region_space_bitmap_->AtomicTestAndSet(to_ref)
+                      : region_space_bitmap_->Set(to_ref))) {
         // It may be already marked if we accidentally pushed the same object twice due to the racy
         // bitmap read in MarkUnevacFromSpaceRegion.
         if (use_generational_cc_ && young_gen_) {
@@ -2174,7 +2538,11 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
     case space::RegionSpace::RegionType::kRegionTypeToSpace:
       if (use_generational_cc_) {
         // Copied to to-space, set the bit so that the next GC can scan objects.
-        region_space_bitmap_->Set(to_ref);
+        if (kParallel) {
+          region_space_bitmap_->AtomicTestAndSet(to_ref);
+        } else {
+          region_space_bitmap_->Set(to_ref);
+        }
       }
       perform_scan = true;
       break;
@@ -2205,12 +2573,14 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
               heap_->GetLargeObjectsSpace()->GetMarkBitmap();
           DCHECK(los_bitmap->HasAddress(to_ref));
           // Only the GC thread could be setting the LOS bit map hence doesn't
-          // need to be atomically done.
-          perform_scan = !los_bitmap->Set(to_ref);
+          // need to be atomically done (unless marking in parallel).
+          perform_scan = kParallel ? !los_bitmap->AtomicTestAndSet(to_ref)
+                                   : !los_bitmap->Set(to_ref);
         } else {
           // Only the GC thread could be setting the non-moving space bit map
-          // hence doesn't need to be atomically done.
-          perform_scan = !mark_bitmap->Set(to_ref);
+          // hence doesn't need to be atomically done (unless marking in parallel).
+          perform_scan = kParallel ? !mark_bitmap->AtomicTestAndSet(to_ref)
+                                   : !mark_bitmap->Set(to_ref);
         }
       } else {
         perform_scan = true;
@@ -2222,6 +2592,11 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
     } else {
       Scan<false>(to_ref);
     }
+    if (class_histogram_ != nullptr) {
+      // Scan() updated the class reference to the to-space copy of the class.
+      class_histogram_->AddObject(to_ref->GetClass<kVerifyNone, kWithoutReadBarrier>(),
+                                  to_ref->SizeOf<kDefaultVerifyFlags>());
+    }
   }
   if (kUseBakerReadBarrier) {
     DCHECK(to_ref->GetReadBarrierState() == ReadBarrier::GrayState())
@@ -2261,12 +2636,16 @@ inline void ConcurrentCopying::ProcessMarkStackRef(mirror::Object* to_ref) {
 #endif
 
   if (add_to_live_bytes) {
-    // Add to the live bytes per unevacuated from-space. Note this code is always run by the
-    // GC-running thread (no synchronization required).
+    // Add to the live bytes per unevacuated from-space. Note this code is run by the GC-running
+    // thread (no synchronization required) unless GC worker threads are marking in parallel.
     DCHECK(region_space_bitmap_->Test(to_ref));
     size_t obj_size = to_ref->SizeOf<kDefaultVerifyFlags>();
     size_t alloc_size = RoundUp(obj_size, space::RegionSpace::kAlignment);
-    region_space_->AddLiveBytes(to_ref, alloc_size);
+    if (kParallel) {
+      region_space_->AtomicAddLiveBytes(to_ref, alloc_size);
+    } else {
+      region_space_->AddLiveBytes(to_ref, alloc_size);
+    }
   }
   if (ReadBarrier::kEnableToSpaceInvariantChecks) {
     CHECK(to_ref != nullptr);
@@ -2599,6 +2978,13 @@ void ConcurrentCopying::ReclaimPhase() {
   }
   Thread* self = Thread::Current();
 
+  if (class_histogram_ != nullptr) {
+    // All the counted classes were marked, they stay valid until the end of this collection.
+    TimingLogger::ScopedTiming split2("PublishClassHistogram", GetTimings());
+    class_histogram_->Publish();
+    class_histogram_ = nullptr;
+  }
+
   {
     // Double-check that the mark stack is empty.
     // Note: need to set this after VerifyNoFromSpaceRef().
@@ -3037,7 +3423,7 @@ class ConcurrentCopying::RefFieldsVisitor {
   void operator()(mirror::Object* obj, MemberOffset offset, bool /* is_static */)
       const ALWAYS_INLINE REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES_SHARED(Locks::heap_bitmap_lock_) {
-    collector_->Process<kNoUnEvac>(obj, offset);
+    collector_->Process<kNoUnEvac>(thread_, obj, offset);
   }
 
   void operator()(ObjPtr<mirror::Class> klass, ObjPtr<mirror::Reference> ref) const
@@ -3076,25 +3462,28 @@ inline void ConcurrentCopying::Scan(mirror::Object* to_ref) {
     Thread::Current()->ModifyDebugDisallowReadBarrier(1);
   }
   DCHECK(!region_space_->IsInFromSpace(to_ref));
-  DCHECK_EQ(Thread::Current(), thread_running_gc_);
-  RefFieldsVisitor<kNoUnEvac> visitor(this, thread_running_gc_);
+  Thread* const self = Thread::Current();
+  DCHECK(self == thread_running_gc_ || parallel_marking_active_.load(std::memory_order_relaxed));
+  RefFieldsVisitor<kNoUnEvac> visitor(this, self);
   // Disable the read barrier for a performance reason.
   to_ref->VisitReferences</*kVisitNativeRoots=*/true, kDefaultVerifyFlags, kWithoutReadBarrier>(
       visitor, visitor);
   if (kDisallowReadBarrierDuringScan && !Runtime::Current()->IsActiveTransaction()) {
-    thread_running_gc_->ModifyDebugDisallowReadBarrier(-1);
+    self->ModifyDebugDisallowReadBarrier(-1);
   }
 }
 
 template <bool kNoUnEvac>
-inline void ConcurrentCopying::Process(mirror::Object* obj, MemberOffset offset) {
+inline void ConcurrentCopying::Process(Thread* const self,
+                                       mirror::Object* obj,
+                                       MemberOffset offset) {
   // Cannot have `kNoUnEvac` when Generational CC collection is disabled.
   DCHECK(!kNoUnEvac || use_generational_cc_);
-  DCHECK_EQ(Thread::Current(), thread_running_gc_);
+  DCHECK_EQ(Thread::Current(), self);
   mirror::Object* ref = obj->GetFieldObject<
       mirror::Object, kVerifyNone, kWithoutReadBarrier, false>(offset);
   mirror::Object* to_ref = Mark</*kGrayImmuneObject=*/false, kNoUnEvac, /*kFromGCThread=*/true>(
-      thread_running_gc_,
+      self,
       ref,
       /*holder=*/ obj,
       offset);
@@ -3783,6 +4172,33 @@ void ConcurrentCopying::DumpPerformanceInfo(std::ostream& os) {
      << ") / " << region_space_->GetNumRegions() / 2 << " ("
      << PrettySize(region_space_->GetNumRegions() * space::RegionSpace::kRegionSize / 2)
      << ")\n";
+
+  if (parallel_mark_rounds_ > 0) {
+    os << "Parallel mark stack processing rounds " << parallel_mark_rounds_ << "\n";
+    for (size_t i = 0; i < parallel_mark_thread_time_ns_.size(); ++i) {
+      os << "Parallel mark thread " << i << ": time "
+         << PrettyDuration(parallel_mark_thread_time_ns_[i]) << " objects "
+         << parallel_mark_thread_objects_[i] << "\n";
+    }
+  }
+
+  if (young_gen_card_scans_ > 0) {
+    os << "Young GC cards scanned: average " << young_gen_cards_scanned_sum_ / young_gen_card_scans_
+       << ", max " << max_young_gen_cards_scanned_ << " over " << young_gen_card_scans_
+       << " GCs\n";
+  }
+
+  for (Histogram<uint64_t>* histogram : { &flip_suspend_histogram_,
+                                          &flip_callback_histogram_,
+                                          &flip_suspended_threads_histogram_,
+                                          &capture_thread_roots_histogram_,
+                                          &young_gen_card_scan_histogram_ }) {
+    if (histogram->SampleSize() > 0) {
+      Histogram<uint64_t>::CumulativeData cumulative_data;
+      histogram->CreateHistogram(&cumulative_data);
+      histogram->PrintConfidenceIntervals(os, 0.99, cumulative_data);
+    }
+  }
 }
 
 }  // namespace collector
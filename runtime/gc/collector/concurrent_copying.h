@@ -29,6 +29,7 @@ namespace art {
 class Barrier;
 class Closure;
 class RootInfo;
+class ThreadPool;
 
 namespace mirror {
 template<class MirrorType> class CompressedReference;
@@ -38,6 +39,8 @@ class Object;
 
 namespace gc {
 
+class ClassHistogram;
+
 namespace accounting {
 template<typename T> class AtomicStack;
 typedef AtomicStack<mirror::Object> ObjectStack;
@@ -64,6 +67,8 @@ class ConcurrentCopying : public GarbageCollector {
   // If kGrayDirtyImmuneObjects is true then we gray dirty objects in the GC pause to prevent dirty
   // pages.
   static constexpr bool kGrayDirtyImmuneObjects = true;
+  // Minimum number of mark stack entries required to hand marking work to the GC worker threads.
+  static constexpr size_t kMinimumParallelMarkStackSize = 128;
 
   ConcurrentCopying(Heap* heap,
                     bool young_gen,
@@ -164,10 +169,14 @@ class ConcurrentCopying : public GarbageCollector {
                        MemberOffset offset)
       REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_, !skipped_blocks_lock_, !immune_gray_stack_lock_);
-  // Scan the reference fields of object `to_ref`.
+  // Scan the reference fields of object `to_ref`. Called by the GC-running thread, or by a GC
+  // worker thread during parallel marking.
   template <bool kNoUnEvac>
   void Scan(mirror::Object* to_ref) REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
+  // Scan the dirty cards of the old objects for a young GC, with the parallel marking threads.
+  void ScanYoungGenCards() REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(Locks::heap_bitmap_lock_, !mark_stack_lock_);
   // Scan the reference fields of object 'obj' in the dirty cards during
   // card-table scan. In addition to visiting the references, it also sets the
   // read-barrier state to gray for Reference-type objects to ensure that
@@ -177,7 +186,7 @@ class ConcurrentCopying : public GarbageCollector {
       REQUIRES(!mark_stack_lock_);
   // Process a field.
   template <bool kNoUnEvac>
-  void Process(mirror::Object* obj, MemberOffset offset)
+  void Process(Thread* const self, mirror::Object* obj, MemberOffset offset)
       REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_ , !skipped_blocks_lock_, !immune_gray_stack_lock_);
   void VisitRoots(mirror::Object*** roots, size_t count, const RootInfo& info) override
@@ -198,8 +207,29 @@ class ConcurrentCopying : public GarbageCollector {
   void ProcessMarkStack() override REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
   bool ProcessMarkStackOnce() REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!mark_stack_lock_);
+  // Process the given mark stack entry. If `kParallel` is true, mark bitmaps and live bytes are
+  // updated atomically so that GC worker threads can process entries concurrently.
+  template <bool kParallel = false>
   void ProcessMarkStackRef(mirror::Object* to_ref) REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
+  // Number of threads (including the GC-running thread) to use for processing the mark stack in
+  // the thread-local mark stack mode.
+  size_t GetParallelMarkThreadCount() const;
+  // Drain the thread-local and GC mark stacks using `thread_count` threads from the heap's thread
+  // pool. Returns the number of processed refs.
+  size_t ProcessMarkStackParallel(size_t thread_count) REQUIRES_SHARED(Locks::mutator_lock_)
+      REQUIRES(!mark_stack_lock_);
+  // The heap's thread pool, set up to run the thread root visits of suspended threads in
+  // parallel, or null if they should be done by the GC-running thread alone.
+  ThreadPool* GetThreadRootsVisitPool() const;
+  // Pop a ref from the mark stack that `self` pushes onto, or from a revoked thread-local mark
+  // stack left by another thread. Returns null if there is no work left. Used by parallel marking.
+  mirror::Object* PopParallelMarkStackRef(Thread* const self,
+                                          accounting::ObjectStack** stolen_mark_stack)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!mark_stack_lock_);
+  // Return a thread-local mark stack to the pool, or delete it if the pool is full.
+  void RecycleMarkStack(Thread* const self, accounting::ObjectStack* mark_stack)
+      REQUIRES(mark_stack_lock_);
   void GrayAllDirtyImmuneObjects()
       REQUIRES(Locks::mutator_lock_)
       REQUIRES(!mark_stack_lock_);
@@ -382,6 +412,9 @@ class ConcurrentCopying : public GarbageCollector {
                                 // without a lock. Other threads won't access the mark stack.
   };
   Atomic<MarkStackMode> mark_stack_mode_;
+  // True while GC worker threads are marking in parallel (processing the mark stack or scanning
+  // the cards of a young GC).
+  Atomic<bool> parallel_marking_active_;
   bool weak_ref_access_enabled_ GUARDED_BY(Locks::thread_list_lock_);
 
   // How many objects and bytes we moved. The GC thread moves many more objects
@@ -415,6 +448,35 @@ class ConcurrentCopying : public GarbageCollector {
   // reclaimed_bytes_ratio = reclaimed_bytes/num_allocated_bytes per GC cycle
   float reclaimed_bytes_ratio_sum_;
 
+  // Cumulative parallel marking statistics, indexed by marking task slot (slot 0 is usually picked
+  // up by the GC-running thread). Only written by the GC-running thread once all tasks of a round
+  // are done, and read by DumpPerformanceInfo (see the comment above gc_count_).
+  size_t parallel_mark_rounds_;
+  std::vector<uint64_t> parallel_mark_thread_time_ns_;
+  std::vector<uint64_t> parallel_mark_thread_objects_;
+
+  // Breakdown of the thread flip: suspending the threads, running the flip callback (the rest of
+  // the pause), and flipping the roots of the threads that stay suspended after the pause. Also the
+  // time to capture the thread roots for marking. Same access rules as the statistics above.
+  uint64_t flip_callback_start_ns_;
+  uint64_t flip_callback_end_ns_;
+  Histogram<uint64_t> flip_suspend_histogram_;
+  Histogram<uint64_t> flip_callback_histogram_;
+  Histogram<uint64_t> flip_suspended_threads_histogram_;
+  Histogram<uint64_t> capture_thread_roots_histogram_;
+
+  // Card scans of young GCs: the number of non-clean cards scanned, i.e. the size of the card-level
+  // remembered set, and the scan times. Same access rules as the statistics above.
+  uint64_t young_gen_card_scans_;
+  uint64_t young_gen_cards_scanned_sum_;
+  uint64_t max_young_gen_cards_scanned_;
+  Histogram<uint64_t> young_gen_card_scan_histogram_;
+
+  // The heap's class histogram while this collection counts the objects it marks, null otherwise.
+  // Only full-heap collections count. Set by the GC-running thread in InitializePhase and reset
+  // once the histogram is published.
+  ClassHistogram* class_histogram_;
+
   // The skipped blocks are memory blocks/chucks that were copies of
   // objects that were unused due to lost races (cas failures) at
   // object copy/forward pointer install. They may be reused.
@@ -474,6 +536,7 @@ class ConcurrentCopying : public GarbageCollector {
   template <bool kConcurrent> class GrayImmuneObjectVisitor;
   class ImmuneSpaceScanObjVisitor;
   class LostCopyVisitor;
+  class ParallelMarkTask;
   template <bool kNoUnEvac> class RefFieldsVisitor;
   class RevokeThreadLocalMarkStackCheckpoint;
   class ScopedGcGraysImmuneObjects;
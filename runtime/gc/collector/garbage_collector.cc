@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -331,6 +332,49 @@ void GarbageCollector::DumpPerformanceInfo(std::ostream& os) {
      << PrettySize(freed_bytes / cpu_seconds) << "/s\n";
 }
 
+void GarbageCollector::DumpPerformanceStats(std::ostream& os) {
+  const CumulativeLogger& logger = GetCumulativeTimings();
+  const size_t iterations = logger.GetIterations();
+  if (iterations == 0) {
+    return;
+  }
+  // Keys must not contain spaces, "concurrent copying" becomes "concurrent-copying".
+  std::string prefix = name_;
+  std::replace(prefix.begin(), prefix.end(), ' ', '-');
+  prefix += '.';
+  os << prefix << "iterations=" << iterations << "\n"
+     << prefix << "total-time-ns=" << logger.GetTotalNs() << "\n"
+     << prefix << "cpu-time-ns=" << GetTotalCpuTime() << "\n"
+     << prefix << "freed-bytes=" << GetTotalFreedBytes() << "\n"
+     << prefix << "freed-objects=" << GetTotalFreedObjects() << "\n"
+     << prefix << "throughput-bytes-per-sec=" << GetEstimatedMeanThroughput() << "\n";
+  {
+    MutexLock mu(Thread::Current(), pause_histogram_lock_);
+    os << prefix << "pause-count=" << pause_histogram_.SampleSize() << "\n"
+       << prefix << "paused-time-ns=" << pause_histogram_.AdjustedSum() << "\n";
+    if (pause_histogram_.SampleSize() > 0) {
+      Histogram<uint64_t>::CumulativeData cumulative_data;
+      pause_histogram_.CreateHistogram(&cumulative_data);
+      static constexpr std::pair<const char*, double> kPercentiles[] = {
+          { "p50", 0.50 }, { "p90", 0.90 }, { "p95", 0.95 }, { "p99", 0.99 } };
+      for (const auto& percentile : kPercentiles) {
+        os << prefix << "pause-" << percentile.first << "-ns="
+           << static_cast<uint64_t>(pause_histogram_.Percentile(percentile.second,
+                                                                cumulative_data))
+           << "\n";
+      }
+      os << prefix << "pause-max-ns=" << pause_histogram_.Max() << "\n";
+    }
+  }
+  // Only populated when the collector captures RSS at its peak, see
+  // ConcurrentCopying::CaptureRssAtPeak().
+  if (rss_histogram_.SampleSize() > 0) {
+    os << prefix << "peak-rss-mean-bytes=" << static_cast<uint64_t>(rss_histogram_.Mean() * KB)
+       << "\n"
+       << prefix << "peak-rss-max-bytes=" << rss_histogram_.Max() * KB << "\n";
+  }
+}
+
 }  // namespace collector
 }  // namespace gc
 }  // namespace art
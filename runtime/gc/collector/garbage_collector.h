@@ -110,6 +110,9 @@ class GarbageCollector : public RootVisitor, public IsMarkedVisitor, public Mark
   // Record a free of large objects.
   void RecordFreeLOS(const ObjectBytePair& freed);
   virtual void DumpPerformanceInfo(std::ostream& os) REQUIRES(!pause_histogram_lock_);
+  // Machine-readable counterpart of DumpPerformanceInfo(), writes one "<collector>.<key>=<value>"
+  // line per statistic. See Heap::DumpGcPerformanceStats().
+  void DumpPerformanceStats(std::ostream& os) REQUIRES(!pause_histogram_lock_);
 
   // Extract RSS for GC-specific memory ranges using mincore().
   uint64_t ExtractRssFromMincore(std::list<std::pair<void*, void*>>* gc_ranges);
@@ -223,7 +223,7 @@ void MarkSweep::PreCleanCards() {
     Thread* self = Thread::Current();
     CHECK(!Locks::mutator_lock_->IsExclusiveHeld(self));
     // Process dirty cards and add dirty cards to mod union tables, also ages cards.
-    heap_->ProcessCards(GetTimings(), false, true, false);
+    heap_->ProcessCards(GetTimings(), false, true, false, GetThreadCount(false));
     // The checkpoint root marking is required to avoid a race condition which occurs if the
     // following happens during a reference write:
     // 1. mutator dirties the card (write barrier)
@@ -284,7 +284,8 @@ void MarkSweep::MarkingPhase() {
   heap_->ProcessCards(GetTimings(),
                       /* use_rem_sets= */ false,
                       /* process_alloc_space_cards= */ true,
-                      /* clear_alloc_space_cards= */ GetGcType() != kGcTypeSticky);
+                      /* clear_alloc_space_cards= */ GetGcType() != kGcTypeSticky,
+                      GetThreadCount(false));
   WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
   MarkRoots(self);
   MarkReachableObjects();
@@ -312,7 +313,31 @@ class MarkSweep::ScanObjectVisitor {
   MarkSweep* const mark_sweep_;
 };
 
+// Marks with MarkObjectNonNullParallel(), for the mod-union tables updated by several threads.
+class MarkSweep::ParallelMarkObjectVisitor : public MarkObjectVisitor {
+ public:
+  explicit ParallelMarkObjectVisitor(MarkSweep* mark_sweep) : mark_sweep_(mark_sweep) {}
+
+  mirror::Object* MarkObject(mirror::Object* obj) override NO_THREAD_SAFETY_ANALYSIS {
+    if (obj != nullptr) {
+      mark_sweep_->MarkObjectNonNullParallel(obj);
+    }
+    return obj;
+  }
+
+  void MarkHeapReference(mirror::HeapReference<mirror::Object>* ref,
+                         bool do_atomic_update ATTRIBUTE_UNUSED) override
+      NO_THREAD_SAFETY_ANALYSIS {
+    MarkObject(ref->AsMirrorPtr());
+  }
+
+ private:
+  MarkSweep* const mark_sweep_;
+};
+
 void MarkSweep::UpdateAndMarkModUnion() {
+  const size_t thread_count = GetThreadCount(false);
+  ParallelMarkObjectVisitor parallel_visitor(this);
   for (const auto& space : immune_spaces_.GetSpaces()) {
     const char* name = space->IsZygoteSpace()
         ? "UpdateAndMarkZygoteModUnionTable"
@@ -320,7 +345,11 @@ void MarkSweep::UpdateAndMarkModUnion() {
     DCHECK(space->IsZygoteSpace() || space->IsImageSpace()) << *space;
     TimingLogger::ScopedTiming t(name, GetTimings());
     accounting::ModUnionTable* mod_union_table = heap_->FindModUnionTableFromSpace(space);
-    if (mod_union_table != nullptr) {
+    if (mod_union_table != nullptr && thread_count > 1) {
+      mod_union_table->UpdateAndMarkReferencesParallel(&parallel_visitor,
+                                                       heap_->GetThreadPool(),
+                                                       thread_count);
+    } else if (mod_union_table != nullptr) {
       mod_union_table->UpdateAndMarkReferences(this);
     } else {
       // No mod-union table, scan all the live bits. This can only occur for app images.
@@ -361,6 +361,7 @@ class MarkSweep : public GarbageCollector {
   class DelayReferenceReferentVisitor;
   template<bool kUseFinger> class MarkStackTask;
   class MarkObjectSlowPath;
+  class ParallelMarkObjectVisitor;
   class RecursiveMarkTask;
   class ScanObjectParallelVisitor;
   class ScanObjectVisitor;
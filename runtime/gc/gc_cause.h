@@ -62,6 +62,8 @@ enum GcCause {
   kGcCauseGetObjectsAllocated,
   // GC cause for the profile saver.
   kGcCauseProfileSaver,
+  // GC triggered to compact a fragmented space while the heap is idle.
+  kGcCauseBackgroundCompaction,
 };
 
 const char* PrettyCause(GcCause cause);
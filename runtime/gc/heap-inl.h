@@ -188,6 +188,10 @@ inline mirror::Object* Heap::AllocObjectWithAllocator(Thread* self,
       // Otherwise we'd have to perform this under a lock.
       l->ObjectAllocated(self, &obj, bytes_allocated);
     }
+    AllocationListener* sampler = alloc_sampling_listener_.load(std::memory_order_relaxed);
+    if (sampler != nullptr) {
+      sampler->ObjectAllocated(self, &obj, bytes_allocated);
+    }
   } else {
     DCHECK(!IsAllocTrackingEnabled());
   }
@@ -215,9 +219,6 @@ inline mirror::Object* Heap::AllocObjectWithAllocator(Thread* self,
   return obj.Ptr();
 }
 
-// The size of a thread-local allocation stack in the number of references.
-static constexpr size_t kThreadLocalAllocationStackSize = 128;
-
 inline void Heap::PushOnAllocationStack(Thread* self, ObjPtr<mirror::Object>* obj) {
   if (kUseThreadLocalAllocationStack) {
     if (UNLIKELY(!self->PushOnThreadLocalAllocationStack(obj->Ptr()))) {
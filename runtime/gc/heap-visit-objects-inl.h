@@ -108,8 +108,20 @@ inline void Heap::VisitObjectsInternal(Visitor&& visitor) {
     // Visit objects in bump pointer space.
     bump_pointer_space_->Walk(visitor);
   }
+  VisitAllocationStackObjects(allocation_stack_->Begin(), allocation_stack_->End(), visitor);
+  {
+    ReaderMutexLock mu(Thread::Current(), *Locks::heap_bitmap_lock_);
+    GetLiveBitmap()->Visit<Visitor>(visitor);
+  }
+}
+
+// Visit the valid objects of the allocation stack entries in [begin, end).
+template <typename Visitor>
+inline void Heap::VisitAllocationStackObjects(StackReference<mirror::Object>* begin,
+                                              StackReference<mirror::Object>* end,
+                                              Visitor&& visitor) {
   // TODO: Switch to standard begin and end to use ranged a based loop.
-  for (auto* it = allocation_stack_->Begin(), *end = allocation_stack_->End(); it < end; ++it) {
+  for (auto* it = begin; it < end; ++it) {
     mirror::Object* const obj = it->AsMirrorPtr();
 
     mirror::Class* kls = nullptr;
@@ -157,10 +169,6 @@ inline void Heap::VisitObjectsInternal(Visitor&& visitor) {
       visitor(obj);
     }
   }
-  {
-    ReaderMutexLock mu(Thread::Current(), *Locks::heap_bitmap_lock_);
-    GetLiveBitmap()->Visit<Visitor>(visitor);
-  }
 }
 
 }  // namespace gc
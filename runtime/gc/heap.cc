@@ -16,16 +16,19 @@
 
 #include "heap.h"
 
+#include <functional>
 #include <limits>
 #if defined(__BIONIC__) || defined(__GLIBC__)
 #include <malloc.h>  // For mallinfo()
 #endif
 #include <memory>
+#include <numeric>
 #include <vector>
 
 #include "android-base/stringprintf.h"
 
 #include "allocation_listener.h"
+#include "allocation_sampler.h"
 #include "art_field-inl.h"
 #include "backtrace_helper.h"
 #include "base/allocator.h"
@@ -41,6 +44,7 @@
 #include "base/systrace.h"
 #include "base/time_utils.h"
 #include "base/utils.h"
+#include "class_histogram.h"
 #include "common_throws.h"
 #include "debugger.h"
 #include "dex/dex_file-inl.h"
@@ -90,6 +94,7 @@
 #include "runtime.h"
 #include "scoped_thread_state_change-inl.h"
 #include "thread_list.h"
+#include "thread_pool.h"
 #include "verify_object-inl.h"
 #include "well_known_classes.h"
 
@@ -145,6 +150,19 @@ static constexpr bool kLogAllGCs = false;
 static constexpr size_t kPartialTlabSize = 16 * KB;
 static constexpr bool kUsePartialTlabs = true;
 
+// If true, the TLAB refill size (kDefaultTLABSize or kPartialTlabSize initially) adapts per
+// thread. It doubles every kTlabRefillsToGrow refills between two GCs, and halves at the first
+// refill after a GC if the thread refilled fewer than kTlabRefillsToShrink times during the
+// previous GC cycle and wasted more than its refill size. Under region TLABs, a thread whose
+// refill size dropped to the minimum allocates from the shared region instead of claiming a whole
+// region that it would mostly strand. Its refill size doubles again at the first refill after a GC
+// if it allocated as much as kTlabRefillsToGrow refills from the shared region in the meantime.
+static constexpr bool kUseAdaptiveTlabSize = true;
+static constexpr size_t kMinAdaptiveTlabSize = 4 * KB;
+static constexpr size_t kMaxAdaptiveTlabSize = 128 * KB;
+static constexpr uint64_t kTlabRefillsToGrow = 8;
+static constexpr uint64_t kTlabRefillsToShrink = 2;
+
 // Use Max heap for 2 seconds, this is smaller than the usual 5s window since we don't want to leave
 // allocate with relaxed ergonomics for that long.
 static constexpr size_t kPostForkMaxHeapDurationMS = 2000;
@@ -186,9 +204,13 @@ Heap::Heap(size_t initial_size,
            size_t large_object_threshold,
            size_t parallel_gc_threads,
            size_t conc_gc_threads,
+           size_t cc_parallel_mark_threads,
+           size_t parallel_reference_clearing_threads,
            bool low_memory_mode,
            size_t long_pause_log_threshold,
            size_t long_gc_log_threshold,
+           double gc_cpu_percent_target,
+           uint64_t gc_pause_time_target,
            bool ignore_target_footprint,
            bool use_tlab,
            bool verify_pre_gc_heap,
@@ -197,6 +219,7 @@ Heap::Heap(size_t initial_size,
            bool verify_pre_gc_rosalloc,
            bool verify_pre_sweeping_rosalloc,
            bool verify_post_gc_rosalloc,
+           bool parallel_heap_verification,
            bool gc_stress_mode,
            bool measure_gc_performance,
            bool use_homogeneous_space_compaction_for_oom,
@@ -204,6 +227,7 @@ Heap::Heap(size_t initial_size,
            uint64_t min_interval_homogeneous_space_compaction_by_oom,
            bool dump_region_info_before_gc,
            bool dump_region_info_after_gc,
+           size_t region_space_resident_budget,
            space::ImageSpaceLoadingOrder image_space_loading_order)
     : non_moving_space_(nullptr),
       rosalloc_space_(nullptr),
@@ -216,9 +240,17 @@ Heap::Heap(size_t initial_size,
       pending_task_lock_(nullptr),
       parallel_gc_threads_(parallel_gc_threads),
       conc_gc_threads_(conc_gc_threads),
+      cc_parallel_mark_threads_(cc_parallel_mark_threads),
+      parallel_reference_clearing_threads_(parallel_reference_clearing_threads),
       low_memory_mode_(low_memory_mode),
       long_pause_log_threshold_(long_pause_log_threshold),
       long_gc_log_threshold_(long_gc_log_threshold),
+      gc_cpu_percent_target_(gc_cpu_percent_target),
+      gc_pause_time_target_(gc_pause_time_target),
+      heap_growth_controller_factor_(1.0),
+      heap_growth_controller_gc_cpu_percent_(0.0),
+      heap_growth_controller_last_gc_cpu_time_ns_(0u),
+      heap_growth_controller_last_process_cpu_time_ns_(ProcessCpuNanoTime()),
       process_cpu_start_time_ns_(ProcessCpuNanoTime()),
       pre_gc_last_process_cpu_time_ns_(process_cpu_start_time_ns_),
       post_gc_last_process_cpu_time_ns_(process_cpu_start_time_ns_),
@@ -246,6 +278,11 @@ Heap::Heap(size_t initial_size,
       old_native_bytes_allocated_(0),
       native_objects_notified_(0),
       num_bytes_freed_revoke_(0),
+      gcs_completed_(0u),
+      tlab_refills_(0u),
+      tlab_wasted_bytes_(0u),
+      alloc_stack_refills_(0u),
+      alloc_stack_overflow_gcs_(0u),
       verify_missing_card_marks_(false),
       verify_system_weaks_(false),
       verify_pre_gc_heap_(verify_pre_gc_heap),
@@ -255,6 +292,7 @@ Heap::Heap(size_t initial_size,
       verify_pre_gc_rosalloc_(verify_pre_gc_rosalloc),
       verify_pre_sweeping_rosalloc_(verify_pre_sweeping_rosalloc),
       verify_post_gc_rosalloc_(verify_post_gc_rosalloc),
+      parallel_heap_verification_(parallel_heap_verification),
       gc_stress_mode_(gc_stress_mode),
       /* For GC a lot mode, we limit the allocation stacks to be kGcAlotInterval allocations. This
        * causes a lot of GC since we do a GC for alloc whenever the stack is full. When heap
@@ -289,6 +327,12 @@ Heap::Heap(size_t initial_size,
       last_time_homogeneous_space_compaction_by_oom_(NanoTime()),
       pending_collector_transition_(nullptr),
       pending_heap_trim_(nullptr),
+      pending_region_release_(nullptr),
+      pending_background_compaction_(nullptr),
+      background_compaction_cpu_budget_(0.0),
+      background_compaction_start_ns_(0u),
+      background_compaction_cpu_ns_(0u),
+      background_compaction_count_(0u),
       use_homogeneous_space_compaction_for_oom_(use_homogeneous_space_compaction_for_oom),
       use_generational_cc_(use_generational_cc),
       running_collection_is_blocking_(false),
@@ -308,7 +352,8 @@ Heap::Heap(size_t initial_size,
       unique_backtrace_count_(0u),
       gc_disabled_for_shutdown_(false),
       dump_region_info_before_gc_(dump_region_info_before_gc),
-      dump_region_info_after_gc_(dump_region_info_after_gc) {
+      dump_region_info_after_gc_(dump_region_info_after_gc),
+      class_histogram_(nullptr) {
   if (VLOG_IS_ON(heap) || VLOG_IS_ON(startup)) {
     LOG(INFO) << "Heap() entering";
   }
@@ -502,6 +547,7 @@ Heap::Heap(size_t initial_size,
     CHECK(region_space_mem_map.IsValid()) << "No region space mem map";
     region_space_ = space::RegionSpace::Create(
         kRegionSpaceName, std::move(region_space_mem_map), use_generational_cc_);
+    region_space_->SetResidentFreeRegionBudget(region_space_resident_budget);
     AddSpace(region_space_);
   } else if (IsMovingGc(foreground_collector_type_)) {
     // Create bump pointer spaces.
@@ -943,7 +989,11 @@ void Heap::UpdateProcessState(ProcessState old_process_state, ProcessState new_p
 }
 
 void Heap::CreateThreadPool() {
-  const size_t num_threads = std::max(parallel_gc_threads_, conc_gc_threads_);
+  const size_t num_threads =
+      std::max({parallel_gc_threads_,
+                conc_gc_threads_,
+                cc_parallel_mark_threads_,
+                parallel_reference_clearing_threads_});
   if (num_threads != 0) {
     thread_pool_.reset(new ThreadPool("Heap thread pool", num_threads));
   }
@@ -1110,6 +1160,24 @@ void Heap::DumpGcPerformanceInfo(std::ostream& os) {
   os << "Total GC time: " << PrettyDuration(GetGcTime()) << "\n";
   os << "Total blocking GC count: " << GetBlockingGcCount() << "\n";
   os << "Total blocking GC time: " << PrettyDuration(GetBlockingGcTime()) << "\n";
+  os << "Total TLAB refills: " << tlab_refills_.load(std::memory_order_relaxed) << "\n";
+  os << "Total TLAB bytes wasted: "
+     << PrettySize(tlab_wasted_bytes_.load(std::memory_order_relaxed)) << "\n";
+  os << "Total allocation stack refills: "
+     << alloc_stack_refills_.load(std::memory_order_relaxed) << "\n";
+  os << "Total allocation stack overflow GCs: "
+     << alloc_stack_overflow_gcs_.load(std::memory_order_relaxed) << "\n";
+  for (const auto& entry : mod_union_tables_) {
+    entry.second->DumpStats(os);
+  }
+  if (background_compaction_cpu_budget_ != 0.0) {
+    os << "Background compactions: " << background_compaction_count_.load() << " CPU time: "
+       << PrettyDuration(background_compaction_cpu_ns_.load(std::memory_order_relaxed)) << "\n";
+  }
+  if (IsHeapGrowthControllerEnabled()) {
+    os << "Heap growth controller factor: " << heap_growth_controller_factor_
+       << " GC CPU: " << heap_growth_controller_gc_cpu_percent_ << "%\n";
+  }
 
   {
     MutexLock mu(Thread::Current(), *gc_complete_lock_);
@@ -1130,15 +1198,63 @@ void Heap::DumpGcPerformanceInfo(std::ostream& os) {
     rosalloc_space_->DumpStats(os);
   }
 
+  if (large_object_space_ != nullptr) {
+    large_object_space_->DumpFragmentationInfo(os);
+  }
+
+  if (region_space_ != nullptr) {
+    os << "Region space page faults avoided by resident free regions: "
+       << region_space_->GetResidentPagesReused()
+       << " bytes released: " << PrettySize(region_space_->GetReleasedBytes()) << "\n";
+  }
+
   os << "Native bytes total: " << GetNativeBytes()
      << " registered: " << native_bytes_registered_.load(std::memory_order_relaxed) << "\n";
 
   os << "Total native bytes at last GC: "
      << old_native_bytes_allocated_.load(std::memory_order_relaxed) << "\n";
 
+  AllocationSampler* sampler = allocation_sampler_.load(std::memory_order_acquire);
+  if (sampler != nullptr) {
+    sampler->DumpStats(os);
+  }
+
   BaseMutex::DumpAll(os);
 }
 
+void Heap::DumpGcPerformanceStats(std::ostream& os) {
+  uint64_t total_paused_time = 0;
+  for (auto* collector : garbage_collectors_) {
+    total_paused_time += collector->GetTotalPausedTimeNs();
+    collector->DumpPerformanceStats(os);
+  }
+  os << "heap.gc-count=" << GetGcCount() << "\n"
+     << "heap.gc-time-ns=" << GetGcTime() << "\n"
+     << "heap.gc-cpu-time-ns=" << GetTotalGcCpuTime() << "\n"
+     << "heap.blocking-gc-count=" << GetBlockingGcCount() << "\n"
+     << "heap.blocking-gc-time-ns=" << GetBlockingGcTime() << "\n"
+     << "heap.paused-time-ns=" << total_paused_time << "\n"
+     << "heap.wait-time-ns=" << total_wait_time_ << "\n"
+     << "heap.objects-allocated=" << GetObjectsAllocatedEver() << "\n"
+     << "heap.bytes-allocated=" << GetBytesAllocatedEver() << "\n"
+     << "heap.objects-freed=" << GetObjectsFreedEver() << "\n"
+     << "heap.bytes-freed=" << GetBytesFreedEver() << "\n"
+     << "heap.total-memory=" << GetTotalMemory() << "\n"
+     << "heap.free-memory=" << GetFreeMemory() << "\n"
+     << "heap.max-memory=" << GetMaxMemory() << "\n"
+     << "heap.native-bytes=" << GetNativeBytes() << "\n";
+  if (region_space_ != nullptr) {
+    os << "heap.region-page-faults-avoided=" << region_space_->GetResidentPagesReused() << "\n"
+       << "heap.region-bytes-released=" << region_space_->GetReleasedBytes() << "\n";
+  }
+  if (IsHeapGrowthControllerEnabled()) {
+    os << "heap.growth-controller-factor-permille="
+       << static_cast<uint64_t>(heap_growth_controller_factor_ * 1000) << "\n"
+       << "heap.growth-controller-gc-cpu-permille="
+       << static_cast<uint64_t>(heap_growth_controller_gc_cpu_percent_ * 10) << "\n";
+  }
+}
+
 void Heap::ResetGcPerformanceInfo() {
   for (auto* collector : garbage_collectors_) {
     collector->ResetMeasurements();
@@ -1159,6 +1275,13 @@ void Heap::ResetGcPerformanceInfo() {
   blocking_gc_time_ = 0;
   gc_count_last_window_ = 0;
   blocking_gc_count_last_window_ = 0;
+  tlab_refills_.store(0u, std::memory_order_relaxed);
+  tlab_wasted_bytes_.store(0u, std::memory_order_relaxed);
+  alloc_stack_refills_.store(0u, std::memory_order_relaxed);
+  alloc_stack_overflow_gcs_.store(0u, std::memory_order_relaxed);
+  for (const auto& entry : mod_union_tables_) {
+    entry.second->ResetStats();
+  }
   last_update_time_gc_count_rate_histograms_ =  // Round down by the window duration.
       (NanoTime() / kGcCountRateHistogramWindowDuration) * kGcCountRateHistogramWindowDuration;
   {
@@ -1218,6 +1341,8 @@ Heap::~Heap() {
   // If we don't reset then the mark stack complains in its destructor.
   allocation_stack_->Reset();
   allocation_records_.reset();
+  delete allocation_sampler_.load(std::memory_order_relaxed);
+  delete class_histogram_.load(std::memory_order_relaxed);
   live_stack_->Reset();
   STLDeleteValues(&mod_union_tables_);
   STLDeleteValues(&remembered_sets_);
@@ -2549,6 +2674,9 @@ collector::GcType Heap::CollectGarbageInternal(collector::GcType gc_type,
   total_bytes_freed_ever_ += GetCurrentGcIteration()->GetFreedBytes() +
       GetCurrentGcIteration()->GetFreedLargeObjectBytes();
   RequestTrim(self);
+  RequestLargeObjectFree(self);
+  RequestRegionRelease(self);
+  RequestBackgroundCompaction(self);
   // Collect cleared references.
   SelfDeletingTask* clear = reference_processor_->CollectClearedReferences(self);
   // Grow the heap so that we know when to perform the next GC.
@@ -2596,6 +2724,8 @@ void Heap::LogGC(GcCause gc_cause, collector::GarbageCollector* collector) {
       pause_string << PrettyDuration((pause_times[i] / 1000) * 1000)
                    << ((i != pause_times.size() - 1) ? "," : "");
     }
+    std::ostringstream reference_string;
+    reference_processor_->DumpLastStats(reference_string);
     LOG(INFO) << gc_cause << " " << collector->GetName()
               << " GC freed "  << current_gc_iteration_.GetFreedObjects() << "("
               << PrettySize(current_gc_iteration_.GetFreedBytes()) << ") AllocSpace objects, "
@@ -2603,7 +2733,8 @@ void Heap::LogGC(GcCause gc_cause, collector::GarbageCollector* collector) {
               << PrettySize(current_gc_iteration_.GetFreedLargeObjectBytes()) << ") LOS objects, "
               << percent_free << "% free, " << PrettySize(current_heap_size) << "/"
               << PrettySize(total_memory) << ", " << "paused " << pause_string.str()
-              << " total " << PrettyDuration((duration / 1000) * 1000);
+              << " total " << PrettyDuration((duration / 1000) * 1000) << ", "
+              << reference_string.str();
     VLOG(heap) << Dumpable<TimingLogger>(*current_gc_iteration_.GetTimings());
   }
 }
@@ -2615,6 +2746,7 @@ void Heap::FinishGC(Thread* self, collector::GcType gc_type) {
     last_gc_type_ = gc_type;
 
     // Update stats.
+    gcs_completed_.fetch_add(1u, std::memory_order_relaxed);
     ++gc_count_last_window_;
     if (running_collection_is_blocking_) {
       // If the currently running collection was a blocking one,
@@ -2891,18 +3023,38 @@ void Heap::PushOnAllocationStackWithInternalGC(Thread* self, ObjPtr<mirror::Obje
     // to heap verification requiring that roots are live (either in the live bitmap or in the
     // allocation stack).
     CHECK(allocation_stack_->AtomicPushBackIgnoreGrowthLimit(obj->Ptr()));
+    alloc_stack_overflow_gcs_.fetch_add(1u, std::memory_order_relaxed);
     CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseForAlloc, false);
   } while (!allocation_stack_->AtomicPushBack(obj->Ptr()));
 }
 
+// Thread-local allocation stacks start small and double with every refill of the same thread, up
+// to the max size, so that the threads allocating the most bump the shared back index the least.
+// The sizes are reset when the GC revokes the thread-local allocation stacks.
+static constexpr size_t kThreadLocalAllocationStackMinSize = 128;
+static constexpr size_t kThreadLocalAllocationStackMaxSize = 4 * KB;
+// A refill takes at most this fraction of the free slots, which bounds the slots left unused by
+// threads that stop allocating.
+static constexpr size_t kThreadLocalAllocationStackFreeSlotsFraction = 64;
+
 void Heap::PushOnThreadLocalAllocationStackWithInternalGC(Thread* self,
                                                           ObjPtr<mirror::Object>* obj) {
   // Slow path, the allocation stack push back must have already failed.
   DCHECK(!self->PushOnThreadLocalAllocationStack(obj->Ptr()));
+  size_t num_slots = std::min(2 * self->GetThreadLocalAllocationStackChunkSize(),
+                              kThreadLocalAllocationStackMaxSize);
+  const size_t free_slots = allocation_stack_->FreeSlots();
+  num_slots = std::min(num_slots, free_slots / kThreadLocalAllocationStackFreeSlotsFraction);
+  num_slots = std::max(num_slots, kThreadLocalAllocationStackMinSize);
   StackReference<mirror::Object>* start_address;
   StackReference<mirror::Object>* end_address;
-  while (!allocation_stack_->AtomicBumpBack(kThreadLocalAllocationStackSize, &start_address,
-                                            &end_address)) {
+  while (!allocation_stack_->AtomicBumpBack(num_slots, &start_address, &end_address)) {
+    if (num_slots > kThreadLocalAllocationStackMinSize) {
+      // Other threads took the free slots since we sized the refill, use what is left before
+      // resorting to a GC.
+      num_slots = kThreadLocalAllocationStackMinSize;
+      continue;
+    }
     // TODO: Add handle VerifyObject.
     StackHandleScope<1> hs(self);
     HandleWrapperObjPtr<mirror::Object> wrapper(hs.NewHandleWrapper(obj));
@@ -2911,13 +3063,114 @@ void Heap::PushOnThreadLocalAllocationStackWithInternalGC(Thread* self,
     // allocation stack).
     CHECK(allocation_stack_->AtomicPushBackIgnoreGrowthLimit(obj->Ptr()));
     // Push into the reserve allocation stack.
+    alloc_stack_overflow_gcs_.fetch_add(1u, std::memory_order_relaxed);
     CollectGarbageInternal(collector::kGcTypeSticky, kGcCauseForAlloc, false);
   }
+  alloc_stack_refills_.fetch_add(1u, std::memory_order_relaxed);
   self->SetThreadLocalAllocationStack(start_address, end_address);
   // Retry on the new thread-local allocation stack.
   CHECK(self->PushOnThreadLocalAllocationStack(obj->Ptr()));  // Must succeed.
 }
 
+// Granularity of the work split of GetObjectVisitChunks.
+static constexpr size_t kObjectVisitRegionsPerChunk = 16;
+static constexpr size_t kObjectVisitStackEntriesPerChunk = 16 * KB;
+static constexpr size_t kObjectVisitBitmapBytesPerChunk = 4 * MB;
+
+std::vector<Heap::ObjectVisitChunk> Heap::GetObjectVisitChunks(Thread* self) {
+  Locks::mutator_lock_->AssertExclusiveHeld(self);
+  // The threads visiting the chunks run on behalf of this thread, which keeps the mutators
+  // suspended until all the chunks are visited, so they can walk the spaces without holding the
+  // mutator lock themselves.
+  using ObjectCallback = std::function<void(mirror::Object*)>;
+  std::vector<ObjectVisitChunk> chunks;
+  if (region_space_ != nullptr) {
+    const size_t num_regions = region_space_->GetNumRegions();
+    for (size_t begin = 0; begin < num_regions; begin += kObjectVisitRegionsPerChunk) {
+      const size_t end = std::min(begin + kObjectVisitRegionsPerChunk, num_regions);
+      chunks.push_back([this, begin, end](const ObjectCallback& callback)
+          NO_THREAD_SAFETY_ANALYSIS {
+        region_space_->WalkRegions(begin, end, callback);
+      });
+    }
+  }
+  if (bump_pointer_space_ != nullptr) {
+    chunks.push_back([this](const ObjectCallback& callback) NO_THREAD_SAFETY_ANALYSIS {
+      bump_pointer_space_->Walk(callback);
+    });
+  }
+  StackReference<mirror::Object>* const stack_begin = allocation_stack_->Begin();
+  const size_t stack_size = allocation_stack_->Size();
+  for (size_t begin = 0; begin < stack_size; begin += kObjectVisitStackEntriesPerChunk) {
+    const size_t end = std::min(begin + kObjectVisitStackEntriesPerChunk, stack_size);
+    chunks.push_back([this, stack_begin, begin, end](const ObjectCallback& callback)
+        NO_THREAD_SAFETY_ANALYSIS {
+      VisitAllocationStackObjects(stack_begin + begin, stack_begin + end, callback);
+    });
+  }
+  {
+    // The bitmaps cannot be added or removed while the mutators are suspended, the lock is only
+    // taken to read the lists.
+    ReaderMutexLock mu(self, *Locks::heap_bitmap_lock_);
+    for (accounting::ContinuousSpaceBitmap* bitmap : GetLiveBitmap()->continuous_space_bitmaps_) {
+      const uintptr_t limit = static_cast<uintptr_t>(bitmap->HeapLimit());
+      for (uintptr_t begin = bitmap->HeapBegin(); begin < limit;
+           begin += kObjectVisitBitmapBytesPerChunk) {
+        const uintptr_t end = std::min(begin + kObjectVisitBitmapBytesPerChunk, limit);
+        chunks.push_back([bitmap, begin, end](const ObjectCallback& callback)
+            NO_THREAD_SAFETY_ANALYSIS {
+          ReaderMutexLock mu2(Thread::Current(), *Locks::heap_bitmap_lock_);
+          bitmap->VisitMarkedRange(begin, end, callback);
+        });
+      }
+    }
+    for (accounting::LargeObjectBitmap* bitmap : GetLiveBitmap()->large_object_bitmaps_) {
+      chunks.push_back([bitmap](const ObjectCallback& callback) NO_THREAD_SAFETY_ANALYSIS {
+        ReaderMutexLock mu2(Thread::Current(), *Locks::heap_bitmap_lock_);
+        bitmap->VisitMarkedRange(bitmap->HeapBegin(), bitmap->HeapLimit(), callback);
+      });
+    }
+  }
+  return chunks;
+}
+
+size_t Heap::VerifyObjectsParallel(Thread* self, bool verify_referents) {
+  Locks::mutator_lock_->AssertExclusiveHeld(self);
+  DCHECK(thread_pool_ != nullptr);
+  std::vector<ObjectVisitChunk> chunks = GetObjectVisitChunks(self);
+  if (chunks.empty()) {
+    return 0u;
+  }
+
+  // Each task claims chunks until there are none left and counts its failures separately since
+  // VerifyReferenceVisitor requires the fail count to be private to the calling thread.
+  const size_t num_tasks = std::min(thread_pool_->GetThreadCount() + 1u, chunks.size());
+  std::vector<size_t> fail_counts(num_tasks, 0u);
+  Atomic<size_t> next_chunk(0u);
+  auto verify_chunks = [&](size_t task) NO_THREAD_SAFETY_ANALYSIS {
+    VerifyObjectVisitor visitor(Thread::Current(), this, &fail_counts[task], verify_referents);
+    std::function<void(mirror::Object*)> callback = [&visitor](mirror::Object* obj)
+        NO_THREAD_SAFETY_ANALYSIS {
+      visitor(obj);
+    };
+    for (size_t i = next_chunk.fetch_add(1u, std::memory_order_relaxed);
+         i < chunks.size();
+         i = next_chunk.fetch_add(1u, std::memory_order_relaxed)) {
+      chunks[i](callback);
+    }
+  };
+  for (size_t task = 0; task < num_tasks; ++task) {
+    thread_pool_->AddTask(self, new FunctionTask([&verify_chunks, task](Thread*) {
+      verify_chunks(task);
+    }));
+  }
+  thread_pool_->SetMaxActiveWorkers(num_tasks - 1u);
+  thread_pool_->StartWorkers(self);
+  thread_pool_->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+  thread_pool_->StopWorkers(self);
+  return std::accumulate(fail_counts.begin(), fail_counts.end(), static_cast<size_t>(0u));
+}
+
 // Must do this with mutators suspended since we are directly accessing the allocation stacks.
 size_t Heap::VerifyHeapReferences(bool verify_referents) {
   Thread* self = Thread::Current();
@@ -2935,7 +3188,11 @@ size_t Heap::VerifyHeapReferences(bool verify_referents) {
   // 2. Allocated during the GC (pre sweep GC verification).
   // We don't want to verify the objects in the live stack since they themselves may be
   // pointing to dead objects if they are not reachable.
-  VisitObjectsPaused(visitor);
+  if (parallel_heap_verification_ && thread_pool_ != nullptr) {
+    fail_count += VerifyObjectsParallel(self, verify_referents);
+  } else {
+    VisitObjectsPaused(visitor);
+  }
   // Verify the roots:
   visitor.VerifyRoots();
   if (visitor.GetFailureCount() > 0) {
@@ -3125,7 +3382,8 @@ accounting::RememberedSet* Heap::FindRememberedSetFromSpace(space::Space* space)
 void Heap::ProcessCards(TimingLogger* timings,
                         bool use_rem_sets,
                         bool process_alloc_space_cards,
-                        bool clear_alloc_space_cards) {
+                        bool clear_alloc_space_cards,
+                        size_t thread_count) {
   TimingLogger::ScopedTiming t(__FUNCTION__, timings);
   // Clear cards and keep track of cards cleared in the mod-union table.
   for (const auto& space : continuous_spaces_) {
@@ -3135,7 +3393,11 @@ void Heap::ProcessCards(TimingLogger* timings,
       const char* name = space->IsZygoteSpace() ? "ZygoteModUnionClearCards" :
           "ImageModUnionClearCards";
       TimingLogger::ScopedTiming t2(name, timings);
-      table->ProcessCards();
+      if (thread_pool_ != nullptr && thread_count > 1u) {
+        table->ProcessCardsParallel(thread_pool_.get(), thread_count);
+      } else {
+        table->ProcessCards();
+      }
     } else if (use_rem_sets && rem_set != nullptr) {
       DCHECK(collector::SemiSpace::kUseRememberedSet) << static_cast<int>(collector_type_);
       TimingLogger::ScopedTiming t2("AllocSpaceRemSetClearCards", timings);
@@ -3399,8 +3661,11 @@ void Heap::GrowForUtilization(collector::GarbageCollector* collector_ran,
   uint64_t target_size;
   collector::GcType gc_type = collector_ran->GetGcType();
   // Use the multiplier to grow more for foreground.
-  const double multiplier = HeapGrowthMultiplier();  // Use the multiplier to grow more for
-  // foreground.
+  double multiplier = HeapGrowthMultiplier();
+  if (IsHeapGrowthControllerEnabled()) {
+    UpdateHeapGrowthController();
+    multiplier *= heap_growth_controller_factor_;
+  }
   const size_t adjusted_min_free = static_cast<size_t>(min_free_ * multiplier);
   const size_t adjusted_max_free = static_cast<size_t>(max_free_ * multiplier);
   if (gc_type != collector::kGcTypeSticky) {
@@ -3481,6 +3746,66 @@ void Heap::GrowForUtilization(collector::GarbageCollector* collector_ran,
   }
 }
 
+void Heap::UpdateHeapGrowthController() {
+  const uint64_t gc_cpu_time = GetTotalGcCpuTime();
+  const uint64_t process_cpu_time = ProcessCpuNanoTime();
+  if (gc_cpu_time < heap_growth_controller_last_gc_cpu_time_ns_ ||
+      process_cpu_time <= heap_growth_controller_last_process_cpu_time_ns_) {
+    // The GC performance info was reset, start a new measurement window.
+    heap_growth_controller_last_gc_cpu_time_ns_ = gc_cpu_time;
+    heap_growth_controller_last_process_cpu_time_ns_ = process_cpu_time;
+    return;
+  }
+  const double gc_cpu_percent = 100.0 *
+      static_cast<double>(gc_cpu_time - heap_growth_controller_last_gc_cpu_time_ns_) /
+      static_cast<double>(process_cpu_time - heap_growth_controller_last_process_cpu_time_ns_);
+  heap_growth_controller_last_gc_cpu_time_ns_ = gc_cpu_time;
+  heap_growth_controller_last_process_cpu_time_ns_ = process_cpu_time;
+  // Smooth the CPU usage over the last few GCs.
+  heap_growth_controller_gc_cpu_percent_ = (heap_growth_controller_gc_cpu_percent_ == 0.0)
+      ? gc_cpu_percent
+      : (heap_growth_controller_gc_cpu_percent_ + gc_cpu_percent) / 2;
+  uint64_t max_pause = 0u;
+  for (uint64_t pause : current_gc_iteration_.GetPauseTimes()) {
+    max_pause = std::max(max_pause, pause);
+  }
+
+  // Ratio by which the free space should change. The GC cost per allocated byte is roughly
+  // inversely proportional to the free space, while the pauses grow with the amount of memory a
+  // GC has to process.
+  double adjustment = 1.0;
+  const char* reason = "on target";
+  if (gc_pause_time_target_ != 0u && max_pause > gc_pause_time_target_) {
+    adjustment = static_cast<double>(gc_pause_time_target_) / max_pause;
+    reason = "pause above target";
+  } else if (gc_cpu_percent_target_ != 0.0) {
+    adjustment = heap_growth_controller_gc_cpu_percent_ / gc_cpu_percent_target_;
+    reason = adjustment > 1.0 ? "GC CPU above target" : "GC CPU below target";
+    if (gc_pause_time_target_ != 0u && adjustment > 1.0) {
+      // Do not grow past what the pause goal allows.
+      adjustment = std::min(adjustment, static_cast<double>(gc_pause_time_target_) /
+                                        std::max<uint64_t>(max_pause, 1u));
+    }
+  } else if (heap_growth_controller_factor_ < 1.0) {
+    // Pause goal only: recover the default sizing while the pauses allow it.
+    adjustment = std::min(1.0 / heap_growth_controller_factor_,
+                          static_cast<double>(gc_pause_time_target_) /
+                          std::max<uint64_t>(max_pause, 1u));
+    reason = "pause below target";
+  }
+  // Move half way to the adjustment, bounded per GC, to avoid oscillating.
+  adjustment = std::min(std::max(adjustment, 0.5), 2.0);
+  const double old_factor = heap_growth_controller_factor_;
+  heap_growth_controller_factor_ = std::min(
+      std::max(old_factor * (1.0 + (adjustment - 1.0) / 2), kMinHeapGrowthControllerFactor),
+      kMaxHeapGrowthControllerFactor);
+  VLOG(heap) << "Heap growth controller: " << reason << ", GC CPU "
+             << heap_growth_controller_gc_cpu_percent_ << "% (target " << gc_cpu_percent_target_
+             << "%), max pause " << PrettyDuration(max_pause) << " (target "
+             << PrettyDuration(gc_pause_time_target_) << "), factor " << old_factor << " -> "
+             << heap_growth_controller_factor_;
+}
+
 void Heap::ClampGrowthLimit() {
   // Use heap bitmap lock to guard against races with BindLiveToMarkBitmap.
   ScopedObjectAccess soa(Thread::Current());
@@ -3689,6 +4014,222 @@ void Heap::RequestTrim(Thread* self) {
   task_processor_->AddTask(self, added_task);
 }
 
+class Heap::LargeObjectFreeTask : public HeapTask {
+ public:
+  LargeObjectFreeTask() : HeapTask(NanoTime()) { }
+  void Run(Thread* self) override {
+    Runtime::Current()->GetHeap()->GetLargeObjectsSpace()->FreePendingObjects(self);
+  }
+};
+
+void Heap::RequestLargeObjectFree(Thread* self) {
+  // The large object space sweep only records the dead objects, release their memory off the GC
+  // thread. If no task can be added, the objects are freed by the next sweep or when a large
+  // object allocation does not fit.
+  if (large_object_space_ == nullptr ||
+      !large_object_space_->HasPendingObjects() ||
+      !CanAddHeapTask(self)) {
+    return;
+  }
+  task_processor_->AddTask(self, new LargeObjectFreeTask());
+}
+
+class Heap::RegionReleaseTask : public HeapTask {
+ public:
+  explicit RegionReleaseTask(uint64_t bytes_allocated_ever)
+      : HeapTask(NanoTime() + kRegionReleaseWait), bytes_allocated_ever_(bytes_allocated_ever) { }
+  void Run(Thread* self) override {
+    gc::Heap* heap = Runtime::Current()->GetHeap();
+    {
+      MutexLock mu(self, *heap->pending_task_lock_);
+      heap->pending_region_release_ = nullptr;
+    }
+    // Only release while the mutators are mostly idle. Otherwise, the resident regions are likely
+    // to be allocated soon and releasing them would cost the page faults they are kept for. The
+    // task is not re-queued: the resident regions never exceed the budget, and the next GC, which
+    // may free more of them, queues it again.
+    if (heap->GetBytesAllocatedEver() - bytes_allocated_ever_ >= kRegionReleaseChunkSize) {
+      return;
+    }
+    // Release a chunk at a time, as ReleaseResidentFreeRegions holds the region lock.
+    size_t released = 0;
+    for (size_t chunk = heap->region_space_->ReleaseResidentFreeRegions(kRegionReleaseChunkSize);
+         chunk != 0;
+         chunk = heap->region_space_->ReleaseResidentFreeRegions(kRegionReleaseChunkSize)) {
+      released += chunk;
+    }
+    VLOG(heap) << "Released " << PrettySize(released) << " of resident free regions";
+  }
+
+ private:
+  const uint64_t bytes_allocated_ever_;
+};
+
+void Heap::RequestRegionRelease(Thread* self) {
+  // Release the resident free regions if they go kRegionReleaseWait without the heap allocating.
+  // Called after each GC.
+  if (region_space_ == nullptr ||
+      !region_space_->HasResidentFreeRegions() ||
+      !CanAddHeapTask(self)) {
+    return;
+  }
+  RegionReleaseTask* added_task = nullptr;
+  {
+    MutexLock mu(self, *pending_task_lock_);
+    if (pending_region_release_ != nullptr) {
+      return;
+    }
+    added_task = new RegionReleaseTask(GetBytesAllocatedEver());
+    pending_region_release_ = added_task;
+  }
+  task_processor_->AddTask(self, added_task);
+}
+
+class Heap::BackgroundCompactionTask : public HeapTask {
+ public:
+  explicit BackgroundCompactionTask(uint64_t bytes_allocated_ever)
+      : HeapTask(NanoTime() + kBackgroundCompactionWait),
+        bytes_allocated_ever_(bytes_allocated_ever) { }
+  void Run(Thread* self) override {
+    gc::Heap* heap = Runtime::Current()->GetHeap();
+    {
+      MutexLock mu(self, *heap->pending_task_lock_);
+      heap->pending_background_compaction_ = nullptr;
+    }
+    heap->DoBackgroundCompaction(self, bytes_allocated_ever_);
+  }
+
+ private:
+  const uint64_t bytes_allocated_ever_;
+};
+
+void Heap::RequestBackgroundCompaction(Thread* self) {
+  // Checked after every GC, and again while the heap is busy or the CPU budget is exhausted.
+  if (background_compaction_cpu_budget_ == 0.0 || !CanAddHeapTask(self)) {
+    return;
+  }
+  BackgroundCompactionTask* added_task = nullptr;
+  {
+    MutexLock mu(self, *pending_task_lock_);
+    if (pending_background_compaction_ != nullptr) {
+      return;
+    }
+    added_task = new BackgroundCompactionTask(GetBytesAllocatedEver());
+    pending_background_compaction_ = added_task;
+  }
+  task_processor_->AddTask(self, added_task);
+}
+
+double Heap::GetSpaceFragmentation(space::ContinuousSpace* space, size_t* wasted_bytes) {
+  size_t used_bytes = 0u;
+  size_t allocated_bytes = 0u;
+  if (space->IsRegionSpace()) {
+    used_bytes = space->AsRegionSpace()->NonFreeRegionsSize();
+    allocated_bytes = space->AsRegionSpace()->GetBytesAllocated();
+  } else if (space == main_space_) {
+    // MallocSpace::GetBytesAllocated() suspends all threads for a RosAlloc space. Estimate the
+    // bytes allocated in the main space from the heap total less the other spaces instead.
+    used_bytes = main_space_->GetFootprint();
+    size_t other_bytes = 0u;
+    if (large_object_space_ != nullptr) {
+      other_bytes += large_object_space_->GetBytesAllocated();
+    }
+    if (zygote_space_ != nullptr) {
+      other_bytes += zygote_space_->GetBytesAllocated();
+    }
+    if (non_moving_space_ != nullptr &&
+        non_moving_space_ != main_space_ &&
+        !non_moving_space_->IsRosAllocSpace()) {
+      other_bytes += non_moving_space_->GetBytesAllocated();
+    }
+    const size_t total_bytes = GetBytesAllocated();
+    allocated_bytes = total_bytes - std::min(other_bytes, total_bytes);
+  } else if (space->IsMallocSpace()) {
+    used_bytes = space->AsMallocSpace()->GetFootprint();
+    allocated_bytes = space->AsMallocSpace()->GetBytesAllocated();
+  }
+  *wasted_bytes = used_bytes - std::min(allocated_bytes, used_bytes);
+  return used_bytes != 0u ? static_cast<double>(*wasted_bytes) / used_bytes : 0.0;
+}
+
+void Heap::DoBackgroundCompaction(Thread* self, uint64_t bytes_allocated_ever) {
+  if (GetBytesAllocatedEver() - bytes_allocated_ever >= kBackgroundCompactionIdleBytes) {
+    // Not idle, a compaction would compete with the mutators. Check again later.
+    RequestBackgroundCompaction(self);
+    return;
+  }
+  // Only the region space and the main space (with homogeneous space compaction) can be
+  // compacted. The non-moving space is measured for the log only, measuring a RosAlloc space
+  // suspends all threads.
+  space::ContinuousSpace* to_compact = nullptr;
+  {
+    // Measure between collections: while a CC collection runs, both the from-space and the
+    // to-space regions are non-free and the region space would look fragmented.
+    ScopedGCCriticalSection gcs(self, kGcCauseBackgroundCompaction, kCollectorTypeCriticalSection);
+    ScopedObjectAccess soa(self);
+    double max_fragmentation = 0.0;
+    space::ContinuousSpace* const spaces[] = { region_space_, main_space_, non_moving_space_ };
+    for (space::ContinuousSpace* space : spaces) {
+      if (space == nullptr ||
+          (space == non_moving_space_ && (space == main_space_ || !VLOG_IS_ON(heap)))) {
+        continue;
+      }
+      size_t wasted_bytes;
+      double fragmentation = GetSpaceFragmentation(space, &wasted_bytes);
+      VLOG(heap) << "Fragmentation of " << space->GetName() << ": "
+                 << static_cast<int>(fragmentation * 100) << "% (" << PrettySize(wasted_bytes)
+                 << ")";
+      bool can_compact = space == region_space_ ||
+          (space == main_space_ && SupportHomogeneousSpaceCompactAndCollectorTransitions());
+      if (can_compact &&
+          fragmentation >= kBackgroundCompactionFragmentation &&
+          wasted_bytes >= kBackgroundCompactionMinWastedBytes &&
+          fragmentation > max_fragmentation) {
+        to_compact = space;
+        max_fragmentation = fragmentation;
+      }
+    }
+  }
+  if (to_compact == nullptr) {
+    // The next GC requests a new check.
+    return;
+  }
+  const uint64_t elapsed_ns = NanoTime() - background_compaction_start_ns_;
+  if (background_compaction_cpu_ns_.load(std::memory_order_relaxed) >
+      elapsed_ns * background_compaction_cpu_budget_) {
+    VLOG(heap) << "Background compaction of " << to_compact->GetName()
+               << " delayed, CPU budget exhausted";
+    RequestBackgroundCompaction(self);
+    return;
+  }
+  const uint64_t cpu_start_ns = ThreadCpuNanoTime();
+  bool compacted;
+  if (to_compact == region_space_) {
+    // A full CC collection evacuates all the regions for this cause.
+    compacted = CollectGarbageInternal(collector::kGcTypeFull,
+                                       kGcCauseBackgroundCompaction,
+                                       /*clear_soft_references=*/false) != collector::kGcTypeNone;
+  } else {
+    compacted = PerformHomogeneousSpaceCompact() == kSuccess;
+  }
+  const uint64_t cpu_ns = ThreadCpuNanoTime() - cpu_start_ns;
+  background_compaction_cpu_ns_.fetch_add(cpu_ns, std::memory_order_relaxed);
+  if (!compacted) {
+    VLOG(heap) << "Background compaction of " << to_compact->GetName() << " rejected";
+    return;
+  }
+  ++background_compaction_count_;
+  VLOG(heap) << "Background compaction of " << to_compact->GetName() << " took "
+             << PrettyDuration(cpu_ns) << " of CPU time";
+}
+
+void Heap::SetBackgroundCompactionCpuBudget(double percent) {
+  DCHECK_GE(percent, 0.0);
+  DCHECK_LE(percent, 100.0);
+  background_compaction_cpu_budget_ = percent / 100.0;
+  background_compaction_start_ns_ = NanoTime();
+}
+
 void Heap::IncrementNumberOfBytesFreedRevoke(size_t freed_bytes_revoke) {
   size_t previous_num_bytes_freed_revoke =
       num_bytes_freed_revoke_.fetch_add(freed_bytes_revoke, std::memory_order_relaxed);
@@ -4053,6 +4594,70 @@ void Heap::RemoveAllocationListener() {
   }
 }
 
+void Heap::SetAllocationSamplingInterval(size_t sampling_interval) {
+  Thread* self = Thread::Current();
+  Runtime* runtime = Runtime::Current();
+  MutexLock mu(self, *Locks::instrument_entrypoints_lock_);
+  AllocationSampler* sampler = allocation_sampler_.load(std::memory_order_relaxed);
+  if (sampler == nullptr) {
+    if (sampling_interval == 0u) {
+      return;
+    }
+    sampler = new AllocationSampler();
+    runtime->AddSystemWeakHolder(sampler);
+    allocation_sampler_.store(sampler, std::memory_order_release);
+  }
+  bool was_enabled = IsAllocationSamplingEnabled();
+  if (sampling_interval != 0u) {
+    LOG(INFO) << "Enabling allocation sampling every " << PrettySize(sampling_interval)
+              << " on average";
+    sampler->Start(sampling_interval);
+    alloc_sampling_listener_.store(sampler, std::memory_order_relaxed);
+    if (!was_enabled) {
+      runtime->GetInstrumentation()->InstrumentQuickAllocEntryPointsLocked();
+    }
+  } else if (was_enabled) {
+    LOG(INFO) << "Disabling allocation sampling";
+    // If an allocation comes in before we uninstrument, the sampler drops it on the floor.
+    sampler->Stop();
+    alloc_sampling_listener_.store(nullptr, std::memory_order_relaxed);
+    runtime->GetInstrumentation()->UninstrumentQuickAllocEntryPointsLocked();
+  }
+}
+
+void Heap::DumpAllocationSamples(std::ostream& os) {
+  AllocationSampler* sampler = allocation_sampler_.load(std::memory_order_acquire);
+  if (sampler != nullptr) {
+    sampler->DumpProfile(os);
+  }
+}
+
+void Heap::SetClassHistogramEnabled(bool enabled) {
+  ClassHistogram* histogram = GetClassHistogram();
+  if (histogram == nullptr) {
+    if (!enabled) {
+      return;
+    }
+    ClassHistogram* new_histogram = new ClassHistogram();
+    if (class_histogram_.CompareAndSetStrongRelease(nullptr, new_histogram)) {
+      histogram = new_histogram;
+    } else {
+      // Lost the race with another thread enabling the histogram.
+      delete new_histogram;
+      histogram = GetClassHistogram();
+    }
+  }
+  VLOG(heap) << (enabled ? "Enabling" : "Disabling") << " the class histogram";
+  histogram->SetEnabled(enabled);
+}
+
+void Heap::DumpClassHistogram(std::ostream& os) {
+  ClassHistogram* histogram = GetClassHistogram();
+  if (histogram != nullptr && histogram->HasSnapshot()) {
+    histogram->Dump(os);
+  }
+}
+
 void Heap::SetGcPauseListener(GcPauseListener* l) {
   gc_pause_listener_.store(l, std::memory_order_relaxed);
 }
@@ -4068,6 +4673,7 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
                                        size_t* usable_size,
                                        size_t* bytes_tl_bulk_allocated) {
   const AllocatorType allocator_type = GetCurrentAllocator();
+  const size_t refill_size = GetTlabRefillSize(self, allocator_type);
   if (kUsePartialTlabs && alloc_size <= self->TlabRemainingCapacity()) {
     DCHECK_GT(alloc_size, self->TlabSize());
     // There is enough space if we grow the TLAB. Lets do that. This increases the
@@ -4075,7 +4681,7 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
     const size_t min_expand_size = alloc_size - self->TlabSize();
     const size_t expand_bytes = std::max(
         min_expand_size,
-        std::min(self->TlabRemainingCapacity() - self->TlabSize(), kPartialTlabSize));
+        std::min(self->TlabRemainingCapacity() - self->TlabSize(), refill_size));
     if (UNLIKELY(IsOutOfMemoryOnAllocation(allocator_type, expand_bytes, grow))) {
       return nullptr;
     }
@@ -4084,7 +4690,7 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
     DCHECK_LE(alloc_size, self->TlabSize());
   } else if (allocator_type == kAllocatorTypeTLAB) {
     DCHECK(bump_pointer_space_ != nullptr);
-    const size_t new_tlab_size = alloc_size + kDefaultTLABSize;
+    const size_t new_tlab_size = alloc_size + refill_size;
     if (UNLIKELY(IsOutOfMemoryOnAllocation(allocator_type, new_tlab_size, grow))) {
       return nullptr;
     }
@@ -4094,16 +4700,32 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
       return nullptr;
     }
     *bytes_tl_bulk_allocated = new_tlab_size;
+    CountTlabRefill(self);
   } else {
     DCHECK(allocator_type == kAllocatorTypeRegionTLAB);
     DCHECK(region_space_ != nullptr);
     if (space::RegionSpace::kRegionSize >= alloc_size) {
+      if (kUseAdaptiveTlabSize && refill_size <= kMinAdaptiveTlabSize) {
+        // The thread allocates too little to make use of a whole region. Allocate from the
+        // shared region instead.
+        if (!IsOutOfMemoryOnAllocation(allocator_type, alloc_size, grow)) {
+          mirror::Object* obj = region_space_->AllocNonvirtual<false>(alloc_size,
+                                                                      bytes_allocated,
+                                                                      usable_size,
+                                                                      bytes_tl_bulk_allocated);
+          if (obj != nullptr) {
+            self->GetTlabSizingInfo()->shared_bytes += alloc_size;
+          }
+          return obj;
+        }
+        return nullptr;
+      }
       // Non-large. Check OOME for a tlab.
       if (LIKELY(!IsOutOfMemoryOnAllocation(allocator_type,
                                             space::RegionSpace::kRegionSize,
                                             grow))) {
         const size_t new_tlab_size = kUsePartialTlabs
-            ? std::max(alloc_size, kPartialTlabSize)
+            ? std::max(alloc_size, refill_size)
             : gc::space::RegionSpace::kRegionSize;
         // Try to allocate a tlab.
         if (!region_space_->AllocNewTlab(self, new_tlab_size)) {
@@ -4114,6 +4736,7 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
                                                        bytes_tl_bulk_allocated);
         }
         *bytes_tl_bulk_allocated = new_tlab_size;
+        CountTlabRefill(self);
         // Fall-through to using the TLAB below.
       } else {
         // Check OOME for a non-tlab allocation.
@@ -4145,6 +4768,49 @@ mirror::Object* Heap::AllocWithNewTLAB(Thread* self,
   return ret;
 }
 
+size_t Heap::GetTlabRefillSize(Thread* self, AllocatorType allocator_type) {
+  const size_t default_size =
+      (allocator_type == kAllocatorTypeTLAB) ? kDefaultTLABSize : kPartialTlabSize;
+  if (!kUseAdaptiveTlabSize) {
+    return default_size;
+  }
+  static_assert(kMaxAdaptiveTlabSize <= space::RegionSpace::kRegionSize,
+                "A TLAB refill must fit in a region");
+  TlabSizingInfo* info = self->GetTlabSizingInfo();
+  const uint64_t gc_epoch = gcs_completed_.load(std::memory_order_relaxed);
+  if (info->refill_size == 0u) {
+    info->refill_size = default_size;
+    info->gc_epoch = gc_epoch;
+  } else if (info->gc_epoch != gc_epoch) {
+    // A GC revoked the TLABs since the last adjustment. Shrink the refill size if the thread
+    // mostly stranded its TLABs during the previous GC cycle. Grow it back if the thread allocated
+    // from the shared region as much as it would have with kTlabRefillsToGrow refills.
+    if (info->refills < kTlabRefillsToShrink && info->wasted_bytes > info->refill_size) {
+      info->refill_size = std::max<uint64_t>(info->refill_size / 2, kMinAdaptiveTlabSize);
+    } else if (info->shared_bytes >= kTlabRefillsToGrow * info->refill_size) {
+      info->refill_size = std::min<uint64_t>(info->refill_size * 2, kMaxAdaptiveTlabSize);
+    }
+    info->refills = 0u;
+    info->wasted_bytes = 0u;
+    info->shared_bytes = 0u;
+    info->gc_epoch = gc_epoch;
+  }
+  return info->refill_size;
+}
+
+void Heap::CountTlabRefill(Thread* self) {
+  tlab_refills_.fetch_add(1u, std::memory_order_relaxed);
+  if (!kUseAdaptiveTlabSize) {
+    return;
+  }
+  TlabSizingInfo* info = self->GetTlabSizingInfo();
+  ++info->refills;
+  if (info->refills % kTlabRefillsToGrow == 0u) {
+    // The thread keeps refilling, give it more room.
+    info->refill_size = std::min<uint64_t>(info->refill_size * 2, kMaxAdaptiveTlabSize);
+  }
+}
+
 const Verification* Heap::GetVerification() const {
   return verification_.get();
 }
@@ -17,6 +17,7 @@
 #ifndef ART_RUNTIME_GC_HEAP_H_
 #define ART_RUNTIME_GC_HEAP_H_
 
+#include <functional>
 #include <iosfwd>
 #include <string>
 #include <unordered_set>
@@ -66,7 +67,9 @@ class Object;
 namespace gc {
 
 class AllocationListener;
+class AllocationSampler;
 class AllocRecordObjectMap;
+class ClassHistogram;
 class GcPauseListener;
 class ReferenceProcessor;
 class TaskProcessor;
@@ -138,6 +141,9 @@ class Heap {
   static constexpr size_t kDefaultTLABSize = 32 * KB;
   static constexpr double kDefaultTargetUtilization = 0.5;
   static constexpr double kDefaultHeapGrowthMultiplier = 2.0;
+  // Bounds of the factor applied to the heap growth by the heap growth controller.
+  static constexpr double kMinHeapGrowthControllerFactor = 0.25;
+  static constexpr double kMaxHeapGrowthControllerFactor = 8.0;
   // Primitive arrays larger than this size are put in the large object space.
   static constexpr size_t kMinLargeObjectThreshold = 3 * kPageSize;
   static constexpr size_t kDefaultLargeObjectThreshold = kMinLargeObjectThreshold;
@@ -172,6 +178,19 @@ class Heap {
 
   // How often we allow heap trimming to happen (nanoseconds).
   static constexpr uint64_t kHeapTrimWait = MsToNs(5000);
+  // How long after a GC the resident free regions of the region space get released if the heap is
+  // idle, and how many bytes of them are released with the region lock held (nanoseconds, bytes).
+  static constexpr uint64_t kRegionReleaseWait = MsToNs(200);
+  static constexpr size_t kRegionReleaseChunkSize = 2 * MB;
+  // How long the background compaction waits after a GC before measuring fragmentation, and how
+  // many bytes may be allocated meanwhile for the heap to still be considered idle (nanoseconds,
+  // bytes).
+  static constexpr uint64_t kBackgroundCompactionWait = MsToNs(10000);
+  static constexpr size_t kBackgroundCompactionIdleBytes = 4 * MB;
+  // A space is compacted in the background once this fraction of its memory, and at least the
+  // given number of bytes, is not used by objects.
+  static constexpr double kBackgroundCompactionFragmentation = 0.25;
+  static constexpr size_t kBackgroundCompactionMinWastedBytes = 4 * MB;
   // How long we wait after a transition request to perform a collector transition (nanoseconds).
   static constexpr uint64_t kCollectorTransitionWait = MsToNs(5000);
   // Whether the transition-wait applies or not. Zero wait will stress the
@@ -200,9 +219,13 @@ class Heap {
        size_t large_object_threshold,
        size_t parallel_gc_threads,
        size_t conc_gc_threads,
+       size_t cc_parallel_mark_threads,
+       size_t parallel_reference_clearing_threads,
        bool low_memory_mode,
        size_t long_pause_threshold,
        size_t long_gc_threshold,
+       double gc_cpu_percent_target,
+       uint64_t gc_pause_time_target,
        bool ignore_target_footprint,
        bool use_tlab,
        bool verify_pre_gc_heap,
@@ -211,6 +234,7 @@ class Heap {
        bool verify_pre_gc_rosalloc,
        bool verify_pre_sweeping_rosalloc,
        bool verify_post_gc_rosalloc,
+       bool parallel_heap_verification,
        bool gc_stress_mode,
        bool measure_gc_performance,
        bool use_homogeneous_space_compaction,
@@ -218,6 +242,7 @@ class Heap {
        uint64_t min_interval_homogeneous_space_compaction_by_oom,
        bool dump_region_info_before_gc,
        bool dump_region_info_after_gc,
+       size_t region_space_resident_budget,
        space::ImageSpaceLoadingOrder image_space_loading_order);
 
   ~Heap();
@@ -325,6 +350,20 @@ class Heap {
       REQUIRES(Locks::mutator_lock_, !*gc_complete_lock_);
   bool VerifyMissingCardMarks()
       REQUIRES(Locks::heap_bitmap_lock_, Locks::mutator_lock_);
+  // Verify the objects visited by VisitObjectsPaused() with the heap thread pool, used by
+  // VerifyHeapReferences() with -Xgc:parallelverify. Like the serial verification, this must run
+  // with the mutators suspended. Returns how many failures occured.
+  size_t VerifyObjectsParallel(Thread* self, bool verify_referents)
+      REQUIRES(Locks::mutator_lock_, !Locks::heap_bitmap_lock_, !*gc_complete_lock_);
+
+  // A part of the objects visited by VisitObjectsPaused(), visited with the given callback.
+  using ObjectVisitChunk = std::function<void(const std::function<void(mirror::Object*)>&)>;
+  // Split the objects visited by VisitObjectsPaused() into chunks by space, and by range of
+  // regions or addresses within the large spaces. The chunks can be visited concurrently by
+  // threads working on behalf of the calling thread, which must keep the mutators suspended until
+  // all the chunks are visited.
+  std::vector<ObjectVisitChunk> GetObjectVisitChunks(Thread* self)
+      REQUIRES(Locks::mutator_lock_, !Locks::heap_bitmap_lock_);
 
   // A weaker test than IsLiveObject or VerifyObject that doesn't require the heap lock,
   // and doesn't abort on error, allowing the caller to report more
@@ -730,8 +769,18 @@ class Heap {
   // GC performance measuring
   void DumpGcPerformanceInfo(std::ostream& os)
       REQUIRES(!*gc_complete_lock_);
+  // Machine-readable snapshot of the same statistics, for tools that scrape them in production
+  // (exported as the "art.gc.performance-stats" runtime stat). One "<scope>.<key>=<value>" line
+  // per statistic where scope is "heap" or the collector name with spaces replaced by dashes.
+  // Times are in nanoseconds and sizes in bytes; keys may be added but are never renamed.
+  void DumpGcPerformanceStats(std::ostream& os);
   void ResetGcPerformanceInfo() REQUIRES(!*gc_complete_lock_);
 
+  // Record bytes left unused in a revoked TLAB.
+  void RecordTlabWaste(size_t wasted_bytes) {
+    tlab_wasted_bytes_.fetch_add(wasted_bytes, std::memory_order_relaxed);
+  }
+
   // Thread pool.
   void CreateThreadPool();
   void DeleteThreadPool();
@@ -744,6 +793,12 @@ class Heap {
   size_t GetConcGCThreadCount() const {
     return conc_gc_threads_;
   }
+  size_t GetCCParallelMarkThreadCount() const {
+    return cc_parallel_mark_threads_;
+  }
+  size_t GetParallelReferenceClearingThreadCount() const {
+    return parallel_reference_clearing_threads_;
+  }
   accounting::ModUnionTable* FindModUnionTableFromSpace(space::Space* space);
   void AddModUnionTable(accounting::ModUnionTable* mod_union_table);
 
@@ -800,6 +855,16 @@ class Heap {
   // Request an asynchronous trim.
   void RequestTrim(Thread* self) REQUIRES(!*pending_task_lock_);
 
+  // Request the asynchronous freeing of the large objects found dead by the last sweep.
+  void RequestLargeObjectFree(Thread* self);
+
+  // Request the asynchronous release of the region space's resident free regions.
+  void RequestRegionRelease(Thread* self) REQUIRES(!*pending_task_lock_);
+
+  // Request a check of the fragmentation of the spaces, which compacts them if the heap is idle,
+  // see BackgroundCompactionTask.
+  void RequestBackgroundCompaction(Thread* self) REQUIRES(!*pending_task_lock_);
+
   // Request asynchronous GC.
   void RequestConcurrentGC(Thread* self, GcCause cause, bool force_full)
       REQUIRES(!*pending_task_lock_);
@@ -878,6 +943,31 @@ class Heap {
   // reasons, we assume it stays valid when we read it (so that we don't require a lock).
   void RemoveAllocationListener();
 
+  // Enable sampled heap profiling with the given mean sampling interval in bytes, see
+  // AllocationSampler. An interval of 0 disables sampling, the samples taken so far are kept until
+  // sampling is enabled again.
+  void SetAllocationSamplingInterval(size_t sampling_interval)
+      REQUIRES(!Locks::instrument_entrypoints_lock_, !Locks::mutator_lock_);
+  bool IsAllocationSamplingEnabled() const {
+    return alloc_sampling_listener_.load(std::memory_order_relaxed) != nullptr;
+  }
+  // Write the profile of the sampled live objects in pprof's Java heap profile format.
+  void DumpAllocationSamples(std::ostream& os);
+
+  // Enable counting the live objects of every class during full-heap collections, see
+  // ClassHistogram. Disabling keeps the snapshot of the last counting collection.
+  void SetClassHistogramEnabled(bool enabled);
+  // The class histogram, or null if it has never been enabled.
+  ClassHistogram* GetClassHistogram() const {
+    return class_histogram_.load(std::memory_order_acquire);
+  }
+  // Write the class histogram snapshot of the last full-heap collection, nothing if there is none.
+  void DumpClassHistogram(std::ostream& os);
+
+  // Enable compacting fragmented spaces while the heap is idle, spending at most the given
+  // percentage of the elapsed time compacting. 0 disables it.
+  void SetBackgroundCompactionCpuBudget(double percent);
+
   // Install a gc pause listener.
   void SetGcPauseListener(GcPauseListener* l);
   // Get the currently installed gc pause listener, or null.
@@ -896,8 +986,20 @@ class Heap {
   class ConcurrentGCTask;
   class CollectorTransitionTask;
   class HeapTrimTask;
+  class LargeObjectFreeTask;
+  class RegionReleaseTask;
+  class BackgroundCompactionTask;
   class TriggerPostForkCCGcTask;
 
+  // Measure the fragmentation of the spaces and compact the most fragmented one that can be
+  // compacted, if the heap stayed idle since the check was requested and the CPU budget allows.
+  void DoBackgroundCompaction(Thread* self, uint64_t bytes_allocated_ever)
+      REQUIRES(!*gc_complete_lock_, !*pending_task_lock_);
+  // Fraction of the memory of the space that is not used by objects. The unused bytes are stored
+  // in wasted_bytes.
+  double GetSpaceFragmentation(space::ContinuousSpace* space, size_t* wasted_bytes)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
   // Compact source space to target space. Returns the collector used.
   collector::GarbageCollector* Compact(space::ContinuousMemMapAllocSpace* target_space,
                                        space::ContinuousMemMapAllocSpace* source_space,
@@ -1024,6 +1126,14 @@ class Heap {
                                    size_t* bytes_tl_bulk_allocated)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Return how many bytes a TLAB refill of `self` should provide. The size adapts to the thread's
+  // allocation rate and TLAB waste, see kUseAdaptiveTlabSize.
+  size_t GetTlabRefillSize(Thread* self, AllocatorType allocator_type);
+
+  // Count a new TLAB handed out to `self`. Partial TLAB expansions and allocations outside of a
+  // TLAB are not refills.
+  void CountTlabRefill(Thread* self);
+
   void ThrowOutOfMemoryError(Thread* self, size_t byte_count, AllocatorType allocator_type)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
@@ -1097,6 +1207,13 @@ class Heap {
   void GrowForUtilization(collector::GarbageCollector* collector_ran,
                           size_t bytes_allocated_before_gc = 0);
 
+  bool IsHeapGrowthControllerEnabled() const {
+    return gc_cpu_percent_target_ != 0.0 || gc_pause_time_target_ != 0u;
+  }
+  // Update heap_growth_controller_factor_ from the GC CPU usage since the previous GC and the
+  // pauses of the GC that just finished.
+  void UpdateHeapGrowthController();
+
   size_t GetPercentFree();
 
   // Swap the allocation stack with the live stack.
@@ -1104,11 +1221,13 @@ class Heap {
 
   // Clear cards and update the mod union table. When process_alloc_space_cards is true,
   // if clear_alloc_space_cards is true, then we clear cards instead of ageing them. We do
-  // not process the alloc space if process_alloc_space_cards is false.
+  // not process the alloc space if process_alloc_space_cards is false. The cards of the
+  // mod-union tables are processed by thread_count threads of the thread pool.
   void ProcessCards(TimingLogger* timings,
                     bool use_rem_sets,
                     bool process_alloc_space_cards,
-                    bool clear_alloc_space_cards)
+                    bool clear_alloc_space_cards,
+                    size_t thread_count = 1u)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
   // Push an object onto the allocation stack.
@@ -1147,6 +1266,11 @@ class Heap {
   template <typename Visitor>
   ALWAYS_INLINE void VisitObjectsInternalRegionSpace(Visitor&& visitor)
       REQUIRES(Locks::mutator_lock_, !Locks::heap_bitmap_lock_, !*gc_complete_lock_);
+  template <typename Visitor>
+  ALWAYS_INLINE void VisitAllocationStackObjects(StackReference<mirror::Object>* begin,
+                                                 StackReference<mirror::Object>* end,
+                                                 Visitor&& visitor)
+      REQUIRES_SHARED(Locks::mutator_lock_);
 
   void UpdateGcCountRateHistograms() REQUIRES(gc_complete_lock_);
 
@@ -1237,6 +1361,14 @@ class Heap {
   // How many GC threads we may use for unpaused parts of garbage collection.
   const size_t conc_gc_threads_;
 
+  // How many GC worker threads the concurrent copying collector may use, in addition to the
+  // GC-running thread, to process its mark stack. Zero means the mark stack is processed serially.
+  const size_t cc_parallel_mark_threads_;
+
+  // How many GC worker threads may clear soft, weak and phantom references, in addition to the
+  // GC-running thread. Zero means the reference queues are cleared serially.
+  const size_t parallel_reference_clearing_threads_;
+
   // Boolean for if we are in low memory mode.
   const bool low_memory_mode_;
 
@@ -1247,6 +1379,21 @@ class Heap {
   // If we get a GC longer than long GC log threshold, then we print out the GC after it finishes.
   const size_t long_gc_log_threshold_;
 
+  // Goals of the heap growth controller, zero when disabled. The controller scales the free space
+  // GrowForUtilization gives the heap after each GC: it grows it while GCs use more than
+  // gc_cpu_percent_target_ percent of the process CPU time and shrinks it while GC pauses exceed
+  // gc_pause_time_target_ (in ns). The pause goal wins when both are set and violated.
+  const double gc_cpu_percent_target_;
+  const uint64_t gc_pause_time_target_;
+
+  // Current scale factor of the controller and the GC CPU percentage it last measured. Only
+  // updated by the thread running the GC, read racily for stats.
+  double heap_growth_controller_factor_;
+  double heap_growth_controller_gc_cpu_percent_;
+  // GC and process CPU times at the previous controller update.
+  uint64_t heap_growth_controller_last_gc_cpu_time_ns_;
+  uint64_t heap_growth_controller_last_process_cpu_time_ns_;
+
   // Starting time of the new process; meant to be used for measuring total process CPU time.
   uint64_t process_cpu_start_time_ns_;
 
@@ -1353,6 +1500,19 @@ class Heap {
   // GC.
   Atomic<size_t> num_bytes_freed_revoke_;
 
+  // Number of completed GCs. Used as the epoch for adaptive TLAB sizing.
+  Atomic<uint64_t> gcs_completed_;
+
+  // Number of new TLABs and bytes left unused in revoked TLABs since the last
+  // ResetGcPerformanceInfo.
+  Atomic<uint64_t> tlab_refills_;
+  Atomic<uint64_t> tlab_wasted_bytes_;
+
+  // Number of thread-local allocation stack refills, and of GCs run because the allocation stack
+  // overflowed, since the last ResetGcPerformanceInfo.
+  Atomic<uint64_t> alloc_stack_refills_;
+  Atomic<uint64_t> alloc_stack_overflow_gcs_;
+
   // Info related to the current or previous GC iteration.
   collector::Iteration current_gc_iteration_;
 
@@ -1366,6 +1526,9 @@ class Heap {
   bool verify_pre_gc_rosalloc_;
   bool verify_pre_sweeping_rosalloc_;
   bool verify_post_gc_rosalloc_;
+  // Partition VerifyHeapReferences across the heap thread pool. The verification still runs with
+  // the mutators suspended, only the pause gets shorter.
+  const bool parallel_heap_verification_;
   const bool gc_stress_mode_;
 
   // RAII that temporarily disables the rosalloc verification during
@@ -1494,6 +1657,16 @@ class Heap {
   // Active tasks which we can modify (change target time, desired collector type, etc..).
   CollectorTransitionTask* pending_collector_transition_ GUARDED_BY(pending_task_lock_);
   HeapTrimTask* pending_heap_trim_ GUARDED_BY(pending_task_lock_);
+  RegionReleaseTask* pending_region_release_ GUARDED_BY(pending_task_lock_);
+  BackgroundCompactionTask* pending_background_compaction_ GUARDED_BY(pending_task_lock_);
+
+  // Fraction of the elapsed time since the background compaction was enabled that it may spend
+  // compacting, measured in CPU time of the thread running the compactions. 0 if disabled.
+  double background_compaction_cpu_budget_;
+  uint64_t background_compaction_start_ns_;
+  // CPU time spent and number of background compactions.
+  Atomic<uint64_t> background_compaction_cpu_ns_;
+  Atomic<size_t> background_compaction_count_;
 
   // Whether or not we use homogeneous space compaction to avoid OOM errors.
   bool use_homogeneous_space_compaction_for_oom_;
@@ -1554,11 +1727,21 @@ class Heap {
 
   // An installed allocation listener.
   Atomic<AllocationListener*> alloc_listener_;
+  // The allocation sampler while sampling is enabled, kept separate from alloc_listener_ so that
+  // heap profiling does not conflict with agents installing a listener.
+  Atomic<AllocationListener*> alloc_sampling_listener_;
+  // Created the first time sampling is enabled and only deleted with the heap since it is
+  // registered as a system weak holder. Written with Locks::instrument_entrypoints_lock_ held.
+  Atomic<AllocationSampler*> allocation_sampler_;
+  // Created the first time the class histogram is enabled and only deleted with the heap since
+  // the collector may be counting into it.
+  Atomic<ClassHistogram*> class_histogram_;
   // An installed GC Pause listener.
   Atomic<GcPauseListener*> gc_pause_listener_;
 
   std::unique_ptr<Verification> verification_;
 
+  friend class AdaptiveTlabHeapTest;
   friend class CollectorTransitionTask;
   friend class collector::GarbageCollector;
   friend class collector::ConcurrentCopying;
@@ -14,10 +14,15 @@
  * limitations under the License.
  */
 
+#include <limits>
+#include <sstream>
+#include <string>
+
 #include "class_linker-inl.h"
 #include "common_runtime_test.h"
 #include "gc/accounting/card_table-inl.h"
 #include "gc/accounting/space_bitmap-inl.h"
+#include "gc/class_histogram.h"
 #include "handle_scope-inl.h"
 #include "mirror/class-inl.h"
 #include "mirror/object-inl.h"
@@ -99,6 +104,228 @@ TEST_F(HeapTest, DumpGCPerformanceOnShutdown) {
   Runtime::Current()->SetDumpGCPerformanceOnShutdown(true);
 }
 
+TEST_F(HeapTest, DumpGcPerformanceStats) {
+  Heap* heap = Runtime::Current()->GetHeap();
+  heap->CollectGarbage(/* clear_soft_references= */ false);
+  std::ostringstream oss;
+  heap->DumpGcPerformanceStats(oss);
+  std::istringstream iss(oss.str());
+  std::string line;
+  size_t collector_iterations = 0u;
+  bool has_gc_count = false;
+  while (std::getline(iss, line)) {
+    // Every line is "<scope>.<key>=<integer>" with no spaces.
+    size_t dot = line.find('.');
+    size_t equals = line.find('=');
+    ASSERT_NE(dot, std::string::npos) << line;
+    ASSERT_NE(equals, std::string::npos) << line;
+    ASSERT_LT(dot, equals) << line;
+    EXPECT_EQ(line.find(' '), std::string::npos) << line;
+    std::string value = line.substr(equals + 1u);
+    ASSERT_FALSE(value.empty()) << line;
+    EXPECT_EQ(value.find_first_not_of("-0123456789"), std::string::npos) << line;
+    std::string key = line.substr(dot + 1u, equals - dot - 1u);
+    if (line.compare(0, dot, "heap") == 0) {
+      has_gc_count = has_gc_count || key == "gc-count";
+    } else if (key == "iterations") {
+      collector_iterations += std::stoul(value);
+    }
+  }
+  EXPECT_TRUE(has_gc_count);
+  EXPECT_GE(collector_iterations, 1u);
+}
+
+class ParallelVerificationHeapTest : public CommonRuntimeTest {
+  void SetUpRuntimeOptions(RuntimeOptions* options) override {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    options->push_back(std::make_pair("-Xgc:preverify,postverify,parallelverify", nullptr));
+    options->push_back(std::make_pair("-XX:ParallelGCThreads=3", nullptr));
+  }
+};
+
+TEST_F(ParallelVerificationHeapTest, CollectGarbage) {
+  // Heap verification failures are fatal, so the GC completing means that the parallel
+  // verification found the heap consistent before and after the collection.
+  {
+    ScopedObjectAccess soa(Thread::Current());
+    StackHandleScope<1> hs(soa.Self());
+    Handle<mirror::Class> c(
+        hs.NewHandle(class_linker_->FindSystemClass(soa.Self(), "[Ljava/lang/Object;")));
+    for (size_t i = 0; i < 64; ++i) {
+      StackHandleScope<1> hs2(soa.Self());
+      Handle<mirror::ObjectArray<mirror::Object>> array(hs2.NewHandle(
+          mirror::ObjectArray<mirror::Object>::Alloc(soa.Self(), c.Get(), 1024)));
+      for (size_t j = 0; j < 1024; ++j) {
+        ObjPtr<mirror::String> string =
+            mirror::String::AllocFromModifiedUtf8(soa.Self(), "hello, world!");
+        array->Set<false>(j, string);
+      }
+    }
+  }
+  ASSERT_TRUE(Runtime::Current()->GetHeap()->GetThreadPool() != nullptr);
+  Runtime::Current()->GetHeap()->CollectGarbage(/* clear_soft_references= */ false);
+}
+
+class ClassHistogramHeapTest : public CommonRuntimeTest {
+  void SetUpRuntimeOptions(RuntimeOptions* options) override {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    options->push_back(std::make_pair("-XX:GcClassHistogram", nullptr));
+  }
+};
+
+TEST_F(ClassHistogramHeapTest, CollectGarbage) {
+  if (!kUseReadBarrier) {
+    // Only the concurrent copying collector counts the objects it marks.
+    return;
+  }
+  Heap* heap = Runtime::Current()->GetHeap();
+  ClassHistogram* histogram = heap->GetClassHistogram();
+  ASSERT_TRUE(histogram != nullptr);
+  ASSERT_TRUE(histogram->IsEnabled());
+  static constexpr size_t kStringCount = 1024;
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<2> hs(soa.Self());
+  Handle<mirror::Class> c(
+      hs.NewHandle(class_linker_->FindSystemClass(soa.Self(), "[Ljava/lang/Object;")));
+  Handle<mirror::ObjectArray<mirror::Object>> array(hs.NewHandle(
+      mirror::ObjectArray<mirror::Object>::Alloc(soa.Self(), c.Get(), kStringCount)));
+  for (size_t i = 0; i < kStringCount; ++i) {
+    ObjPtr<mirror::String> string =
+        mirror::String::AllocFromModifiedUtf8(soa.Self(), "hello, world!");
+    array->Set<false>(i, string);
+  }
+  {
+    ScopedThreadSuspension sts(soa.Self(), kSuspended);
+    heap->CollectGarbage(/* clear_soft_references= */ false);
+  }
+  ASSERT_TRUE(histogram->HasSnapshot());
+  uint64_t string_count = 0u;
+  uint64_t previous_bytes = std::numeric_limits<uint64_t>::max();
+  for (const ClassHistogram::Entry& entry : histogram->GetSnapshot()) {
+    EXPECT_LE(entry.bytes, previous_bytes) << "Not sorted by size: " << entry.descriptor;
+    EXPECT_GT(entry.count, 0u) << entry.descriptor;
+    previous_bytes = entry.bytes;
+    if (entry.descriptor == "java.lang.String") {
+      string_count = entry.count;
+    }
+  }
+  // The strings of the array are live, the strings of the image are not counted.
+  EXPECT_GE(string_count, kStringCount);
+  std::ostringstream oss;
+  heap->DumpClassHistogram(oss);
+  EXPECT_EQ(oss.str().rfind("gc-time-ns=", 0), 0u) << oss.str();
+}
+
+class AdaptiveTlabHeapTest : public CommonRuntimeTest {
+ protected:
+  void SetUp() override {
+    CommonRuntimeTest::SetUp();
+    heap_ = Runtime::Current()->GetHeap();
+    info_ = Thread::Current()->GetTlabSizingInfo();
+    *info_ = TlabSizingInfo();
+  }
+
+  size_t GetRefillSize() {
+    return heap_->GetTlabRefillSize(Thread::Current(), kAllocatorTypeRegionTLAB);
+  }
+
+  // Hand out a new TLAB of the current refill size.
+  size_t Refill() {
+    const size_t refill_size = GetRefillSize();
+    heap_->CountTlabRefill(Thread::Current());
+    return refill_size;
+  }
+
+  // Start a new GC epoch, as completing a GC does.
+  void FinishGc() {
+    heap_->gcs_completed_.fetch_add(1u, std::memory_order_relaxed);
+  }
+
+  uint64_t GetTotalRefills() {
+    return heap_->tlab_refills_.load(std::memory_order_relaxed);
+  }
+
+  Heap* heap_;
+  TlabSizingInfo* info_;
+};
+
+// Test that a thread refilling often gets larger TLABs, and that looking up the refill size does
+// not count as a refill.
+TEST_F(AdaptiveTlabHeapTest, Grow) {
+  const size_t initial_size = GetRefillSize();
+  ASSERT_GT(initial_size, 0u);
+  const uint64_t total_refills = GetTotalRefills();
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(initial_size, GetRefillSize());
+  }
+  EXPECT_EQ(total_refills, GetTotalRefills());
+  EXPECT_EQ(0u, info_->refills);
+
+  size_t refills = 0u;
+  while (GetRefillSize() == initial_size) {
+    Refill();
+    ++refills;
+    ASSERT_LT(refills, 100u);
+  }
+  EXPECT_EQ(2 * initial_size, GetRefillSize());
+  EXPECT_GE(GetTotalRefills(), total_refills + refills);
+
+  // The size is kept across GCs while the thread keeps refilling.
+  FinishGc();
+  for (size_t i = 0; i < refills - 1u; ++i) {
+    EXPECT_EQ(2 * initial_size, Refill());
+  }
+  FinishGc();
+  EXPECT_EQ(2 * initial_size, GetRefillSize());
+}
+
+// Test that a thread stranding its TLABs gets smaller ones after the next GC, down to the minimum,
+// and that it only grows back at the next GC if it allocated enough from the shared region.
+TEST_F(AdaptiveTlabHeapTest, ShrinkAndGrowAcrossGcs) {
+  const size_t initial_size = GetRefillSize();
+  Refill();
+  info_->wasted_bytes = initial_size + 1u;
+  // Within the same GC epoch, the size does not change.
+  EXPECT_EQ(initial_size, GetRefillSize());
+  FinishGc();
+  EXPECT_EQ(initial_size / 2, GetRefillSize());
+
+  // Strand TLABs until the size reaches the minimum.
+  size_t min_size = initial_size / 2;
+  for (size_t gcs = 0; ; ++gcs) {
+    ASSERT_LT(gcs, 32u);
+    Refill();
+    info_->wasted_bytes = min_size + 1u;
+    FinishGc();
+    const size_t size = GetRefillSize();
+    if (size == min_size) {
+      break;
+    }
+    EXPECT_EQ(min_size / 2, size);
+    min_size = size;
+  }
+
+  // Small allocations from the shared region do not grow the size, within the GC epoch or after.
+  const uint64_t total_refills = GetTotalRefills();
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(min_size, GetRefillSize());
+    info_->shared_bytes += 16u;
+  }
+  EXPECT_EQ(total_refills, GetTotalRefills());
+  FinishGc();
+  EXPECT_EQ(min_size, GetRefillSize());
+
+  // Allocating as much as several refills from the shared region grows the size at the next GC.
+  while (info_->shared_bytes < 16 * min_size) {
+    EXPECT_EQ(min_size, GetRefillSize());
+    info_->shared_bytes += 64u;
+  }
+  EXPECT_EQ(min_size, GetRefillSize());
+  FinishGc();
+  EXPECT_EQ(2 * min_size, GetRefillSize());
+  EXPECT_EQ(0u, info_->shared_bytes);
+}
+
 class ZygoteHeapTest : public CommonRuntimeTest {
   void SetUpRuntimeOptions(RuntimeOptions* options) override {
     CommonRuntimeTest::SetUpRuntimeOptions(options);
@@ -16,6 +16,9 @@
 
 #include "reference_processor.h"
 
+#include <algorithm>
+#include <ostream>
+
 #include "art_field-inl.h"
 #include "base/mutex.h"
 #include "base/time_utils.h"
@@ -174,6 +177,11 @@ void ReferenceProcessor::ProcessReferences(bool concurrent,
     DCHECK(finalizer_reference_queue_.IsEmpty());
     DCHECK(phantom_reference_queue_.IsEmpty());
   }
+  soft_stats_ = KindStats();
+  weak_stats_ = KindStats();
+  finalizer_stats_ = KindStats();
+  phantom_stats_ = KindStats();
+  const size_t thread_count = GetClearingThreadCount(collector->GetHeap());
   // Unless required to clear soft references with white references, preserve some white referents.
   if (!clear_soft_references) {
     TimingLogger::ScopedTiming split(concurrent ? "ForwardSoftReferences" :
@@ -190,8 +198,8 @@ void ReferenceProcessor::ProcessReferences(bool concurrent,
     }
   }
   // Clear all remaining soft and weak references with white referents.
-  soft_reference_queue_.ClearWhiteReferences(&cleared_references_, collector);
-  weak_reference_queue_.ClearWhiteReferences(&cleared_references_, collector);
+  ClearWhiteReferences(&soft_reference_queue_, &soft_stats_, collector, thread_count);
+  ClearWhiteReferences(&weak_reference_queue_, &weak_stats_, collector, thread_count);
   {
     TimingLogger::ScopedTiming t2(concurrent ? "EnqueueFinalizerReferences" :
         "(Paused)EnqueueFinalizerReferences", timings);
@@ -199,17 +207,21 @@ void ReferenceProcessor::ProcessReferences(bool concurrent,
       StartPreservingReferences(self);
     }
     // Preserve all white objects with finalize methods and schedule them for finalization.
-    finalizer_reference_queue_.EnqueueFinalizerReferences(&cleared_references_, collector);
+    // This marks the referents, which only the GC thread may do, so it is not parallelized.
+    const uint64_t start_time = NanoTime();
+    finalizer_stats_.counts =
+        finalizer_reference_queue_.EnqueueFinalizerReferences(&cleared_references_, collector);
     collector->ProcessMarkStack();
+    finalizer_stats_.time_ns = NanoTime() - start_time;
     if (concurrent) {
       StopPreservingReferences(self);
     }
   }
   // Clear all finalizer referent reachable soft and weak references with white referents.
-  soft_reference_queue_.ClearWhiteReferences(&cleared_references_, collector);
-  weak_reference_queue_.ClearWhiteReferences(&cleared_references_, collector);
+  ClearWhiteReferences(&soft_reference_queue_, &soft_stats_, collector, thread_count);
+  ClearWhiteReferences(&weak_reference_queue_, &weak_stats_, collector, thread_count);
   // Clear all phantom references with white referents.
-  phantom_reference_queue_.ClearWhiteReferences(&cleared_references_, collector);
+  ClearWhiteReferences(&phantom_reference_queue_, &phantom_stats_, collector, thread_count);
   // At this point all reference queues other than the cleared references should be empty.
   DCHECK(soft_reference_queue_.IsEmpty());
   DCHECK(weak_reference_queue_.IsEmpty());
@@ -229,6 +241,46 @@ void ReferenceProcessor::ProcessReferences(bool concurrent,
   }
 }
 
+size_t ReferenceProcessor::GetClearingThreadCount(Heap* heap) {
+  // Parallel clearing is off unless enabled with -XX:ParallelReferenceClearingThreads. As for
+  // parallel marking, leave the CPUs to the foreground apps when in the background.
+  ThreadPool* thread_pool = heap->GetThreadPool();
+  const size_t worker_count = heap->GetParallelReferenceClearingThreadCount();
+  if (worker_count == 0u ||
+      thread_pool == nullptr ||
+      !Runtime::Current()->InJankPerceptibleProcessState()) {
+    return 1u;
+  }
+  return std::min(worker_count, thread_pool->GetThreadCount()) + 1u;
+}
+
+void ReferenceProcessor::ClearWhiteReferences(ReferenceQueue* queue,
+                                              KindStats* stats,
+                                              collector::GarbageCollector* collector,
+                                              size_t thread_count) {
+  const uint64_t start_time = NanoTime();
+  stats->counts += queue->ClearWhiteReferences(&cleared_references_,
+                                               collector,
+                                               collector->GetHeap()->GetThreadPool(),
+                                               thread_count);
+  stats->time_ns += NanoTime() - start_time;
+}
+
+void ReferenceProcessor::DumpLastStats(std::ostream& os) const {
+  auto dump_kind = [&os](const char* kind, const KindStats& stats) {
+    os << kind << " " << stats.counts.cleared << "/" << stats.counts.processed << " "
+       << PrettyDuration(stats.time_ns);
+  };
+  os << "references cleared ";
+  dump_kind("soft", soft_stats_);
+  os << ", ";
+  dump_kind("weak", weak_stats_);
+  os << ", ";
+  dump_kind("finalizer", finalizer_stats_);
+  os << ", ";
+  dump_kind("phantom", phantom_stats_);
+}
+
 // Process the "referent" field in a java.lang.ref.Reference.  If the referent has not yet been
 // marked, put it on the appropriate list in the heap for later processing.
 void ReferenceProcessor::DelayReferenceReferent(ObjPtr<mirror::Class> klass,
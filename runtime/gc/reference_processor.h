@@ -17,6 +17,8 @@
 #ifndef ART_RUNTIME_GC_REFERENCE_PROCESSOR_H_
 #define ART_RUNTIME_GC_REFERENCE_PROCESSOR_H_
 
+#include <iosfwd>
+
 #include "base/locks.h"
 #include "jni.h"
 #include "reference_queue.h"
@@ -79,7 +81,28 @@ class ReferenceProcessor {
       REQUIRES_SHARED(Locks::mutator_lock_)
       REQUIRES(!Locks::reference_processor_lock_);
 
+  // Print the per kind reference counts and processing times of the last ProcessReferences, for
+  // the GC log line.
+  void DumpLastStats(std::ostream& os) const;
+
  private:
+  // Counts and time spent processing one kind of references in the last ProcessReferences. Only
+  // accessed by the thread running the GC.
+  struct KindStats {
+    ReferenceCounts counts;
+    uint64_t time_ns = 0u;
+  };
+
+  // Number of threads, the GC thread included, to clear reference queues with.
+  static size_t GetClearingThreadCount(Heap* heap);
+
+  // Clear the white referents of `queue` and account for it in `stats`.
+  void ClearWhiteReferences(ReferenceQueue* queue,
+                            KindStats* stats,
+                            collector::GarbageCollector* collector,
+                            size_t thread_count)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
   bool SlowPathEnabled() REQUIRES_SHARED(Locks::mutator_lock_);
   // Called by ProcessReferences.
   void DisableSlowPath(Thread* self) REQUIRES(Locks::reference_processor_lock_)
@@ -109,6 +132,11 @@ class ReferenceProcessor {
   ReferenceQueue phantom_reference_queue_;
   ReferenceQueue cleared_references_;
 
+  KindStats soft_stats_;
+  KindStats weak_stats_;
+  KindStats finalizer_stats_;
+  KindStats phantom_stats_;
+
   DISALLOW_COPY_AND_ASSIGN(ReferenceProcessor);
 };
 
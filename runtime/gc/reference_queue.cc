@@ -16,7 +16,10 @@
 
 #include "reference_queue.h"
 
+#include <algorithm>
+
 #include "accounting/card_table-inl.h"
+#include "base/bit_utils.h"
 #include "base/mutex.h"
 #include "collector/concurrent_copying.h"
 #include "heap.h"
@@ -28,6 +31,9 @@
 namespace art {
 namespace gc {
 
+// Below this many references per thread, clearing a queue is not worth waking up the workers.
+static constexpr size_t kMinReferencesPerThread = 512;
+
 ReferenceQueue::ReferenceQueue(Mutex* lock) : lock_(lock), list_(nullptr) {
 }
 
@@ -130,32 +136,97 @@ size_t ReferenceQueue::GetLength() const {
   return count;
 }
 
-void ReferenceQueue::ClearWhiteReferences(ReferenceQueue* cleared_references,
-                                          collector::GarbageCollector* collector) {
+bool ReferenceQueue::ClearWhiteReferent(ObjPtr<mirror::Reference> ref,
+                                        collector::GarbageCollector* collector) {
+  mirror::HeapReference<mirror::Object>* referent_addr = ref->GetReferentReferenceAddr();
+  // do_atomic_update is false because this happens during the reference processing phase where
+  // Reference.clear() would block.
+  if (collector->IsNullOrMarkedHeapReference(referent_addr, /*do_atomic_update=*/false)) {
+    return false;
+  }
+  // Referent is white, clear it.
+  if (Runtime::Current()->IsActiveTransaction()) {
+    ref->ClearReferent<true>();
+  } else {
+    ref->ClearReferent<false>();
+  }
+  return true;
+}
+
+ReferenceCounts ReferenceQueue::ClearWhiteReferences(ReferenceQueue* cleared_references,
+                                                     collector::GarbageCollector* collector,
+                                                     ThreadPool* thread_pool,
+                                                     size_t thread_count) {
+  ReferenceCounts counts;
+  // Transactions record the clearing of referents, which is not thread safe.
+  if (thread_pool == nullptr || thread_count <= 1u || Runtime::Current()->IsActiveTransaction()) {
+    while (!IsEmpty()) {
+      ObjPtr<mirror::Reference> ref = DequeuePendingReference();
+      ++counts.processed;
+      if (ClearWhiteReferent(ref, collector)) {
+        cleared_references->EnqueueReference(ref);
+        ++counts.cleared;
+      }
+      // Delay disabling the read barrier until here so that the ClearReferent call above in
+      // transaction mode will trigger the read barrier.
+      DisableReadBarrierForReference(ref);
+    }
+    return counts;
+  }
+
+  // Unlink the whole list first. The referents are then checked on several threads, and the
+  // references with cleared referents are enqueued on this thread since EnqueueReference is not
+  // thread safe.
+  std::vector<mirror::Reference*> refs;
   while (!IsEmpty()) {
-    ObjPtr<mirror::Reference> ref = DequeuePendingReference();
-    mirror::HeapReference<mirror::Object>* referent_addr = ref->GetReferentReferenceAddr();
-    // do_atomic_update is false because this happens during the reference processing phase where
-    // Reference.clear() would block.
-    if (!collector->IsNullOrMarkedHeapReference(referent_addr, /*do_atomic_update=*/false)) {
-      // Referent is white, clear it.
-      if (Runtime::Current()->IsActiveTransaction()) {
-        ref->ClearReferent<true>();
-      } else {
-        ref->ClearReferent<false>();
+    refs.push_back(DequeuePendingReference().Ptr());
+  }
+  counts.processed = refs.size();
+  const size_t num_tasks = std::min(thread_count, refs.size() / kMinReferencesPerThread);
+  std::vector<std::vector<mirror::Reference*>> cleared(std::max<size_t>(num_tasks, 1u));
+  auto clear_range = [this, &refs, &cleared, collector](size_t task, size_t begin, size_t end)
+      NO_THREAD_SAFETY_ANALYSIS {
+    for (size_t i = begin; i != end; ++i) {
+      ObjPtr<mirror::Reference> ref = refs[i];
+      if (ClearWhiteReferent(ref, collector)) {
+        cleared[task].push_back(ref.Ptr());
       }
+      DisableReadBarrierForReference(ref);
+    }
+  };
+  if (num_tasks <= 1u) {
+    clear_range(0u, 0u, refs.size());
+  } else {
+    // No thread safety analysis in the tasks since the calling thread holds the mutator lock on
+    // behalf of the workers.
+    Thread* const self = Thread::Current();
+    const size_t chunk_size = RoundUp(refs.size(), num_tasks) / num_tasks;
+    for (size_t task = 0, begin = 0; begin < refs.size(); ++task, begin += chunk_size) {
+      const size_t end = std::min(begin + chunk_size, refs.size());
+      thread_pool->AddTask(self, new FunctionTask([&clear_range, task, begin, end](Thread*) {
+        clear_range(task, begin, end);
+      }));
+    }
+    thread_pool->SetMaxActiveWorkers(num_tasks - 1u);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+    thread_pool->StopWorkers(self);
+  }
+  for (const std::vector<mirror::Reference*>& task_cleared : cleared) {
+    for (mirror::Reference* ref : task_cleared) {
       cleared_references->EnqueueReference(ref);
     }
-    // Delay disabling the read barrier until here so that the ClearReferent call above in
-    // transaction mode will trigger the read barrier.
-    DisableReadBarrierForReference(ref);
+    counts.cleared += task_cleared.size();
   }
+  return counts;
 }
 
-void ReferenceQueue::EnqueueFinalizerReferences(ReferenceQueue* cleared_references,
-                                                collector::GarbageCollector* collector) {
+ReferenceCounts ReferenceQueue::EnqueueFinalizerReferences(ReferenceQueue* cleared_references,
+                                                           collector::GarbageCollector* collector) {
+  ReferenceCounts counts;
   while (!IsEmpty()) {
     ObjPtr<mirror::FinalizerReference> ref = DequeuePendingReference()->AsFinalizerReference();
+    ++counts.processed;
     mirror::HeapReference<mirror::Object>* referent_addr = ref->GetReferentReferenceAddr();
     // do_atomic_update is false because this happens during the reference processing phase where
     // Reference.clear() would block.
@@ -170,11 +241,13 @@ void ReferenceQueue::EnqueueFinalizerReferences(ReferenceQueue* cleared_referenc
         ref->ClearReferent<false>();
       }
       cleared_references->EnqueueReference(ref);
+      ++counts.cleared;
     }
     // Delay disabling the read barrier until here so that the ClearReferent call above in
     // transaction mode will trigger the read barrier.
     DisableReadBarrierForReference(ref->AsReference());
   }
+  return counts;
 }
 
 void ReferenceQueue::ForwardSoftReferences(MarkObjectVisitor* visitor) {
@@ -49,6 +49,19 @@ class GarbageCollector;
 
 class Heap;
 
+// Number of references dequeued and cleared (or, for finalizer references, enqueued for
+// finalization) by a ReferenceQueue operation.
+struct ReferenceCounts {
+  size_t processed = 0u;
+  size_t cleared = 0u;
+
+  ReferenceCounts& operator+=(const ReferenceCounts& other) {
+    processed += other.processed;
+    cleared += other.cleared;
+    return *this;
+  }
+};
+
 // Used to temporarily store java.lang.ref.Reference(s) during GC and prior to queueing on the
 // appropriate java.lang.ref.ReferenceQueue. The linked list is maintained as an unordered,
 // circular, and singly-linked list using the pendingNext fields of the java.lang.ref.Reference
@@ -79,8 +92,8 @@ class ReferenceQueue {
 
   // Enqueues finalizer references with white referents.  White referents are blackened, moved to
   // the zombie field, and the referent field is cleared.
-  void EnqueueFinalizerReferences(ReferenceQueue* cleared_references,
-                                  collector::GarbageCollector* collector)
+  ReferenceCounts EnqueueFinalizerReferences(ReferenceQueue* cleared_references,
+                                             collector::GarbageCollector* collector)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
   // Walks the reference list marking any references subject to the reference clearing policy.
@@ -91,8 +104,13 @@ class ReferenceQueue {
 
   // Unlink the reference list clearing references objects with white referents. Cleared references
   // registered to a reference queue are scheduled for appending by the heap worker thread.
-  void ClearWhiteReferences(ReferenceQueue* cleared_references,
-                            collector::GarbageCollector* collector)
+  // If `thread_pool` is not null, the referents are checked and cleared by up to `thread_count`
+  // threads, the calling thread included; the cleared references are still enqueued in order by
+  // the calling thread.
+  ReferenceCounts ClearWhiteReferences(ReferenceQueue* cleared_references,
+                                       collector::GarbageCollector* collector,
+                                       ThreadPool* thread_pool = nullptr,
+                                       size_t thread_count = 1u)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
   void Dump(std::ostream& os) const REQUIRES_SHARED(Locks::mutator_lock_);
@@ -113,6 +131,12 @@ class ReferenceQueue {
       REQUIRES_SHARED(Locks::mutator_lock_);
 
  private:
+  // Clear the referent of `ref` if it is white. Returns whether the referent was cleared. Thread
+  // safe as long as no transaction is active.
+  static bool ClearWhiteReferent(ObjPtr<mirror::Reference> ref,
+                                 collector::GarbageCollector* collector)
+      REQUIRES_SHARED(Locks::mutator_lock_);
+
   // Lock, used for parallel GC reference enqueuing. It allows for multiple threads simultaneously
   // calling AtomicEnqueueIfNotEnqueued.
   Mutex* const lock_;
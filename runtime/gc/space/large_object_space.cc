@@ -19,6 +19,7 @@
 #include <sys/mman.h>
 
 #include <memory>
+#include <ostream>
 
 #include <android-base/logging.h>
 
@@ -27,6 +28,7 @@
 #include "base/mutex-inl.h"
 #include "base/os.h"
 #include "base/stl_util.h"
+#include "base/utils.h"
 #include "gc/accounting/heap_bitmap-inl.h"
 #include "gc/accounting/space_bitmap-inl.h"
 #include "gc/heap.h"
@@ -113,7 +115,7 @@ LargeObjectSpace::LargeObjectSpace(const std::string& name, uint8_t* begin, uint
     : DiscontinuousSpace(name, kGcRetentionPolicyAlwaysCollect),
       lock_(lock_name, kAllocSpaceLock),
       num_bytes_allocated_(0), num_objects_allocated_(0), total_bytes_allocated_(0),
-      total_objects_allocated_(0), begin_(begin), end_(end) {
+      total_objects_allocated_(0), pending_free_bytes_(0), begin_(begin), end_(end) {
 }
 
 
@@ -177,6 +179,7 @@ bool LargeObjectMapSpace::IsZygoteLargeObject(Thread* self, mirror::Object* obj)
 }
 
 void LargeObjectMapSpace::SetAllLargeObjectsAsZygoteObjects(Thread* self) {
+  FreePendingObjects(self);
   MutexLock mu(self, lock_);
   for (auto& pair : large_objects_) {
     pair.second.is_zygote = true;
@@ -222,7 +225,56 @@ size_t LargeObjectSpace::FreeList(Thread* self, size_t num_ptrs, mirror::Object*
   return total;
 }
 
+size_t LargeObjectSpace::AddPendingObjects(Thread* self, size_t num_ptrs, mirror::Object** ptrs) {
+  // Get the sizes outside of lock_, the objects are dead so nobody else frees them.
+  size_t total = 0;
+  std::vector<std::pair<mirror::Object*, size_t>> objects;
+  objects.reserve(num_ptrs);
+  for (size_t i = 0; i < num_ptrs; ++i) {
+    if (kDebugSpaces) {
+      CHECK(Contains(ptrs[i]));
+    }
+    const size_t size = AllocationSize(ptrs[i], nullptr);
+    objects.emplace_back(ptrs[i], size);
+    total += size;
+  }
+  MutexLock mu(self, lock_);
+  pending_free_objects_.insert(pending_free_objects_.end(), objects.begin(), objects.end());
+  pending_free_bytes_ += total;
+  return total;
+}
+
+size_t LargeObjectSpace::FreePendingObjects(Thread* self) {
+  // Free one object at a time so that allocations are not blocked for long, Free() takes lock_.
+  size_t total = 0;
+  while (true) {
+    std::pair<mirror::Object*, size_t> object;
+    {
+      MutexLock mu(self, lock_);
+      if (pending_free_objects_.empty()) {
+        break;
+      }
+      object = pending_free_objects_.back();
+      pending_free_objects_.pop_back();
+      DCHECK_GE(pending_free_bytes_, object.second);
+      pending_free_bytes_ -= object.second;
+    }
+    const size_t freed = Free(self, object.first);
+    DCHECK_EQ(freed, object.second);
+    total += freed;
+  }
+  return total;
+}
+
+void LargeObjectSpace::DumpFragmentationInfo(std::ostream& os) const {
+  MutexLock mu(Thread::Current(), lock_);
+  os << GetName() << ": " << PrettySize(num_bytes_allocated_ - pending_free_bytes_)
+     << " allocated, " << pending_free_objects_.size() << " dead objects ("
+     << PrettySize(pending_free_bytes_) << ") pending free\n";
+}
+
 void LargeObjectMapSpace::Walk(DlMallocSpace::WalkCallback callback, void* arg) {
+  FreePendingObjects(Thread::Current());
   MutexLock mu(Thread::Current(), lock_);
   for (auto& pair : large_objects_) {
     MemMap* mem_map = &pair.second.mem_map;
@@ -388,6 +440,7 @@ FreeListSpace::FreeListSpace(const std::string& name,
 FreeListSpace::~FreeListSpace() {}
 
 void FreeListSpace::Walk(DlMallocSpace::WalkCallback callback, void* arg) {
+  FreePendingObjects(Thread::Current());
   MutexLock mu(Thread::Current(), lock_);
   const uintptr_t free_end_start = reinterpret_cast<uintptr_t>(end_) - free_end_;
   AllocationInfo* cur_info = &allocation_info_[0];
@@ -411,12 +464,18 @@ void FreeListSpace::ForEachMemMap(std::function<void(const MemMap&)> func) const
   func(mem_map_);
 }
 
+void FreeListSpace::AddFreePrev(AllocationInfo* info) {
+  CHECK_GT(info->GetPrevFree(), 0U);
+  free_blocks_[GetFreeBlockBucket(info->GetPrevFreeBytes())].insert(info);
+}
+
 void FreeListSpace::RemoveFreePrev(AllocationInfo* info) {
   CHECK_GT(info->GetPrevFree(), 0U);
-  auto it = free_blocks_.lower_bound(info);
-  CHECK(it != free_blocks_.end());
+  FreeBlocks& free_blocks = free_blocks_[GetFreeBlockBucket(info->GetPrevFreeBytes())];
+  auto it = free_blocks.lower_bound(info);
+  CHECK(it != free_blocks.end());
   CHECK_EQ(*it, info);
-  free_blocks_.erase(it);
+  free_blocks.erase(it);
 }
 
 size_t FreeListSpace::Free(Thread* self, mirror::Object* obj) {
@@ -463,7 +522,7 @@ size_t FreeListSpace::Free(Thread* self, mirror::Object* obj) {
       new_free_info = next_info;
     }
     new_free_info->SetPrevFreeBytes(new_free_size);
-    free_blocks_.insert(new_free_info);
+    AddFreePrev(new_free_info);
     info->SetByteSize(new_free_size, true);
     DCHECK_EQ(info->GetNextInfo(), new_free_info);
   }
@@ -491,17 +550,36 @@ size_t FreeListSpace::AllocationSize(mirror::Object* obj, size_t* usable_size) {
 
 mirror::Object* FreeListSpace::Alloc(Thread* self, size_t num_bytes, size_t* bytes_allocated,
                                      size_t* usable_size, size_t* bytes_tl_bulk_allocated) {
+  mirror::Object* obj =
+      TryAlloc(self, num_bytes, bytes_allocated, usable_size, bytes_tl_bulk_allocated);
+  if (UNLIKELY(obj == nullptr) && FreePendingObjects(self) != 0u) {
+    // The objects found dead by the last GC may not have been freed yet.
+    obj = TryAlloc(self, num_bytes, bytes_allocated, usable_size, bytes_tl_bulk_allocated);
+  }
+  return obj;
+}
+
+mirror::Object* FreeListSpace::TryAlloc(Thread* self, size_t num_bytes, size_t* bytes_allocated,
+                                        size_t* usable_size, size_t* bytes_tl_bulk_allocated) {
   MutexLock mu(self, lock_);
   const size_t allocation_size = RoundUp(num_bytes, kAlignment);
   AllocationInfo temp_info;
   temp_info.SetPrevFreeBytes(allocation_size);
   temp_info.SetByteSize(0, false);
   AllocationInfo* new_info;
-  // Find the smallest chunk at least num_bytes in size.
-  auto it = free_blocks_.lower_bound(&temp_info);
-  if (it != free_blocks_.end()) {
-    AllocationInfo* info = *it;
-    free_blocks_.erase(it);
+  // Find the smallest chunk at least num_bytes in size. Larger buckets only have larger chunks, so
+  // the first chunk found is the best fit.
+  AllocationInfo* info = nullptr;
+  for (size_t bucket = GetFreeBlockBucket(allocation_size);
+       bucket < kNumFreeBlockBuckets && info == nullptr;
+       ++bucket) {
+    auto it = free_blocks_[bucket].lower_bound(&temp_info);
+    if (it != free_blocks_[bucket].end()) {
+      info = *it;
+      free_blocks_[bucket].erase(it);
+    }
+  }
+  if (info != nullptr) {
     // Fit our object in the previous allocation info free space.
     new_info = info->GetPrevFreeInfo();
     // Remove the newly allocated block from the info and update the prev_free_.
@@ -511,7 +589,7 @@ mirror::Object* FreeListSpace::Alloc(Thread* self, size_t num_bytes, size_t* byt
       new_free->SetPrevFreeBytes(0);
       new_free->SetByteSize(info->GetPrevFreeBytes(), true);
       // If there is remaining space, insert back into the free set.
-      free_blocks_.insert(info);
+      AddFreePrev(info);
     }
   } else {
     // Try to steal some memory from the free space at the end of the space.
@@ -573,6 +651,37 @@ void FreeListSpace::Dump(std::ostream& os) const {
   }
 }
 
+void FreeListSpace::DumpFragmentationInfo(std::ostream& os) const {
+  LargeObjectSpace::DumpFragmentationInfo(os);
+  MutexLock mu(Thread::Current(), lock_);
+  size_t free_blocks = 0;
+  size_t free_block_bytes = 0;
+  size_t largest_free_block = 0;
+  os << GetName() << " free blocks by size:";
+  for (size_t bucket = 0; bucket < kNumFreeBlockBuckets; ++bucket) {
+    if (free_blocks_[bucket].empty()) {
+      continue;
+    }
+    size_t bucket_bytes = 0;
+    for (const AllocationInfo* info : free_blocks_[bucket]) {
+      bucket_bytes += info->GetPrevFreeBytes();
+      largest_free_block = std::max(largest_free_block, info->GetPrevFreeBytes());
+    }
+    os << " " << PrettySize(kAlignment << bucket)
+       << (bucket == kNumFreeBlockBuckets - 1 ? "+" : "") << ": " << free_blocks_[bucket].size()
+       << " (" << PrettySize(bucket_bytes) << ")";
+    free_blocks += free_blocks_[bucket].size();
+    free_block_bytes += bucket_bytes;
+  }
+  // Fragmentation is the share of the free memory that a single allocation cannot use.
+  const size_t free_bytes = free_block_bytes + free_end_;
+  const size_t largest_free = std::max(largest_free_block, free_end_);
+  os << "\n" << GetName() << " free blocks " << free_blocks << " (" << PrettySize(free_block_bytes)
+     << "), free end " << PrettySize(free_end_) << ", largest free block "
+     << PrettySize(largest_free) << ", fragmentation "
+     << (free_bytes == 0u ? 0u : 100u - largest_free * 100u / free_bytes) << "%\n";
+}
+
 bool FreeListSpace::IsZygoteLargeObject(Thread* self ATTRIBUTE_UNUSED, mirror::Object* obj) const {
   const AllocationInfo* info = GetAllocationInfoForAddress(reinterpret_cast<uintptr_t>(obj));
   DCHECK(info != nullptr);
@@ -580,6 +689,7 @@ bool FreeListSpace::IsZygoteLargeObject(Thread* self ATTRIBUTE_UNUSED, mirror::O
 }
 
 void FreeListSpace::SetAllLargeObjectsAsZygoteObjects(Thread* self) {
+  FreePendingObjects(self);
   MutexLock mu(self, lock_);
   uintptr_t free_end_start = reinterpret_cast<uintptr_t>(end_) - free_end_;
   for (AllocationInfo* cur_info = GetAllocationInfoForAddress(reinterpret_cast<uintptr_t>(Begin())),
@@ -605,13 +715,15 @@ void LargeObjectSpace::SweepCallback(size_t num_ptrs, mirror::Object** ptrs, voi
     }
   }
   context->freed.objects += num_ptrs;
-  context->freed.bytes += space->FreeList(self, num_ptrs, ptrs);
+  context->freed.bytes += space->AddPendingObjects(self, num_ptrs, ptrs);
 }
 
 collector::ObjectBytePair LargeObjectSpace::Sweep(bool swap_bitmaps) {
   if (Begin() >= End()) {
     return collector::ObjectBytePair(0, 0);
   }
+  // Normally done by a heap task after the previous GC, bounds the pending objects to one sweep.
+  FreePendingObjects(Thread::Current());
   accounting::LargeObjectBitmap* live_bitmap = GetLiveBitmap();
   accounting::LargeObjectBitmap* mark_bitmap = GetMarkBitmap();
   if (swap_bitmaps) {
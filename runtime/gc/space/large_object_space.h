@@ -18,13 +18,16 @@
 #define ART_RUNTIME_GC_SPACE_LARGE_OBJECT_SPACE_H_
 
 #include "base/allocator.h"
+#include "base/bit_utils.h"
 #include "base/safe_map.h"
 #include "base/tracking_safe_map.h"
 #include "dlmalloc_space.h"
 #include "space.h"
 #include "thread-current-inl.h"
 
+#include <algorithm>
 #include <set>
+#include <utility>
 #include <vector>
 
 namespace art {
@@ -50,13 +53,14 @@ class LargeObjectSpace : public DiscontinuousSpace, public AllocSpace {
   virtual void Walk(DlMallocSpace::WalkCallback, void* arg) = 0;
   virtual ~LargeObjectSpace() {}
 
+  // Objects found dead by a sweep but not freed yet are not counted as allocated.
   uint64_t GetBytesAllocated() override {
     MutexLock mu(Thread::Current(), lock_);
-    return num_bytes_allocated_;
+    return num_bytes_allocated_ - pending_free_bytes_;
   }
   uint64_t GetObjectsAllocated() override {
     MutexLock mu(Thread::Current(), lock_);
-    return num_objects_allocated_;
+    return num_objects_allocated_ - pending_free_objects_.size();
   }
   uint64_t GetTotalBytesAllocated() const {
     MutexLock mu(Thread::Current(), lock_);
@@ -80,7 +84,18 @@ class LargeObjectSpace : public DiscontinuousSpace, public AllocSpace {
   AllocSpace* AsAllocSpace() override {
     return this;
   }
+  // Sweep only records the dead objects and their sizes. Their memory is released (madvise or
+  // munmap, both under lock_) by FreePendingObjects, off the GC's critical path.
   collector::ObjectBytePair Sweep(bool swap_bitmaps);
+  // Free the objects found dead by the previous sweeps. Called from a heap task after the GC, when
+  // an allocation does not fit and before walking the space. Returns the number of bytes freed.
+  size_t FreePendingObjects(Thread* self) REQUIRES(!lock_);
+  bool HasPendingObjects() const REQUIRES(!lock_) {
+    MutexLock mu(Thread::Current(), lock_);
+    return !pending_free_objects_.empty();
+  }
+  // Dump statistics on the free memory of the space for the SIGQUIT dump.
+  virtual void DumpFragmentationInfo(std::ostream& os) const REQUIRES(!lock_);
   bool CanMoveObjects() const override {
     return false;
   }
@@ -120,6 +135,9 @@ class LargeObjectSpace : public DiscontinuousSpace, public AllocSpace {
                             const char* lock_name);
   static void SweepCallback(size_t num_ptrs, mirror::Object** ptrs, void* arg);
 
+  // Record dead objects to be freed by FreePendingObjects. Returns their total size.
+  size_t AddPendingObjects(Thread* self, size_t num_ptrs, mirror::Object** ptrs) REQUIRES(!lock_);
+
   // Used to ensure mutual exclusion when the allocation spaces data structures,
   // including the allocation counters below, are being modified.
   mutable Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
@@ -136,6 +154,10 @@ class LargeObjectSpace : public DiscontinuousSpace, public AllocSpace {
   uint64_t total_bytes_allocated_ GUARDED_BY(lock_);
   uint64_t total_objects_allocated_ GUARDED_BY(lock_);
 
+  // Dead objects and their sizes, still counted in the fields above until they are freed.
+  std::vector<std::pair<mirror::Object*, size_t>> pending_free_objects_ GUARDED_BY(lock_);
+  uint64_t pending_free_bytes_ GUARDED_BY(lock_);
+
   // Begin and end, may change as more large objects are allocated.
   uint8_t* begin_;
   uint8_t* end_;
@@ -194,10 +216,21 @@ class FreeListSpace final : public LargeObjectSpace {
   size_t Free(Thread* self, mirror::Object* obj) override REQUIRES(!lock_);
   void Walk(DlMallocSpace::WalkCallback callback, void* arg) override REQUIRES(!lock_);
   void Dump(std::ostream& os) const override REQUIRES(!lock_);
+  void DumpFragmentationInfo(std::ostream& os) const override REQUIRES(!lock_);
   void ForEachMemMap(std::function<void(const MemMap&)> func) const override REQUIRES(!lock_);
   std::pair<uint8_t*, uint8_t*> GetBeginEndAtomic() const override REQUIRES(!lock_);
 
  protected:
+  // Free blocks are segregated by size: bucket i holds the blocks of [2^i, 2^(i+1)) pages, the
+  // last bucket holds all larger blocks.
+  static constexpr size_t kNumFreeBlockBuckets = 16;
+
+  static size_t GetFreeBlockBucket(size_t free_bytes) {
+    DCHECK_GE(free_bytes, kAlignment);
+    return std::min(static_cast<size_t>(MostSignificantBit(free_bytes / kAlignment)),
+                    kNumFreeBlockBuckets - 1);
+  }
+
   FreeListSpace(const std::string& name, MemMap&& mem_map, uint8_t* begin, uint8_t* end);
   size_t GetSlotIndexForAddress(uintptr_t address) const {
     DCHECK(Contains(reinterpret_cast<mirror::Object*>(address)));
@@ -212,6 +245,11 @@ class FreeListSpace final : public LargeObjectSpace {
   uintptr_t GetAddressForAllocationInfo(const AllocationInfo* info) const {
     return GetAllocationAddressForSlot(GetSlotIndexForAllocationInfo(info));
   }
+  // Allocate without freeing the pending objects, returns null if there is no room.
+  mirror::Object* TryAlloc(Thread* self, size_t num_bytes, size_t* bytes_allocated,
+                           size_t* usable_size, size_t* bytes_tl_bulk_allocated) REQUIRES(!lock_);
+  // Adds the free block preceding `info` to the free blocks of its size.
+  void AddFreePrev(AllocationInfo* info) REQUIRES(lock_);
   // Removes header from the free blocks set by finding the corresponding iterator and erasing it.
   void RemoveFreePrev(AllocationInfo* info) REQUIRES(lock_);
   bool IsZygoteLargeObject(Thread* self, mirror::Object* obj) const override;
@@ -233,7 +271,7 @@ class FreeListSpace final : public LargeObjectSpace {
 
   // Free bytes at the end of the space.
   size_t free_end_ GUARDED_BY(lock_);
-  FreeBlocks free_blocks_ GUARDED_BY(lock_);
+  FreeBlocks free_blocks_[kNumFreeBlockBuckets] GUARDED_BY(lock_);
 };
 
 }  // namespace space
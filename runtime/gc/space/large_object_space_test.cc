@@ -30,6 +30,9 @@ class LargeObjectSpaceTest : public SpaceTest<CommonRuntimeTest> {
   static constexpr size_t kNumThreads = 10;
   static constexpr size_t kNumIterations = 1000;
   void RaceTest();
+
+  void SweepTest();
+  void BestFitTest();
 };
 
 
@@ -174,6 +177,100 @@ void LargeObjectSpaceTest::RaceTest() {
   }
 }
 
+void LargeObjectSpaceTest::SweepTest() {
+  Thread* const self = Thread::Current();
+  for (size_t i = 0; i < 2; ++i) {
+    const size_t capacity = 16 * MB;
+    LargeObjectSpace* los = (i == 0)
+        ? static_cast<LargeObjectSpace*>(space::LargeObjectMapSpace::Create("large object space"))
+        : static_cast<LargeObjectSpace*>(space::FreeListSpace::Create("large object space",
+                                                                       capacity));
+    static constexpr size_t kNumObjects = 8;
+    const size_t object_size = capacity / kNumObjects;
+    std::vector<mirror::Object*> objects;
+    for (size_t j = 0; j < kNumObjects; ++j) {
+      size_t bytes_allocated = 0, bytes_tl_bulk_allocated;
+      mirror::Object* obj =
+          los->Alloc(self, object_size, &bytes_allocated, nullptr, &bytes_tl_bulk_allocated);
+      ASSERT_TRUE(obj != nullptr);
+      los->GetLiveBitmap()->Set(obj);
+      // Keep every other object alive.
+      if (j % 2 == 0) {
+        los->GetMarkBitmap()->Set(obj);
+      }
+      objects.push_back(obj);
+    }
+
+    collector::ObjectBytePair freed;
+    {
+      WriterMutexLock mu(self, *Locks::heap_bitmap_lock_);
+      freed = los->Sweep(/* swap_bitmaps= */ false);
+    }
+    EXPECT_EQ(kNumObjects / 2, freed.objects);
+    EXPECT_EQ(static_cast<int64_t>(kNumObjects / 2 * object_size), freed.bytes);
+    // The dead objects are not counted as allocated any more, but only freed later.
+    EXPECT_EQ(kNumObjects / 2, los->GetObjectsAllocated());
+    EXPECT_TRUE(los->HasPendingObjects());
+    std::ostringstream oss;
+    los->DumpFragmentationInfo(oss);
+    LOG(INFO) << oss.str();
+
+    if (i == 1) {
+      // The space is full, an allocation frees the pending objects to make room.
+      size_t bytes_allocated = 0, bytes_tl_bulk_allocated;
+      mirror::Object* obj =
+          los->Alloc(self, object_size, &bytes_allocated, nullptr, &bytes_tl_bulk_allocated);
+      EXPECT_TRUE(obj != nullptr);
+      EXPECT_FALSE(los->HasPendingObjects());
+      los->Free(self, obj);
+    } else {
+      EXPECT_EQ(kNumObjects / 2 * object_size, los->FreePendingObjects(self));
+    }
+    EXPECT_FALSE(los->HasPendingObjects());
+    EXPECT_EQ(kNumObjects / 2, los->GetObjectsAllocated());
+    for (size_t j = 0; j < kNumObjects; j += 2) {
+      los->Free(self, objects[j]);
+    }
+    EXPECT_EQ(0U, los->GetBytesAllocated());
+    delete los;
+  }
+}
+
+void LargeObjectSpaceTest::BestFitTest() {
+  Thread* const self = Thread::Current();
+  std::unique_ptr<FreeListSpace> los(FreeListSpace::Create("large object space", 64 * MB));
+  // Allocate objects of increasing sizes separated by small objects, then free the large ones to
+  // get holes of sizes falling in different free block buckets.
+  std::vector<mirror::Object*> holes;
+  std::vector<mirror::Object*> separators;
+  for (size_t pages : {1u, 3u, 7u, 40u, 300u}) {
+    size_t bytes_allocated = 0, bytes_tl_bulk_allocated;
+    holes.push_back(los->Alloc(
+        self, pages * kPageSize, &bytes_allocated, nullptr, &bytes_tl_bulk_allocated));
+    separators.push_back(los->Alloc(
+        self, kPageSize, &bytes_allocated, nullptr, &bytes_tl_bulk_allocated));
+    ASSERT_TRUE(holes.back() != nullptr);
+    ASSERT_TRUE(separators.back() != nullptr);
+  }
+  for (mirror::Object* obj : holes) {
+    los->Free(self, obj);
+  }
+  // Each allocation must go to the smallest hole it fits in.
+  static constexpr struct {
+    size_t pages;
+    size_t hole;
+  } kExpectations[] = { { 300u, 4u }, { 5u, 2u }, { 20u, 3u }, { 2u, 1u } };
+  for (const auto& expectation : kExpectations) {
+    size_t bytes_allocated = 0, bytes_tl_bulk_allocated;
+    mirror::Object* obj = los->Alloc(
+        self, expectation.pages * kPageSize, &bytes_allocated, nullptr, &bytes_tl_bulk_allocated);
+    EXPECT_EQ(holes[expectation.hole], obj) << expectation.pages << " pages";
+  }
+  std::ostringstream oss;
+  los->DumpFragmentationInfo(oss);
+  LOG(INFO) << oss.str();
+}
+
 TEST_F(LargeObjectSpaceTest, LargeObjectTest) {
   LargeObjectTest();
 }
@@ -182,6 +279,14 @@ TEST_F(LargeObjectSpaceTest, RaceTest) {
   RaceTest();
 }
 
+TEST_F(LargeObjectSpaceTest, SweepTest) {
+  SweepTest();
+}
+
+TEST_F(LargeObjectSpaceTest, BestFitTest) {
+  BestFitTest();
+}
+
 }  // namespace space
 }  // namespace gc
 }  // namespace art
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <deque>
+#include <vector>
 
 #include "bump_pointer_space-inl.h"
 #include "bump_pointer_space.h"
@@ -116,7 +117,11 @@ RegionSpace::RegionSpace(const std::string& name, MemMap&& mem_map, bool use_gen
       non_free_region_index_limit_(0U),
       current_region_(&full_region_),
       evac_region_(nullptr),
-      cyclic_alloc_region_index_(0U) {
+      cyclic_alloc_region_index_(0U),
+      resident_free_region_budget_(0U),
+      num_resident_free_regions_(0U),
+      resident_pages_reused_(0U),
+      released_bytes_(0U) {
   CHECK_ALIGNED(mem_map_.Size(), kRegionSize);
   CHECK_ALIGNED(mem_map_.Begin(), kRegionSize);
   DCHECK_GT(num_regions_, 0U);
@@ -158,6 +163,11 @@ size_t RegionSpace::FromSpaceSize() {
   return num_regions * kRegionSize;
 }
 
+size_t RegionSpace::NonFreeRegionsSize() {
+  MutexLock mu(Thread::Current(), region_lock_);
+  return num_non_free_regions_ * kRegionSize;
+}
+
 size_t RegionSpace::UnevacFromSpaceSize() {
   uint64_t num_regions = 0;
   MutexLock mu(Thread::Current(), region_lock_);
@@ -429,6 +439,8 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
   // the lock and loop over the regions to clear the from-space regions and make
   // them availabe for allocation.
   std::deque<std::pair<uint8_t*, uint8_t*>> madvise_list;
+  // Used ranges of the regions kept resident, which are zeroed in place instead.
+  std::vector<std::pair<uint8_t*, uint8_t*>> zero_list;
   // Gather memory ranges that need to be madvised.
   {
     MutexLock mu(Thread::Current(), region_lock_);
@@ -456,6 +468,21 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
       }
       clear_block_end = r->End();
     };
+    // Lambda expression `clear_region` keeps regular regions resident while the budget allows,
+    // and adds the others to the clear block. Pages of a regular region past its top were never
+    // touched, so only the used part needs zeroing.
+    size_t num_new_resident_regions = 0;
+    auto clear_region = [&](Region* r) REQUIRES(region_lock_) {
+      if (r->IsAllocated() &&
+          (num_resident_free_regions_ + num_new_resident_regions + 1) * kRegionSize <=
+              resident_free_region_budget_) {
+        r->is_resident_ = true;
+        ++num_new_resident_regions;
+        zero_list.push_back(std::make_pair(r->Begin(), r->Top()));
+      } else {
+        expand_madvise_range(r);
+      }
+    };
     for (size_t i = 0; i < std::min(num_regions_, non_free_region_index_limit_); ++i) {
       Region* r = &regions_[i];
       // The following check goes through objects in the region, therefore it
@@ -465,7 +492,7 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
         CheckLiveBytesAgainstRegionBitmap(r);
       }
       if (r->IsInFromSpace()) {
-        expand_madvise_range(r);
+        clear_region(r);
       } else if (r->IsInUnevacFromSpace()) {
         // We must skip tails of live large objects.
         if (r->LiveBytes() == 0 && !r->IsLargeTail()) {
@@ -475,7 +502,7 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
           // references to invalid objects. It is also better to clear these regions now
           // instead of at the end of the next GC to save RAM. If we don't clear the regions
           // here, they will be cleared in next GC by the normal live percent evacuation logic.
-          expand_madvise_range(r);
+          clear_region(r);
           // Also release RAM for large tails.
           while (i + 1 < num_regions_ && regions_[i + 1].IsLargeTail()) {
             expand_madvise_range(&regions_[i + 1]);
@@ -495,8 +522,10 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
   }
 
   // Madvise the memory ranges.
+  uint64_t released_bytes = 0;
   for (const auto &iter : madvise_list) {
     ZeroAndProtectRegion(iter.first, iter.second);
+    released_bytes += iter.second - iter.first;
     if (clear_bitmap) {
       GetLiveBitmap()->ClearRange(
           reinterpret_cast<mirror::Object*>(iter.first),
@@ -504,11 +533,22 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
     }
   }
   madvise_list.clear();
+  // Zero the resident regions.
+  for (const auto &iter : zero_list) {
+    std::fill(iter.first, iter.second, 0u);
+    if (clear_bitmap) {
+      GetLiveBitmap()->ClearRange(
+          reinterpret_cast<mirror::Object*>(iter.first),
+          reinterpret_cast<mirror::Object*>(iter.first + kRegionSize));
+    }
+  }
+  zero_list.clear();
 
   // Iterate over regions again and actually make the from space regions
   // available for allocation.
   MutexLock mu(Thread::Current(), region_lock_);
   VerifyNonFreeRegionLimit();
+  released_bytes_ += released_bytes;
 
   // Update max of peak non free region count before reclaiming evacuated regions.
   max_peak_num_non_free_regions_ = std::max(max_peak_num_non_free_regions_,
@@ -522,12 +562,14 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
       *cleared_objects += r->ObjectsAllocated();
       --num_non_free_regions_;
       r->Clear(/*zero_and_release_pages=*/false);
+      num_resident_free_regions_ += r->is_resident_ ? 1u : 0u;
     } else if (r->IsInUnevacFromSpace()) {
       if (r->LiveBytes() == 0) {
         DCHECK(!r->IsLargeTail());
         *cleared_bytes += r->BytesAllocated();
         *cleared_objects += r->ObjectsAllocated();
         r->Clear(/*zero_and_release_pages=*/false);
+        num_resident_free_regions_ += r->is_resident_ ? 1u : 0u;
         size_t free_regions = 1;
         // Also release RAM for large tails.
         while (i + free_regions < num_regions_ && regions_[i + free_regions].IsLargeTail()) {
@@ -626,6 +668,58 @@ void RegionSpace::ClearFromSpace(/* out */ uint64_t* cleared_bytes,
   num_evac_regions_ = 0;
 }
 
+void RegionSpace::SetResidentFreeRegionBudget(size_t budget) {
+  MutexLock mu(Thread::Current(), region_lock_);
+  resident_free_region_budget_ = RoundDown(budget, kRegionSize);
+}
+
+bool RegionSpace::HasResidentFreeRegions() {
+  MutexLock mu(Thread::Current(), region_lock_);
+  return num_resident_free_regions_ != 0u;
+}
+
+size_t RegionSpace::ReleaseResidentFreeRegions(size_t max_bytes) {
+  // Unlike ClearFromSpace, this calls madvise with region_lock_ held so that the regions cannot be
+  // allocated while their pages are released. The callers keep max_bytes small.
+  MutexLock mu(Thread::Current(), region_lock_);
+  size_t released = 0;
+  for (size_t i = 0; i < num_regions_ && num_resident_free_regions_ != 0u; ++i) {
+    if (!regions_[i].IsFree() || !regions_[i].is_resident_) {
+      continue;
+    }
+    if (released + kRegionSize > max_bytes) {
+      break;
+    }
+    // Release adjacent resident free regions with a single madvise.
+    size_t end = i + 1;
+    while (end < num_regions_ &&
+           regions_[end].IsFree() &&
+           regions_[end].is_resident_ &&
+           released + (end + 1 - i) * kRegionSize <= max_bytes) {
+      ++end;
+    }
+    ZeroAndProtectRegion(regions_[i].Begin(), regions_[end - 1].End());
+    for (size_t j = i; j < end; ++j) {
+      regions_[j].is_resident_ = false;
+    }
+    num_resident_free_regions_ -= end - i;
+    released += (end - i) * kRegionSize;
+    i = end - 1;
+  }
+  released_bytes_ += released;
+  return released;
+}
+
+uint64_t RegionSpace::GetResidentPagesReused() {
+  MutexLock mu(Thread::Current(), region_lock_);
+  return resident_pages_reused_;
+}
+
+uint64_t RegionSpace::GetReleasedBytes() {
+  MutexLock mu(Thread::Current(), region_lock_);
+  return released_bytes_;
+}
+
 void RegionSpace::CheckLiveBytesAgainstRegionBitmap(Region* r) {
   if (r->LiveBytes() == static_cast<size_t>(-1)) {
     // Live bytes count is undefined for `r`; nothing to check here.
@@ -763,6 +857,7 @@ void RegionSpace::Clear() {
   }
   SetNonFreeRegionLimit(0);
   DCHECK_EQ(num_non_free_regions_, 0u);
+  num_resident_free_regions_ = 0u;
   current_region_ = &full_region_;
   evac_region_ = &full_region_;
 }
@@ -971,6 +1066,7 @@ void RegionSpace::Region::Clear(bool zero_and_release_pages) {
   live_bytes_ = static_cast<size_t>(-1);
   if (zero_and_release_pages) {
     ZeroAndProtectRegion(begin_, end_);
+    is_resident_ = false;
   }
   is_newly_allocated_ = false;
   is_a_tlab_ = false;
@@ -1019,6 +1115,11 @@ void RegionSpace::Region::MarkAsAllocated(RegionSpace* region_space, uint32_t al
   alloc_time_ = alloc_time;
   region_space->AdjustNonFreeRegionLimit(idx_);
   type_ = RegionType::kRegionTypeToSpace;
+  if (is_resident_) {
+    is_resident_ = false;
+    --region_space->num_resident_free_regions_;
+    region_space->resident_pages_reused_ += kRegionSize / kPageSize;
+  }
   if (kProtectClearedRegions) {
     CheckedCall(mprotect, __FUNCTION__, Begin(), kRegionSize, PROT_READ | PROT_WRITE);
   }
@@ -208,6 +208,12 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
   ALWAYS_INLINE void Walk(Visitor&& visitor) REQUIRES(Locks::mutator_lock_);
   template <typename Visitor>
   ALWAYS_INLINE void WalkToSpace(Visitor&& visitor) REQUIRES(Locks::mutator_lock_);
+  // Same as Walk() but only for the regions in [begin, end). Used to partition a walk across GC
+  // worker threads, which do not hold the mutator lock themselves but run on behalf of the thread
+  // that holds it exclusively.
+  template <typename Visitor>
+  ALWAYS_INLINE void WalkRegions(size_t begin, size_t end, Visitor&& visitor)
+      NO_THREAD_SAFETY_ANALYSIS;
 
   // Scans regions and calls visitor for objects in unevac-space corresponding
   // to the bits set in 'bitmap'.
@@ -242,6 +248,16 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
     return regions_[idx].IsNewlyAllocated();
   }
 
+  bool IsRegionUnevacFromSpace(size_t idx) const NO_THREAD_SAFETY_ANALYSIS {
+    DCHECK_LT(idx, num_regions_);
+    return regions_[idx].IsInUnevacFromSpace();
+  }
+
+  uint8_t* RegionBegin(size_t idx) const NO_THREAD_SAFETY_ANALYSIS {
+    DCHECK_LT(idx, num_regions_);
+    return regions_[idx].Begin();
+  }
+
   bool IsInNewlyAllocatedRegion(mirror::Object* ref) {
     if (HasAddress(ref)) {
       Region* r = RefToRegionUnlocked(ref);
@@ -303,6 +319,8 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
       REQUIRES(!region_lock_);
 
   size_t FromSpaceSize() REQUIRES(!region_lock_);
+  // Size of the regions that are not free, including the unused parts of allocated regions.
+  size_t NonFreeRegionsSize() REQUIRES(!region_lock_);
   size_t UnevacFromSpaceSize() REQUIRES(!region_lock_);
   size_t ToSpaceSize() REQUIRES(!region_lock_);
   void ClearFromSpace(/* out */ uint64_t* cleared_bytes,
@@ -310,11 +328,32 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
                       const bool clear_bitmap)
       REQUIRES(!region_lock_);
 
+  // Keep up to `budget` bytes of the regions freed by ClearFromSpace resident: they are zeroed in
+  // place instead of having their pages released, so that the allocations following a GC do not
+  // fault the same pages back in. Resident free regions are released later, in chunks, by
+  // ReleaseResidentFreeRegions. Zero (the default) releases all the freed regions eagerly.
+  void SetResidentFreeRegionBudget(size_t budget) REQUIRES(!region_lock_);
+  bool HasResidentFreeRegions() REQUIRES(!region_lock_);
+  // Release the pages of at most `max_bytes` of resident free regions. Returns the number of
+  // bytes released.
+  size_t ReleaseResidentFreeRegions(size_t max_bytes) REQUIRES(!region_lock_);
+  // Number of page faults avoided by allocating in resident free regions (counting all the pages
+  // of a reused region), and bytes of freed regions returned to the OS, since the space was
+  // created.
+  uint64_t GetResidentPagesReused() REQUIRES(!region_lock_);
+  uint64_t GetReleasedBytes() REQUIRES(!region_lock_);
+
   void AddLiveBytes(mirror::Object* ref, size_t alloc_size) {
     Region* reg = RefToRegionUnlocked(ref);
     reg->AddLiveBytes(alloc_size);
   }
 
+  // Same as AddLiveBytes, but safe to call from multiple GC threads at once.
+  void AtomicAddLiveBytes(mirror::Object* ref, size_t alloc_size) {
+    Region* reg = RefToRegionUnlocked(ref);
+    reg->AtomicAddLiveBytes(alloc_size);
+  }
+
   void AssertAllRegionLiveBytesZeroOrCleared() REQUIRES(!region_lock_) {
     if (kIsDebugBuild) {
       MutexLock mu(Thread::Current(), region_lock_);
@@ -385,6 +424,7 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
           alloc_time_(0),
           is_newly_allocated_(false),
           is_a_tlab_(false),
+          is_resident_(false),
           state_(RegionState::kRegionStateAllocated),
           type_(RegionType::kRegionTypeToSpace) {}
 
@@ -400,6 +440,7 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
       live_bytes_ = static_cast<size_t>(-1);
       is_newly_allocated_ = false;
       is_a_tlab_ = false;
+      is_resident_ = false;
       thread_ = nullptr;
       DCHECK_LT(begin, end);
       DCHECK_EQ(static_cast<size_t>(end - begin), kRegionSize);
@@ -550,6 +591,14 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
       DCHECK_LE(live_bytes_, BytesAllocated());
     }
 
+    void AtomicAddLiveBytes(size_t live_bytes) {
+      DCHECK(GetUseGenerationalCC() || IsInUnevacFromSpace());
+      DCHECK(!IsLargeTail());
+      DCHECK_NE(live_bytes_, static_cast<size_t>(-1));
+      reinterpret_cast<Atomic<size_t>*>(&live_bytes_)->fetch_add(
+          IsLarge() ? Top() - begin_ : live_bytes, std::memory_order_relaxed);
+    }
+
     bool AllAllocatedBytesAreLive() const {
       return LiveBytes() == static_cast<size_t>(Top() - Begin());
     }
@@ -616,6 +665,9 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
     // special value for `live_bytes_`.
     bool is_newly_allocated_;           // True if it's allocated after the last collection.
     bool is_a_tlab_;                    // True if it's a tlab.
+    // True if the region is free and was zeroed in place by ClearFromSpace rather than having its
+    // pages released, see RegionSpace::SetResidentFreeRegionBudget.
+    bool is_resident_;
     RegionState state_;                 // The region state (see RegionState).
     RegionType type_;                   // The region type (see RegionType).
 
@@ -623,7 +675,8 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
   };
 
   template<bool kToSpaceOnly, typename Visitor>
-  ALWAYS_INLINE void WalkInternal(Visitor&& visitor) NO_THREAD_SAFETY_ANALYSIS;
+  ALWAYS_INLINE void WalkInternal(size_t begin, size_t end, Visitor&& visitor)
+      NO_THREAD_SAFETY_ANALYSIS;
 
   // Visitor will be iterating on objects in increasing address order.
   template<typename Visitor>
@@ -755,6 +808,12 @@ class RegionSpace final : public ContinuousMemMapAllocSpace {
   // `kCyclicRegionAllocation` is true.
   size_t cyclic_alloc_region_index_ GUARDED_BY(region_lock_);
 
+  // Resident free regions, see SetResidentFreeRegionBudget.
+  size_t resident_free_region_budget_ GUARDED_BY(region_lock_);
+  size_t num_resident_free_regions_ GUARDED_BY(region_lock_);
+  uint64_t resident_pages_reused_ GUARDED_BY(region_lock_);
+  uint64_t released_bytes_ GUARDED_BY(region_lock_);
+
   // Mark bitmap used by the GC.
   std::unique_ptr<accounting::ContinuousSpaceBitmap> mark_bitmap_;
 
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "region_space-inl.h"
+
+#include <memory>
+
+#include "base/globals.h"
+#include "common_runtime_test.h"
+
+namespace art {
+namespace gc {
+namespace space {
+
+class RegionSpaceTest : public CommonRuntimeTest {
+ protected:
+  // At most half of the regions can be allocated outside of evacuation.
+  static constexpr size_t kNumRegions = 32;
+  static constexpr size_t kRegionSize = RegionSpace::kRegionSize;
+
+  void SetUp() override {
+    CommonRuntimeTest::SetUp();
+    MemMap mem_map = RegionSpace::CreateMemMap("region space test",
+                                               kNumRegions * kRegionSize,
+                                               /* requested_begin= */ nullptr);
+    ASSERT_TRUE(mem_map.IsValid());
+    region_space_.reset(RegionSpace::Create(
+        "region space test", std::move(mem_map), /* use_generational_cc= */ false));
+  }
+
+  void TearDown() override {
+    region_space_.reset();
+    CommonRuntimeTest::TearDown();
+  }
+
+  // Fill `num_regions` regions, then evacuate and free all of them, as a full GC would.
+  void AllocateAndFreeRegions(size_t num_regions) {
+    for (size_t i = 0; i != num_regions; ++i) {
+      size_t bytes_allocated;
+      size_t usable_size;
+      size_t bytes_tl_bulk_allocated;
+      ASSERT_TRUE(region_space_->AllocNonvirtual</* kForEvac= */ false>(
+          kRegionSize, &bytes_allocated, &usable_size, &bytes_tl_bulk_allocated) != nullptr);
+    }
+    region_space_->SetFromSpace(/* rb_table= */ nullptr,
+                                RegionSpace::kEvacModeForceAll,
+                                /* clear_live_bytes= */ true);
+    uint64_t cleared_bytes;
+    uint64_t cleared_objects;
+    region_space_->ClearFromSpace(&cleared_bytes, &cleared_objects, /* clear_bitmap= */ false);
+    EXPECT_EQ(num_regions * kRegionSize, cleared_bytes);
+  }
+
+  std::unique_ptr<RegionSpace> region_space_;
+};
+
+TEST_F(RegionSpaceTest, ResidentFreeRegionBudget) {
+  // The budget is rounded down to whole regions.
+  region_space_->SetResidentFreeRegionBudget(3 * kRegionSize + kRegionSize / 2);
+  AllocateAndFreeRegions(8);
+  EXPECT_TRUE(region_space_->HasResidentFreeRegions());
+  EXPECT_EQ(5 * kRegionSize, region_space_->GetReleasedBytes());
+
+  // The regions still resident count against the budget. Which regions the allocations reuse
+  // depends on the region allocation strategy.
+  AllocateAndFreeRegions(8);
+  size_t reused_regions = region_space_->GetResidentPagesReused() / (kRegionSize / kPageSize);
+  EXPECT_LE(reused_regions, 3u);
+  EXPECT_EQ((13 - reused_regions) * kRegionSize, region_space_->GetReleasedBytes());
+  EXPECT_TRUE(region_space_->HasResidentFreeRegions());
+}
+
+TEST_F(RegionSpaceTest, ReleaseResidentFreeRegions) {
+  region_space_->SetResidentFreeRegionBudget(4 * kRegionSize);
+  AllocateAndFreeRegions(4);
+  EXPECT_EQ(0u, region_space_->GetReleasedBytes());
+
+  // Never releases more than asked for, even part of a region.
+  EXPECT_EQ(0u, region_space_->ReleaseResidentFreeRegions(kRegionSize / 2));
+  EXPECT_EQ(kRegionSize, region_space_->ReleaseResidentFreeRegions(kRegionSize + kRegionSize / 2));
+  EXPECT_EQ(2 * kRegionSize, region_space_->ReleaseResidentFreeRegions(2 * kRegionSize));
+  EXPECT_TRUE(region_space_->HasResidentFreeRegions());
+  EXPECT_EQ(kRegionSize, region_space_->ReleaseResidentFreeRegions(8 * kRegionSize));
+  EXPECT_FALSE(region_space_->HasResidentFreeRegions());
+  EXPECT_EQ(0u, region_space_->ReleaseResidentFreeRegions(8 * kRegionSize));
+  EXPECT_EQ(4 * kRegionSize, region_space_->GetReleasedBytes());
+
+  // Released regions make room in the budget for the next GC.
+  AllocateAndFreeRegions(4);
+  EXPECT_EQ(4 * kRegionSize, region_space_->GetReleasedBytes());
+  EXPECT_TRUE(region_space_->HasResidentFreeRegions());
+}
+
+}  // namespace space
+}  // namespace gc
+}  // namespace art
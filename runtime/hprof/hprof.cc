@@ -15,32 +15,43 @@
  */
 
 /*
- * Preparation and completion of hprof data generation.  The output is
- * written into two files and then combined.  This is necessary because
- * we generate some of the data (strings and classes) while we dump the
- * heap, and some analysis tools require that the class and string data
- * appear first.
+ * Preparation and completion of hprof data generation.  The dump is
+ * written in a single pass and streamed to the output.  Some of the data
+ * (strings and classes) is only generated while we dump the heap, and
+ * some analysis tools require that the class and string data appear
+ * before the data that refers to them, so their records are emitted
+ * right before the first heap dump segments that use them.  The heap is
+ * split by space and dumped in parallel with the heap thread pool.
+ * Dumps to a file whose name ends with ".gz" are gzip compressed.
  */
 
 #include "hprof.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
 #include <sys/uio.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <zlib.h>
+
+#include <functional>
+#include <memory>
 #include <set>
 
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 
 #include "art_field-inl.h"
 #include "art_method-inl.h"
 #include "base/array_ref.h"
+#include "base/atomic.h"
 #include "base/file_utils.h"
 #include "base/macros.h"
 #include "base/mutex.h"
@@ -68,18 +79,26 @@
 #include "runtime_globals.h"
 #include "scoped_thread_state_change-inl.h"
 #include "thread_list.h"
+#include "thread_pool.h"
 
 namespace art {
 
 namespace hprof {
 
-static constexpr bool kDirectStream = true;
-
 static constexpr uint32_t kHprofTime = 0;
 static constexpr uint32_t kHprofNullThread = 0;
 
 static constexpr size_t kMaxObjectsPerSegment = 128;
 static constexpr size_t kMaxBytesPerSegment = 4096;
+// The heap dump segments are handed over to the output in blocks of about this size. Compressed
+// dumps compress each block on its own, so larger blocks compress better but use more memory.
+static constexpr size_t kOutputBlockSize = 1 * MB;
+
+// A forked child writing a heap dump is killed if it has not finished after this long, so that a
+// stuck child (e.g. blocked on a lock that a thread of the parent held at the fork) cannot hang the
+// caller. The parent checks on the child at the given interval.
+static constexpr uint64_t kForkedDumpTimeoutMs = 5 * 60 * 1000;
+static constexpr useconds_t kForkedDumpPollIntervalUs = 10 * 1000;
 
 // The static field-name for the synthetic object generated to account for class static overhead.
 static constexpr const char* kClassOverheadName = "$classOverhead";
@@ -389,31 +408,6 @@ class EndianOutputBuffered : public EndianOutput {
   std::vector<uint8_t> buffer_;
 };
 
-class FileEndianOutput final : public EndianOutputBuffered {
- public:
-  FileEndianOutput(File* fp, size_t reserved_size)
-      : EndianOutputBuffered(reserved_size), fp_(fp), errors_(false) {
-    DCHECK(fp != nullptr);
-  }
-  ~FileEndianOutput() {
-  }
-
-  bool Errors() {
-    return errors_;
-  }
-
- protected:
-  void HandleFlush(const uint8_t* buffer, size_t length) override {
-    if (!errors_) {
-      errors_ = !fp_->WriteFully(buffer, length);
-    }
-  }
-
- private:
-  File* fp_;
-  bool errors_;
-};
-
 class VectorEndianOuputput final : public EndianOutputBuffered {
  public:
   VectorEndianOuputput(std::vector<uint8_t>& data, size_t reserved_size)
@@ -431,64 +425,87 @@ class VectorEndianOuputput final : public EndianOutputBuffered {
   std::vector<uint8_t>& full_data_;
 };
 
-#define __ output_->
+// Destination of the dump. Blocks are appended in order by the thread holding Hprof::lock_.
+class HprofSink {
+ public:
+  virtual ~HprofSink() {}
+
+  virtual bool Write(const uint8_t* data, size_t length) = 0;
+};
 
-class Hprof : public SingleRootVisitor {
+class FileHprofSink final : public HprofSink {
  public:
-  Hprof(const char* output_filename, int fd, bool direct_to_ddms)
-      : filename_(output_filename),
-        fd_(fd),
-        direct_to_ddms_(direct_to_ddms) {
-    LOG(INFO) << "hprof: heap dump \"" << filename_ << "\" starting...";
+  explicit FileHprofSink(File* fp) : fp_(fp) {
+    DCHECK(fp != nullptr);
   }
 
-  void Dump()
-    REQUIRES(Locks::mutator_lock_)
-    REQUIRES(!Locks::heap_bitmap_lock_, !Locks::alloc_tracker_lock_) {
-    {
-      MutexLock mu(Thread::Current(), *Locks::alloc_tracker_lock_);
-      if (Runtime::Current()->GetHeap()->IsAllocTrackingEnabled()) {
-        PopulateAllocationTrackingTraces();
-      }
-    }
+  bool Write(const uint8_t* data, size_t length) override {
+    return fp_->WriteFully(data, length);
+  }
 
-    // First pass to measure the size of the dump.
-    size_t overall_size;
-    size_t max_length;
-    {
-      EndianOutput count_output;
-      output_ = &count_output;
-      ProcessHeap(false);
-      overall_size = count_output.SumLength();
-      max_length = count_output.MaxLength();
-      output_ = nullptr;
-    }
+ private:
+  File* fp_;
+};
 
-    bool okay;
-    visited_objects_.clear();
-    if (direct_to_ddms_) {
-      if (kDirectStream) {
-        okay = DumpToDdmsDirect(overall_size, max_length, CHUNK_TYPE("HPDS"));
-      } else {
-        okay = DumpToDdmsBuffered(overall_size, max_length);
-      }
-    } else {
-      okay = DumpToFile(overall_size, max_length);
-    }
+// Accumulates the dump for DDMS, which takes the whole dump as a single chunk.
+class VectorHprofSink final : public HprofSink {
+ public:
+  explicit VectorHprofSink(std::vector<uint8_t>* data) : data_(data) {}
 
-    if (okay) {
-      const uint64_t duration = NanoTime() - start_ns_;
-      LOG(INFO) << "hprof: heap dump completed (" << PrettySize(RoundUp(overall_size, KB))
-                << ") in " << PrettyDuration(duration)
-                << " objects " << total_objects_
-                << " objects with stack traces " << total_objects_with_stack_trace_;
-    }
+  bool Write(const uint8_t* data, size_t length) override {
+    data_->insert(data_->end(), data, data + length);
+    return true;
   }
 
  private:
+  std::vector<uint8_t>* data_;
+};
+
+// Compress a block of the dump as a complete gzip member. Concatenated members form a valid gzip
+// file, so blocks can be compressed independently by the threads that wrote them.
+static bool GzipCompress(const uint8_t* data, size_t length, std::vector<uint8_t>* out) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // 16 + MAX_WBITS selects the gzip format. Favor speed since the dump runs with all the threads
+  // suspended.
+  if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    return false;
+  }
+  out->resize(deflateBound(&stream, length));
+  stream.next_in = const_cast<uint8_t*>(data);
+  stream.avail_in = static_cast<uInt>(length);
+  stream.next_out = out->data();
+  stream.avail_out = static_cast<uInt>(out->size());
+  int result = deflate(&stream, Z_FINISH);
+  out->resize(stream.total_out);
+  deflateEnd(&stream);
+  return result == Z_STREAM_END;
+}
+
+#define __ output_->
+
+class Hprof;
+
+// Writes heap dump segments for the roots or a part of the heap, and hands them over to the Hprof
+// in blocks of about kOutputBlockSize. The threads dumping the heap in parallel have their own
+// writer. The string and class ids are assigned by the Hprof, which defines them in the output
+// before the blocks that use them.
+class HeapDumpWriter : public SingleRootVisitor {
+ public:
+  explicit HeapDumpWriter(Hprof* hprof);
+
   void DumpHeapObject(mirror::Object* obj)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Hand the last segment over to the Hprof.
+  void Finish();
+
+  size_t GetTotalObjects() const {
+    return total_objects_;
+  }
+
+ private:
   void DumpHeapClass(mirror::Class* klass)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
@@ -505,126 +522,108 @@ class Hprof : public SingleRootVisitor {
 
   bool AddRuntimeInternalObjectsField(mirror::Class* klass) REQUIRES_SHARED(Locks::mutator_lock_);
 
-  void ProcessHeap(bool header_first)
-      REQUIRES(Locks::mutator_lock_) {
-    // Reset current heap and object count.
-    current_heap_ = HPROF_HEAP_DEFAULT;
-    objects_in_segment_ = 0;
+  void StartNewHeapDumpSegment();
 
-    if (header_first) {
-      ProcessHeader(true);
-      ProcessBody();
-    } else {
-      ProcessBody();
-      ProcessHeader(false);
+  void CheckHeapSegmentConstraints() {
+    if (objects_in_segment_ >= kMaxObjectsPerSegment || output_->Length() >= kMaxBytesPerSegment) {
+      StartNewHeapDumpSegment();
     }
   }
 
-  void ProcessBody() REQUIRES(Locks::mutator_lock_) {
-    Runtime* const runtime = Runtime::Current();
-    // Walk the roots and the heap.
-    output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_SEGMENT, kHprofTime);
-
-    simple_roots_.clear();
-    runtime->VisitRoots(this);
-    runtime->VisitImageRoots(this);
-    auto dump_object = [this](mirror::Object* obj) REQUIRES_SHARED(Locks::mutator_lock_) {
-      DCHECK(obj != nullptr);
-      DumpHeapObject(obj);
-    };
-    runtime->GetHeap()->VisitObjectsPaused(dump_object);
-    output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_END, kHprofTime);
-    output_->EndRecord();
-  }
+  void VisitRoot(mirror::Object* obj, const RootInfo& root_info)
+      override REQUIRES_SHARED(Locks::mutator_lock_);
+  void MarkRootObject(const mirror::Object* obj, jobject jni_obj, HprofHeapTag heap_tag,
+                      uint32_t thread_serial);
 
-  void ProcessHeader(bool string_first) REQUIRES(Locks::mutator_lock_) {
-    // Write the header.
-    WriteFixedHeader();
-    // Write the string and class tables, and any stack traces, to the header.
-    // (jhat requires that these appear before any of the data in the body that refers to them.)
-    // jhat also requires the string table appear before class table and stack traces.
-    // However, WriteStackTraces() can modify the string table, so it's necessary to call
-    // WriteStringTable() last in the first pass, to compute the correct length of the output.
-    if (string_first) {
-      WriteStringTable();
-    }
-    WriteClassTable();
-    WriteStackTraces();
-    if (!string_first) {
-      WriteStringTable();
-    }
-    output_->EndRecord();
+  // The lookups go through a cache of this writer so that the writers rarely contend on the lock
+  // of the Hprof.
+  HprofClassObjectId LookupClassId(mirror::Class* c) REQUIRES_SHARED(Locks::mutator_lock_);
+  HprofStringId LookupStringId(const char* string) {
+    return LookupStringId(std::string(string));
   }
+  HprofStringId LookupStringId(const std::string& string);
+  HprofStackTraceSerialNumber LookupStackTraceSerialNumber(const mirror::Object* obj);
 
-  void WriteClassTable() REQUIRES_SHARED(Locks::mutator_lock_) {
-    for (const auto& p : classes_) {
-      mirror::Class* c = p.first;
-      HprofClassSerialNumber sn = p.second;
-      CHECK(c != nullptr);
-      output_->StartNewRecord(HPROF_TAG_LOAD_CLASS, kHprofTime);
-      // LOAD CLASS format:
-      // U4: class serial number (always > 0)
-      // ID: class object ID. We use the address of the class object structure as its ID.
-      // U4: stack trace serial number
-      // ID: class name string ID
-      __ AddU4(sn);
-      __ AddObjectId(c);
-      __ AddStackTraceSerialNumber(LookupStackTraceSerialNumber(c));
-      __ AddStringId(LookupClassNameId(c));
-    }
-  }
+  Hprof* const hprof_;
 
-  void WriteStringTable() {
-    for (const auto& p : strings_) {
-      const std::string& string = p.first;
-      const HprofStringId id = p.second;
+  std::vector<uint8_t> block_;
+  VectorEndianOuputput block_output_;
+  EndianOutput* const output_;
 
-      output_->StartNewRecord(HPROF_TAG_STRING, kHprofTime);
+  HprofHeapId current_heap_ = HPROF_HEAP_DEFAULT;  // Which heap we're currently dumping.
+  size_t objects_in_segment_ = 0;
 
-      // STRING format:
-      // ID:  ID for this string
-      // U1*: UTF8 characters for string (NOT null terminated)
-      //      (the record format encodes the length)
-      __ AddU4(id);
-      __ AddUtf8String(string.c_str());
-    }
-  }
+  size_t total_objects_ = 0u;
+
+  std::unordered_set<mirror::Class*> known_classes_;
+  std::unordered_map<std::string, HprofStringId> known_strings_;
 
-  void StartNewHeapDumpSegment() {
-    // This flushes the old segment and starts a new one.
-    output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_SEGMENT, kHprofTime);
-    objects_in_segment_ = 0;
-    // Starting a new HEAP_DUMP resets the heap to default.
-    current_heap_ = HPROF_HEAP_DEFAULT;
+  // To make sure we don't dump the same object multiple times. b/34967844
+  std::unordered_set<mirror::Object*> visited_objects_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeapDumpWriter);
+};
+
+class Hprof {
+ public:
+  Hprof(const char* output_filename, int fd, bool direct_to_ddms, bool forked)
+      : filename_(output_filename),
+        fd_(fd),
+        direct_to_ddms_(direct_to_ddms),
+        forked_(forked),
+        compress_(!direct_to_ddms && android::base::EndsWith(filename_, ".gz")),
+        lock_("hprof lock") {
+    LOG(INFO) << "hprof: heap dump \"" << filename_ << "\" starting...";
   }
 
-  void CheckHeapSegmentConstraints() {
-    if (objects_in_segment_ >= kMaxObjectsPerSegment || output_->Length() >= kMaxBytesPerSegment) {
-      StartNewHeapDumpSegment();
+  // Returns whether the dump was written.
+  bool Dump()
+    REQUIRES(Locks::mutator_lock_)
+    REQUIRES(!Locks::heap_bitmap_lock_, !Locks::alloc_tracker_lock_, !lock_) {
+    {
+      MutexLock mu(Thread::Current(), *Locks::alloc_tracker_lock_);
+      if (Runtime::Current()->GetHeap()->IsAllocTrackingEnabled()) {
+        PopulateAllocationTrackingTraces();
+      }
     }
-  }
 
-  void VisitRoot(mirror::Object* obj, const RootInfo& root_info)
-      override REQUIRES_SHARED(Locks::mutator_lock_);
-  void MarkRootObject(const mirror::Object* obj, jobject jni_obj, HprofHeapTag heap_tag,
-                      uint32_t thread_serial);
+    bool okay;
+    if (direct_to_ddms_) {
+      okay = DumpToDdms(CHUNK_TYPE("HPDS"));
+    } else {
+      okay = DumpToFile();
+    }
 
-  HprofClassObjectId LookupClassId(mirror::Class* c) REQUIRES_SHARED(Locks::mutator_lock_) {
+    if (okay) {
+      const uint64_t duration = NanoTime() - start_ns_;
+      MutexLock mu(Thread::Current(), lock_);
+      LOG(INFO) << "hprof: heap dump completed (" << PrettySize(RoundUp(dump_bytes_, KB))
+                << (compress_ ? ", compressed to " + PrettySize(RoundUp(bytes_written_, KB)) : "")
+                << ") in " << PrettyDuration(duration)
+                << " objects " << total_objects_
+                << " objects with stack traces " << total_objects_with_stack_trace_
+                << " threads " << num_threads_;
+    }
+    return okay;
+  }
+
+  // Called by the writers, possibly concurrently.
+  HprofClassObjectId LookupClassId(mirror::Class* c)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_) {
     if (c != nullptr) {
-      auto it = classes_.find(c);
-      if (it == classes_.end()) {
-        // first time to see this class
-        HprofClassSerialNumber sn = next_class_serial_number_++;
-        classes_.Put(c, sn);
-        // Make sure that we've assigned a string ID for this class' name
-        LookupClassNameId(c);
-      }
+      MutexLock mu(Thread::Current(), lock_);
+      LookupClassSerialNumber(c);
     }
     return PointerToLowMemUInt32(c);
   }
 
-  HprofStackTraceSerialNumber LookupStackTraceSerialNumber(const mirror::Object* obj)
-      REQUIRES_SHARED(Locks::mutator_lock_) {
+  HprofStringId LookupStringId(const std::string& string) REQUIRES(!lock_) {
+    MutexLock mu(Thread::Current(), lock_);
+    return LookupStringIdLocked(string);
+  }
+
+  HprofStackTraceSerialNumber LookupStackTraceSerialNumber(const mirror::Object* obj) {
+    // The allocation records and traces are not modified once the dump has started.
     auto r = allocation_records_.find(obj);
     if (r == allocation_records_.end()) {
       return kHprofNullStackTrace;
@@ -636,26 +635,212 @@ class Hprof : public SingleRootVisitor {
     }
   }
 
-  HprofStringId LookupStringId(mirror::String* string) REQUIRES_SHARED(Locks::mutator_lock_) {
-    return LookupStringId(string->ToModifiedUtf8());
+  // Returns whether the simple root record with the given key has not been emitted yet, see
+  // simple_roots_.
+  bool AddSimpleRoot(uint64_t key) REQUIRES(!lock_) {
+    MutexLock mu(Thread::Current(), lock_);
+    return simple_roots_.insert(key).second;
   }
 
-  HprofStringId LookupStringId(const char* string) {
-    return LookupStringId(std::string(string));
+  // Append a block of records to the output. The strings and classes looked up for the block are
+  // defined first. Clears the block.
+  void WriteBlock(std::vector<uint8_t>* block) REQUIRES(!lock_) {
+    if (block->empty()) {
+      return;
+    }
+    // Compress without holding the lock so that the writers compress in parallel.
+    std::vector<uint8_t> compressed;
+    bool compressed_okay = !compress_ || GzipCompress(block->data(), block->size(), &compressed);
+    MutexLock mu(Thread::Current(), lock_);
+    if (!compressed_okay) {
+      errors_ = true;
+    }
+    WritePendingTables();
+    dump_bytes_ += block->size();
+    if (compress_) {
+      Output(compressed.data(), compressed.size());
+    } else {
+      Output(block->data(), block->size());
+    }
+    block->clear();
+  }
+
+ private:
+  void DumpHeader() REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_) {
+    std::vector<uint8_t> block;
+    VectorEndianOuputput block_output(block, kMaxBytesPerSegment);
+    output_ = &block_output;
+    // The fixed header goes first, before any string or class definition.
+    WriteFixedHeader();
+    output_->EndRecord();
+    WriteBlock(&block);
+    // The strings and classes used by the stack traces are defined before them by WriteBlock().
+    WriteStackTraces();
+    output_->EndRecord();
+    WriteBlock(&block);
+    output_ = nullptr;
+  }
+
+  void DumpBody() REQUIRES(Locks::mutator_lock_) REQUIRES(!Locks::heap_bitmap_lock_, !lock_) {
+    Thread* const self = Thread::Current();
+    Runtime* const runtime = Runtime::Current();
+    gc::Heap* const heap = runtime->GetHeap();
+    // The workers of the heap thread pool do not exist in a forked child.
+    ThreadPool* const thread_pool = forked_ ? nullptr : heap->GetThreadPool();
+    // Walk the roots, and the heap if there is no thread pool to split the walk.
+    {
+      HeapDumpWriter writer(this);
+      runtime->VisitRoots(&writer);
+      runtime->VisitImageRoots(&writer);
+      if (thread_pool == nullptr) {
+        auto dump_object = [&writer](mirror::Object* obj) REQUIRES_SHARED(Locks::mutator_lock_) {
+          DCHECK(obj != nullptr);
+          writer.DumpHeapObject(obj);
+        };
+        heap->VisitObjectsPaused(dump_object);
+        num_threads_ = 1u;
+      }
+      writer.Finish();
+      total_objects_ += writer.GetTotalObjects();
+    }
+    if (thread_pool != nullptr) {
+      DumpObjectsParallel(self, heap, thread_pool);
+    }
+
+    std::vector<uint8_t> block;
+    {
+      VectorEndianOuputput block_output(block, kMaxBytesPerSegment);
+      block_output.StartNewRecord(HPROF_TAG_HEAP_DUMP_END, kHprofTime);
+      block_output.EndRecord();
+    }
+    WriteBlock(&block);
+  }
+
+  // Split the heap by space and dump the parts with the heap thread pool. The workers run on behalf
+  // of this thread, which keeps the mutators suspended.
+  void DumpObjectsParallel(Thread* self, gc::Heap* heap, ThreadPool* thread_pool)
+      REQUIRES(Locks::mutator_lock_) REQUIRES(!Locks::heap_bitmap_lock_, !lock_) {
+    std::vector<gc::Heap::ObjectVisitChunk> chunks = heap->GetObjectVisitChunks(self);
+    if (chunks.empty()) {
+      return;
+    }
+    const size_t num_tasks = std::min(thread_pool->GetThreadCount() + 1u, chunks.size());
+    std::vector<std::unique_ptr<HeapDumpWriter>> writers;
+    Atomic<size_t> next_chunk(0u);
+    for (size_t task = 0; task < num_tasks; ++task) {
+      writers.emplace_back(new HeapDumpWriter(this));
+      HeapDumpWriter* writer = writers.back().get();
+      thread_pool->AddTask(self, new FunctionTask([writer, &chunks, &next_chunk](Thread*)
+          NO_THREAD_SAFETY_ANALYSIS {
+        std::function<void(mirror::Object*)> callback = [writer](mirror::Object* obj)
+            NO_THREAD_SAFETY_ANALYSIS {
+          DCHECK(obj != nullptr);
+          writer->DumpHeapObject(obj);
+        };
+        for (size_t i = next_chunk.fetch_add(1u, std::memory_order_relaxed);
+             i < chunks.size();
+             i = next_chunk.fetch_add(1u, std::memory_order_relaxed)) {
+          chunks[i](callback);
+        }
+        writer->Finish();
+      }));
+    }
+    thread_pool->SetMaxActiveWorkers(num_tasks - 1u);
+    thread_pool->StartWorkers(self);
+    thread_pool->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+    thread_pool->StopWorkers(self);
+    for (const std::unique_ptr<HeapDumpWriter>& writer : writers) {
+      total_objects_ += writer->GetTotalObjects();
+    }
+    num_threads_ = num_tasks;
+  }
+
+  // Define the strings and classes looked up since the last block. The class names are looked up
+  // with the classes, so the STRING records come first.
+  void WritePendingTables() REQUIRES(lock_) {
+    if (pending_strings_.empty() && pending_classes_.empty()) {
+      return;
+    }
+    std::vector<uint8_t> tables;
+    {
+      VectorEndianOuputput output(tables, kMaxBytesPerSegment);
+      for (const auto& p : pending_strings_) {
+        const HprofStringId id = p.first;
+        const std::string& string = p.second;
+
+        output.StartNewRecord(HPROF_TAG_STRING, kHprofTime);
+
+        // STRING format:
+        // ID:  ID for this string
+        // U1*: UTF8 characters for string (NOT null terminated)
+        //      (the record format encodes the length)
+        output.AddU4(id);
+        output.AddUtf8String(string.c_str());
+      }
+      for (const PendingClass& p : pending_classes_) {
+        output.StartNewRecord(HPROF_TAG_LOAD_CLASS, kHprofTime);
+        // LOAD CLASS format:
+        // U4: class serial number (always > 0)
+        // ID: class object ID. We use the address of the class object structure as its ID.
+        // U4: stack trace serial number
+        // ID: class name string ID
+        output.AddU4(p.serial_number);
+        output.AddObjectId(p.klass);
+        output.AddStackTraceSerialNumber(LookupStackTraceSerialNumber(p.klass));
+        output.AddStringId(p.name_id);
+      }
+      output.EndRecord();
+    }
+    pending_strings_.clear();
+    pending_classes_.clear();
+    dump_bytes_ += tables.size();
+    if (compress_) {
+      std::vector<uint8_t> compressed;
+      if (!GzipCompress(tables.data(), tables.size(), &compressed)) {
+        errors_ = true;
+        return;
+      }
+      Output(compressed.data(), compressed.size());
+    } else {
+      Output(tables.data(), tables.size());
+    }
   }
 
-  HprofStringId LookupStringId(const std::string& string) {
+  void Output(const uint8_t* data, size_t length) REQUIRES(lock_) {
+    if (!errors_) {
+      errors_ = !sink_->Write(data, length);
+      bytes_written_ += length;
+    }
+  }
+
+  HprofClassSerialNumber LookupClassSerialNumber(mirror::Class* c)
+      REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(lock_) {
+    DCHECK(c != nullptr);
+    auto it = classes_.find(c);
+    if (it != classes_.end()) {
+      return it->second;
+    }
+    // first time to see this class
+    HprofClassSerialNumber sn = next_class_serial_number_++;
+    classes_.Put(c, sn);
+    // Make sure that we've assigned a string ID for this class' name
+    pending_classes_.push_back(PendingClass { c, sn, LookupStringIdLocked(c->PrettyDescriptor()) });
+    return sn;
+  }
+
+  HprofStringId LookupStringIdLocked(const std::string& string) REQUIRES(lock_) {
     auto it = strings_.find(string);
     if (it != strings_.end()) {
       return it->second;
     }
     HprofStringId id = next_string_id_++;
     strings_.Put(string, id);
+    pending_strings_.emplace_back(id, string);
     return id;
   }
 
-  HprofStringId LookupClassNameId(mirror::Class* c) REQUIRES_SHARED(Locks::mutator_lock_) {
-    return LookupStringId(c->PrettyDescriptor());
+  HprofStringId LookupStringId(const char* string) REQUIRES(!lock_) {
+    return LookupStringId(std::string(string));
   }
 
   void WriteFixedHeader() {
@@ -682,7 +867,7 @@ class Hprof : public SingleRootVisitor {
     __ AddU4(static_cast<uint32_t>(nowMs & 0xFFFFFFFF));
   }
 
-  void WriteStackTraces() REQUIRES_SHARED(Locks::mutator_lock_) {
+  void WriteStackTraces() REQUIRES_SHARED(Locks::mutator_lock_) REQUIRES(!lock_) {
     // Write a dummy stack trace record so the analysis tools don't freak out.
     output_->StartNewRecord(HPROF_TAG_STACK_TRACE, kHprofTime);
     __ AddStackTraceSerialNumber(kHprofNullStackTrace);
@@ -719,9 +904,11 @@ class Hprof : public SingleRootVisitor {
           source_file = "";
         }
         __ AddStringId(LookupStringId(source_file));
-        auto class_result = classes_.find(method->GetDeclaringClass().Ptr());
-        CHECK(class_result != classes_.end());
-        __ AddU4(class_result->second);
+        {
+          // The heap has not been dumped yet, the declaring class may not have a serial number.
+          MutexLock mu(Thread::Current(), lock_);
+          __ AddU4(LookupClassSerialNumber(method->GetDeclaringClass().Ptr()));
+        }
         __ AddU4(frame->ComputeLineNumber());
       }
 
@@ -744,34 +931,37 @@ class Hprof : public SingleRootVisitor {
     }
   }
 
-  bool DumpToDdmsBuffered(size_t overall_size ATTRIBUTE_UNUSED, size_t max_length ATTRIBUTE_UNUSED)
-      REQUIRES(Locks::mutator_lock_) {
-    LOG(FATAL) << "Unimplemented";
-    UNREACHABLE();
-    //        // Send the data off to DDMS.
-    //        iovec iov[2];
-    //        iov[0].iov_base = header_data_ptr_;
-    //        iov[0].iov_len = header_data_size_;
-    //        iov[1].iov_base = body_data_ptr_;
-    //        iov[1].iov_len = body_data_size_;
-    //        Dbg::DdmSendChunkV(CHUNK_TYPE("HPDS"), iov, 2);
+  // Write the header and the heap in a single pass. The records are streamed to the sink in
+  // blocks, see WriteBlock().
+  void DumpToSink(HprofSink* sink)
+      REQUIRES(Locks::mutator_lock_) REQUIRES(!Locks::heap_bitmap_lock_, !lock_) {
+    {
+      MutexLock mu(Thread::Current(), lock_);
+      sink_ = sink;
+    }
+    DumpHeader();
+    DumpBody();
+    MutexLock mu(Thread::Current(), lock_);
+    sink_ = nullptr;
   }
 
-  bool DumpToFile(size_t overall_size, size_t max_length)
-      REQUIRES(Locks::mutator_lock_) {
+  bool DumpToFile() REQUIRES(Locks::mutator_lock_) REQUIRES(!Locks::heap_bitmap_lock_, !lock_) {
     // Where exactly are we writing to?
     int out_fd;
     if (fd_ >= 0) {
       out_fd = DupCloexec(fd_);
       if (out_fd < 0) {
-        ThrowRuntimeException("Couldn't dump heap; dup(%d) failed: %s", fd_, strerror(errno));
+        ReportError(android::base::StringPrintf("Couldn't dump heap; dup(%d) failed: %s",
+                                                fd_,
+                                                strerror(errno)));
         return false;
       }
     } else {
       out_fd = open(filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
       if (out_fd < 0) {
-        ThrowRuntimeException("Couldn't dump heap; open(\"%s\") failed: %s", filename_.c_str(),
-                              strerror(errno));
+        ReportError(android::base::StringPrintf("Couldn't dump heap; open(\"%s\") failed: %s",
+                                                filename_.c_str(),
+                                                strerror(errno)));
         return false;
       }
     }
@@ -779,17 +969,10 @@ class Hprof : public SingleRootVisitor {
     std::unique_ptr<File> file(new File(out_fd, filename_, true));
     bool okay;
     {
-      FileEndianOutput file_output(file.get(), max_length);
-      output_ = &file_output;
-      ProcessHeap(true);
-      okay = !file_output.Errors();
-
-      if (okay) {
-        // Check for expected size. Output is expected to be less-or-equal than first phase, see
-        // b/23521263.
-        DCHECK_LE(file_output.SumLength(), overall_size);
-      }
-      output_ = nullptr;
+      FileHprofSink sink(file.get());
+      DumpToSink(&sink);
+      MutexLock mu(Thread::Current(), lock_);
+      okay = !errors_;
     }
 
     if (okay) {
@@ -801,33 +984,38 @@ class Hprof : public SingleRootVisitor {
       std::string msg(android::base::StringPrintf("Couldn't dump heap; writing \"%s\" failed: %s",
                                                   filename_.c_str(),
                                                   strerror(errno)));
-      ThrowRuntimeException("%s", msg.c_str());
-      LOG(ERROR) << msg;
+      ReportError(msg);
+      if (!forked_) {
+        LOG(ERROR) << msg;
+      }
     }
 
     return okay;
   }
 
-  bool DumpToDdmsDirect(size_t overall_size, size_t max_length, uint32_t chunk_type)
-      REQUIRES(Locks::mutator_lock_) {
+  // A forked child must not allocate in its copy of the heap, it only logs the error. The parent
+  // throws once the child exits, see DumpHeapForked().
+  void ReportError(const std::string& msg) REQUIRES_SHARED(Locks::mutator_lock_) {
+    if (forked_) {
+      LOG(ERROR) << msg;
+    } else {
+      ThrowRuntimeException("%s", msg.c_str());
+    }
+  }
+
+  bool DumpToDdms(uint32_t chunk_type)
+      REQUIRES(Locks::mutator_lock_) REQUIRES(!Locks::heap_bitmap_lock_, !lock_) {
     CHECK(direct_to_ddms_);
 
     std::vector<uint8_t> out_data;
-
-    // TODO It would be really good to have some streaming thing again. b/73084059
-    VectorEndianOuputput output(out_data, max_length);
-    output_ = &output;
+    VectorHprofSink sink(&out_data);
 
     // Write the dump.
-    ProcessHeap(true);
+    DumpToSink(&sink);
 
     Runtime::Current()->GetRuntimeCallbacks()->DdmPublishChunk(
         chunk_type, ArrayRef<const uint8_t>(out_data.data(), out_data.size()));
 
-    // Check for expected size. See DumpToFile for comment.
-    DCHECK_LE(output.SumLength(), overall_size);
-    output_ = nullptr;
-
     return true;
   }
 
@@ -871,27 +1059,46 @@ class Hprof : public SingleRootVisitor {
     total_objects_with_stack_trace_ = count;
   }
 
+  struct PendingClass {
+    mirror::Class* klass;
+    HprofClassSerialNumber serial_number;
+    HprofStringId name_id;
+  };
+
   // If direct_to_ddms_ is set, "filename_" and "fd" will be ignored.
   // Otherwise, "filename_" must be valid, though if "fd" >= 0 it will
   // only be used for debug messages.
   std::string filename_;
   int fd_;
   bool direct_to_ddms_;
+  // Dumping in a forked child, see DumpHeapForked().
+  const bool forked_;
+  // Write the file as gzip, for file names ending with ".gz".
+  const bool compress_;
 
   uint64_t start_ns_ = NanoTime();
 
+  // Used by the dumping thread for the header.
   EndianOutput* output_ = nullptr;
 
-  HprofHeapId current_heap_ = HPROF_HEAP_DEFAULT;  // Which heap we're currently dumping.
-  size_t objects_in_segment_ = 0;
-
   size_t total_objects_ = 0u;
   size_t total_objects_with_stack_trace_ = 0u;
-
-  HprofStringId next_string_id_ = 0x400000;
-  SafeMap<std::string, HprofStringId> strings_;
-  HprofClassSerialNumber next_class_serial_number_ = 1;
-  SafeMap<mirror::Class*, HprofClassSerialNumber> classes_;
+  size_t num_threads_ = 0u;
+
+  // Protects the string and class tables, which are shared by the writers, and the output.
+  Mutex lock_;
+  HprofSink* sink_ GUARDED_BY(lock_) = nullptr;
+  bool errors_ GUARDED_BY(lock_) = false;
+  size_t dump_bytes_ GUARDED_BY(lock_) = 0u;  // Size of the dump before compression.
+  size_t bytes_written_ GUARDED_BY(lock_) = 0u;
+
+  HprofStringId next_string_id_ GUARDED_BY(lock_) = 0x400000;
+  SafeMap<std::string, HprofStringId> strings_ GUARDED_BY(lock_);
+  HprofClassSerialNumber next_class_serial_number_ GUARDED_BY(lock_) = 1;
+  SafeMap<mirror::Class*, HprofClassSerialNumber> classes_ GUARDED_BY(lock_);
+  // Strings and classes looked up since the last block was written, see WritePendingTables().
+  std::vector<std::pair<HprofStringId, std::string>> pending_strings_ GUARDED_BY(lock_);
+  std::vector<PendingClass> pending_classes_ GUARDED_BY(lock_);
 
   std::unordered_map<const gc::AllocRecordStackTrace*, HprofStackTraceSerialNumber,
                      gc::HashAllocRecordTypesPtr<gc::AllocRecordStackTrace>,
@@ -907,15 +1114,56 @@ class Hprof : public SingleRootVisitor {
   // id. A pair of root type and object id is packed into a uint64_t, with
   // the root type in the upper 32 bits and the object id in the lower 32
   // bits.
-  std::unordered_set<uint64_t> simple_roots_;
-
-  // To make sure we don't dump the same object multiple times. b/34967844
-  std::unordered_set<mirror::Object*> visited_objects_;
+  std::unordered_set<uint64_t> simple_roots_ GUARDED_BY(lock_);
 
-  friend class GcRootVisitor;
   DISALLOW_COPY_AND_ASSIGN(Hprof);
 };
 
+HeapDumpWriter::HeapDumpWriter(Hprof* hprof)
+    : hprof_(hprof),
+      block_output_(block_, kMaxBytesPerSegment),
+      output_(&block_output_) {
+  output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_SEGMENT, kHprofTime);
+}
+
+void HeapDumpWriter::Finish() {
+  output_->EndRecord();
+  hprof_->WriteBlock(&block_);
+}
+
+void HeapDumpWriter::StartNewHeapDumpSegment() {
+  // This flushes the old segment and starts a new one.
+  output_->StartNewRecord(HPROF_TAG_HEAP_DUMP_SEGMENT, kHprofTime);
+  objects_in_segment_ = 0;
+  // Starting a new HEAP_DUMP resets the heap to default.
+  current_heap_ = HPROF_HEAP_DEFAULT;
+  if (block_.size() >= kOutputBlockSize) {
+    hprof_->WriteBlock(&block_);
+  }
+}
+
+HprofClassObjectId HeapDumpWriter::LookupClassId(mirror::Class* c) {
+  if (c != nullptr && known_classes_.insert(c).second) {
+    hprof_->LookupClassId(c);
+  }
+  return PointerToLowMemUInt32(c);
+}
+
+HprofStringId HeapDumpWriter::LookupStringId(const std::string& string) {
+  auto it = known_strings_.find(string);
+  if (it != known_strings_.end()) {
+    return it->second;
+  }
+  HprofStringId id = hprof_->LookupStringId(string);
+  known_strings_.emplace(string, id);
+  return id;
+}
+
+HprofStackTraceSerialNumber HeapDumpWriter::LookupStackTraceSerialNumber(
+    const mirror::Object* obj) {
+  return hprof_->LookupStackTraceSerialNumber(obj);
+}
+
 static HprofBasicType SignatureToBasicTypeAndSize(const char* sig, size_t* size_out) {
   char c = sig[0];
   HprofBasicType ret;
@@ -975,8 +1223,10 @@ static HprofBasicType SignatureToBasicTypeAndSize(const char* sig, size_t* size_
 // something when ctx->gc_scan_state_ is non-zero, which is usually
 // only true when marking the root set or unreachable
 // objects.  Used to add rootset references to obj.
-void Hprof::MarkRootObject(const mirror::Object* obj, jobject jni_obj, HprofHeapTag heap_tag,
-                           uint32_t thread_serial) {
+void HeapDumpWriter::MarkRootObject(const mirror::Object* obj,
+                                    jobject jni_obj,
+                                    HprofHeapTag heap_tag,
+                                    uint32_t thread_serial) {
   if (heap_tag == 0) {
     return;
   }
@@ -992,7 +1242,7 @@ void Hprof::MarkRootObject(const mirror::Object* obj, jobject jni_obj, HprofHeap
     case HPROF_ROOT_DEBUGGER:
     case HPROF_ROOT_VM_INTERNAL: {
       uint64_t key = (static_cast<uint64_t>(heap_tag) << 32) | PointerToLowMemUInt32(obj);
-      if (simple_roots_.insert(key).second) {
+      if (hprof_->AddSimpleRoot(key)) {
         __ AddU1(heap_tag);
         __ AddObjectId(obj);
       }
@@ -1057,7 +1307,7 @@ void Hprof::MarkRootObject(const mirror::Object* obj, jobject jni_obj, HprofHeap
   ++objects_in_segment_;
 }
 
-bool Hprof::AddRuntimeInternalObjectsField(mirror::Class* klass) {
+bool HeapDumpWriter::AddRuntimeInternalObjectsField(mirror::Class* klass) {
   if (klass->IsDexCacheClass()) {
     return true;
   }
@@ -1069,7 +1319,7 @@ bool Hprof::AddRuntimeInternalObjectsField(mirror::Class* klass) {
   return false;
 }
 
-void Hprof::DumpHeapObject(mirror::Object* obj) {
+void HeapDumpWriter::DumpHeapObject(mirror::Object* obj) {
   // Ignore classes that are retired.
   if (obj->IsClass() && obj->AsClass()->IsRetired()) {
     return;
@@ -1183,7 +1433,7 @@ void Hprof::DumpHeapObject(mirror::Object* obj) {
   ++objects_in_segment_;
 }
 
-void Hprof::DumpHeapClass(mirror::Class* klass) {
+void HeapDumpWriter::DumpHeapClass(mirror::Class* klass) {
   if (!klass->IsResolved()) {
     // Class is allocated but not yet resolved: we cannot access its fields or super class.
     return;
@@ -1415,7 +1665,8 @@ void Hprof::DumpHeapClass(mirror::Class* klass) {
   }
 }
 
-void Hprof::DumpFakeObjectArray(mirror::Object* obj, const std::set<mirror::Object*>& elements) {
+void HeapDumpWriter::DumpFakeObjectArray(mirror::Object* obj,
+                                         const std::set<mirror::Object*>& elements) {
   __ AddU1(HPROF_OBJECT_ARRAY_DUMP);
   __ AddObjectId(obj);
   __ AddStackTraceSerialNumber(LookupStackTraceSerialNumber(obj));
@@ -1426,7 +1677,7 @@ void Hprof::DumpFakeObjectArray(mirror::Object* obj, const std::set<mirror::Obje
   }
 }
 
-void Hprof::DumpHeapArray(mirror::Array* obj, mirror::Class* klass) {
+void HeapDumpWriter::DumpHeapArray(mirror::Array* obj, mirror::Class* klass) {
   uint32_t length = obj->GetLength();
 
   if (obj->IsObjectArray()) {
@@ -1466,9 +1717,9 @@ void Hprof::DumpHeapArray(mirror::Array* obj, mirror::Class* klass) {
   }
 }
 
-void Hprof::DumpHeapInstanceObject(mirror::Object* obj,
-                                   mirror::Class* klass,
-                                   const std::set<mirror::Object*>& fake_roots) {
+void HeapDumpWriter::DumpHeapInstanceObject(mirror::Object* obj,
+                                            mirror::Class* klass,
+                                            const std::set<mirror::Object*>& fake_roots) {
   // obj is an instance object.
   __ AddU1(HPROF_INSTANCE_DUMP);
   __ AddObjectId(obj);
@@ -1570,7 +1821,7 @@ void Hprof::DumpHeapInstanceObject(mirror::Object* obj,
   }
 }
 
-void Hprof::VisitRoot(mirror::Object* obj, const RootInfo& info) {
+void HeapDumpWriter::VisitRoot(mirror::Object* obj, const RootInfo& info) {
   static const HprofHeapTag xlate[] = {
     HPROF_ROOT_UNKNOWN,
     HPROF_ROOT_JNI_GLOBAL,
@@ -1595,21 +1846,95 @@ void Hprof::VisitRoot(mirror::Object* obj, const RootInfo& info) {
   MarkRootObject(obj, nullptr, xlate[info.GetType()], info.GetThreadId());
 }
 
+// Suspend all threads only for as long as it takes to fork. The child writes the dump from its
+// copy-on-write snapshot of the heap while the threads of this process resume, and this thread
+// waits for the child to exit. Returns false if the fork failed and nothing was dumped.
+static bool DumpHeapForked(Thread* self, const char* filename, int fd) {
+  pid_t pid;
+  const uint64_t pause_start_ns = NanoTime();
+  {
+    gc::ScopedGCCriticalSection gcs(self,
+                                    gc::kGcCauseHprof,
+                                    gc::kCollectorTypeHprof);
+    ScopedSuspendAll ssa(__FUNCTION__);
+    pid = fork();
+    if (pid == 0) {
+      // Only this thread exists in the child. It still holds the mutator lock exclusively and the
+      // other threads' stacks are part of the snapshot, so their roots can be visited as usual.
+      Hprof hprof(filename, fd, /* direct_to_ddms= */ false, /* forked= */ true);
+      _exit(hprof.Dump() ? 0 : 1);
+    }
+  }
+  if (pid < 0) {
+    PLOG(WARNING) << "hprof: fork failed, dumping the heap with threads suspended";
+    return false;
+  }
+  LOG(INFO) << "hprof: threads were suspended for " << PrettyDuration(NanoTime() - pause_start_ns)
+            << ", dumping in process " << pid;
+
+  int status = -1;
+  bool timed_out = false;
+  const uint64_t deadline_ms = MilliTime() + kForkedDumpTimeoutMs;
+  pid_t result;
+  while ((result = TEMP_FAILURE_RETRY(waitpid(pid, &status, WNOHANG))) == 0) {
+    if (MilliTime() >= deadline_ms) {
+      LOG(ERROR) << "hprof: process " << pid << " did not finish the heap dump in "
+                 << PrettyDuration(MsToNs(kForkedDumpTimeoutMs)) << ", killing it";
+      kill(pid, SIGKILL);
+      result = TEMP_FAILURE_RETRY(waitpid(pid, &status, 0));
+      timed_out = true;
+      break;
+    }
+    usleep(kForkedDumpPollIntervalUs);
+  }
+  if (result != pid) {
+    PLOG(ERROR) << "hprof: waitpid(" << pid << ") failed";
+    status = -1;
+  }
+  if (timed_out) {
+    // Do not leave a truncated dump behind. A dump to a file descriptor belongs to the caller.
+    if (fd < 0) {
+      unlink(filename);
+    }
+    ScopedObjectAccess soa(self);
+    ThrowRuntimeException("Couldn't dump heap; writing \"%s\" in process %d timed out",
+                          filename,
+                          pid);
+  } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    ScopedObjectAccess soa(self);
+    ThrowRuntimeException("Couldn't dump heap; writing \"%s\" in process %d failed",
+                          filename,
+                          pid);
+  }
+  return true;
+}
+
 // If "direct_to_ddms" is true, the other arguments are ignored, and data is
 // sent directly to DDMS.
 // If "fd" is >= 0, the output will be written to that file descriptor.
 // Otherwise, "filename" is used to create an output file.
+// With -XX:HprofFork, dumps to a file are written by a forked child, see DumpHeapForked().
 void DumpHeap(const char* filename, int fd, bool direct_to_ddms) {
   CHECK(filename != nullptr);
   Thread* self = Thread::Current();
+  // DDMS dumps are published as a chunk by this process, they are never forked.
+  if (!direct_to_ddms &&
+      Runtime::Current()->IsHprofForkEnabled() &&
+      DumpHeapForked(self, filename, fd)) {
+    return;
+  }
   // Need to take a heap dump while GC isn't running. See the comment in Heap::VisitObjects().
   // Also we need the critical section to avoid visiting the same object twice. See b/34967844
   gc::ScopedGCCriticalSection gcs(self,
                                   gc::kGcCauseHprof,
                                   gc::kCollectorTypeHprof);
-  ScopedSuspendAll ssa(__FUNCTION__, true /* long suspend */);
-  Hprof hprof(filename, fd, direct_to_ddms);
-  hprof.Dump();
+  const uint64_t pause_start_ns = NanoTime();
+  {
+    ScopedSuspendAll ssa(__FUNCTION__, true /* long suspend */);
+    Hprof hprof(filename, fd, direct_to_ddms, /* forked= */ false);
+    hprof.Dump();
+  }
+  LOG(INFO) << "hprof: threads were suspended for " << PrettyDuration(NanoTime() - pause_start_ns);
 }
 
 }  // namespace hprof
@@ -0,0 +1,477 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hprof.h"
+
+#include <zlib.h>
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include "class_linker-inl.h"
+#include "common_runtime_test.h"
+#include "gc/heap.h"
+#include "handle_scope-inl.h"
+#include "mirror/object_array-alloc-inl.h"
+#include "mirror/object_array-inl.h"
+#include "mirror/string-alloc-inl.h"
+#include "runtime.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+#include "thread_pool.h"
+
+namespace art {
+namespace hprof {
+
+class HprofForkTest : public CommonRuntimeTest {
+ protected:
+  void SetUpRuntimeOptions(RuntimeOptions* options) override {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    options->push_back(std::make_pair("-XX:HprofFork", nullptr));
+  }
+
+  // Check that the dump succeeded and that the file holds a heap dump.
+  static void CheckDump(const std::string& filename) {
+    {
+      ScopedObjectAccess soa(Thread::Current());
+      EXPECT_FALSE(soa.Self()->IsExceptionPending());
+      soa.Self()->ClearException();
+    }
+    std::string dump;
+    ASSERT_TRUE(android::base::ReadFileToString(filename, &dump));
+    const std::string magic("JAVA PROFILE 1.0.3");
+    ASSERT_GT(dump.size(), magic.size());
+    EXPECT_EQ(0, dump.compare(0, magic.size(), magic));
+  }
+};
+
+// Test that a forked child writes the dump to a file.
+TEST_F(HprofForkTest, DumpToFile) {
+  ASSERT_TRUE(Runtime::Current()->IsHprofForkEnabled());
+  ScratchFile file;
+  DumpHeap(file.GetFilename().c_str(), /* fd= */ -1, /* direct_to_ddms= */ false);
+  CheckDump(file.GetFilename());
+}
+
+// Test that a forked child writes the dump to a file descriptor.
+TEST_F(HprofForkTest, DumpToFd) {
+  ScratchFile file;
+  DumpHeap("[fd]", file.GetFd(), /* direct_to_ddms= */ false);
+  CheckDump(file.GetFilename());
+}
+
+// Decompress a file made of concatenated gzip members.
+static bool Gunzip(const std::string& compressed, std::string* out, std::string* error_msg) {
+  z_stream stream = {};
+  // 16 + MAX_WBITS selects the gzip format.
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+    *error_msg = "inflateInit2 failed";
+    return false;
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = compressed.size();
+  uint8_t buffer[64 * KB];
+  int result = Z_OK;
+  while (stream.avail_in != 0u) {
+    stream.next_out = buffer;
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_NO_FLUSH);
+    if (result != Z_OK && result != Z_STREAM_END) {
+      *error_msg = android::base::StringPrintf("inflate failed: %d", result);
+      break;
+    }
+    out->append(reinterpret_cast<const char*>(buffer), sizeof(buffer) - stream.avail_out);
+    if (result == Z_STREAM_END && stream.avail_in != 0u) {
+      // The next gzip member.
+      inflateReset(&stream);
+    }
+  }
+  inflateEnd(&stream);
+  if (error_msg->empty() && result != Z_STREAM_END) {
+    *error_msg = "Truncated gzip stream";
+  }
+  return error_msg->empty();
+}
+
+// Reads the records of a heap dump, and checks that strings and classes are defined before they
+// are used.
+class HprofChecker {
+ public:
+  explicit HprofChecker(const std::string& dump)
+      : data_(reinterpret_cast<const uint8_t*>(dump.data())), size_(dump.size()) {}
+
+  // Returns an error message, empty if the dump is valid.
+  std::string Check() {
+    static const char kMagic[] = "JAVA PROFILE 1.0.3";
+    if (size_ < sizeof(kMagic) || memcmp(data_, kMagic, sizeof(kMagic)) != 0) {
+      return "Bad magic";
+    }
+    pos_ = sizeof(kMagic);
+    uint32_t id_size;
+    uint32_t time;
+    if (!ReadU4(&id_size) || !ReadU4(&time) || !ReadU4(&time)) {
+      return "Truncated header";
+    }
+    if (id_size != sizeof(uint32_t)) {
+      return "Unexpected id size";
+    }
+    while (error_.empty() && pos_ != size_) {
+      uint8_t tag;
+      uint32_t length;
+      if (!ReadU1(&tag) || !ReadU4(&time) || !ReadU4(&length)) {
+        return Error("Truncated record header");
+      }
+      if (seen_end_) {
+        return Error("Record after HEAP_DUMP_END");
+      }
+      if (length > size_ - pos_) {
+        return Error("Truncated record");
+      }
+      const size_t end = pos_ + length;
+      CheckRecord(tag, end);
+      if (error_.empty() && pos_ != end) {
+        Error(android::base::StringPrintf("Record 0x%x has %zu unread bytes", tag, end - pos_));
+      }
+    }
+    if (error_.empty() && !seen_end_) {
+      Error("No HEAP_DUMP_END");
+    }
+    return error_;
+  }
+
+  size_t GetInstances() const { return instances_; }
+  size_t GetClassDumps() const { return class_dumps_; }
+
+ private:
+  // Top-level record tags.
+  static constexpr uint8_t kString = 0x01;
+  static constexpr uint8_t kLoadClass = 0x02;
+  static constexpr uint8_t kStackFrame = 0x04;
+  static constexpr uint8_t kStackTrace = 0x05;
+  static constexpr uint8_t kHeapDump = 0x0c;
+  static constexpr uint8_t kHeapDumpSegment = 0x1c;
+  static constexpr uint8_t kHeapDumpEnd = 0x2c;
+
+  void CheckRecord(uint8_t tag, size_t end) {
+    uint32_t id;
+    uint32_t u4;
+    switch (tag) {
+      case kString:
+        if (ReadU4(&id)) {
+          if (!strings_.insert(id).second) {
+            Error("String defined twice");
+          }
+          pos_ = end;
+        }
+        break;
+      case kLoadClass:
+        if (ReadU4(&u4) && ReadU4(&id) && ReadU4(&u4) && UseString()) {
+          if (!classes_.insert(id).second) {
+            Error("Class loaded twice");
+          }
+        }
+        break;
+      case kStackFrame:
+        if (ReadU4(&id) && UseString() && UseString() && UseString() && ReadU4(&u4)) {
+          ReadU4(&u4);
+        }
+        break;
+      case kStackTrace:
+        pos_ = end;
+        break;
+      case kHeapDump:
+      case kHeapDumpSegment:
+        while (error_.empty() && pos_ < end) {
+          CheckSubRecord();
+        }
+        break;
+      case kHeapDumpEnd:
+        seen_end_ = true;
+        break;
+      default:
+        Error(android::base::StringPrintf("Unexpected record 0x%x", tag));
+        break;
+    }
+  }
+
+  void CheckSubRecord() {
+    uint8_t tag;
+    uint32_t u4;
+    uint8_t type;
+    if (!ReadU1(&tag)) {
+      return;
+    }
+    switch (tag) {
+      case 0xff:  // ROOT_UNKNOWN
+      case 0x05:  // ROOT_STICKY_CLASS
+      case 0x07:  // ROOT_MONITOR_USED
+      case 0x89:  // ROOT_INTERNED_STRING
+      case 0x8b:  // ROOT_DEBUGGER
+      case 0x8d:  // ROOT_VM_INTERNAL
+        Skip(4u);
+        break;
+      case 0x01:  // ROOT_JNI_GLOBAL
+      case 0x04:  // ROOT_NATIVE_STACK
+      case 0x06:  // ROOT_THREAD_BLOCK
+        Skip(8u);
+        break;
+      case 0x02:  // ROOT_JNI_LOCAL
+      case 0x03:  // ROOT_JAVA_FRAME
+      case 0x08:  // ROOT_THREAD_OBJECT
+      case 0x8e:  // ROOT_JNI_MONITOR
+        Skip(12u);
+        break;
+      case 0xfe:  // HEAP_DUMP_INFO
+        if (ReadU4(&u4)) {
+          UseString();
+        }
+        break;
+      case 0x20: {  // CLASS_DUMP
+        ++class_dumps_;
+        if (!UseClass() || !Skip(4u) || !UseClass(/* allow_null= */ true) || !Skip(5u * 4u) ||
+            !Skip(4u)) {
+          return;
+        }
+        uint16_t count;
+        if (!ReadU2(&count)) {
+          return;
+        }
+        for (uint16_t i = 0; i < count && error_.empty(); ++i) {
+          if (Skip(2u) && ReadU1(&type)) {
+            Skip(TypeSize(type));
+          }
+        }
+        if (!ReadU2(&count)) {
+          return;
+        }
+        for (uint16_t i = 0; i < count && error_.empty(); ++i) {
+          if (UseString() && ReadU1(&type)) {
+            Skip(TypeSize(type));
+          }
+        }
+        if (!ReadU2(&count)) {
+          return;
+        }
+        for (uint16_t i = 0; i < count && error_.empty(); ++i) {
+          if (UseString() && ReadU1(&type)) {
+            TypeSize(type);
+          }
+        }
+        break;
+      }
+      case 0x21:  // INSTANCE_DUMP
+        ++instances_;
+        if (Skip(8u) && UseClass() && ReadU4(&u4)) {
+          Skip(u4);
+        }
+        break;
+      case 0x22:  // OBJECT_ARRAY_DUMP
+        if (Skip(8u) && ReadU4(&u4) && UseClass()) {
+          Skip(static_cast<size_t>(u4) * 4u);
+        }
+        break;
+      case 0x23:  // PRIMITIVE_ARRAY_DUMP
+        if (Skip(8u) && ReadU4(&u4) && ReadU1(&type)) {
+          Skip(static_cast<size_t>(u4) * TypeSize(type));
+        }
+        break;
+      case 0xc3:  // PRIMITIVE_ARRAY_NODATA_DUMP
+        if (Skip(12u) && ReadU1(&type)) {
+          TypeSize(type);
+        }
+        break;
+      default:
+        Error(android::base::StringPrintf("Unexpected heap dump record 0x%x", tag));
+        break;
+    }
+  }
+
+  size_t TypeSize(uint8_t type) {
+    switch (type) {
+      case 4:  // boolean
+      case 8:  // byte
+        return 1u;
+      case 5:  // char
+      case 9:  // short
+        return 2u;
+      case 2:  // object
+      case 6:  // float
+      case 10:  // int
+        return 4u;
+      case 7:  // double
+      case 11:  // long
+        return 8u;
+      default:
+        Error(android::base::StringPrintf("Unexpected basic type %u", type));
+        return 0u;
+    }
+  }
+
+  bool UseString() {
+    uint32_t id;
+    if (!ReadU4(&id)) {
+      return false;
+    }
+    if (strings_.find(id) == strings_.end()) {
+      Error(android::base::StringPrintf("String 0x%x used before its definition", id));
+      return false;
+    }
+    return true;
+  }
+
+  bool UseClass(bool allow_null = false) {
+    uint32_t id;
+    if (!ReadU4(&id)) {
+      return false;
+    }
+    if ((id != 0u || !allow_null) && classes_.find(id) == classes_.end()) {
+      Error(android::base::StringPrintf("Class 0x%x used before its definition", id));
+      return false;
+    }
+    return true;
+  }
+
+  bool Skip(size_t count) {
+    if (count > size_ - pos_) {
+      Error("Truncated dump");
+      return false;
+    }
+    pos_ += count;
+    return true;
+  }
+
+  bool ReadU1(uint8_t* value) {
+    if (!Skip(1u)) {
+      return false;
+    }
+    *value = data_[pos_ - 1u];
+    return true;
+  }
+
+  bool ReadU2(uint16_t* value) {
+    if (!Skip(2u)) {
+      return false;
+    }
+    *value = (data_[pos_ - 2u] << 8) | data_[pos_ - 1u];
+    return true;
+  }
+
+  bool ReadU4(uint32_t* value) {
+    if (!Skip(4u)) {
+      return false;
+    }
+    const uint8_t* p = data_ + pos_ - 4u;
+    *value = (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    return true;
+  }
+
+  const std::string& Error(const std::string& message) {
+    if (error_.empty()) {
+      error_ = android::base::StringPrintf("%s at offset %zu", message.c_str(), pos_);
+    }
+    return error_;
+  }
+
+  const uint8_t* const data_;
+  const size_t size_;
+  size_t pos_ = 0u;
+  std::string error_;
+  bool seen_end_ = false;
+  std::unordered_set<uint32_t> strings_;
+  std::unordered_set<uint32_t> classes_;
+  size_t instances_ = 0u;
+  size_t class_dumps_ = 0u;
+};
+
+class HprofTest : public CommonRuntimeTest {
+ protected:
+  void SetUpRuntimeOptions(RuntimeOptions* options) override {
+    CommonRuntimeTest::SetUpRuntimeOptions(options);
+    // Dump the heap with several threads.
+    options->push_back(std::make_pair("-XX:ParallelGCThreads=3", nullptr));
+  }
+
+  // Dump the heap to a gzipped file, and decompress it.
+  void DumpGzipped(std::string* dump) {
+    ScratchFile base;
+    ScratchFile file(base, ".gz");
+    DumpHeap(file.GetFilename().c_str(), /* fd= */ -1, /* direct_to_ddms= */ false);
+    std::string compressed;
+    ASSERT_TRUE(android::base::ReadFileToString(file.GetFilename(), &compressed));
+    // The gzip magic.
+    ASSERT_GT(compressed.size(), 2u);
+    EXPECT_EQ(0x1f, static_cast<uint8_t>(compressed[0]));
+    EXPECT_EQ(0x8b, static_cast<uint8_t>(compressed[1]));
+    std::string error_msg;
+    ASSERT_TRUE(Gunzip(compressed, dump, &error_msg)) << error_msg;
+  }
+};
+
+// Test that a gzipped dump holds a valid record stream, with the classes and strings defined
+// before their first use.
+TEST_F(HprofTest, DumpToGzipFile) {
+  std::string dump;
+  DumpGzipped(&dump);
+  HprofChecker checker(dump);
+  std::string error = checker.Check();
+  ASSERT_TRUE(error.empty()) << error;
+  EXPECT_GT(checker.GetClassDumps(), 0u);
+  EXPECT_GT(checker.GetInstances(), 0u);
+}
+
+// Test a dump made of several output blocks, written by the heap thread pool.
+TEST_F(HprofTest, ParallelDumpToGzipFile) {
+  ThreadPool* thread_pool = Runtime::Current()->GetHeap()->GetThreadPool();
+  ASSERT_TRUE(thread_pool != nullptr);
+  ASSERT_GT(thread_pool->GetThreadCount(), 1u);
+  static constexpr size_t kArrays = 64;
+  static constexpr size_t kStringsPerArray = 1024;
+  Thread* self = Thread::Current();
+  ScopedObjectAccess soa(self);
+  StackHandleScope<2> hs(self);
+  Handle<mirror::Class> array_class(
+      hs.NewHandle(class_linker_->FindSystemClass(self, "[Ljava/lang/Object;")));
+  Handle<mirror::ObjectArray<mirror::Object>> arrays(hs.NewHandle(
+      mirror::ObjectArray<mirror::Object>::Alloc(self, array_class.Get(), kArrays)));
+  ASSERT_TRUE(arrays != nullptr);
+  for (size_t i = 0; i < kArrays; ++i) {
+    ObjPtr<mirror::ObjectArray<mirror::Object>> array =
+        mirror::ObjectArray<mirror::Object>::Alloc(self, array_class.Get(), kStringsPerArray);
+    ASSERT_TRUE(array != nullptr);
+    arrays->Set<false>(i, array);
+    for (size_t j = 0; j < kStringsPerArray; ++j) {
+      std::string value = android::base::StringPrintf("string %zu.%zu", i, j);
+      ObjPtr<mirror::String> string = mirror::String::AllocFromModifiedUtf8(self, value.c_str());
+      ASSERT_TRUE(string != nullptr);
+      arrays->Get(i)->AsObjectArray<mirror::Object>()->Set<false>(j, string);
+    }
+  }
+
+  ScopedThreadSuspension sts(self, kSuspended);
+  std::string dump;
+  DumpGzipped(&dump);
+  HprofChecker checker(dump);
+  std::string error = checker.Check();
+  ASSERT_TRUE(error.empty()) << error;
+  EXPECT_GE(checker.GetInstances(), kArrays * kStringsPerArray);
+}
+
+}  // namespace hprof
+}  // namespace art
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "profiling_info.h"
+
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "class_linker-inl.h"
+#include "common_runtime_test.h"
+#include "mirror/class-inl.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+
+namespace art {
+
+class InlineCacheTest : public CommonRuntimeTest {
+ protected:
+  static constexpr uint32_t kDexPc = 0;
+
+  void SetUp() override {
+    CommonRuntimeTest::SetUp();
+    // A profiling info with a single inline cache. It is not attached to a method, only its inline
+    // cache is used.
+    memory_.reset(new uint64_t[
+        RoundUp(sizeof(ProfilingInfo) + sizeof(InlineCache), sizeof(uint64_t)) / sizeof(uint64_t)]);
+    info_ = new (memory_.get()) ProfilingInfo(/* method= */ nullptr, { kDexPc });
+
+    ScopedObjectAccess soa(Thread::Current());
+    cache_ = info_->GetInlineCache(kDexPc);
+    for (const char* descriptor : { "Ljava/lang/Object;",
+                                    "Ljava/lang/String;",
+                                    "Ljava/lang/Class;",
+                                    "Ljava/lang/Integer;",
+                                    "Ljava/lang/Long;",
+                                    "Ljava/lang/Float;",
+                                    "Ljava/lang/Double;",
+                                    "Ljava/lang/Thread;" }) {
+      ObjPtr<mirror::Class> klass = class_linker_->FindSystemClass(soa.Self(), descriptor);
+      ASSERT_TRUE(klass != nullptr) << descriptor;
+      // Boot classes do not move, the test does not hold them in handles.
+      classes_.push_back(klass.Ptr());
+    }
+  }
+
+  void AddCalls(mirror::Class* klass, size_t calls) {
+    ScopedObjectAccess soa(Thread::Current());
+    ScopedAssertNoThreadSuspension sants("InlineCacheTest");
+    for (size_t i = 0; i < calls; ++i) {
+      info_->AddInvokeInfo(kDexPc, klass);
+    }
+  }
+
+  // Return the count of `klass` in the cache, or -1 if it is not in the cache.
+  int64_t GetCount(mirror::Class* klass) {
+    ScopedObjectAccess soa(Thread::Current());
+    for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
+      if (cache_->classes_[i].Read() == klass) {
+        return cache_->counts_[i].load(std::memory_order_relaxed);
+      }
+    }
+    return -1;
+  }
+
+  uint32_t GetMegamorphicCount() {
+    return cache_->megamorphic_count_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t EstimateTotalCalls() {
+    uint32_t counts[InlineCache::kIndividualCacheSize];
+    for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
+      counts[i] = cache_->counts_[i].load(std::memory_order_relaxed);
+    }
+    return InlineCache::EstimateTotalCalls(
+        counts, InlineCache::kIndividualCacheSize, GetMegamorphicCount());
+  }
+
+  std::unique_ptr<uint64_t[]> memory_;
+  ProfilingInfo* info_;
+  InlineCache* cache_;
+  std::vector<mirror::Class*> classes_;
+};
+
+// Test that the calls of each receiver are counted while the cache is not full.
+TEST_F(InlineCacheTest, Polymorphic) {
+  AddCalls(classes_[0], 3);
+  AddCalls(classes_[1], 2);
+  AddCalls(classes_[0], 1);
+  EXPECT_EQ(4, GetCount(classes_[0]));
+  EXPECT_EQ(2, GetCount(classes_[1]));
+  EXPECT_EQ(-1, GetCount(classes_[2]));
+  EXPECT_EQ(0u, GetMegamorphicCount());
+  EXPECT_EQ(6u, EstimateTotalCalls());
+}
+
+// Test that dominant receivers stay in a megamorphic cache, and that the total number of calls is
+// estimated from the counts and the megamorphic count.
+TEST_F(InlineCacheTest, Megamorphic) {
+  // Each round makes 6 calls with the first receiver, 3 with the second and 1 with one of the six
+  // others, in turn.
+  static constexpr size_t kRounds = 1000;
+  const size_t number_of_others = classes_.size() - 2u;
+  for (size_t round = 0; round < kRounds; ++round) {
+    AddCalls(classes_[0], 6);
+    AddCalls(classes_[1], 3);
+    AddCalls(classes_[2u + round % number_of_others], 1);
+  }
+  EXPECT_GT(GetMegamorphicCount(), 0u);
+  // Counts are lower bounds of the number of calls.
+  const int64_t first_count = GetCount(classes_[0]);
+  const int64_t second_count = GetCount(classes_[1]);
+  EXPECT_GT(first_count, 0);
+  EXPECT_LE(first_count, static_cast<int64_t>(6 * kRounds));
+  EXPECT_GT(second_count, 0);
+  EXPECT_LE(second_count, static_cast<int64_t>(3 * kRounds));
+  EXPECT_GT(first_count, second_count);
+  // Without concurrent updates, every call is accounted for.
+  const uint64_t total = EstimateTotalCalls();
+  EXPECT_EQ(10 * kRounds, total);
+  // The two dominant receivers still account for most of the calls.
+  EXPECT_GE(static_cast<uint64_t>(first_count + second_count) * 100, total * 75);
+}
+
+// Test that a receiver whose count dropped to zero is replaced by a new one.
+TEST_F(InlineCacheTest, Replacement) {
+  for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
+    AddCalls(classes_[i], 1);
+  }
+  // Decrements all the counts to zero.
+  AddCalls(classes_[InlineCache::kIndividualCacheSize], 1);
+  EXPECT_EQ(1u, GetMegamorphicCount());
+  EXPECT_EQ(-1, GetCount(classes_[InlineCache::kIndividualCacheSize]));
+  // Takes the place of a receiver with a zero count.
+  AddCalls(classes_[InlineCache::kIndividualCacheSize + 1u], 2);
+  EXPECT_EQ(2, GetCount(classes_[InlineCache::kIndividualCacheSize + 1u]));
+  EXPECT_EQ(1u, GetMegamorphicCount());
+  EXPECT_EQ(InlineCache::kIndividualCacheSize + 1u + 2u, EstimateTotalCalls());
+}
+
+}  // namespace art
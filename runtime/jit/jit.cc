@@ -25,11 +25,15 @@
 #include "base/memory_tool.h"
 #include "base/runtime_debug.h"
 #include "base/scoped_flock.h"
+#include "base/time_utils.h"
 #include "base/utils.h"
+#include "class_loader_utils.h"
 #include "class_root.h"
 #include "debugger.h"
+#include "dex/dex_file_loader.h"
 #include "dex/type_lookup_table.h"
 #include "entrypoints/runtime_asm_entrypoints.h"
+#include "handle_scope-inl.h"
 #include "interpreter/interpreter.h"
 #include "jit-inl.h"
 #include "jit_code_cache.h"
@@ -95,6 +99,13 @@ JitOptions* JitOptions::CreateFromRuntimeArguments(const RuntimeArgumentMap& opt
       options.GetOrDefault(RuntimeArgumentMap::ProfileSaverOpts);
   jit_options->thread_pool_pthread_priority_ =
       options.GetOrDefault(RuntimeArgumentMap::JITPoolThreadPthreadPriority);
+  jit_options->thread_pool_thread_count_ =
+      options.GetOrDefault(RuntimeArgumentMap::JITPoolThreadCount);
+  jit_options->compile_profile_at_startup_ =
+      options.GetOrDefault(RuntimeArgumentMap::JITCompileProfileAtStartup);
+  if (jit_options->thread_pool_thread_count_ == 0) {
+    LOG(FATAL) << "JIT thread count cannot be 0.";
+  }
 
   if (options.Exists(RuntimeArgumentMap::JITCompileThreshold)) {
     jit_options->compile_threshold_ = *options.Get(RuntimeArgumentMap::JITCompileThreshold);
@@ -160,8 +171,19 @@ JitOptions* JitOptions::CreateFromRuntimeArguments(const RuntimeArgumentMap& opt
 void Jit::DumpInfo(std::ostream& os) {
   code_cache_->Dump(os);
   cumulative_timings_.Dump(os);
-  MutexLock mu(Thread::Current(), lock_);
+  Thread* self = Thread::Current();
+  // Read the queue length before taking `lock_`, AddCompileTask does not nest the locks either.
+  size_t queue_length = (thread_pool_ != nullptr) ? thread_pool_->GetTaskCount(self) : 0u;
+  MutexLock mu(self, lock_);
   memory_use_.PrintMemoryUse(os);
+  os << "JIT threads: " << options_->GetThreadPoolThreadCount() << "\n"
+     << "JIT queued compilations: " << queued_tasks_ << "\n"
+     << "JIT queue length: " << queue_length << " (max " << max_queue_length_ << ")\n";
+  if (queue_latency_.SampleSize() != 0u) {
+    Histogram<uint64_t>::CumulativeData data;
+    queue_latency_.CreateHistogram(&data);
+    queue_latency_.PrintConfidenceIntervals(os, 0.99, data);
+  }
 }
 
 void Jit::DumpForSigQuit(std::ostream& os) {
@@ -178,6 +200,9 @@ Jit::Jit(JitCodeCache* code_cache, JitOptions* options)
       options_(options),
       cumulative_timings_("JIT timings"),
       memory_use_("Memory used for compilation", 16),
+      queue_latency_("JIT queueing latency", 50),
+      queued_tasks_(0u),
+      max_queue_length_(0u),
       lock_("JIT memory use lock") {}
 
 Jit* Jit::Create(JitCodeCache* code_cache, JitOptions* options) {
@@ -329,6 +354,9 @@ void Jit::StartProfileSaver(const std::string& filename,
                             const std::vector<std::string>& code_paths) {
   if (options_->GetSaveProfilingInfo()) {
     ProfileSaver::Start(options_->GetProfileSaverOptions(), filename, code_cache_, code_paths);
+    if (options_->GetCompileProfileAtStartup()) {
+      CompileProfileAtStartup(filename, code_paths);
+    }
   }
 }
 
@@ -554,6 +582,11 @@ void Jit::AddMemoryUsage(ArtMethod* method, size_t bytes) {
   memory_use_.AddValue(bytes);
 }
 
+void Jit::AddQueueLatency(uint64_t latency_ns) {
+  MutexLock mu(Thread::Current(), lock_);
+  queue_latency_.AdjustAndAddValue(latency_ns);
+}
+
 class JitCompileTask final : public Task {
  public:
   enum class TaskKind {
@@ -563,7 +596,8 @@ class JitCompileTask final : public Task {
     kCompileOsr,
   };
 
-  JitCompileTask(ArtMethod* method, TaskKind kind) : method_(method), kind_(kind), klass_(nullptr) {
+  JitCompileTask(ArtMethod* method, TaskKind kind)
+      : method_(method), kind_(kind), klass_(nullptr), enqueue_time_ns_(0u) {
     ScopedObjectAccess soa(Thread::Current());
     // For a non-bootclasspath class, add a global ref to the class to prevent class unloading
     // until compilation is done.
@@ -580,7 +614,42 @@ class JitCompileTask final : public Task {
     }
   }
 
+  // OSR compilations first, as the method is stuck in a loop in the interpreter, then regular
+  // compilations, then profiling info allocations, then baseline compilations. Within a kind, the
+  // hottest methods first, by their current hotness counter: the JIT thread pool reads priorities
+  // again when taking a task, so a method getting hotter moves up the queue. Other JIT tasks have
+  // the default priority 0 and run last.
+  //
+  // Called with the task queue lock held and without the mutator lock. The method stays valid as
+  // the task holds its class, and a racy read of the counter is fine for ordering.
+  int32_t GetPriority() const override NO_THREAD_SAFETY_ANALYSIS {
+    int32_t kind_priority = 0;
+    switch (kind_) {
+      case TaskKind::kCompileOsr:
+        kind_priority = 4;
+        break;
+      case TaskKind::kCompile:
+        kind_priority = 3;
+        break;
+      case TaskKind::kAllocateProfile:
+        kind_priority = 2;
+        break;
+      case TaskKind::kCompileBaseline:
+        kind_priority = 1;
+        break;
+    }
+    const uint16_t hotness = method_->IsAbstract() ? 0u : method_->GetCounter();
+    return (kind_priority << 16) | hotness;
+  }
+
+  void SetEnqueueTime(uint64_t time_ns) {
+    enqueue_time_ns_ = time_ns;
+  }
+
   void Run(Thread* self) override {
+    if (enqueue_time_ns_ != 0u) {
+      Runtime::Current()->GetJit()->AddQueueLatency(NanoTime() - enqueue_time_ns_);
+    }
     ScopedObjectAccess soa(self);
     switch (kind_) {
       case TaskKind::kCompile:
@@ -611,6 +680,8 @@ class JitCompileTask final : public Task {
   ArtMethod* const method_;
   const TaskKind kind_;
   jobject klass_;
+  // Set when the task is added to the queue, zero for tasks run directly.
+  uint64_t enqueue_time_ns_;
 
   DISALLOW_IMPLICIT_CONSTRUCTORS(JitCompileTask);
 };
@@ -634,8 +705,12 @@ class ZygoteTask final : public Task {
     ScopedNullHandle<mirror::ClassLoader> null_handle;
     // We add to the queue for zygote so that we can fork processes in-between
     // compilations.
-    runtime->GetJit()->CompileMethodsFromProfile(
-        self, boot_class_path, profile_file, null_handle, /* add_to_queue= */ true);
+    runtime->GetJit()->CompileMethodsFromProfile(self,
+                                                 boot_class_path,
+                                                 profile_file,
+                                                 null_handle,
+                                                 /* add_to_queue= */ true,
+                                                 /* hot_methods_only= */ false);
   }
 
   void Finalize() override {
@@ -679,7 +754,8 @@ class JitProfileTask final : public Task {
         dex_files_,
         GetProfileFile(dex_files_[0]->GetLocation()),
         loader,
-        /* add_to_queue= */ false);
+        /* add_to_queue= */ false,
+        /* hot_methods_only= */ false);
   }
 
   void Finalize() override {
@@ -693,15 +769,96 @@ class JitProfileTask final : public Task {
   DISALLOW_COPY_AND_ASSIGN(JitProfileTask);
 };
 
+class GetClassLoadersVisitor : public ClassLoaderVisitor {
+ public:
+  GetClassLoadersVisitor(VariableSizedHandleScope* hs,
+                         std::vector<Handle<mirror::ClassLoader>>* class_loaders)
+      : hs_(hs), class_loaders_(class_loaders) {}
+
+  void Visit(ObjPtr<mirror::ClassLoader> class_loader)
+      REQUIRES_SHARED(Locks::classlinker_classes_lock_, Locks::mutator_lock_) override {
+    class_loaders_->push_back(hs_->NewHandle(class_loader));
+  }
+
+ private:
+  VariableSizedHandleScope* const hs_;
+  std::vector<Handle<mirror::ClassLoader>>* const class_loaders_;
+};
+
+// Compiles the hot methods of the profile written by the ProfileSaver during previous runs of the
+// app, so that they do not have to get hot in the interpreter again.
+class JitStartupProfileTask final : public Task {
+ public:
+  JitStartupProfileTask(const std::string& profile_file,
+                        const std::vector<std::string>& code_paths)
+      : profile_file_(profile_file), code_paths_(code_paths.begin(), code_paths.end()) {}
+
+  void Run(Thread* self) override {
+    ScopedObjectAccess soa(self);
+    Runtime* runtime = Runtime::Current();
+    ClassLinker* class_linker = runtime->GetClassLinker();
+    VariableSizedHandleScope hs(self);
+    // The boot class loader first, for the boot class path code paths of the system server.
+    std::vector<Handle<mirror::ClassLoader>> class_loaders;
+    class_loaders.push_back(hs.NewHandle<mirror::ClassLoader>(nullptr));
+    {
+      GetClassLoadersVisitor visitor(&hs, &class_loaders);
+      ReaderMutexLock mu(self, *Locks::classlinker_classes_lock_);
+      class_linker->VisitClassLoaders(&visitor);
+    }
+    for (Handle<mirror::ClassLoader> class_loader : class_loaders) {
+      std::vector<const DexFile*> dex_files;
+      auto add_tracked = [&](const DexFile* dex_file) {
+        if (code_paths_.find(DexFileLoader::GetBaseLocation(dex_file->GetLocation())) !=
+                code_paths_.end()) {
+          dex_files.push_back(dex_file);
+        }
+        return true;
+      };
+      if (class_loader == nullptr) {
+        for (const DexFile* dex_file : class_linker->GetBootClassPath()) {
+          add_tracked(dex_file);
+        }
+      } else if (IsPathOrDexClassLoader(soa, class_loader) ||
+                 IsDelegateLastClassLoader(soa, class_loader) ||
+                 IsInMemoryDexClassLoader(soa, class_loader)) {
+        VisitClassLoaderDexFiles(soa, class_loader, add_tracked);
+      }
+      if (!dex_files.empty()) {
+        // Queue the compilations, so that methods getting hot now are compiled first.
+        runtime->GetJit()->CompileMethodsFromProfile(self,
+                                                     dex_files,
+                                                     profile_file_,
+                                                     class_loader,
+                                                     /* add_to_queue= */ true,
+                                                     /* hot_methods_only= */ true);
+      }
+    }
+  }
+
+  void Finalize() override {
+    delete this;
+  }
+
+ private:
+  const std::string profile_file_;
+  const std::set<std::string> code_paths_;
+
+  DISALLOW_COPY_AND_ASSIGN(JitStartupProfileTask);
+};
+
 void Jit::CreateThreadPool() {
   // There is a DCHECK in the 'AddSamples' method to ensure the tread pool
   // is not null when we instrument.
 
   // We need peers as we may report the JIT thread, e.g., in the debugger.
   constexpr bool kJitPoolNeedsPeers = true;
-  thread_pool_.reset(new ThreadPool("Jit thread pool", 1, kJitPoolNeedsPeers));
+  thread_pool_.reset(new ThreadPool(
+      "Jit thread pool", options_->GetThreadPoolThreadCount(), kJitPoolNeedsPeers));
 
   thread_pool_->SetPthreadPriority(options_->GetThreadPoolPthreadPriority());
+  // Compile tasks are ranked by the hotness of their method, which keeps growing while they wait.
+  thread_pool_->SetUpdateTaskPriorities(true);
   Start();
 
   // If we're not using the default boot image location, request a JIT task to
@@ -712,6 +869,14 @@ void Jit::CreateThreadPool() {
   }
 }
 
+void Jit::CompileProfileAtStartup(const std::string& profile_file,
+                                  const std::vector<std::string>& code_paths) {
+  // The profile holds the methods which got hot in previous runs, compile them again.
+  if (UseJitCompilation() && thread_pool_ != nullptr) {
+    thread_pool_->AddTask(Thread::Current(), new JitStartupProfileTask(profile_file, code_paths));
+  }
+}
+
 void Jit::RegisterDexFiles(const std::vector<std::unique_ptr<const DexFile>>& dex_files,
                            ObjPtr<mirror::ClassLoader> class_loader) {
   if (dex_files.empty()) {
@@ -728,7 +893,8 @@ void Jit::CompileMethodsFromProfile(
     const std::vector<const DexFile*>& dex_files,
     const std::string& profile_file,
     Handle<mirror::ClassLoader> class_loader,
-    bool add_to_queue) {
+    bool add_to_queue,
+    bool hot_methods_only) {
 
   if (profile_file.empty()) {
     LOG(WARNING) << "Expected a profile file in JIT zygote mode";
@@ -770,11 +936,13 @@ void Jit::CompileMethodsFromProfile(
 
     std::set<dex::TypeIndex> class_types;
     std::set<uint16_t> all_methods;
+    std::set<uint16_t> other_methods;
+    std::set<uint16_t>* non_hot_methods = hot_methods_only ? &other_methods : &all_methods;
     if (!profile_info.GetClassesAndMethods(*dex_file,
                                            &class_types,
                                            &all_methods,
-                                           &all_methods,
-                                           &all_methods)) {
+                                           non_hot_methods,
+                                           non_hot_methods)) {
       // This means the profile file did not reference the dex file, which is the case
       // if there's no classes and methods of that dex file in the profile.
       continue;
@@ -807,14 +975,22 @@ void Jit::CompileMethodsFromProfile(
                 "Lcom/android/internal/os/ZygoteServer;")) {
           CompileMethod(method, self, /* baseline= */ false, /* osr= */ false);
         } else {
-          thread_pool_->AddTask(self,
-              new JitCompileTask(method, JitCompileTask::TaskKind::kCompile));
+          AddCompileTask(self, new JitCompileTask(method, JitCompileTask::TaskKind::kCompile));
         }
       }
     }
   }
 }
 
+void Jit::AddCompileTask(Thread* self, JitCompileTask* task) {
+  task->SetEnqueueTime(NanoTime());
+  thread_pool_->AddTask(self, task);
+  size_t queue_length = thread_pool_->GetTaskCount(self);
+  MutexLock mu(self, lock_);
+  ++queued_tasks_;
+  max_queue_length_ = std::max(max_queue_length_, queue_length);
+}
+
 static bool IgnoreSamplesForMethod(ArtMethod* method) REQUIRES_SHARED(Locks::mutator_lock_) {
   if (method->IsClassInitializer() || !method->IsCompilable()) {
     // We do not want to compile such methods.
@@ -880,7 +1056,7 @@ bool Jit::MaybeCompileMethod(Thread* self,
       if (!success) {
         // We failed allocating. Instead of doing the collection on the Java thread, we push
         // an allocation to a compiler thread, that will do the collection.
-        thread_pool_->AddTask(
+        AddCompileTask(
             self, new JitCompileTask(method, JitCompileTask::TaskKind::kAllocateProfile));
       }
     }
@@ -896,7 +1072,7 @@ bool Jit::MaybeCompileMethod(Thread* self,
     if (old_count < HotMethodThreshold() && new_count >= HotMethodThreshold()) {
       if (!code_cache_->ContainsPc(method->GetEntryPointFromQuickCompiledCode())) {
         DCHECK(thread_pool_ != nullptr);
-        thread_pool_->AddTask(self, new JitCompileTask(method, JitCompileTask::TaskKind::kCompile));
+        AddCompileTask(self, new JitCompileTask(method, JitCompileTask::TaskKind::kCompile));
       }
     }
     if (old_count < OSRMethodThreshold() && new_count >= OSRMethodThreshold()) {
@@ -906,7 +1082,7 @@ bool Jit::MaybeCompileMethod(Thread* self,
       DCHECK(!method->IsNative());  // No back edges reported for native methods.
       if (!code_cache_->IsOsrCompiled(method)) {
         DCHECK(thread_pool_ != nullptr);
-        thread_pool_->AddTask(
+        AddCompileTask(
             self, new JitCompileTask(method, JitCompileTask::TaskKind::kCompileOsr));
       }
     }
@@ -44,6 +44,7 @@ class ClassLoader;
 namespace jit {
 
 class JitCodeCache;
+class JitCompileTask;
 class JitOptions;
 
 static constexpr int16_t kJitCheckForOSR = -1;
@@ -51,6 +52,7 @@ static constexpr int16_t kJitHotnessDisabled = -2;
 // At what priority to schedule jit threads. 9 is the lowest foreground priority on device.
 // See android/os/Process.java.
 static constexpr int kJitPoolThreadPthreadDefaultPriority = 9;
+static constexpr unsigned int kJitPoolDefaultThreadCount = 1;
 static constexpr uint32_t kJitSamplesBatchSize = 32;  // Must be power of 2.
 
 class JitOptions {
@@ -101,6 +103,14 @@ class JitOptions {
     return thread_pool_pthread_priority_;
   }
 
+  size_t GetThreadPoolThreadCount() const {
+    return thread_pool_thread_count_;
+  }
+
+  bool GetCompileProfileAtStartup() const {
+    return compile_profile_at_startup_;
+  }
+
   bool UseJitCompilation() const {
     return use_jit_compilation_;
   }
@@ -141,6 +151,9 @@ class JitOptions {
   uint16_t invoke_transition_weight_;
   bool dump_info_on_shutdown_;
   int thread_pool_pthread_priority_;
+  size_t thread_pool_thread_count_;
+  // Whether to compile the hot methods of the saved profile when the profile saver starts.
+  bool compile_profile_at_startup_;
   ProfileSaverOptions profile_saver_options_;
 
   JitOptions()
@@ -153,7 +166,9 @@ class JitOptions {
         priority_thread_weight_(0),
         invoke_transition_weight_(0),
         dump_info_on_shutdown_(false),
-        thread_pool_pthread_priority_(kJitPoolThreadPthreadDefaultPriority) {}
+        thread_pool_pthread_priority_(kJitPoolThreadPthreadDefaultPriority),
+        thread_pool_thread_count_(kJitPoolDefaultThreadCount),
+        compile_profile_at_startup_(false) {}
 
   DISALLOW_COPY_AND_ASSIGN(JitOptions);
 };
@@ -186,7 +201,7 @@ class Jit {
   void WaitForWorkersToBeCreated();
 
   // Dump interesting info: #methods compiled, code vs data size, compile / verify cumulative
-  // loggers.
+  // loggers, compilation queue length and latency.
   void DumpInfo(std::ostream& os) REQUIRES(!lock_);
   // Add a timing logger to cumulative_timings_.
   void AddTimingLogger(const TimingLogger& logger);
@@ -309,12 +324,14 @@ class Jit {
 
   // Compile methods from the given profile. If `add_to_queue` is true, methods
   // in the profile are added to the JIT queue. Otherwise they are compiled
-  // directly.
+  // directly. If `hot_methods_only` is true, startup and post-startup methods
+  // which were not hot are skipped.
   void CompileMethodsFromProfile(Thread* self,
                                  const std::vector<const DexFile*>& dex_files,
                                  const std::string& profile_path,
                                  Handle<mirror::ClassLoader> class_loader,
-                                 bool add_to_queue);
+                                 bool add_to_queue,
+                                 bool hot_methods_only);
 
   // Register the dex files to the JIT. This is to perform any compilation/optimization
   // at the point of loading the dex files.
@@ -335,6 +352,20 @@ class Jit {
 
   static bool BindCompilerMethods(std::string* error_msg);
 
+  // Queue the compilation of the hot methods of the profile saved for `code_paths` by previous
+  // runs, instead of waiting for them to get hot again.
+  void CompileProfileAtStartup(const std::string& profile_file,
+                               const std::vector<std::string>& code_paths);
+
+  // Add a compilation task to the thread pool, which runs it by priority, and record the queue
+  // length.
+  void AddCompileTask(Thread* self, JitCompileTask* task) REQUIRES(!lock_);
+
+  // Record how long a compilation task waited in the queue.
+  void AddQueueLatency(uint64_t latency_ns) REQUIRES(!lock_);
+
+  friend class JitCompileTask;
+
   // JIT compiler
   static void* jit_library_handle_;
   static void* jit_compiler_handle_;
@@ -356,6 +387,9 @@ class Jit {
   // Performance monitoring.
   CumulativeLogger cumulative_timings_;
   Histogram<uint64_t> memory_use_ GUARDED_BY(lock_);
+  Histogram<uint64_t> queue_latency_ GUARDED_BY(lock_);
+  uint64_t queued_tasks_ GUARDED_BY(lock_);
+  size_t max_queue_length_ GUARDED_BY(lock_);
   Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
 
   DISALLOW_COPY_AND_ASSIGN(Jit);
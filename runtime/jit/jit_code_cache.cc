@@ -70,6 +70,22 @@ static constexpr size_t kStackMapSizeLogThreshold = 50 * KB;
 // TODO: Make this variable?
 static constexpr size_t kCodeAndDataCapacityDivider = 2;
 
+// Shares of the code capacity given to each segment, in eighths, indexed by JitCodeSegment.
+// Optimized code gets the largest share, baseline code is replaced by optimized code and OSR and
+// JNI stub code is comparatively rare.
+static constexpr size_t kCodeSegmentShares[] = { 4, 1, 2, 1 };
+static constexpr size_t kCodeSegmentSharesTotal = 8;
+static_assert(arraysize(kCodeSegmentShares) == static_cast<size_t>(JitCodeSegment::kLast) + 1u,
+              "Missing code segment share");
+static constexpr const char* kCodeSegmentNames[] = { "optimized", "baseline", "osr", "jni stub" };
+
+// Below this code capacity, segments would be too small and all code is allocated from the
+// optimized segment.
+static constexpr size_t kMinSegmentedCodeCapacity = 1 * MB;
+
+// Number of method headers freed under one acquisition of the code cache lock.
+static constexpr size_t kFreeMethodHeadersBatchSize = 64;
+
 static constexpr int kProtR = PROT_READ;
 static constexpr int kProtRW = PROT_READ | PROT_WRITE;
 static constexpr int kProtRWX = PROT_READ | PROT_WRITE | PROT_EXEC;
@@ -418,6 +434,10 @@ JitCodeCache::JitCodeCache()
       number_of_compilations_(0),
       number_of_osr_compilations_(0),
       number_of_collections_(0),
+      total_collection_time_ns_(0),
+      total_collection_checkpoint_time_ns_(0),
+      max_collection_checkpoint_time_ns_(0),
+      total_collection_bytes_freed_(0),
       histogram_stack_map_memory_use_("Memory used for stack maps", 16),
       histogram_code_memory_use_("Memory used for compiled code", 16),
       histogram_profiling_info_memory_use_("Memory used for profiling info", 16),
@@ -425,8 +445,7 @@ JitCodeCache::JitCodeCache()
       inline_cache_cond_("Jit inline cache condition variable", lock_),
       zygote_data_pages_(),
       zygote_exec_pages_(),
-      zygote_data_mspace_(nullptr),
-      zygote_exec_mspace_(nullptr) {
+      zygote_data_mspace_(nullptr) {
 }
 
 void JitCodeCache::InitializeState(size_t initial_capacity, size_t max_capacity) {
@@ -441,6 +460,10 @@ void JitCodeCache::InitializeState(size_t initial_capacity, size_t max_capacity)
   number_of_compilations_ = 0;
   number_of_osr_compilations_ = 0;
   number_of_collections_ = 0;
+  total_collection_time_ns_ = 0;
+  total_collection_checkpoint_time_ns_ = 0;
+  max_collection_checkpoint_time_ns_ = 0;
+  total_collection_bytes_freed_ = 0;
 
   data_pages_ = MemMap();
   exec_pages_ = MemMap();
@@ -449,7 +472,36 @@ void JitCodeCache::InitializeState(size_t initial_capacity, size_t max_capacity)
   max_capacity_ = max_capacity;
   current_capacity_ = initial_capacity,
   data_end_ = initial_capacity / kCodeAndDataCapacityDivider;
-  exec_end_ = initial_capacity - data_end_;
+
+  // Lay out the segments in the code mapping, which is sized for the maximum capacity. Each
+  // segment starts with its share of the initial code capacity, and at least a page.
+  const size_t exec_capacity = max_capacity - max_capacity / kCodeAndDataCapacityDivider;
+  const size_t exec_initial_capacity = initial_capacity - data_end_;
+  const bool segmented = exec_capacity >= kMinSegmentedCodeCapacity;
+  size_t begin = 0u;
+  for (size_t i = 0; i < kNumberOfCodeSegments; ++i) {
+    CodeSegment& segment = code_segments_[i];
+    segment = CodeSegment();
+    segment.begin = begin;
+    if (!segmented) {
+      if (i == static_cast<size_t>(JitCodeSegment::kOptimized)) {
+        segment.capacity = exec_capacity;
+        segment.end = exec_initial_capacity;
+      }
+    } else {
+      segment.capacity = (i == kNumberOfCodeSegments - 1u)
+          ? exec_capacity - begin
+          : RoundDown(exec_capacity / kCodeSegmentSharesTotal * kCodeSegmentShares[i], kPageSize);
+      segment.end = std::min(
+          segment.capacity,
+          std::max(static_cast<size_t>(kPageSize),
+                   RoundDown(exec_initial_capacity / kCodeSegmentSharesTotal *
+                                 kCodeSegmentShares[i],
+                             kPageSize)));
+    }
+    begin += segment.capacity;
+  }
+  DCHECK_EQ(begin, exec_capacity);
 }
 
 void JitCodeCache::InitializeSpaces() {
@@ -468,14 +520,21 @@ void JitCodeCache::InitializeSpaces() {
     // Make all pages reserved for the code heap writable. The mspace allocator, that manages the
     // heap, will take and initialize pages in create_mspace_with_base().
     CheckedCall(mprotect, "create code heap", code_heap->Begin(), code_heap->Size(), kProtRW);
-    exec_mspace_ = create_mspace_with_base(code_heap->Begin(), exec_end_, false /*locked*/);
-    CHECK(exec_mspace_ != nullptr) << "create_mspace_with_base (exec) failed";
+    for (CodeSegment& segment : code_segments_) {
+      if (segment.capacity != 0u) {
+        segment.mspace = create_mspace_with_base(
+            code_heap->Begin() + segment.begin, segment.end, false /*locked*/);
+        CHECK(segment.mspace != nullptr) << "create_mspace_with_base (exec) failed";
+      }
+    }
     SetFootprintLimit(initial_capacity_);
     // Protect pages containing heap metadata. Updates to the code heap toggle write permission to
     // perform the update and there are no other times write access is required.
     CheckedCall(mprotect, "protect code heap", code_heap->Begin(), code_heap->Size(), kProtR);
   } else {
-    exec_mspace_ = nullptr;
+    for (CodeSegment& segment : code_segments_) {
+      segment.mspace = nullptr;
+    }
     SetFootprintLimit(initial_capacity_);
   }
 }
@@ -603,6 +662,7 @@ uint8_t* JitCodeCache::CommitCode(Thread* self,
                                   const uint8_t* code,
                                   size_t code_size,
                                   size_t data_size,
+                                  bool baseline,
                                   bool osr,
                                   const std::vector<Handle<mirror::Object>>& roots,
                                   bool has_should_deoptimize_flag,
@@ -614,6 +674,7 @@ uint8_t* JitCodeCache::CommitCode(Thread* self,
                                        code,
                                        code_size,
                                        data_size,
+                                       baseline,
                                        osr,
                                        roots,
                                        has_should_deoptimize_flag,
@@ -628,6 +689,7 @@ uint8_t* JitCodeCache::CommitCode(Thread* self,
                                 code,
                                 code_size,
                                 data_size,
+                                baseline,
                                 osr,
                                 roots,
                                 has_should_deoptimize_flag,
@@ -801,23 +863,34 @@ void JitCodeCache::FreeCodeAndData(const void* code_ptr) {
   FreeCode(code_allocation);
 }
 
-void JitCodeCache::FreeAllMethodHeaders(
+size_t JitCodeCache::FreeAllMethodHeaders(
     const std::unordered_set<OatQuickMethodHeader*>& method_headers) {
+  Thread* self = Thread::Current();
   // We need to remove entries in method_headers from CHA dependencies
   // first since once we do FreeCode() below, the memory can be reused
   // so it's possible for the same method_header to start representing
   // different compile code.
-  MutexLock mu(Thread::Current(), lock_);
   {
-    MutexLock mu2(Thread::Current(), *Locks::cha_lock_);
+    MutexLock mu(self, lock_);
+    MutexLock mu2(self, *Locks::cha_lock_);
     Runtime::Current()->GetClassLinker()->GetClassHierarchyAnalysis()
         ->RemoveDependentsWithMethodHeaders(method_headers);
   }
 
-  ScopedCodeCacheWrite scc(this);
-  for (const OatQuickMethodHeader* method_header : method_headers) {
-    FreeCodeAndData(method_header->GetCode());
+  // The headers are no longer reachable from the cache, so the lock can be released between
+  // batches. Other threads may allocate in between, only the usage change within a batch is ours.
+  size_t bytes_freed = 0;
+  auto it = method_headers.begin();
+  while (it != method_headers.end()) {
+    MutexLock mu(self, lock_);
+    ScopedCodeCacheWrite scc(this);
+    const size_t used_memory_before = used_memory_for_code_ + used_memory_for_data_;
+    for (size_t i = 0; i != kFreeMethodHeadersBatchSize && it != method_headers.end(); ++i, ++it) {
+      FreeCodeAndData((*it)->GetCode());
+    }
+    bytes_freed += used_memory_before - (used_memory_for_code_ + used_memory_for_data_);
   }
+  return bytes_freed;
 }
 
 void JitCodeCache::RemoveMethodsIn(Thread* self, const LinearAlloc& alloc) {
@@ -911,7 +984,9 @@ void JitCodeCache::DisallowInlineCacheAccess() {
 }
 
 void JitCodeCache::CopyInlineCacheInto(const InlineCache& ic,
-                                       Handle<mirror::ObjectArray<mirror::Class>> array) {
+                                       Handle<mirror::ObjectArray<mirror::Class>> array,
+                                       /*out*/ uint32_t* counts,
+                                       /*out*/ uint32_t* megamorphic_count) {
   WaitUntilInlineCacheAccessible(Thread::Current());
   // Note that we don't need to lock `lock_` here, the compiler calling
   // this method has already ensured the inline cache will not be deleted.
@@ -920,9 +995,11 @@ void JitCodeCache::CopyInlineCacheInto(const InlineCache& ic,
        ++in_cache) {
     mirror::Class* object = ic.classes_[in_cache].Read();
     if (object != nullptr) {
+      counts[in_array] = ic.counts_[in_cache].load(std::memory_order_relaxed);
       array->Set(in_array++, object);
     }
   }
+  *megamorphic_count = ic.megamorphic_count_.load(std::memory_order_relaxed);
 }
 
 static void ClearMethodCounter(ArtMethod* method, bool was_warm)
@@ -938,18 +1015,6 @@ static void ClearMethodCounter(ArtMethod* method, bool was_warm)
   method->SetCounter(std::min(jit_warmup_threshold - 1, 1));
 }
 
-void JitCodeCache::WaitForPotentialCollectionToCompleteRunnable(Thread* self) {
-  while (collection_in_progress_) {
-    lock_.Unlock(self);
-    {
-      ScopedThreadSuspension sts(self, kSuspended);
-      MutexLock mu(self, lock_);
-      WaitForPotentialCollectionToComplete(self);
-    }
-    lock_.Lock(self);
-  }
-}
-
 const MemMap* JitCodeCache::GetUpdatableCodeMapping() const {
   if (HasDualCodeMapping()) {
     return &non_exec_pages_;
@@ -967,6 +1032,7 @@ uint8_t* JitCodeCache::CommitCodeInternal(Thread* self,
                                           const uint8_t* code,
                                           size_t code_size,
                                           size_t data_size,
+                                          bool baseline,
                                           bool osr,
                                           const std::vector<Handle<mirror::Object>>& roots,
                                           bool has_should_deoptimize_flag,
@@ -984,9 +1050,8 @@ uint8_t* JitCodeCache::CommitCodeInternal(Thread* self,
   uint8_t* code_ptr = nullptr;
 
   MutexLock mu(self, lock_);
-  // We need to make sure that there will be no jit-gcs going on and wait for any ongoing one to
-  // finish.
-  WaitForPotentialCollectionToCompleteRunnable(self);
+  // A collection may be in progress, the code is marked live below so that the collection does
+  // not free it.
   {
     ScopedCodeCacheWrite scc(this);
 
@@ -997,7 +1062,11 @@ uint8_t* JitCodeCache::CommitCodeInternal(Thread* self,
 
     // AllocateCode allocates memory in non-executable region for alignment header and code. The
     // header size may include alignment padding.
-    uint8_t* nox_memory = AllocateCode(total_size);
+    JitCodeSegment kind = method->IsNative()
+        ? JitCodeSegment::kJniStub
+        : (osr ? JitCodeSegment::kOsr
+               : (baseline ? JitCodeSegment::kBaseline : JitCodeSegment::kOptimized));
+    uint8_t* nox_memory = AllocateCode(total_size, kind);
     if (nox_memory == nullptr) {
       return nullptr;
     }
@@ -1102,6 +1171,9 @@ uint8_t* JitCodeCache::CommitCodeInternal(Thread* self,
       DCHECK(ContainsElement(data->GetMethods(), method))
           << "Entry inserted in NotifyCompilationOf() should contain this method.";
       data->SetCode(code_ptr);
+      if (collection_in_progress_) {
+        MarkCodeLive(code_ptr);
+      }
       instrumentation::Instrumentation* instrum = Runtime::Current()->GetInstrumentation();
       for (ArtMethod* m : data->GetMethods()) {
         if (!class_linker->IsQuickResolutionStub(m->GetEntryPointFromQuickCompiledCode())) {
@@ -1118,6 +1190,9 @@ uint8_t* JitCodeCache::CommitCodeInternal(Thread* self,
         FlushDataCache(roots_data, roots_data + data_size);
       }
       method_code_map_.Put(code_ptr, method);
+      if (collection_in_progress_) {
+        MarkCodeLive(code_ptr);
+      }
       if (osr) {
         number_of_osr_compilations_++;
         osr_code_map_.Put(method, code_ptr);
@@ -1333,9 +1408,10 @@ size_t JitCodeCache::ReserveData(Thread* self,
   uint8_t* result = nullptr;
 
   {
+    // Data can be allocated while a collection is in progress, the collection only frees the
+    // data of the code it removes.
     ScopedThreadSuspension sts(self, kSuspended);
     MutexLock mu(self, lock_);
-    WaitForPotentialCollectionToComplete(self);
     result = AllocateData(size);
   }
 
@@ -1384,7 +1460,9 @@ class MarkCodeClosure final : public Closure {
             return true;
           }
           const void* code = method_header->GetCode();
-          if (code_cache_->ContainsPc(code) && !code_cache_->IsInZygoteExecSpace(code)) {
+          if (code_cache_->ContainsPc(code) &&
+              !code_cache_->IsInZygoteExecSpace(code) &&
+              bitmap_->HasAddress(FromCodeToAllocation(code))) {
             // Use the atomic set version, as multiple threads are executing this code.
             bitmap_->AtomicTestAndSet(FromCodeToAllocation(code));
           }
@@ -1406,8 +1484,8 @@ class MarkCodeClosure final : public Closure {
         OatQuickMethodHeader* method_header =
             code_cache_->LookupMethodHeader(frame.return_pc_, /* method= */ nullptr);
         if (method_header != nullptr) {
-          const void* code = method_header->GetCode();
-          CHECK(bitmap_->Test(FromCodeToAllocation(code)));
+          uintptr_t allocation = FromCodeToAllocation(method_header->GetCode());
+          CHECK(!bitmap_->HasAddress(allocation) || bitmap_->Test(allocation));
         }
       }
     }
@@ -1432,7 +1510,21 @@ void JitCodeCache::SetFootprintLimit(size_t new_footprint) {
   mspace_set_footprint_limit(data_mspace_, data_space_footprint);
   if (HasCodeMapping()) {
     ScopedCodeCacheWrite scc(this);
-    mspace_set_footprint_limit(exec_mspace_, new_footprint - data_space_footprint);
+    // Each segment may grow to its share of the code footprint. A segment running out of space
+    // triggers a collection, as the whole code cache would.
+    const size_t exec_footprint = new_footprint - data_space_footprint;
+    const bool segmented = code_segments_[kNumberOfCodeSegments - 1u].mspace != nullptr;
+    for (size_t i = 0; i < kNumberOfCodeSegments; ++i) {
+      CodeSegment& segment = code_segments_[i];
+      if (segment.mspace == nullptr) {
+        continue;
+      }
+      size_t limit = segmented
+          ? RoundDown(exec_footprint / kCodeSegmentSharesTotal * kCodeSegmentShares[i], kPageSize)
+          : exec_footprint;
+      limit = std::min(segment.capacity, std::max(segment.end, limit));
+      mspace_set_footprint_limit(segment.mspace, limit);
+    }
   }
 }
 
@@ -1505,11 +1597,12 @@ void JitCodeCache::GarbageCollectCache(Thread* self) {
       live_bitmap_.reset(CodeCacheBitmap::Create(
           "code-cache-bitmap",
           reinterpret_cast<uintptr_t>(exec_pages_.Begin()),
-          reinterpret_cast<uintptr_t>(exec_pages_.Begin() + current_capacity_ / 2)));
+          reinterpret_cast<uintptr_t>(exec_pages_.Begin() + GetCodeEnd())));
       collection_in_progress_ = true;
     }
   }
 
+  uint64_t start_ns = NanoTime();
   TimingLogger logger("JIT code cache timing logger", true, VLOG_IS_ON(jit));
   {
     TimingLogger::ScopedTiming st("Code cache collection", &logger);
@@ -1526,14 +1619,16 @@ void JitCodeCache::GarbageCollectCache(Thread* self) {
               << PrettySize(CodeCacheSize())
               << ", data=" << PrettySize(DataCacheSize());
 
-    DoCollection(self, /* collect_profiling_info= */ do_full_collection);
+    size_t bytes_freed = DoCollection(self, /* collect_profiling_info= */ do_full_collection);
 
     VLOG(jit) << "After code cache collection, code="
               << PrettySize(CodeCacheSize())
-              << ", data=" << PrettySize(DataCacheSize());
+              << ", data=" << PrettySize(DataCacheSize())
+              << ", freed=" << PrettySize(bytes_freed);
 
     {
       MutexLock mu(self, lock_);
+      total_collection_bytes_freed_ += bytes_freed;
 
       // Increase the code cache only when we do partial collections.
       // TODO: base this strategy on how full the code cache is?
@@ -1585,13 +1680,26 @@ void JitCodeCache::GarbageCollectCache(Thread* self) {
         }
       }
       live_bitmap_.reset(nullptr);
+      total_collection_time_ns_ += NanoTime() - start_ns;
       NotifyCollectionDone(self);
     }
   }
   Runtime::Current()->GetJit()->AddTimingLogger(logger);
 }
 
-void JitCodeCache::RemoveUnmarkedCode(Thread* self) {
+void JitCodeCache::MarkCodeLive(const void* code_ptr) {
+  uintptr_t allocation = FromCodeToAllocation(code_ptr);
+  if (GetLiveBitmap()->HasAddress(allocation)) {
+    GetLiveBitmap()->AtomicTestAndSet(allocation);
+  }
+}
+
+bool JitCodeCache::IsCodeMarkedLive(const void* code_ptr) {
+  uintptr_t allocation = FromCodeToAllocation(code_ptr);
+  return !GetLiveBitmap()->HasAddress(allocation) || GetLiveBitmap()->Test(allocation);
+}
+
+size_t JitCodeCache::RemoveUnmarkedCode(Thread* self) {
   ScopedTrace trace(__FUNCTION__);
   std::unordered_set<OatQuickMethodHeader*> method_headers;
   {
@@ -1602,7 +1710,7 @@ void JitCodeCache::RemoveUnmarkedCode(Thread* self) {
       JniStubData* data = &it->second;
       if (IsInZygoteExecSpace(data->GetCode()) ||
           !data->IsCompiled() ||
-          GetLiveBitmap()->Test(FromCodeToAllocation(data->GetCode()))) {
+          IsCodeMarkedLive(data->GetCode())) {
         ++it;
       } else {
         method_headers.insert(OatQuickMethodHeader::FromCodePointer(data->GetCode()));
@@ -1611,8 +1719,7 @@ void JitCodeCache::RemoveUnmarkedCode(Thread* self) {
     }
     for (auto it = method_code_map_.begin(); it != method_code_map_.end();) {
       const void* code_ptr = it->first;
-      uintptr_t allocation = FromCodeToAllocation(code_ptr);
-      if (IsInZygoteExecSpace(code_ptr) || GetLiveBitmap()->Test(allocation)) {
+      if (IsInZygoteExecSpace(code_ptr) || IsCodeMarkedLive(code_ptr)) {
         ++it;
       } else {
         OatQuickMethodHeader* header = OatQuickMethodHeader::FromCodePointer(code_ptr);
@@ -1621,7 +1728,7 @@ void JitCodeCache::RemoveUnmarkedCode(Thread* self) {
       }
     }
   }
-  FreeAllMethodHeaders(method_headers);
+  return FreeAllMethodHeaders(method_headers);
 }
 
 bool JitCodeCache::GetGarbageCollectCode() {
@@ -1647,7 +1754,7 @@ void JitCodeCache::SetGarbageCollectCode(bool value) {
   }
 }
 
-void JitCodeCache::DoCollection(Thread* self, bool collect_profiling_info) {
+size_t JitCodeCache::DoCollection(Thread* self, bool collect_profiling_info) {
   ScopedTrace trace(__FUNCTION__);
   {
     MutexLock mu(self, lock_);
@@ -1689,7 +1796,7 @@ void JitCodeCache::DoCollection(Thread* self, bool collect_profiling_info) {
       const OatQuickMethodHeader* method_header = OatQuickMethodHeader::FromCodePointer(code_ptr);
       for (ArtMethod* method : data.GetMethods()) {
         if (method_header->GetEntryPoint() == method->GetEntryPointFromQuickCompiledCode()) {
-          GetLiveBitmap()->AtomicTestAndSet(FromCodeToAllocation(code_ptr));
+          MarkCodeLive(code_ptr);
           break;
         }
       }
@@ -1702,7 +1809,7 @@ void JitCodeCache::DoCollection(Thread* self, bool collect_profiling_info) {
       }
       const OatQuickMethodHeader* method_header = OatQuickMethodHeader::FromCodePointer(code_ptr);
       if (method_header->GetEntryPoint() == method->GetEntryPointFromQuickCompiledCode()) {
-        GetLiveBitmap()->AtomicTestAndSet(FromCodeToAllocation(code_ptr));
+        MarkCodeLive(code_ptr);
       }
     }
 
@@ -1711,16 +1818,24 @@ void JitCodeCache::DoCollection(Thread* self, bool collect_profiling_info) {
     osr_code_map_.clear();
   }
 
-  // Run a checkpoint on all threads to mark the JIT compiled code they are running.
+  // Run a checkpoint on all threads to mark the JIT compiled code they are running. This is
+  // the only pause of the collection, each thread is held for its own stack walk.
+  uint64_t checkpoint_start_ns = NanoTime();
   MarkCompiledCodeOnThreadStacks(self);
+  uint64_t checkpoint_time_ns = NanoTime() - checkpoint_start_ns;
 
   // At this point, mutator threads are still running, and entrypoints of methods can
   // change. We do know they cannot change to a code cache entry that is not marked,
-  // therefore we can safely remove those entries.
-  RemoveUnmarkedCode(self);
+  // therefore we can safely remove those entries. Code committed since the collection
+  // started is marked live when committed.
+  size_t bytes_freed = RemoveUnmarkedCode(self);
 
+  MutexLock mu(self, lock_);
+  total_collection_checkpoint_time_ns_ += checkpoint_time_ns;
+  max_collection_checkpoint_time_ns_ =
+      std::max(max_collection_checkpoint_time_ns_, checkpoint_time_ns);
   if (collect_profiling_info) {
-    MutexLock mu(self, lock_);
+    const size_t used_memory_before = used_memory_for_data_;
     // Free all profiling infos of methods not compiled nor being compiled.
     auto profiling_kept_end = std::remove_if(profiling_infos_.begin(), profiling_infos_.end(),
       [this] (ProfilingInfo* info) NO_THREAD_SAFETY_ANALYSIS {
@@ -1743,7 +1858,9 @@ void JitCodeCache::DoCollection(Thread* self, bool collect_profiling_info) {
       });
     profiling_infos_.erase(profiling_kept_end, profiling_infos_.end());
     DCHECK(CheckLiveCompiledCodeHasProfilingInfo());
+    bytes_freed += used_memory_before - used_memory_for_data_;
   }
+  return bytes_freed;
 }
 
 bool JitCodeCache::CheckLiveCompiledCodeHasProfilingInfo() {
@@ -1899,18 +2016,19 @@ ProfilingInfo* JitCodeCache::AddProfilingInfoInternal(Thread* self ATTRIBUTE_UNU
 // NO_THREAD_SAFETY_ANALYSIS as this is called from mspace code, at which point the lock
 // is already held.
 void* JitCodeCache::MoreCore(const void* mspace, intptr_t increment) NO_THREAD_SAFETY_ANALYSIS {
-  if (mspace == exec_mspace_) {
-    DCHECK(exec_mspace_ != nullptr);
-    const MemMap* const code_pages = GetUpdatableCodeMapping();
-    void* result = code_pages->Begin() + exec_end_;
-    exec_end_ += increment;
-    return result;
-  } else {
-    DCHECK_EQ(data_mspace_, mspace);
-    void* result = data_pages_.Begin() + data_end_;
-    data_end_ += increment;
-    return result;
-  }
+  for (CodeSegment& segment : code_segments_) {
+    if (mspace == segment.mspace) {
+      const MemMap* const code_pages = GetUpdatableCodeMapping();
+      void* result = code_pages->Begin() + segment.begin + segment.end;
+      segment.end += increment;
+      DCHECK_LE(segment.end, segment.capacity);
+      return result;
+    }
+  }
+  DCHECK_EQ(data_mspace_, mspace);
+  void* result = data_pages_.Begin() + data_end_;
+  data_end_ += increment;
+  return result;
 }
 
 void JitCodeCache::GetProfiledMethods(const std::set<std::string>& dex_base_locations,
@@ -2055,7 +2173,7 @@ bool JitCodeCache::NotifyCompilationOf(ArtMethod* method, Thread* self, bool osr
       }
       if (collection_in_progress_) {
         if (!IsInZygoteExecSpace(data->GetCode())) {
-          GetLiveBitmap()->AtomicTestAndSet(FromCodeToAllocation(data->GetCode()));
+          MarkCodeLive(data->GetCode());
         }
       }
     }
@@ -2148,14 +2266,60 @@ void JitCodeCache::InvalidateCompiledCodeFor(ArtMethod* method,
   }
 }
 
-uint8_t* JitCodeCache::AllocateCode(size_t code_size) {
+JitCodeCache::CodeSegment& JitCodeCache::GetCodeSegment(JitCodeSegment kind) {
+  CodeSegment& segment = code_segments_[static_cast<size_t>(kind)];
+  // Without segments, all code goes to the optimized segment.
+  return (segment.mspace != nullptr)
+      ? segment
+      : code_segments_[static_cast<size_t>(JitCodeSegment::kOptimized)];
+}
+
+JitCodeCache::CodeSegment& JitCodeCache::GetCodeSegmentOf(const uint8_t* code) {
+  size_t offset = code - GetUpdatableCodeMapping()->Begin();
+  for (CodeSegment& segment : code_segments_) {
+    if (offset - segment.begin < segment.capacity) {
+      return segment;
+    }
+  }
+  LOG(FATAL) << "Code " << reinterpret_cast<const void*>(code) << " not in the code cache";
+  UNREACHABLE();
+}
+
+size_t JitCodeCache::GetCodeEnd() const {
+  size_t end = 0u;
+  for (const CodeSegment& segment : code_segments_) {
+    if (segment.mspace != nullptr) {
+      end = std::max(end, segment.begin + segment.end);
+    }
+  }
+  return end;
+}
+
+uint8_t* JitCodeCache::AllocateCode(size_t code_size, JitCodeSegment kind) {
+  CodeSegment* segment = &GetCodeSegment(kind);
   size_t alignment = GetInstructionSetAlignment(kRuntimeISA);
   uint8_t* result = reinterpret_cast<uint8_t*>(
-      mspace_memalign(exec_mspace_, alignment, code_size));
+      mspace_memalign(segment->mspace, alignment, code_size));
+  // When the segment of this kind of code is full, spill over to the other segments, so that the
+  // code cache only needs a collection once all of them are full.
+  for (size_t i = 0; result == nullptr && i < kNumberOfCodeSegments; ++i) {
+    CodeSegment* other = &code_segments_[i];
+    if (other != segment && other->mspace != nullptr) {
+      result = reinterpret_cast<uint8_t*>(mspace_memalign(other->mspace, alignment, code_size));
+      if (result != nullptr) {
+        segment = other;
+      }
+    }
+  }
+  if (result == nullptr) {
+    return nullptr;
+  }
   size_t header_size = RoundUp(sizeof(OatQuickMethodHeader), alignment);
   // Ensure the header ends up at expected instruction alignment.
   DCHECK_ALIGNED_PARAM(reinterpret_cast<uintptr_t>(result + header_size), alignment);
-  used_memory_for_code_ += mspace_usable_size(result);
+  size_t usable_size = mspace_usable_size(result);
+  used_memory_for_code_ += usable_size;
+  segment->used_memory += usable_size;
   return result;
 }
 
@@ -2164,8 +2328,11 @@ void JitCodeCache::FreeCode(uint8_t* code) {
     // No need to free, this is shared memory.
     return;
   }
-  used_memory_for_code_ -= mspace_usable_size(code);
-  mspace_free(exec_mspace_, code);
+  CodeSegment& segment = GetCodeSegmentOf(code);
+  size_t usable_size = mspace_usable_size(code);
+  used_memory_for_code_ -= usable_size;
+  segment.used_memory -= usable_size;
+  mspace_free(segment.mspace, code);
 }
 
 uint8_t* JitCodeCache::AllocateData(size_t data_size) {
@@ -2194,7 +2361,23 @@ void JitCodeCache::Dump(std::ostream& os) {
      << "Total number of JIT compilations: " << number_of_compilations_ << "\n"
      << "Total number of JIT compilations for on stack replacement: "
         << number_of_osr_compilations_ << "\n"
-     << "Total number of JIT code cache collections: " << number_of_collections_ << std::endl;
+     << "Total number of JIT code cache collections: " << number_of_collections_ << "\n"
+     << "Total time in JIT code cache collections: "
+        << PrettyDuration(total_collection_time_ns_) << "\n"
+     << "Total time in JIT code cache collection checkpoints: "
+        << PrettyDuration(total_collection_checkpoint_time_ns_)
+        << " (max " << PrettyDuration(max_collection_checkpoint_time_ns_) << ")\n"
+     << "Total memory freed by JIT code cache collections: "
+        << PrettySize(total_collection_bytes_freed_) << std::endl;
+  for (size_t i = 0; i < kNumberOfCodeSegments; ++i) {
+    const CodeSegment& segment = code_segments_[i];
+    if (segment.mspace != nullptr) {
+      os << "JIT code segment " << kCodeSegmentNames[i] << ": "
+         << PrettySize(segment.used_memory) << " used, "
+         << PrettySize(segment.end) << " footprint, "
+         << PrettySize(segment.capacity) << " capacity\n";
+    }
+  }
   histogram_stack_map_memory_use_.PrintMemoryUse(os);
   histogram_code_memory_use_.PrintMemoryUse(os);
   histogram_profiling_info_memory_use_.PrintMemoryUse(os);
@@ -2210,7 +2393,7 @@ void JitCodeCache::PostForkChildAction(bool is_system_server, bool is_zygote) {
   zygote_data_pages_ = std::move(data_pages_);
   zygote_exec_pages_ = std::move(exec_pages_);
   zygote_data_mspace_ = data_mspace_;
-  zygote_exec_mspace_ = exec_mspace_;
+  zygote_code_segments_ = code_segments_;
 
   size_t initial_capacity = Runtime::Current()->GetJITOptions()->GetCodeCacheInitialCapacity();
   size_t max_capacity = Runtime::Current()->GetJITOptions()->GetCodeCacheMaxCapacity();
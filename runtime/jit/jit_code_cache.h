@@ -17,6 +17,7 @@
 #ifndef ART_RUNTIME_JIT_JIT_CODE_CACHE_H_
 #define ART_RUNTIME_JIT_JIT_CODE_CACHE_H_
 
+#include <array>
 #include <iosfwd>
 #include <memory>
 #include <set>
@@ -78,6 +79,17 @@ class ScopedCodeCacheWrite;
 static constexpr int kJitCodeAlignment = 16;
 using CodeCacheBitmap = gc::accounting::MemoryRangeBitmap<kJitCodeAlignment>;
 
+// Kinds of compiled code. Each kind is preferably allocated from its own segment of the code
+// cache, so that the optimized code of hot methods stays together for i-cache and iTLB locality
+// instead of being interleaved with baseline, OSR and JNI stub code.
+enum class JitCodeSegment : uint8_t {
+  kOptimized,
+  kBaseline,
+  kOsr,
+  kJniStub,
+  kLast = kJniStub,
+};
+
 class JitCodeCache {
  public:
   static constexpr size_t kMaxCapacity = 64 * MB;
@@ -133,6 +145,7 @@ class JitCodeCache {
                       const uint8_t* code,
                       size_t code_size,
                       size_t data_size,
+                      bool baseline,
                       bool osr,
                       const std::vector<Handle<mirror::Object>>& roots,
                       bool has_should_deoptimize_flag,
@@ -198,7 +211,12 @@ class JitCodeCache {
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
-  void CopyInlineCacheInto(const InlineCache& ic, Handle<mirror::ObjectArray<mirror::Class>> array)
+  // Copy the classes of `ic` into `array`, and their call counts into the kIndividualCacheSize
+  // entries of `counts`, in the same order.
+  void CopyInlineCacheInto(const InlineCache& ic,
+                           Handle<mirror::ObjectArray<mirror::Class>> array,
+                           /*out*/ uint32_t* counts,
+                           /*out*/ uint32_t* megamorphic_count)
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
@@ -212,7 +230,15 @@ class JitCodeCache {
       REQUIRES_SHARED(Locks::mutator_lock_);
 
   bool OwnsSpace(const void* mspace) const NO_THREAD_SAFETY_ANALYSIS {
-    return mspace == data_mspace_ || mspace == exec_mspace_;
+    if (mspace == data_mspace_) {
+      return true;
+    }
+    for (const CodeSegment& segment : code_segments_) {
+      if (mspace == segment.mspace) {
+        return true;
+      }
+    }
+    return false;
   }
 
   void* MoreCore(const void* mspace, intptr_t increment);
@@ -294,6 +320,7 @@ class JitCodeCache {
                               const uint8_t* code,
                               size_t code_size,
                               size_t data_size,
+                              bool baseline,
                               bool osr,
                               const std::vector<Handle<mirror::Object>>& roots,
                               bool has_should_deoptimize_flag,
@@ -312,19 +339,15 @@ class JitCodeCache {
       REQUIRES(lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
-  // If a collection is in progress, wait for it to finish. Must be called with the mutator lock.
-  // The non-mutator lock version should be used if possible. This method will release then
-  // re-acquire the mutator lock.
-  void WaitForPotentialCollectionToCompleteRunnable(Thread* self)
-      REQUIRES(lock_, !Roles::uninterruptible_) REQUIRES_SHARED(Locks::mutator_lock_);
-
   // If a collection is in progress, wait for it to finish. Return
   // whether the thread actually waited.
   bool WaitForPotentialCollectionToComplete(Thread* self)
       REQUIRES(lock_) REQUIRES(!Locks::mutator_lock_);
 
-  // Remove CHA dependents and underlying allocations for entries in `method_headers`.
-  void FreeAllMethodHeaders(const std::unordered_set<OatQuickMethodHeader*>& method_headers)
+  // Remove CHA dependents and underlying allocations for entries in `method_headers`. The
+  // allocations are freed in batches, releasing lock_ in between so that compilations are not
+  // held up by a large free. Return the number of bytes freed.
+  size_t FreeAllMethodHeaders(const std::unordered_set<OatQuickMethodHeader*>& method_headers)
       REQUIRES(!lock_)
       REQUIRES(!Locks::cha_lock_);
 
@@ -364,14 +387,20 @@ class JitCodeCache {
       REQUIRES(lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
-  void DoCollection(Thread* self, bool collect_profiling_info)
+  // Collect the code not marked live and return the number of bytes freed.
+  size_t DoCollection(Thread* self, bool collect_profiling_info)
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
-  void RemoveUnmarkedCode(Thread* self)
+  size_t RemoveUnmarkedCode(Thread* self)
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
 
+  // Mark `code_ptr` live for the collection in progress. Code allocated after the collection
+  // started may lie beyond the live bitmap, it is live anyway.
+  void MarkCodeLive(const void* code_ptr) REQUIRES(lock_);
+  bool IsCodeMarkedLive(const void* code_ptr) REQUIRES(lock_);
+
   void MarkCompiledCodeOnThreadStacks(Thread* self)
       REQUIRES(!lock_)
       REQUIRES_SHARED(Locks::mutator_lock_);
@@ -384,7 +413,9 @@ class JitCodeCache {
     return live_bitmap_.get();
   }
 
-  uint8_t* AllocateCode(size_t code_size) REQUIRES(lock_);
+  // Allocate code from the segment of the given kind or, if it is full, from another segment.
+  // Return null if all segments are full.
+  uint8_t* AllocateCode(size_t code_size, JitCodeSegment kind) REQUIRES(lock_);
   void FreeCode(uint8_t* code) REQUIRES(lock_);
   uint8_t* AllocateData(size_t data_size) REQUIRES(lock_);
   void FreeData(uint8_t* data) REQUIRES(lock_);
@@ -419,7 +450,8 @@ class JitCodeCache {
   Mutex lock_ BOTTOM_MUTEX_ACQUIRED_AFTER;
   // Condition to wait on during collection.
   ConditionVariable lock_cond_ GUARDED_BY(lock_);
-  // Whether there is a code cache collection in progress.
+  // Whether there is a code cache collection in progress. Compilations may commit code during a
+  // collection, the code is marked live as it is committed.
   bool collection_in_progress_ GUARDED_BY(lock_);
   // Mem map which holds data (stack maps and profiling info).
   MemMap data_pages_;
@@ -430,8 +462,31 @@ class JitCodeCache {
   MemMap non_exec_pages_;
   // The opaque mspace for allocating data.
   void* data_mspace_ GUARDED_BY(lock_);
-  // The opaque mspace for allocating code.
-  void* exec_mspace_ GUARDED_BY(lock_);
+  // A part of the code mapping, with its own mspace.
+  struct CodeSegment {
+    // Offset of the segment in the code mapping.
+    size_t begin = 0u;
+    // Maximum size of the segment, zero if the segment is not used.
+    size_t capacity = 0u;
+    // Current footprint of the mspace, which grows the segment with MoreCore().
+    size_t end = 0u;
+    // The opaque mspace for allocating code, null if the segment is not used.
+    void* mspace = nullptr;
+    // The size in bytes of used memory in the segment.
+    size_t used_memory = 0u;
+  };
+  static constexpr size_t kNumberOfCodeSegments =
+      static_cast<size_t>(JitCodeSegment::kLast) + 1u;
+
+  // Return the segment code of the given kind is allocated from.
+  CodeSegment& GetCodeSegment(JitCodeSegment kind) REQUIRES(lock_);
+  // Return the segment holding `code`, an address in the updatable code mapping.
+  CodeSegment& GetCodeSegmentOf(const uint8_t* code) REQUIRES(lock_);
+  // Return the offset in the code mapping up to which code has been allocated.
+  size_t GetCodeEnd() const REQUIRES(lock_);
+
+  // The segments of the code mapping, by kind of code.
+  std::array<CodeSegment, kNumberOfCodeSegments> code_segments_ GUARDED_BY(lock_);
   // Bitmap for collecting code and data.
   std::unique_ptr<CodeCacheBitmap> live_bitmap_;
   // Holds compiled code associated with the shorty for a JNI stub.
@@ -455,9 +510,6 @@ class JitCodeCache {
   // The current footprint in bytes of the data portion of the code cache.
   size_t data_end_ GUARDED_BY(lock_);
 
-  // The current footprint in bytes of the code portion of the code cache.
-  size_t exec_end_ GUARDED_BY(lock_);
-
   // Whether the last collection round increased the code cache.
   bool last_collection_increased_code_cache_ GUARDED_BY(lock_);
 
@@ -479,6 +531,15 @@ class JitCodeCache {
   // Number of code cache collections done throughout the lifetime of the JIT.
   size_t number_of_collections_ GUARDED_BY(lock_);
 
+  // Time spent in code cache collections, and in their thread stack checkpoints, which are the
+  // only part of a collection that mutators wait for.
+  uint64_t total_collection_time_ns_ GUARDED_BY(lock_);
+  uint64_t total_collection_checkpoint_time_ns_ GUARDED_BY(lock_);
+  uint64_t max_collection_checkpoint_time_ns_ GUARDED_BY(lock_);
+
+  // Code and data bytes freed by code cache collections.
+  uint64_t total_collection_bytes_freed_ GUARDED_BY(lock_);
+
   // Histograms for keeping track of stack map size statistics.
   Histogram<uint64_t> histogram_stack_map_memory_use_ GUARDED_BY(lock_);
 
@@ -502,10 +563,11 @@ class JitCodeCache {
   MemMap zygote_exec_pages_;
   // The opaque mspace for allocating zygote data.
   void* zygote_data_mspace_ GUARDED_BY(lock_);
-  // The opaque mspace for allocating zygote code.
-  void* zygote_exec_mspace_ GUARDED_BY(lock_);
+  // The segments for allocating zygote code.
+  std::array<CodeSegment, kNumberOfCodeSegments> zygote_code_segments_ GUARDED_BY(lock_);
 
   friend class art::JitJniStubTestHelper;
+  friend class JitCodeCacheTest;
   friend class ScopedCodeCacheWrite;
   friend class MarkCodeClosure;
 
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jit_code_cache.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "art_method-inl.h"
+#include "base/arena_allocator.h"
+#include "base/arena_containers.h"
+#include "base/mem_map.h"
+#include "base/mutex.h"
+#include "class_linker.h"
+#include "common_runtime_test.h"
+#include "handle_scope-inl.h"
+#include "mirror/class-inl.h"
+#include "mirror/class_loader.h"
+#include "oat_quick_method_header.h"
+#include "scoped_thread_state_change-inl.h"
+#include "thread-current-inl.h"
+
+namespace art {
+namespace jit {
+
+class JitCodeCacheTest : public CommonRuntimeTest {
+ protected:
+  static constexpr size_t kCodeSize = 256;
+  static constexpr size_t kCommittedCodeSize = 16;
+  static constexpr size_t kStackMapSize = 16;
+
+  void SetUp() override {
+    CommonRuntimeTest::SetUp();
+    std::string error_msg;
+    code_cache_.reset(JitCodeCache::Create(/*used_only_for_profile_data=*/ false,
+                                           /*rwx_memory_allowed=*/ true,
+                                           /*is_zygote=*/ false,
+                                           &error_msg));
+    ASSERT_TRUE(code_cache_ != nullptr) << error_msg;
+    // The code cache keeps its code mapping read-only outside of code updates. The segments are
+    // not grown past their initial footprint here, so their mspaces never call MoreCore().
+    const MemMap* code_pages = code_cache_->GetUpdatableCodeMapping();
+    ASSERT_TRUE(code_pages != nullptr);
+    ASSERT_EQ(0, mprotect(code_pages->Begin(), code_pages->Size(), PROT_READ | PROT_WRITE));
+  }
+
+  void TearDown() override {
+    code_cache_.reset();
+    CommonRuntimeTest::TearDown();
+  }
+
+  uint8_t* AllocateCode(JitCodeSegment kind) {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    return code_cache_->AllocateCode(kCodeSize, kind);
+  }
+
+  void FreeCode(uint8_t* code) {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    code_cache_->FreeCode(code);
+  }
+
+  JitCodeSegment GetCodeSegmentOf(const uint8_t* code) {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    const JitCodeCache::CodeSegment& segment = code_cache_->GetCodeSegmentOf(code);
+    return static_cast<JitCodeSegment>(&segment - code_cache_->code_segments_.data());
+  }
+
+  size_t GetUsedMemory(JitCodeSegment kind) {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    return code_cache_->code_segments_[static_cast<size_t>(kind)].used_memory;
+  }
+
+  size_t GetUsedMemoryForCode() {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    return code_cache_->used_memory_for_code_;
+  }
+
+  // Commit code filled with `pattern` for `method`, the way a compilation does. Returns the method
+  // header of the code.
+  const OatQuickMethodHeader* CommitCode(ArtMethod* method, bool osr, uint8_t pattern)
+      REQUIRES_SHARED(Locks::mutator_lock_) {
+    Thread* self = Thread::Current();
+    uint8_t* stack_map = nullptr;
+    uint8_t* roots_data = nullptr;
+    size_t data_size = 0u;
+    if (method->IsNative()) {
+      // Registers the JNI stub as being compiled.
+      if (!code_cache_->NotifyCompilationOf(method, self, osr)) {
+        return nullptr;
+      }
+    } else {
+      data_size = code_cache_->ReserveData(
+          self, kStackMapSize, /* number_of_roots= */ 0u, method, &stack_map, &roots_data);
+      if (data_size == 0u) {
+        return nullptr;
+      }
+      std::fill_n(stack_map, kStackMapSize, 0u);
+    }
+    std::vector<uint8_t> code(kCommittedCodeSize, pattern);
+    std::vector<Handle<mirror::Object>> roots;
+    ArenaAllocator allocator(Runtime::Current()->GetArenaPool());
+    ArenaSet<ArtMethod*> cha_single_implementation_list(allocator.Adapter(kArenaAllocCHA));
+    uint8_t* header = code_cache_->CommitCode(self,
+                                              method,
+                                              stack_map,
+                                              roots_data,
+                                              code.data(),
+                                              code.size(),
+                                              data_size,
+                                              /* baseline= */ false,
+                                              osr,
+                                              roots,
+                                              /* has_should_deoptimize_flag= */ false,
+                                              cha_single_implementation_list);
+    if (method->IsNative()) {
+      code_cache_->DoneCompiling(method, self, osr);
+    }
+    return reinterpret_cast<const OatQuickMethodHeader*>(header);
+  }
+
+  // Whether the code of `header` is still in the cache, and still holds `pattern`.
+  bool HasCode(const OatQuickMethodHeader* header, uint8_t pattern) {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    const uint8_t* code = reinterpret_cast<const uint8_t*>(header->GetCode());
+    return code_cache_->method_code_map_.find(code) != code_cache_->method_code_map_.end() &&
+           header->GetCodeSize() == kCommittedCodeSize &&
+           std::all_of(code, code + kCommittedCodeSize, [=](uint8_t b) { return b == pattern; });
+  }
+
+  // Whether `header` holds the JNI stub of `method`, filled with `pattern`.
+  bool HasJniStub(ArtMethod* method, const OatQuickMethodHeader* header, uint8_t pattern) {
+    const uint8_t* code = reinterpret_cast<const uint8_t*>(header->GetCode());
+    return code_cache_->GetJniStubCode(method) == code &&
+           std::all_of(code, code + kCommittedCodeSize, [=](uint8_t b) { return b == pattern; });
+  }
+
+  // Start a collection, as GarbageCollectCache() does. Nothing is marked live, the code committed
+  // so far is unreachable.
+  void StartCollection() {
+    MutexLock mu(Thread::Current(), code_cache_->lock_);
+    ASSERT_FALSE(code_cache_->collection_in_progress_);
+    const uint8_t* begin = code_cache_->exec_pages_.Begin();
+    code_cache_->live_bitmap_.reset(CodeCacheBitmap::Create(
+        "code-cache-bitmap",
+        reinterpret_cast<uintptr_t>(begin),
+        reinterpret_cast<uintptr_t>(begin + code_cache_->GetCodeEnd())));
+    code_cache_->collection_in_progress_ = true;
+  }
+
+  // Free the code not marked live, in batches. Returns the number of bytes freed.
+  size_t RemoveUnmarkedCode() REQUIRES_SHARED(Locks::mutator_lock_) {
+    return code_cache_->RemoveUnmarkedCode(Thread::Current());
+  }
+
+  void FinishCollection() {
+    Thread* self = Thread::Current();
+    MutexLock mu(self, code_cache_->lock_);
+    code_cache_->live_bitmap_.reset(nullptr);
+    code_cache_->NotifyCollectionDone(self);
+  }
+
+  std::unique_ptr<JitCodeCache> code_cache_;
+};
+
+static constexpr JitCodeSegment kAllSegments[] = {
+  JitCodeSegment::kOptimized,
+  JitCodeSegment::kBaseline,
+  JitCodeSegment::kOsr,
+  JitCodeSegment::kJniStub,
+};
+
+// Test that each kind of code is allocated from its own segment, and freed back to it.
+TEST_F(JitCodeCacheTest, AllocateAndFree) {
+  std::vector<uint8_t*> codes;
+  for (JitCodeSegment kind : kAllSegments) {
+    uint8_t* code = AllocateCode(kind);
+    ASSERT_TRUE(code != nullptr);
+    EXPECT_EQ(kind, GetCodeSegmentOf(code));
+    EXPECT_GE(GetUsedMemory(kind), kCodeSize);
+    codes.push_back(code);
+  }
+  for (uint8_t* code : codes) {
+    FreeCode(code);
+  }
+  for (JitCodeSegment kind : kAllSegments) {
+    EXPECT_EQ(0u, GetUsedMemory(kind));
+  }
+  EXPECT_EQ(0u, GetUsedMemoryForCode());
+}
+
+// Test that once its segment is full, code spills over to the other segments, and that the code
+// is freed to the segment it was allocated from.
+TEST_F(JitCodeCacheTest, SpillOver) {
+  std::vector<uint8_t*> codes;
+  bool spilled_over = false;
+  for (uint8_t* code = AllocateCode(JitCodeSegment::kOptimized);
+       code != nullptr;
+       code = AllocateCode(JitCodeSegment::kOptimized)) {
+    JitCodeSegment kind = GetCodeSegmentOf(code);
+    if (kind != JitCodeSegment::kOptimized) {
+      spilled_over = true;
+    } else {
+      // Optimized code only goes elsewhere once the optimized segment is full.
+      EXPECT_FALSE(spilled_over);
+    }
+    codes.push_back(code);
+  }
+  EXPECT_TRUE(spilled_over);
+  ASSERT_FALSE(codes.empty());
+  EXPECT_EQ(JitCodeSegment::kOptimized, GetCodeSegmentOf(codes.front()));
+  // All segments are full, other kinds of code cannot be allocated either.
+  EXPECT_TRUE(AllocateCode(JitCodeSegment::kBaseline) == nullptr);
+
+  for (uint8_t* code : codes) {
+    FreeCode(code);
+  }
+  for (JitCodeSegment kind : kAllSegments) {
+    EXPECT_EQ(0u, GetUsedMemory(kind));
+  }
+  EXPECT_EQ(0u, GetUsedMemoryForCode());
+  // The freed memory is available again to the preferred segment.
+  uint8_t* code = AllocateCode(JitCodeSegment::kOsr);
+  ASSERT_TRUE(code != nullptr);
+  EXPECT_EQ(JitCodeSegment::kOsr, GetCodeSegmentOf(code));
+  FreeCode(code);
+}
+
+// Test that code committed while a collection is in progress survives the collection, including
+// code reusing the memory that the collection has freed.
+TEST_F(JitCodeCacheTest, CommitDuringCollection) {
+  // More than one batch of FreeAllMethodHeaders().
+  static constexpr size_t kUnreachableCodeCount = 65;
+  Thread* self = Thread::Current();
+  ScopedObjectAccess soa(self);
+  StackHandleScope<1> hs(self);
+  Handle<mirror::ClassLoader> class_loader(
+      hs.NewHandle(soa.Decode<mirror::ClassLoader>(LoadDex("MyClassNatives"))));
+  ObjPtr<mirror::Class> klass =
+      class_linker_->FindClass(self, "LMyClassNatives;", class_loader);
+  ASSERT_TRUE(klass != nullptr);
+  ArtMethod* method = klass->FindClassMethod("<init>", "()V", kRuntimePointerSize);
+  ArtMethod* native_method = klass->FindClassMethod("foo", "()V", kRuntimePointerSize);
+  ArtMethod* other_native_method = klass->FindClassMethod("bar", "(I)I", kRuntimePointerSize);
+  ASSERT_TRUE(method != nullptr);
+  ASSERT_TRUE(native_method != nullptr && native_method->IsNative());
+  ASSERT_TRUE(other_native_method != nullptr && other_native_method->IsNative());
+  // Committing code updates the entrypoints, restore them once done.
+  const void* entry_point = method->GetEntryPointFromQuickCompiledCode();
+  const void* native_entry_point = native_method->GetEntryPointFromQuickCompiledCode();
+  const void* other_native_entry_point = other_native_method->GetEntryPointFromQuickCompiledCode();
+
+  std::set<const OatQuickMethodHeader*> unreachable_code;
+  for (size_t i = 0; i != kUnreachableCodeCount; ++i) {
+    const OatQuickMethodHeader* header = CommitCode(method, /* osr= */ false, 0u);
+    ASSERT_TRUE(header != nullptr);
+    unreachable_code.insert(header);
+  }
+
+  StartCollection();
+  // Committed after the collection started, before it frees the unreachable code.
+  const OatQuickMethodHeader* optimized = CommitCode(method, /* osr= */ false, 1u);
+  ASSERT_TRUE(optimized != nullptr);
+  const OatQuickMethodHeader* jni_stub = CommitCode(native_method, /* osr= */ false, 2u);
+  ASSERT_TRUE(jni_stub != nullptr);
+
+  EXPECT_GT(RemoveUnmarkedCode(), 0u);
+  for (const OatQuickMethodHeader* header : unreachable_code) {
+    EXPECT_FALSE(HasCode(header, 0u));
+  }
+
+  // Committed while the collection is still in progress, in memory it has freed.
+  const OatQuickMethodHeader* reused = CommitCode(method, /* osr= */ false, 3u);
+  ASSERT_TRUE(reused != nullptr);
+  EXPECT_TRUE(unreachable_code.find(reused) != unreachable_code.end());
+  const OatQuickMethodHeader* osr = CommitCode(method, /* osr= */ true, 4u);
+  ASSERT_TRUE(osr != nullptr);
+  const OatQuickMethodHeader* other_jni_stub =
+      CommitCode(other_native_method, /* osr= */ false, 5u);
+  ASSERT_TRUE(other_jni_stub != nullptr);
+  FinishCollection();
+
+  EXPECT_TRUE(HasCode(optimized, 1u));
+  EXPECT_TRUE(HasJniStub(native_method, jni_stub, 2u));
+  EXPECT_TRUE(HasCode(reused, 3u));
+  EXPECT_TRUE(HasCode(osr, 4u));
+  EXPECT_EQ(osr, code_cache_->LookupOsrMethodHeader(method));
+  EXPECT_TRUE(HasJniStub(other_native_method, other_jni_stub, 5u));
+  EXPECT_EQ(static_cast<const void*>(reused->GetEntryPoint()),
+            method->GetEntryPointFromQuickCompiledCode());
+
+  method->SetEntryPointFromQuickCompiledCode(entry_point);
+  native_method->SetEntryPointFromQuickCompiledCode(native_entry_point);
+  other_native_method->SetEntryPointFromQuickCompiledCode(other_native_entry_point);
+}
+
+}  // namespace jit
+}  // namespace art
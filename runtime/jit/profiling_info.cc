@@ -79,13 +79,21 @@ InlineCache* ProfilingInfo::GetInlineCache(uint32_t dex_pc) {
   UNREACHABLE();
 }
 
+static void IncrementCount(Atomic<uint32_t>* count) {
+  uint32_t value = count->load(std::memory_order_relaxed);
+  if (value != InlineCache::kMaxCount) {
+    count->store(value + 1u, std::memory_order_relaxed);
+  }
+}
+
 void ProfilingInfo::AddInvokeInfo(uint32_t dex_pc, mirror::Class* cls) {
   InlineCache* cache = GetInlineCache(dex_pc);
   for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
     mirror::Class* existing = cache->classes_[i].Read<kWithoutReadBarrier>();
     mirror::Class* marked = ReadBarrier::IsMarked(existing);
     if (marked == cls) {
-      // Receiver type is already in the cache, nothing else to do.
+      // Receiver type is already in the cache, count the call.
+      IncrementCount(&cache->counts_[i]);
       return;
     } else if (marked == nullptr) {
       // Cache entry is empty, try to put `cls` in it.
@@ -100,13 +108,36 @@ void ProfilingInfo::AddInvokeInfo(uint32_t dex_pc, mirror::Class* cls) {
         // entry in case the entry contains `cls`.
         --i;
       } else {
-        // We successfully set `cls`, just return.
+        // We successfully set `cls`, this is its first call.
+        cache->counts_[i].store(1u, std::memory_order_relaxed);
         return;
       }
     }
   }
   // Unsuccessfull - cache is full, making it megamorphic. We do not DCHECK it though,
   // as the garbage collector might clear the entries concurrently.
+
+  // Replace a class whose count dropped to zero, if any.
+  for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
+    if (cache->counts_[i].load(std::memory_order_relaxed) == 0u) {
+      GcRoot<mirror::Class> expected_root(cache->classes_[i].Read<kWithoutReadBarrier>());
+      GcRoot<mirror::Class> desired_root(cls);
+      auto atomic_root = reinterpret_cast<Atomic<GcRoot<mirror::Class>>*>(&cache->classes_[i]);
+      if (atomic_root->CompareAndSetStrongSequentiallyConsistent(expected_root, desired_root)) {
+        cache->counts_[i].store(1u, std::memory_order_relaxed);
+      }
+      // If another thread updated the entry, the call is simply not counted.
+      return;
+    }
+  }
+  // Otherwise decrement all the counts.
+  for (size_t i = 0; i < InlineCache::kIndividualCacheSize; ++i) {
+    uint32_t count = cache->counts_[i].load(std::memory_order_relaxed);
+    if (count != 0u) {
+      cache->counts_[i].store(count - 1u, std::memory_order_relaxed);
+    }
+  }
+  IncrementCount(&cache->megamorphic_count_);
 }
 
 }  // namespace art
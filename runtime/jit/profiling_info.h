@@ -17,8 +17,10 @@
 #ifndef ART_RUNTIME_JIT_PROFILING_INFO_H_
 #define ART_RUNTIME_JIT_PROFILING_INFO_H_
 
+#include <limits>
 #include <vector>
 
+#include "base/atomic.h"
 #include "base/macros.h"
 #include "gc_root.h"
 
@@ -37,16 +39,44 @@ class Class;
 
 // Structure to store the classes seen at runtime for a specific instruction.
 // Once the classes_ array is full, we consider the INVOKE to be megamorphic.
+//
+// Each class comes with the number of calls seen for it. Once the cache is megamorphic,
+// the counts are maintained with the Misra-Gries frequent items algorithm: a call with
+// an unknown receiver decrements all counts, and replaces a class whose count dropped to
+// zero. A receiver class seen in more than 1 / (kIndividualCacheSize + 1) of the calls is
+// thus always in the cache, and its count is a lower bound of its number of calls.
 class InlineCache {
  public:
   static constexpr uint8_t kIndividualCacheSize = 5;
 
+  // Counts are approximate: they are updated without synchronization and saturate.
+  static constexpr uint32_t kMaxCount = std::numeric_limits<uint32_t>::max();
+
+  // Estimate the number of calls profiled by a cache, given the counts of its first
+  // `number_of_classes` classes and its megamorphic count. Each megamorphic count stands for
+  // one call to each of the kIndividualCacheSize receivers in the cache and one call to another
+  // receiver, none of which is in the counts.
+  static uint64_t EstimateTotalCalls(const uint32_t* counts,
+                                     size_t number_of_classes,
+                                     uint32_t megamorphic_count) {
+    uint64_t total = static_cast<uint64_t>(megamorphic_count) * (kIndividualCacheSize + 1u);
+    for (size_t i = 0; i < number_of_classes; ++i) {
+      total += counts[i];
+    }
+    return total;
+  }
+
  private:
   uint32_t dex_pc_;
   GcRoot<mirror::Class> classes_[kIndividualCacheSize];
+  Atomic<uint32_t> counts_[kIndividualCacheSize];
+  // Number of times a call with a receiver not in the full cache decremented all the
+  // counts. Each of these stands for kIndividualCacheSize + 1 calls not in `counts_`.
+  Atomic<uint32_t> megamorphic_count_;
 
   friend class jit::JitCodeCache;
   friend class ProfilingInfo;
+  friend class InlineCacheTest;
 
   DISALLOW_COPY_AND_ASSIGN(InlineCache);
 };
@@ -105,6 +135,10 @@ class ProfilingInfo {
       memset(&cache->classes_[0],
              0,
              InlineCache::kIndividualCacheSize * sizeof(GcRoot<mirror::Class>));
+      for (size_t j = 0; j < InlineCache::kIndividualCacheSize; ++j) {
+        cache->counts_[j].store(0u, std::memory_order_relaxed);
+      }
+      cache->megamorphic_count_.store(0u, std::memory_order_relaxed);
     }
   }
 
@@ -158,6 +192,7 @@ class ProfilingInfo {
   InlineCache cache_[0];
 
   friend class jit::JitCodeCache;
+  friend class InlineCacheTest;
 
   DISALLOW_COPY_AND_ASSIGN(ProfilingInfo);
 };
@@ -457,6 +457,9 @@ enum class VMDebugRuntimeStatId {
   kArtGcBlockingGcTime,
   kArtGcGcCountRateHistogram,
   kArtGcBlockingGcCountRateHistogram,
+  kArtGcPerformanceStats,
+  kArtGcClassHistogram,
+  kArtGcAllocationSamples,
   kNumRuntimeStats,
 };
 
@@ -497,6 +500,21 @@ static jstring VMDebug_getRuntimeStatInternal(JNIEnv* env, jclass, jint statId)
       heap->DumpBlockingGcCountRateHistogram(output);
       return env->NewStringUTF(output.str().c_str());
     }
+    case VMDebugRuntimeStatId::kArtGcPerformanceStats: {
+      std::ostringstream output;
+      heap->DumpGcPerformanceStats(output);
+      return env->NewStringUTF(output.str().c_str());
+    }
+    case VMDebugRuntimeStatId::kArtGcClassHistogram: {
+      std::ostringstream output;
+      heap->DumpClassHistogram(output);
+      return env->NewStringUTF(output.str().c_str());
+    }
+    case VMDebugRuntimeStatId::kArtGcAllocationSamples: {
+      std::ostringstream output;
+      heap->DumpAllocationSamples(output);
+      return env->NewStringUTF(output.str().c_str());
+    }
     default:
       return nullptr;
   }
@@ -563,6 +581,30 @@ static jobjectArray VMDebug_getRuntimeStatsInternal(JNIEnv* env, jclass) {
       return nullptr;
     }
   }
+  {
+    std::ostringstream output;
+    heap->DumpGcPerformanceStats(output);
+    if (!SetRuntimeStatValue(env, result, VMDebugRuntimeStatId::kArtGcPerformanceStats,
+                             output.str())) {
+      return nullptr;
+    }
+  }
+  {
+    std::ostringstream output;
+    heap->DumpClassHistogram(output);
+    if (!SetRuntimeStatValue(env, result, VMDebugRuntimeStatId::kArtGcClassHistogram,
+                             output.str())) {
+      return nullptr;
+    }
+  }
+  {
+    std::ostringstream output;
+    heap->DumpAllocationSamples(output);
+    if (!SetRuntimeStatValue(env, result, VMDebugRuntimeStatId::kArtGcAllocationSamples,
+                             output.str())) {
+      return nullptr;
+    }
+  }
   return result;
 }
 
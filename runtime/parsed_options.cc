@@ -141,6 +141,9 @@ std::unique_ptr<RuntimeParser> ParsedOptions::MakeParser(bool ignore_unrecognize
       .Define("-XX:StopForNativeAllocs=_")
           .WithType<MemoryKiB>()
           .IntoKey(M::StopForNativeAllocs)
+      .Define("-XX:RegionSpaceResidentBudget=_")
+          .WithType<MemoryKiB>()
+          .IntoKey(M::RegionSpaceResidentBudget)
       .Define("-XX:HeapTargetUtilization=_")
           .WithType<double>().WithRange(0.1, 0.9)
           .IntoKey(M::HeapTargetUtilization)
@@ -153,6 +156,12 @@ std::unique_ptr<RuntimeParser> ParsedOptions::MakeParser(bool ignore_unrecognize
       .Define("-XX:ConcGCThreads=_")
           .WithType<unsigned int>()
           .IntoKey(M::ConcGCThreads)
+      .Define("-XX:CCParallelMarkThreads=_")
+          .WithType<unsigned int>()
+          .IntoKey(M::CCParallelMarkThreads)
+      .Define("-XX:ParallelReferenceClearingThreads=_")
+          .WithType<unsigned int>()
+          .IntoKey(M::ParallelReferenceClearingThreads)
       .Define("-XX:FinalizerTimeoutMs=_")
           .WithType<unsigned int>()
           .IntoKey(M::FinalizerTimeoutMs)
@@ -168,8 +177,24 @@ std::unique_ptr<RuntimeParser> ParsedOptions::MakeParser(bool ignore_unrecognize
       .Define("-XX:LongGCLogThreshold=_")  // in ms
           .WithType<MillisecondsToNanoseconds>()  // store as ns
           .IntoKey(M::LongGCLogThreshold)
+      .Define("-XX:GcCpuPercentTarget=_")
+          .WithType<double>().WithRange(0.0, 100.0)
+          .IntoKey(M::GcCpuPercentTarget)
+      .Define("-XX:GcPauseTimeTarget=_")  // in ms
+          .WithType<MillisecondsToNanoseconds>()  // store as ns
+          .IntoKey(M::GcPauseTimeTarget)
       .Define("-XX:DumpGCPerformanceOnShutdown")
           .IntoKey(M::DumpGCPerformanceOnShutdown)
+      .Define("-XX:HeapSamplingInterval=_")
+          .WithType<Memory<1>>()
+          .IntoKey(M::HeapSamplingInterval)
+      .Define("-XX:GcClassHistogram")
+          .IntoKey(M::GcClassHistogram)
+      .Define("-XX:BackgroundCompactionCpuBudget=_")
+          .WithType<double>().WithRange(0.0, 100.0)
+          .IntoKey(M::BackgroundCompactionCpuBudget)
+      .Define("-XX:HprofFork")
+          .IntoKey(M::HprofFork)
       .Define("-XX:DumpRegionInfoBeforeGC")
           .IntoKey(M::DumpRegionInfoBeforeGC)
       .Define("-XX:DumpRegionInfoAfterGC")
@@ -222,6 +247,12 @@ std::unique_ptr<RuntimeParser> ParsedOptions::MakeParser(bool ignore_unrecognize
       .Define("-Xjitpthreadpriority:_")
           .WithType<int>()
           .IntoKey(M::JITPoolThreadPthreadPriority)
+      .Define("-Xjitthreadcount:_")
+          .WithType<unsigned int>()
+          .IntoKey(M::JITPoolThreadCount)
+      .Define({"-Xjitcompileprofileatstartup", "-Xnojitcompileprofileatstartup"})
+          .WithValues({true, false})
+          .IntoKey(M::JITCompileProfileAtStartup)
       .Define("-Xjitsaveprofilinginfo")
           .WithType<ProfileSaverOptions>()
           .AppendValues()
@@ -723,6 +754,8 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -Xgc:[no]preverify_rosalloc\n");
   UsageMessage(stream, "  -Xgc:[no]postsweepingverify_rosalloc\n");
   UsageMessage(stream, "  -Xgc:[no]postverify_rosalloc\n");
+  UsageMessage(stream, "  -Xgc:[no]parallelverify\n"
+                       "     (split the stop-the-world heap verification across the GC threads)\n");
   UsageMessage(stream, "  -Xgc:[no]presweepingverify\n");
   UsageMessage(stream, "  -Xgc:[no]generational_cc\n");
   UsageMessage(stream, "  -Ximage:filename\n");
@@ -731,12 +764,20 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -XX:+DisableExplicitGC\n");
   UsageMessage(stream, "  -XX:ParallelGCThreads=integervalue\n");
   UsageMessage(stream, "  -XX:ConcGCThreads=integervalue\n");
+  UsageMessage(stream, "  -XX:CCParallelMarkThreads=integervalue\n");
+  UsageMessage(stream, "  -XX:ParallelReferenceClearingThreads=integervalue\n");
   UsageMessage(stream, "  -XX:FinalizerTimeoutMs=integervalue\n");
   UsageMessage(stream, "  -XX:MaxSpinsBeforeThinLockInflation=integervalue\n");
   UsageMessage(stream, "  -XX:LongPauseLogThreshold=integervalue\n");
   UsageMessage(stream, "  -XX:LongGCLogThreshold=integervalue\n");
+  UsageMessage(stream, "  -XX:GcCpuPercentTarget=doublevalue\n");
+  UsageMessage(stream, "  -XX:GcPauseTimeTarget=integervalue\n");
   UsageMessage(stream, "  -XX:ThreadSuspendTimeout=integervalue\n");
   UsageMessage(stream, "  -XX:DumpGCPerformanceOnShutdown\n");
+  UsageMessage(stream, "  -XX:HeapSamplingInterval=N\n");
+  UsageMessage(stream, "  -XX:GcClassHistogram\n");
+  UsageMessage(stream, "  -XX:BackgroundCompactionCpuBudget=doublevalue\n");
+  UsageMessage(stream, "  -XX:HprofFork\n");
   UsageMessage(stream, "  -XX:DumpJITInfoOnShutdown\n");
   UsageMessage(stream, "  -XX:IgnoreMaxFootprint\n");
   UsageMessage(stream, "  -XX:UseTLAB\n");
@@ -744,6 +785,7 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -XX:LargeObjectSpace={disabled,map,freelist}\n");
   UsageMessage(stream, "  -XX:LargeObjectThreshold=N\n");
   UsageMessage(stream, "  -XX:StopForNativeAllocs=N\n");
+  UsageMessage(stream, "  -XX:RegionSpaceResidentBudget=N\n");
   UsageMessage(stream, "  -XX:DumpNativeStackOnSigQuit=booleanvalue\n");
   UsageMessage(stream, "  -XX:MadviseRandomAccess:booleanvalue\n");
   UsageMessage(stream, "  -XX:SlowDebug={false,true}\n");
@@ -767,6 +809,8 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -Xjitwarmupthreshold:integervalue\n");
   UsageMessage(stream, "  -Xjitosrthreshold:integervalue\n");
   UsageMessage(stream, "  -Xjitprithreadweight:integervalue\n");
+  UsageMessage(stream, "  -Xjitthreadcount:integervalue\n");
+  UsageMessage(stream, "  -X[no]jitcompileprofileatstartup\n");
   UsageMessage(stream, "  -X[no]relocate\n");
   UsageMessage(stream, "  -X[no]dex2oat (Whether to invoke dex2oat on the application)\n");
   UsageMessage(stream, "  -X[no]image-dex2oat (Whether to create and use a boot image)\n");
@@ -262,6 +262,8 @@ Runtime::Runtime()
       system_thread_group_(nullptr),
       system_class_loader_(nullptr),
       dump_gc_performance_on_shutdown_(false),
+      heap_sampling_interval_(0u),
+      hprof_fork_(false),
       preinitialization_transactions_(),
       verify_(verifier::VerifyMode::kNone),
       allow_dex_file_fallback_(true),
@@ -887,6 +889,10 @@ bool Runtime::Start() {
 
   StartDaemonThreads();
 
+  if (heap_sampling_interval_ != 0u) {
+    GetHeap()->SetAllocationSamplingInterval(heap_sampling_interval_);
+  }
+
   // Make sure the environment is still clean (no lingering local refs from starting daemon
   // threads).
   {
@@ -1314,9 +1320,13 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
                        runtime_options.GetOrDefault(Opt::LargeObjectThreshold),
                        runtime_options.GetOrDefault(Opt::ParallelGCThreads),
                        runtime_options.GetOrDefault(Opt::ConcGCThreads),
+                       runtime_options.GetOrDefault(Opt::CCParallelMarkThreads),
+                       runtime_options.GetOrDefault(Opt::ParallelReferenceClearingThreads),
                        runtime_options.Exists(Opt::LowMemoryMode),
                        runtime_options.GetOrDefault(Opt::LongPauseLogThreshold),
                        runtime_options.GetOrDefault(Opt::LongGCLogThreshold),
+                       runtime_options.GetOrDefault(Opt::GcCpuPercentTarget),
+                       runtime_options.GetOrDefault(Opt::GcPauseTimeTarget),
                        runtime_options.Exists(Opt::IgnoreMaxFootprint),
                        runtime_options.GetOrDefault(Opt::UseTLAB),
                        xgc_option.verify_pre_gc_heap_,
@@ -1325,6 +1335,7 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
                        xgc_option.verify_pre_gc_rosalloc_,
                        xgc_option.verify_pre_sweeping_rosalloc_,
                        xgc_option.verify_post_gc_rosalloc_,
+                       xgc_option.parallel_verify_,
                        xgc_option.gcstress_,
                        xgc_option.measure_,
                        runtime_options.GetOrDefault(Opt::EnableHSpaceCompactForOOM),
@@ -1332,6 +1343,7 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
                        runtime_options.GetOrDefault(Opt::HSpaceCompactForOOMMinIntervalsMs),
                        runtime_options.Exists(Opt::DumpRegionInfoBeforeGC),
                        runtime_options.Exists(Opt::DumpRegionInfoAfterGC),
+                       runtime_options.GetOrDefault(Opt::RegionSpaceResidentBudget),
                        image_space_loading_order_);
 
   if (!heap_->HasBootImageSpace() && !allow_dex_file_fallback_) {
@@ -1340,6 +1352,13 @@ bool Runtime::Init(RuntimeArgumentMap&& runtime_options_in) {
   }
 
   dump_gc_performance_on_shutdown_ = runtime_options.Exists(Opt::DumpGCPerformanceOnShutdown);
+  heap_sampling_interval_ = runtime_options.GetOrDefault(Opt::HeapSamplingInterval);
+  if (runtime_options.Exists(Opt::GcClassHistogram)) {
+    heap_->SetClassHistogramEnabled(true);
+  }
+  heap_->SetBackgroundCompactionCpuBudget(
+      runtime_options.GetOrDefault(Opt::BackgroundCompactionCpuBudget));
+  hprof_fork_ = runtime_options.Exists(Opt::HprofFork);
 
   jdwp_options_ = runtime_options.GetOrDefault(Opt::JdwpOptions);
   jdwp_provider_ = CanonicalizeJdwpProvider(runtime_options.GetOrDefault(Opt::JdwpProvider),
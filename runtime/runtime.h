@@ -803,6 +803,10 @@ class Runtime {
     return dump_gc_performance_on_shutdown_;
   }
 
+  bool IsHprofForkEnabled() const {
+    return hprof_fork_;
+  }
+
   void IncrementDeoptimizationCount(DeoptimizationKind kind) {
     DCHECK_LE(kind, DeoptimizationKind::kLast);
     deoptimization_counts_[static_cast<size_t>(kind)]++;
@@ -1053,6 +1057,12 @@ class Runtime {
   // If true, then we dump the GC cumulative timings on shutdown.
   bool dump_gc_performance_on_shutdown_;
 
+  // Mean sampling interval of the allocation sampler enabled at startup, 0 if disabled.
+  size_t heap_sampling_interval_;
+
+  // If true, heap dumps to a file are written by a forked child process, see hprof::DumpHeap().
+  bool hprof_fork_;
+
   // Transactions used for pre-initializing classes at compilation time.
   // Support nested transactions, maintain a list containing all transactions. Transactions are
   // handled under a stack discipline. Because GC needs to go over all transactions, we choose list
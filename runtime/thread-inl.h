@@ -336,6 +336,7 @@ inline void Thread::SetThreadLocalAllocationStack(StackReference<mirror::Object>
   DCHECK_LT(start, end);
   tlsPtr_.thread_local_alloc_stack_end = end;
   tlsPtr_.thread_local_alloc_stack_top = start;
+  thread_local_alloc_stack_chunk_size_ = end - start;
 }
 
 inline void Thread::RevokeThreadLocalAllocationStack() {
@@ -347,6 +348,7 @@ inline void Thread::RevokeThreadLocalAllocationStack() {
   }
   tlsPtr_.thread_local_alloc_stack_end = nullptr;
   tlsPtr_.thread_local_alloc_stack_top = nullptr;
+  thread_local_alloc_stack_chunk_size_ = 0;
 }
 
 inline void Thread::PoisonObjectPointersIfDebug() {
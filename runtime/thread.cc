@@ -4066,6 +4066,12 @@ void Thread::SetStackEndForStackOverflow() {
 void Thread::SetTlab(uint8_t* start, uint8_t* end, uint8_t* limit) {
   DCHECK_LE(start, end);
   DCHECK_LE(end, limit);
+  if (tlsPtr_.thread_local_pos != nullptr) {
+    // The rest of the old TLAB is stranded until the next GC.
+    const size_t wasted_bytes = tlsPtr_.thread_local_limit - tlsPtr_.thread_local_pos;
+    tls64_.tlab_sizing.wasted_bytes += wasted_bytes;
+    Runtime::Current()->GetHeap()->RecordTlabWaste(wasted_bytes);
+  }
   tlsPtr_.thread_local_start = start;
   tlsPtr_.thread_local_pos  = tlsPtr_.thread_local_start;
   tlsPtr_.thread_local_end = end;
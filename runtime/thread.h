@@ -139,6 +139,21 @@ enum class DeoptimizationMethodType {
 // This should match RosAlloc::kNumThreadLocalSizeBrackets.
 static constexpr size_t kNumRosAllocThreadLocalSizeBracketsInThread = 16;
 
+// Per-thread state used by the heap to adapt the TLAB refill size to the thread's allocation
+// behavior, see Heap::GetTlabRefillSize.
+struct TlabSizingInfo {
+  // Current TLAB refill size in bytes, 0 until the thread refills its first TLAB.
+  uint64_t refill_size = 0u;
+  // Number of TLAB refills since `gc_epoch`.
+  uint64_t refills = 0u;
+  // Bytes left unused in revoked TLABs since `gc_epoch`.
+  uint64_t wasted_bytes = 0u;
+  // Bytes allocated from the shared region instead of a TLAB since `gc_epoch`.
+  uint64_t shared_bytes = 0u;
+  // Number of completed GCs when the refill size was last adjusted.
+  uint64_t gc_epoch = 0u;
+};
+
 // Thread's stack layout for implicit stack overflow checks:
 //
 //   +---------------------+  <- highest address of stack memory
@@ -425,6 +440,20 @@ class Thread {
     return &tls64_.stats;
   }
 
+  TlabSizingInfo* GetTlabSizingInfo() {
+    return &tls64_.tlab_sizing;
+  }
+
+  // Bytes this thread may still allocate before the allocation sampler takes its next sample,
+  // 0 if the sampler has not drawn a sampling interval for this thread yet.
+  uint64_t GetAllocSamplingBytesUntilSample() const {
+    return tls64_.alloc_sampling_bytes_until_sample;
+  }
+
+  void SetAllocSamplingBytesUntilSample(uint64_t bytes) {
+    tls64_.alloc_sampling_bytes_until_sample = bytes;
+  }
+
   bool IsStillStarting() const;
 
   bool IsExceptionPending() const {
@@ -1160,6 +1189,12 @@ class Thread {
   // Resets the thread local allocation pointers.
   void RevokeThreadLocalAllocationStack();
 
+  // Number of slots of the current thread-local allocation stack, 0 if there is none. The heap
+  // sizes the next one from it.
+  size_t GetThreadLocalAllocationStackChunkSize() const {
+    return thread_local_alloc_stack_chunk_size_;
+  }
+
   size_t GetThreadLocalBytesAllocated() const {
     return tlsPtr_.thread_local_end - tlsPtr_.thread_local_start;
   }
@@ -1579,13 +1614,19 @@ class Thread {
   } tls32_;
 
   struct PACKED(8) tls_64bit_sized_values {
-    tls_64bit_sized_values() : trace_clock_base(0) {
+    tls_64bit_sized_values() : trace_clock_base(0), alloc_sampling_bytes_until_sample(0) {
     }
 
     // The clock base used for tracing.
     uint64_t trace_clock_base;
 
     RuntimeStats stats;
+
+    // Adaptive TLAB sizing state.
+    TlabSizingInfo tlab_sizing;
+
+    // Countdown to the next sampled allocation, see gc::AllocationSampler.
+    uint64_t alloc_sampling_bytes_until_sample;
   } tls64_;
 
   struct PACKED(sizeof(void*)) tls_ptr_sized_values {
@@ -1785,6 +1826,9 @@ class Thread {
   // Note that it is not in the packed struct, may not be accessed for cross compilation.
   uintptr_t poison_object_cookie_ = 0;
 
+  // Size of the thread-local allocation stack, in slots.
+  size_t thread_local_alloc_stack_chunk_size_ = 0;
+
   // Pending extra checkpoints if checkpoint_function_ is already used.
   std::list<Closure*> checkpoint_overflow_ GUARDED_BY(Locks::thread_suspend_count_lock_);
 
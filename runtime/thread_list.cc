@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <sstream>
 #include <vector>
 
@@ -29,6 +30,7 @@
 #include "nativehelper/scoped_utf_chars.h"
 
 #include "base/aborting.h"
+#include "base/bit_utils.h"
 #include "base/histogram-inl.h"
 #include "base/mutex-inl.h"
 #include "base/systrace.h"
@@ -46,6 +48,7 @@
 #include "native_stack_dump.h"
 #include "scoped_thread_state_change-inl.h"
 #include "thread.h"
+#include "thread_pool.h"
 #include "trace.h"
 #include "well_known_classes.h"
 
@@ -319,7 +322,61 @@ static void ThreadSuspendSleep(useconds_t delay_us) {
   }
 }
 
-size_t ThreadList::RunCheckpoint(Closure* checkpoint_function, Closure* callback) {
+// Minimum number of threads handed to each task when running closures on behalf of suspended
+// threads in parallel. Below that, waking up the workers costs more than it saves.
+static constexpr size_t kMinSuspendedThreadsPerTask = 8;
+
+// Run fn for each of the threads. If thread_pool is non-null, the threads are split into
+// contiguous slices that are processed by the pool workers and the calling thread. As for the GC
+// marking tasks, the workers run on behalf of the calling thread which holds the locks that fn
+// requires. The threads of the pool workers themselves are left out of the slices and processed
+// by the calling thread once the workers are idle: fn may touch thread-local state (such as the
+// thread-local mark stack) that the worker uses while running a slice.
+static void RunForEachThread(Thread* self,
+                             const std::vector<Thread*>& threads,
+                             ThreadPool* thread_pool,
+                             const std::function<void(Thread*)>& fn) {
+  const size_t num_tasks = thread_pool == nullptr
+      ? 1u
+      : std::min(thread_pool->GetThreadCount() + 1u, threads.size() / kMinSuspendedThreadsPerTask);
+  if (num_tasks <= 1u) {
+    for (Thread* thread : threads) {
+      fn(thread);
+    }
+    return;
+  }
+  std::vector<Thread*> worker_threads;
+  std::vector<Thread*> other_threads;
+  other_threads.reserve(threads.size());
+  const std::vector<ThreadPoolWorker*>& workers = thread_pool->GetWorkers();
+  for (Thread* thread : threads) {
+    auto is_worker = [thread](ThreadPoolWorker* worker) { return worker->GetThread() == thread; };
+    if (std::any_of(workers.begin(), workers.end(), is_worker)) {
+      worker_threads.push_back(thread);
+    } else {
+      other_threads.push_back(thread);
+    }
+  }
+  const size_t chunk_size = RoundUp(other_threads.size(), num_tasks) / num_tasks;
+  for (size_t begin = 0; begin < other_threads.size(); begin += chunk_size) {
+    const size_t end = std::min(begin + chunk_size, other_threads.size());
+    thread_pool->AddTask(self, new FunctionTask([&other_threads, &fn, begin, end](Thread*) {
+      for (size_t i = begin; i != end; ++i) {
+        fn(other_threads[i]);
+      }
+    }));
+  }
+  thread_pool->StartWorkers(self);
+  thread_pool->Wait(self, /* do_work= */ true, /* may_hold_locks= */ true);
+  thread_pool->StopWorkers(self);
+  for (Thread* thread : worker_threads) {
+    fn(thread);
+  }
+}
+
+size_t ThreadList::RunCheckpoint(Closure* checkpoint_function,
+                                 Closure* callback,
+                                 ThreadPool* thread_pool) {
   Thread* self = Thread::Current();
   Locks::mutator_lock_->AssertNotExclusiveHeld(self);
   Locks::thread_list_lock_->AssertNotHeld(self);
@@ -364,7 +421,9 @@ size_t ThreadList::RunCheckpoint(Closure* checkpoint_function, Closure* callback
   checkpoint_function->Run(self);
 
   // Run the checkpoint on the suspended threads.
-  for (const auto& thread : suspended_count_modified_threads) {
+  RunForEachThread(self, suspended_count_modified_threads, thread_pool, [&](Thread* thread) {
+    // Not necessarily self, the checkpoint may run on a thread pool worker.
+    Thread* const current = Thread::Current();
     if (!thread->IsSuspended()) {
       ScopedTrace trace([&]() {
         std::ostringstream oss;
@@ -387,11 +446,11 @@ size_t ThreadList::RunCheckpoint(Closure* checkpoint_function, Closure* callback
     // We know for sure that the thread is suspended at this point.
     checkpoint_function->Run(thread);
     {
-      MutexLock mu2(self, *Locks::thread_suspend_count_lock_);
-      bool updated = thread->ModifySuspendCount(self, -1, nullptr, SuspendReason::kInternal);
+      MutexLock mu2(current, *Locks::thread_suspend_count_lock_);
+      bool updated = thread->ModifySuspendCount(current, -1, nullptr, SuspendReason::kInternal);
       DCHECK(updated);
     }
-  }
+  });
 
   {
     // Imitate ResumeAll, threads may be waiting on Thread::resume_cond_ since we raised their
@@ -516,7 +575,8 @@ void ThreadList::RunEmptyCheckpoint() {
 size_t ThreadList::FlipThreadRoots(Closure* thread_flip_visitor,
                                    Closure* flip_callback,
                                    gc::collector::GarbageCollector* collector,
-                                   gc::GcPauseListener* pause_listener) {
+                                   gc::GcPauseListener* pause_listener,
+                                   ThreadPool* thread_pool) {
   TimingLogger::ScopedTiming split("ThreadListFlip", collector->GetTimings());
   Thread* self = Thread::Current();
   Locks::mutator_lock_->AssertNotHeld(self);
@@ -584,12 +644,12 @@ size_t ThreadList::FlipThreadRoots(Closure* thread_flip_visitor,
   {
     TimingLogger::ScopedTiming split3("FlipOtherThreads", collector->GetTimings());
     ReaderMutexLock mu(self, *Locks::mutator_lock_);
-    for (const auto& thread : other_threads) {
+    RunForEachThread(self, other_threads, thread_pool, [](Thread* thread) {
       Closure* flip_func = thread->GetFlipFunction();
       if (flip_func != nullptr) {
         flip_func->Run(thread);
       }
-    }
+    });
     // Run it for self.
     Closure* flip_func = self->GetFlipFunction();
     if (flip_func != nullptr) {
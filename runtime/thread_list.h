@@ -38,6 +38,7 @@ class GcPauseListener;
 class Closure;
 class RootVisitor;
 class Thread;
+class ThreadPool;
 class TimingLogger;
 enum VisitRootFlags : uint8_t;
 
@@ -106,8 +107,12 @@ class ThreadList {
   // of the suspend check. Returns how many checkpoints that are expected to run, including for
   // already suspended threads for b/24191051. Run the callback, if non-null, inside the
   // thread_list_lock critical section after determining the runnable/suspended states of the
-  // threads.
-  size_t RunCheckpoint(Closure* checkpoint_function, Closure* callback = nullptr)
+  // threads. If thread_pool is non-null, the checkpoints of suspended threads are run in parallel
+  // by its workers on behalf of the calling thread, which must hold the locks the checkpoint
+  // function requires.
+  size_t RunCheckpoint(Closure* checkpoint_function,
+                       Closure* callback = nullptr,
+                       ThreadPool* thread_pool = nullptr)
       REQUIRES(!Locks::thread_list_lock_, !Locks::thread_suspend_count_lock_);
 
   // Run an empty checkpoint on threads. Wait until threads pass the next suspend point or are
@@ -119,11 +124,13 @@ class ThreadList {
       REQUIRES(!Locks::thread_list_lock_, !Locks::thread_suspend_count_lock_);
 
   // Flip thread roots from from-space refs to to-space refs. Used by
-  // the concurrent copying collector.
+  // the concurrent copying collector. If thread_pool is non-null, the flip function of the threads
+  // that stay suspended after the pause is run in parallel by its workers.
   size_t FlipThreadRoots(Closure* thread_flip_visitor,
                          Closure* flip_callback,
                          gc::collector::GarbageCollector* collector,
-                         gc::GcPauseListener* pause_listener)
+                         gc::GcPauseListener* pause_listener,
+                         ThreadPool* thread_pool = nullptr)
       REQUIRES(!Locks::mutator_lock_,
                !Locks::thread_list_lock_,
                !Locks::thread_suspend_count_lock_);
@@ -23,6 +23,8 @@
 
 #include <pthread.h>
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -112,7 +114,8 @@ void* ThreadPoolWorker::Callback(void* arg) {
 
 void ThreadPool::AddTask(Thread* self, Task* task) {
   MutexLock mu(self, task_queue_lock_);
-  tasks_.push_back(task);
+  tasks_.push_back(QueuedTask { task, task->GetPriority(), task_sequence_number_++ });
+  std::push_heap(tasks_.begin(), tasks_.end(), QueuedTaskOrder());
   // If we have any waiters, signal one.
   if (started_ && waiting_count_ != 0) {
     task_queue_condition_.Signal(self);
@@ -135,6 +138,8 @@ ThreadPool::ThreadPool(const char* name,
     started_(false),
     shutting_down_(false),
     waiting_count_(0),
+    task_sequence_number_(0),
+    update_task_priorities_(false),
     start_time_(0),
     total_wait_time_(0),
     creation_barier_(0),
@@ -249,8 +254,15 @@ Task* ThreadPool::TryGetTask(Thread* self) {
 
 Task* ThreadPool::TryGetTaskLocked() {
   if (HasOutstandingTasks()) {
-    Task* task = tasks_.front();
-    tasks_.pop_front();
+    if (update_task_priorities_) {
+      for (QueuedTask& queued_task : tasks_) {
+        queued_task.priority = queued_task.task->GetPriority();
+      }
+      std::make_heap(tasks_.begin(), tasks_.end(), QueuedTaskOrder());
+    }
+    std::pop_heap(tasks_.begin(), tasks_.end(), QueuedTaskOrder());
+    Task* task = tasks_.back().task;
+    tasks_.pop_back();
     return task;
   }
   return nullptr;
@@ -281,6 +293,11 @@ size_t ThreadPool::GetTaskCount(Thread* self) {
   return tasks_.size();
 }
 
+void ThreadPool::SetUpdateTaskPriorities(bool value) {
+  MutexLock mu(Thread::Current(), task_queue_lock_);
+  update_task_priorities_ = value;
+}
+
 void ThreadPool::SetPthreadPriority(int priority) {
   for (ThreadPoolWorker* worker : threads_) {
     worker->SetPthreadPriority(priority);
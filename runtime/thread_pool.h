@@ -17,7 +17,6 @@
 #ifndef ART_RUNTIME_THREAD_POOL_H_
 #define ART_RUNTIME_THREAD_POOL_H_
 
-#include <deque>
 #include <functional>
 #include <vector>
 
@@ -50,6 +49,13 @@ class Task : public Closure {
  public:
   // Called after Closure::Run has been called.
   virtual void Finalize() { }
+
+  // Tasks with a higher priority are run first, tasks of the same priority in the order they were
+  // added. The priority is read when the task is added, and again each time a task is taken if
+  // the pool updates task priorities. It is then read with the task queue lock held.
+  virtual int32_t GetPriority() const {
+    return 0;
+  }
 };
 
 class SelfDeletingTask : public Task {
@@ -160,6 +166,10 @@ class ThreadPool {
   // thread count of the thread pool.
   void SetMaxActiveWorkers(size_t threads) REQUIRES(!task_queue_lock_);
 
+  // Whether to read the priorities of the queued tasks again each time a task is taken, for tasks
+  // whose priority changes while they wait. Taking a task is then linear in the queue length.
+  void SetUpdateTaskPriorities(bool value) REQUIRES(!task_queue_lock_);
+
   // Set the "nice" priorty for threads in the pool.
   void SetPthreadPriority(int priority);
 
@@ -183,6 +193,21 @@ class ThreadPool {
     return started_ && !tasks_.empty();
   }
 
+  struct QueuedTask {
+    Task* task;
+    int32_t priority;
+    uint64_t sequence_number;
+  };
+
+  struct QueuedTaskOrder {
+    // Returns true if `lhs` must be run after `rhs`.
+    bool operator()(const QueuedTask& lhs, const QueuedTask& rhs) const {
+      return lhs.priority != rhs.priority
+          ? lhs.priority < rhs.priority
+          : lhs.sequence_number > rhs.sequence_number;
+    }
+  };
+
   const std::string name_;
   Mutex task_queue_lock_;
   ConditionVariable task_queue_condition_ GUARDED_BY(task_queue_lock_);
@@ -191,7 +216,11 @@ class ThreadPool {
   volatile bool shutting_down_ GUARDED_BY(task_queue_lock_);
   // How many worker threads are waiting on the condition.
   volatile size_t waiting_count_ GUARDED_BY(task_queue_lock_);
-  std::deque<Task*> tasks_ GUARDED_BY(task_queue_lock_);
+  // Heap of the queued tasks, ordered by QueuedTaskOrder.
+  std::vector<QueuedTask> tasks_ GUARDED_BY(task_queue_lock_);
+  // Number of tasks added so far, orders the tasks of the same priority.
+  uint64_t task_sequence_number_ GUARDED_BY(task_queue_lock_);
+  bool update_task_priorities_ GUARDED_BY(task_queue_lock_);
   std::vector<ThreadPoolWorker*> threads_;
   // Work balance detection.
   uint64_t start_time_ GUARDED_BY(task_queue_lock_);
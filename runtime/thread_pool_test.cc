@@ -17,6 +17,7 @@
 #include "thread_pool.h"
 
 #include <string>
+#include <vector>
 
 #include "base/atomic.h"
 #include "common_runtime_test.h"
@@ -160,6 +161,94 @@ TEST_F(ThreadPoolTest, RecursiveTest) {
   EXPECT_EQ((1 << depth) - 1, count.load(std::memory_order_seq_cst));
 }
 
+class PriorityTask : public Task {
+ public:
+  PriorityTask(std::vector<int>* order, int id, int32_t priority)
+      : order_(order), id_(id), priority_(priority) {}
+
+  void Run(Thread* self ATTRIBUTE_UNUSED) override {
+    order_->push_back(id_);
+  }
+
+  void Finalize() override {
+    delete this;
+  }
+
+  int32_t GetPriority() const override {
+    return priority_;
+  }
+
+ private:
+  std::vector<int>* const order_;
+  const int id_;
+  const int32_t priority_;
+};
+
+// Test that tasks are run by decreasing priority, and in the order they were added within a
+// priority.
+TEST_F(ThreadPoolTest, PriorityTest) {
+  Thread* self = Thread::Current();
+  // A single worker so that the tasks run one after the other.
+  ThreadPool thread_pool("Thread pool test thread pool", 1);
+  std::vector<int> order;
+  thread_pool.AddTask(self, new PriorityTask(&order, 0, 0));
+  thread_pool.AddTask(self, new PriorityTask(&order, 1, 2));
+  thread_pool.AddTask(self, new PriorityTask(&order, 2, 1));
+  thread_pool.AddTask(self, new PriorityTask(&order, 3, 2));
+  thread_pool.AddTask(self, new PriorityTask(&order, 4, 0));
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, false, false);
+  EXPECT_EQ(std::vector<int>({ 1, 3, 2, 0, 4 }), order);
+}
+
+// A task whose priority can change after it was added to the pool.
+class UpdatedPriorityTask : public Task {
+ public:
+  UpdatedPriorityTask(std::vector<int>* order, int id, const std::vector<int32_t>* priorities)
+      : order_(order), id_(id), priorities_(priorities) {}
+
+  void Run(Thread* self ATTRIBUTE_UNUSED) override {
+    order_->push_back(id_);
+  }
+
+  void Finalize() override {
+    delete this;
+  }
+
+  int32_t GetPriority() const override {
+    return (*priorities_)[id_];
+  }
+
+ private:
+  std::vector<int>* const order_;
+  const int id_;
+  const std::vector<int32_t>* const priorities_;
+};
+
+// Test that a task whose priority increased while queued jumps the queue when the pool updates
+// priorities, and keeps its place otherwise.
+TEST_F(ThreadPoolTest, UpdatePriorityTest) {
+  Thread* self = Thread::Current();
+  for (bool update : { true, false }) {
+    ThreadPool thread_pool("Thread pool test thread pool", 1);
+    thread_pool.SetUpdateTaskPriorities(update);
+    std::vector<int> order;
+    std::vector<int32_t> priorities = { 3, 2, 1, 0 };
+    for (int id = 0; id != 4; ++id) {
+      thread_pool.AddTask(self, new UpdatedPriorityTask(&order, id, &priorities));
+    }
+    // The last task gets hotter before any task runs.
+    priorities[3] = 4;
+    thread_pool.StartWorkers(self);
+    thread_pool.Wait(self, false, false);
+    if (update) {
+      EXPECT_EQ(std::vector<int>({ 3, 0, 1, 2 }), order);
+    } else {
+      EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3 }), order);
+    }
+  }
+}
+
 class PeerTask : public Task {
  public:
   PeerTask() {}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+abstract class Super {
+  abstract int getValue();
+}
+
+class SubA extends Super {
+  int getValue() { return 42; }
+}
+
+class SubB extends Super {
+  int getValue() { return 38; }
+}
+
+class SubC extends Super {
+  int getValue() { return 1; }
+}
+
+class SubD extends Super {
+  int getValue() { return 2; }
+}
+
+class SubE extends Super {
+  int getValue() { return 3; }
+}
+
+class SubF extends Super {
+  int getValue() { return 4; }
+}
+
+class SubG extends Super {
+  int getValue() { return 5; }
+}
+
+class SubH extends Super {
+  int getValue() { return 6; }
+}
+
+public class Main {
+
+  /// CHECK-START: int Main.$noinline$megamorphicCall(Super) inliner (before)
+  /// CHECK:       InvokeVirtual method_name:Super.getValue
+
+  // SubA and SubB make 90% of the calls, the other six receivers make the call site megamorphic.
+  // The most frequent receiver is checked first.
+
+  /// CHECK-START: int Main.$noinline$megamorphicCall(Super) inliner (after)
+  /// CHECK-DAG:  <<SubARet:i\d+>>          IntConstant 42
+  /// CHECK-DAG:  <<SubBRet:i\d+>>          IntConstant 38
+  /// CHECK-DAG:  <<Obj:l\d+>>              NullCheck
+  /// CHECK-DAG:  <<ObjClassSubA:l\d+>>     InstanceFieldGet [<<Obj>>] field_name:java.lang.Object.shadow$_klass_
+  /// CHECK-DAG:  <<InlineClassSubA:l\d+>>  LoadClass class_name:SubA
+  /// CHECK-DAG:  <<TestSubA:z\d+>>         NotEqual [<<InlineClassSubA>>,<<ObjClassSubA>>]
+  /// CHECK-DAG:                            If [<<TestSubA>>]
+
+  /// CHECK-DAG:  <<ObjClassSubB:l\d+>>     InstanceFieldGet field_name:java.lang.Object.shadow$_klass_
+  /// CHECK-DAG:  <<InlineClassSubB:l\d+>>  LoadClass class_name:SubB
+  /// CHECK-DAG:  <<TestSubB:z\d+>>         NotEqual [<<InlineClassSubB>>,<<ObjClassSubB>>]
+  /// CHECK-DAG:  <<DefaultRet:i\d+>>       InvokeVirtual [<<Obj>>] method_name:Super.getValue
+
+  /// CHECK-DAG:  <<FirstMerge:i\d+>>       Phi [<<SubBRet>>,<<DefaultRet>>]
+  /// CHECK-DAG:  <<Ret:i\d+>>              Phi [<<SubARet>>,<<FirstMerge>>]
+  /// CHECK-DAG:                            Return [<<Ret>>]
+
+  /// CHECK-START: int Main.$noinline$megamorphicCall(Super) inliner (after)
+  /// CHECK-NOT:                            Deoptimize
+
+  /// CHECK-START: int Main.$noinline$megamorphicCall(Super) inliner (after)
+  /// CHECK-NOT:                            LoadClass class_name:SubC
+  public static int $noinline$megamorphicCall(Super a) {
+    return a.getValue();
+  }
+
+  public static void main(String[] args) {
+    System.loadLibrary(args[0]);
+    Super[] others = {
+        new SubC(), new SubD(), new SubE(), new SubF(), new SubG(), new SubH()
+    };
+    Super subA = new SubA();
+    Super subB = new SubB();
+    // Each round makes 6 calls with SubA, 3 with SubB and 1 with one of the others, in turn.
+    int sum = 0;
+    for (int round = 0; round < 3000; ++round) {
+      for (int i = 0; i < 6; ++i) {
+        sum += $noinline$megamorphicCall(subA);
+      }
+      for (int i = 0; i < 3; ++i) {
+        sum += $noinline$megamorphicCall(subB);
+      }
+      sum += $noinline$megamorphicCall(others[round % others.length]);
+    }
+    ensureJitCompiled(Main.class, "$noinline$megamorphicCall");
+
+    // The inlined receivers and the fallback call return the right values.
+    expectEquals(42, $noinline$megamorphicCall(subA));
+    expectEquals(38, $noinline$megamorphicCall(subB));
+    for (int i = 0; i < others.length; ++i) {
+      expectEquals(i + 1, $noinline$megamorphicCall(others[i]));
+    }
+    expectEquals(3000 * (6 * 42 + 3 * 38) + 500 * (1 + 2 + 3 + 4 + 5 + 6), sum);
+  }
+
+  private static void expectEquals(int expected, int actual) {
+    if (expected != actual) {
+      throw new Error("Expected " + expected + ", got " + actual);
+    }
+  }
+
+  private static native void ensureJitCompiled(Class<?> itf, String method_name);
+}
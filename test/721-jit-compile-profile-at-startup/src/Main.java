@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import java.io.File;
+import java.lang.reflect.Method;
+
+public class Main {
+  public static void main(String[] args) throws Exception {
+    System.loadLibrary(args[0]);
+    File profile = new File(System.getenv("DEX_LOCATION") + "-jit-profile.prof");
+    String[] codePaths =
+        new String[] { System.getenv("DEX_LOCATION") + "/721-jit-compile-profile-at-startup.jar" };
+    if (profile.createNewFile()) {
+      // First run: the profile saver writes the profile on shutdown.
+      VMRuntime.registerAppInfo(profile.getPath(), codePaths);
+      for (int i = 0; i < 10; ++i) {
+        $noinline$profiled(i);
+      }
+      ensureJitCompiled(Main.class, "$noinline$profiled");
+      System.out.println("Compiled in the first run");
+      return;
+    }
+
+    // Second run: the method is not called, only the profile can get it compiled.
+    try {
+      VMRuntime.registerAppInfo(profile.getPath(), codePaths);
+      for (int i = 0; i < 1000 && !hasJitCompiledCode(Main.class, "$noinline$profiled"); ++i) {
+        Thread.sleep(10);
+      }
+      if (!hasJitCompiledCode(Main.class, "$noinline$profiled")) {
+        throw new Error("Expected $noinline$profiled to be compiled from the profile");
+      }
+      System.out.println("Compiled from the saved profile");
+    } finally {
+      profile.delete();
+    }
+  }
+
+  public static int $noinline$profiled(int value) {
+    return value * 31 + 7;
+  }
+
+  private static native void ensureJitCompiled(Class<?> cls, String methodName);
+  private static native boolean hasJitCompiledCode(Class<?> cls, String methodName);
+
+  private static class VMRuntime {
+    private static final Method registerAppInfoMethod;
+    static {
+      try {
+        Class<? extends Object> c = Class.forName("dalvik.system.VMRuntime");
+        registerAppInfoMethod = c.getDeclaredMethod("registerAppInfo",
+            String.class, String[].class);
+      } catch (Exception e) {
+        throw new RuntimeException(e);
+      }
+    }
+
+    public static void registerAppInfo(String profile, String[] codePaths)
+        throws Exception {
+      registerAppInfoMethod.invoke(null, profile, codePaths);
+    }
+  }
+}